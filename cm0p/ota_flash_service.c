@@ -0,0 +1,278 @@
+/******************************************************************************
+* File Name: ota_flash_service.c
+*
+* Description: This file contains the flash service run by the CM0+ for the OTA
+* application of the CM7 (CM0P_FLASH=1). It erases and programs the code
+* flash and hashes the downloaded image as the CM7 queues the operations in
+* the ring of configs/COMPONENT_MCUBOOT/flash/cy_ota_flash_ipc.h.
+*
+* Build it into the CM0+ image (the MCUboot bootloader), with the PDL and
+* mbedTLS of that image, and call ota_flash_service_run() once the CM7 has
+* been started, in place of the idle loop. The crypto block is left to the
+* CM7, the SHA-256 runs in software.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdbool.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "mbedtls/sha256.h"
+/* Ring shared with the CM7 */
+#include "cy_ota_flash_ipc.h"
+#include "ota_flash_service.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Delay between two looks at the ring while it is empty */
+#define OTA_FLASH_SERVICE_POLL_US           (20u)
+
+/* Delay between two looks at the IPC channel, until the CM7 publishes the ring */
+#define OTA_FLASH_SERVICE_WAIT_MS           (10u)
+
+/* Erase size of the code flash large sectors holding the application slots */
+#define OTA_FLASH_SERVICE_SECTOR_SIZE       (0x8000U)
+
+/* Programming attempts of a row that does not read back */
+#define OTA_FLASH_SERVICE_PROGRAM_ATTEMPTS  (2u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static mbedtls_sha256_context image_hash;
+static bool image_hash_active;
+
+/*******************************************************************************
+* Function Name: flash_erase_sector
+*******************************************************************************
+* Summary:
+*  Erases a code flash sector with the interrupts masked. The function and the
+*  PDL flash driver run from code flash, as in MCUboot, which erases and
+*  programs the same slots from the CM0+ when it swaps them.
+*
+* Parameters:
+*  uint32_t addr : Absolute address of the sector
+*
+* Return:
+*  int32_t : OTA_FLASH_IPC_STATUS_OK or OTA_FLASH_IPC_STATUS_FLASH
+*
+*******************************************************************************/
+static int32_t flash_erase_sector(uint32_t addr)
+{
+    uint32_t intr_status;
+    cy_en_flashdrv_status_t rc;
+
+    intr_status = Cy_SysLib_EnterCriticalSection();
+    rc = Cy_Flash_EraseSector(addr);
+    Cy_SysLib_ExitCriticalSection(intr_status);
+
+    return (rc == CY_FLASH_DRV_SUCCESS) ? OTA_FLASH_IPC_STATUS_OK : OTA_FLASH_IPC_STATUS_FLASH;
+}
+
+/*******************************************************************************
+* Function Name: flash_program_row
+*******************************************************************************
+* Summary:
+*  Programs a code flash row, unless it already holds the data, and checks that
+*  it reads back. A row that does not read back is programmed once more. The
+*  interrupts are masked while the row is programmed.
+*
+* Parameters:
+*  uint32_t addr : Absolute address of the row
+*  const uint8_t *data : CY_FLASH_SIZEOF_ROW bytes, word aligned
+*
+* Return:
+*  int32_t : OTA_FLASH_IPC_STATUS_OK or OTA_FLASH_IPC_STATUS_FLASH
+*
+*******************************************************************************/
+static int32_t flash_program_row(uint32_t addr, const uint8_t *data)
+{
+    uint32_t intr_status;
+    cy_en_flashdrv_status_t rc;
+
+    for (uint32_t attempt = 0u; attempt < OTA_FLASH_SERVICE_PROGRAM_ATTEMPTS; attempt++)
+    {
+        if (memcmp((const void *)addr, data, CY_FLASH_SIZEOF_ROW) == 0)
+        {
+            return OTA_FLASH_IPC_STATUS_OK;
+        }
+
+        intr_status = Cy_SysLib_EnterCriticalSection();
+        rc = Cy_Flash_ProgramRow(addr, (const uint32_t *)data);
+        Cy_SysLib_ExitCriticalSection(intr_status);
+        if (rc != CY_FLASH_DRV_SUCCESS)
+        {
+            return OTA_FLASH_IPC_STATUS_FLASH;
+        }
+    }
+
+    return (memcmp((const void *)addr, data, CY_FLASH_SIZEOF_ROW) == 0) ?
+           OTA_FLASH_IPC_STATUS_OK : OTA_FLASH_IPC_STATUS_FLASH;
+}
+
+/*******************************************************************************
+* Function Name: handle_descriptor
+*******************************************************************************
+* Summary:
+*  Carries out one operation of the ring.
+*
+* Parameters:
+*  ota_flash_ipc_ring_t *ring : Ring holding the descriptor
+*  ota_flash_ipc_desc_t *desc : Descriptor to handle
+*
+* Return:
+*  int32_t : Status of the operation, OTA_FLASH_IPC_STATUS_*
+*
+*******************************************************************************/
+static int32_t handle_descriptor(ota_flash_ipc_ring_t *ring, ota_flash_ipc_desc_t *desc)
+{
+    uint8_t digest[sizeof(ring->digest)];
+
+    switch (desc->op)
+    {
+        case OTA_FLASH_IPC_OP_ERASE:
+            if ((desc->addr % OTA_FLASH_SERVICE_SECTOR_SIZE) != 0u)
+            {
+                return OTA_FLASH_IPC_STATUS_BAD_OP;
+            }
+            return flash_erase_sector(desc->addr);
+
+        case OTA_FLASH_IPC_OP_PROGRAM:
+            if (((desc->addr % CY_FLASH_SIZEOF_ROW) != 0u) || (desc->hash_len > CY_FLASH_SIZEOF_ROW))
+            {
+                return OTA_FLASH_IPC_STATUS_BAD_OP;
+            }
+            /* The hash covers the data as received, whatever ends up in flash */
+            if ((desc->hash_len != 0u) &&
+                (!image_hash_active || (mbedtls_sha256_update(&image_hash, desc->data, desc->hash_len) != 0)))
+            {
+                return OTA_FLASH_IPC_STATUS_HASH;
+            }
+            return flash_program_row(desc->addr, desc->data);
+
+        case OTA_FLASH_IPC_OP_HASH_START:
+            if (image_hash_active)
+            {
+                mbedtls_sha256_free(&image_hash);
+            }
+            mbedtls_sha256_init(&image_hash);
+            image_hash_active = (mbedtls_sha256_starts(&image_hash, 0) == 0);
+            return image_hash_active ? OTA_FLASH_IPC_STATUS_OK : OTA_FLASH_IPC_STATUS_HASH;
+
+        case OTA_FLASH_IPC_OP_HASH_FINISH:
+            if (!image_hash_active || (mbedtls_sha256_finish(&image_hash, digest) != 0))
+            {
+                return OTA_FLASH_IPC_STATUS_HASH;
+            }
+            mbedtls_sha256_free(&image_hash);
+            image_hash_active = false;
+            for (uint32_t i = 0; i < sizeof(digest); i++)
+            {
+                ring->digest[i] = digest[i];
+            }
+            return OTA_FLASH_IPC_STATUS_OK;
+
+        default:
+            return OTA_FLASH_IPC_STATUS_BAD_OP;
+    }
+}
+
+/*******************************************************************************
+* Function Name: ota_flash_service_run
+*******************************************************************************
+* Summary:
+*  Waits for the CM7 to publish the ring of flash operations in the data
+*  register of OTA_FLASH_IPC_CHANNEL, then carries out the operations in the
+*  order they are queued. Does not return. The first failed operation is kept
+*  in the error of the ring until the CM7 clears it.
+*
+*******************************************************************************/
+void ota_flash_service_run(void)
+{
+    IPC_STRUCT_Type *ipc = Cy_IPC_Drv_GetIpcBaseAddress(OTA_FLASH_IPC_CHANNEL);
+    ota_flash_ipc_ring_t *ring = NULL;
+    ota_flash_ipc_desc_t *desc;
+    int32_t status;
+
+    /* The CM7 publishes the ring before its first download */
+    while (ring == NULL)
+    {
+        if (Cy_IPC_Drv_IsLockAcquired(ipc))
+        {
+            ring = (ota_flash_ipc_ring_t *)Cy_IPC_Drv_ReadDataValue(ipc);
+            if ((ring != NULL) && (ring->magic != OTA_FLASH_IPC_MAGIC))
+            {
+                ring = NULL;
+            }
+        }
+        if (ring == NULL)
+        {
+            Cy_SysLib_Delay(OTA_FLASH_SERVICE_WAIT_MS);
+        }
+    }
+
+    Cy_Flash_Init();
+    Cy_Flashc_MainWriteEnable();
+
+    ring->ready = OTA_FLASH_IPC_READY;
+
+    while (true)
+    {
+        if (ring->tail == ring->head)
+        {
+            Cy_SysLib_DelayUs(OTA_FLASH_SERVICE_POLL_US);
+            continue;
+        }
+
+        /* Read the descriptor only after head shows it complete */
+        __DMB();
+        desc = &ring->desc[ring->tail % OTA_FLASH_IPC_RING_SIZE];
+
+        /* The CM7 withdraws the ring when the service did not keep up, and may
+         * program the flash itself from then on */
+        status = (ring->magic == OTA_FLASH_IPC_MAGIC) ? handle_descriptor(ring, desc) : OTA_FLASH_IPC_STATUS_CANCELLED;
+        desc->status = status;
+        if ((status != OTA_FLASH_IPC_STATUS_OK) && (ring->error == OTA_FLASH_IPC_STATUS_OK))
+        {
+            ring->error = status;
+        }
+
+        /* The descriptor is free for the CM7 once everything above is visible */
+        __DMB();
+        ring->tail++;
+    }
+}
+
+/* [] END OF FILE */
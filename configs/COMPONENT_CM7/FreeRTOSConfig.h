@@ -123,7 +123,28 @@
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
+#if defined(TELEMETRY)
+/* Task run time from the DWT cycle counter, see source/telemetry.c */
+#define configGENERATE_RUN_TIME_STATS           1
+extern void telemetry_run_time_init(void);
+extern uint32_t telemetry_run_time(void);
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() telemetry_run_time_init()
+#define portGET_RUN_TIME_COUNTER_VALUE()        telemetry_run_time()
+
+/* Allocations and failures of the FreeRTOS heap */
+extern void telemetry_rtos_malloc(void *ptr, size_t size);
+extern void telemetry_rtos_free(void *ptr);
+#define traceMALLOC(pvAddress, uiSize)          telemetry_rtos_malloc(pvAddress, uiSize)
+#define traceFREE(pvAddress, uiSize)            telemetry_rtos_free(pvAddress)
+
+/* Wake-up latency of the task watched by telemetry_latency_watch() */
+extern void telemetry_task_ready(void *task);
+extern void telemetry_task_switched_in(void *task);
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB)   telemetry_task_ready(pxTCB)
+#define traceTASK_SWITCHED_IN()                 telemetry_task_switched_in(pxCurrentTCB)
+#else
 #define configGENERATE_RUN_TIME_STATS           0
+#endif
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
@@ -193,7 +214,7 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       1
-#define INCLUDE_uxTaskGetStackHighWaterMark     0
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
 #define INCLUDE_xTaskGetIdleTaskHandle          0
 #define INCLUDE_eTaskGetState                   0
 #define INCLUDE_xEventGroupSetBitFromISR        1
@@ -0,0 +1,396 @@
+/******************************************************************************
+* File Name:   aes_alt.c
+*
+* Description: This file contains the mbedTLS AES alternative implementation
+*              running on the crypto block
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include "mbedtls/build_info.h"
+
+#if defined(MBEDTLS_AES_ALT)
+
+#include <string.h>
+#include "mbedtls/aes.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+
+/**********************************************************************************************************************************
+ * Internal Functions
+ **********************************************************************************************************************************/
+static int aes_setkey( mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits )
+{
+    CRYPTO_Type *base;
+    cy_en_crypto_aes_key_length_t key_length;
+    cy_en_crypto_status_t status;
+
+    switch(keybits)
+    {
+        case 128:
+            key_length = CY_CRYPTO_KEY_AES_128;
+            break;
+        case 192:
+            key_length = CY_CRYPTO_KEY_AES_192;
+            break;
+        case 256:
+            key_length = CY_CRYPTO_KEY_AES_256;
+            break;
+        default:
+            return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    status = Cy_Crypto_Core_Aes_Init(base, key, key_length, &ctx->aes_state, &ctx->aes_buffers);
+    cy_hw_crypto_unlock();
+
+    return (status == CY_CRYPTO_SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+/* One block, the caller holds the crypto block for the whole operation */
+static int aes_ecb_locked( CRYPTO_Type *base, mbedtls_aes_context *ctx, cy_en_crypto_dir_mode_t dir,
+                           const unsigned char input[16], unsigned char output[16] )
+{
+    cy_en_crypto_status_t status = Cy_Crypto_Core_Aes_Ecb(base, dir, output, input, &ctx->aes_state);
+
+    return (status == CY_CRYPTO_SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+static int aes_ecb( mbedtls_aes_context *ctx, cy_en_crypto_dir_mode_t dir,
+                    const unsigned char input[16], unsigned char output[16] )
+{
+    CRYPTO_Type *base;
+    int ret;
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    ret = aes_ecb_locked(base, ctx, dir, input, output);
+    cy_hw_crypto_unlock();
+
+    return ret;
+}
+
+/**********************************************************************************************************************************
+ * External Functions
+ **********************************************************************************************************************************/
+void mbedtls_aes_init( mbedtls_aes_context *ctx )
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_aes_free( mbedtls_aes_context *ctx )
+{
+    if(ctx == NULL)
+    {
+        return;
+    }
+
+    mbedtls_platform_zeroize(ctx, sizeof(*ctx));
+}
+
+int mbedtls_aes_setkey_enc( mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits )
+{
+    return aes_setkey(ctx, key, keybits);
+}
+
+int mbedtls_aes_setkey_dec( mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits )
+{
+    return aes_setkey(ctx, key, keybits);
+}
+
+int mbedtls_internal_aes_encrypt( mbedtls_aes_context *ctx, const unsigned char input[16], unsigned char output[16] )
+{
+    return aes_ecb(ctx, CY_CRYPTO_ENCRYPT, input, output);
+}
+
+int mbedtls_internal_aes_decrypt( mbedtls_aes_context *ctx, const unsigned char input[16], unsigned char output[16] )
+{
+    return aes_ecb(ctx, CY_CRYPTO_DECRYPT, input, output);
+}
+
+int mbedtls_aes_crypt_ecb( mbedtls_aes_context *ctx, int mode, const unsigned char input[16], unsigned char output[16] )
+{
+    if((mode != MBEDTLS_AES_ENCRYPT) && (mode != MBEDTLS_AES_DECRYPT))
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+
+    return aes_ecb(ctx, (mode == MBEDTLS_AES_ENCRYPT) ? CY_CRYPTO_ENCRYPT : CY_CRYPTO_DECRYPT, input, output);
+}
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+int mbedtls_aes_crypt_cbc( mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                           const unsigned char *input, unsigned char *output )
+{
+    CRYPTO_Type *base;
+    cy_en_crypto_status_t status;
+    unsigned char next_iv[16];
+
+    if((mode != MBEDTLS_AES_ENCRYPT) && (mode != MBEDTLS_AES_DECRYPT))
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+    if((length % 16u) != 0u)
+    {
+        return MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH;
+    }
+    if(length == 0u)
+    {
+        return 0;
+    }
+
+    /* The chaining value for the next call, input and output may overlap */
+    if(mode == MBEDTLS_AES_DECRYPT)
+    {
+        memcpy(next_iv, &input[length - 16u], 16u);
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    status = Cy_Crypto_Core_Aes_Cbc(base, (mode == MBEDTLS_AES_ENCRYPT) ? CY_CRYPTO_ENCRYPT : CY_CRYPTO_DECRYPT,
+                                    (uint32_t)length, iv, output, input, &ctx->aes_state);
+    cy_hw_crypto_unlock();
+
+    if(status != CY_CRYPTO_SUCCESS)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    memcpy(iv, (mode == MBEDTLS_AES_ENCRYPT) ? &output[length - 16u] : next_iv, 16u);
+
+    return 0;
+}
+#endif /* MBEDTLS_CIPHER_MODE_CBC */
+
+#if defined(MBEDTLS_CIPHER_MODE_CFB)
+int mbedtls_aes_crypt_cfb128( mbedtls_aes_context *ctx, int mode, size_t length, size_t *iv_off,
+                              unsigned char iv[16], const unsigned char *input, unsigned char *output )
+{
+    CRYPTO_Type *base;
+    int ret = 0;
+    unsigned char c;
+    size_t n = *iv_off;
+
+    if((mode != MBEDTLS_AES_ENCRYPT) && (mode != MBEDTLS_AES_DECRYPT))
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+    if(n > 15u)
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    while(length-- > 0u)
+    {
+        if(n == 0u)
+        {
+            ret = aes_ecb_locked(base, ctx, CY_CRYPTO_ENCRYPT, iv, iv);
+            if(ret != 0)
+            {
+                break;
+            }
+        }
+
+        c = *input++;
+        *output = c ^ iv[n];
+        iv[n] = (mode == MBEDTLS_AES_ENCRYPT) ? *output : c;
+        output++;
+        n = (n + 1u) & 0x0Fu;
+    }
+    cy_hw_crypto_unlock();
+
+    *iv_off = n;
+
+    return ret;
+}
+
+int mbedtls_aes_crypt_cfb8( mbedtls_aes_context *ctx, int mode, size_t length, unsigned char iv[16],
+                            const unsigned char *input, unsigned char *output )
+{
+    CRYPTO_Type *base;
+    int ret = 0;
+    unsigned char c;
+    unsigned char ov[17];
+
+    if((mode != MBEDTLS_AES_ENCRYPT) && (mode != MBEDTLS_AES_DECRYPT))
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    while(length-- > 0u)
+    {
+        memcpy(ov, iv, 16u);
+        ret = aes_ecb_locked(base, ctx, CY_CRYPTO_ENCRYPT, iv, iv);
+        if(ret != 0)
+        {
+            break;
+        }
+
+        if(mode == MBEDTLS_AES_DECRYPT)
+        {
+            ov[16] = *input;
+        }
+
+        c = *output++ = (unsigned char)(iv[0] ^ *input++);
+
+        if(mode == MBEDTLS_AES_ENCRYPT)
+        {
+            ov[16] = c;
+        }
+
+        memcpy(iv, ov + 1, 16u);
+    }
+    cy_hw_crypto_unlock();
+
+    return ret;
+}
+#endif /* MBEDTLS_CIPHER_MODE_CFB */
+
+#if defined(MBEDTLS_CIPHER_MODE_OFB)
+int mbedtls_aes_crypt_ofb( mbedtls_aes_context *ctx, size_t length, size_t *iv_off, unsigned char iv[16],
+                           const unsigned char *input, unsigned char *output )
+{
+    CRYPTO_Type *base;
+    int ret = 0;
+    size_t n = *iv_off;
+
+    if(n > 15u)
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    while(length-- > 0u)
+    {
+        if(n == 0u)
+        {
+            ret = aes_ecb_locked(base, ctx, CY_CRYPTO_ENCRYPT, iv, iv);
+            if(ret != 0)
+            {
+                break;
+            }
+        }
+        *output++ = *input++ ^ iv[n];
+        n = (n + 1u) & 0x0Fu;
+    }
+    cy_hw_crypto_unlock();
+
+    *iv_off = n;
+
+    return ret;
+}
+#endif /* MBEDTLS_CIPHER_MODE_OFB */
+
+#if defined(MBEDTLS_CIPHER_MODE_CTR)
+int mbedtls_aes_crypt_ctr( mbedtls_aes_context *ctx, size_t length, size_t *nc_off, unsigned char nonce_counter[16],
+                           unsigned char stream_block[16], const unsigned char *input, unsigned char *output )
+{
+    CRYPTO_Type *base;
+    int ret = 0;
+    size_t n = *nc_off;
+
+    if(n > 15u)
+    {
+        return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    while(length-- > 0u)
+    {
+        if(n == 0u)
+        {
+            ret = aes_ecb_locked(base, ctx, CY_CRYPTO_ENCRYPT, nonce_counter, stream_block);
+            if(ret != 0)
+            {
+                break;
+            }
+
+            /* Big endian increment of the counter */
+            for(int i = 16; i > 0; i--)
+            {
+                if(++nonce_counter[i - 1] != 0u)
+                {
+                    break;
+                }
+            }
+        }
+        *output++ = *input++ ^ stream_block[n];
+        n = (n + 1u) & 0x0Fu;
+    }
+    cy_hw_crypto_unlock();
+
+    *nc_off = n;
+
+    return ret;
+}
+#endif /* MBEDTLS_CIPHER_MODE_CTR */
+
+#endif /* MBEDTLS_AES_ALT */
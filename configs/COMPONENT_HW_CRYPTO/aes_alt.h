@@ -0,0 +1,73 @@
+/******************************************************************************
+* File Name:   aes_alt.h
+*
+* Description: This file contains the AES context of the mbedTLS alternative
+*              implementation running on the crypto block
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef AES_ALT_H_
+#define AES_ALT_H_
+
+#include "cy_hw_crypto.h"
+
+#if defined(MBEDTLS_CIPHER_MODE_XTS)
+#error "MBEDTLS_CIPHER_MODE_XTS is not supported by the crypto block AES, undefine it in mbedtls_user_config.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief AES context
+ *
+ * The crypto block derives the decryption key itself, the same context serves
+ * both directions whichever of mbedtls_aes_setkey_enc() or
+ * mbedtls_aes_setkey_dec() was used.
+ */
+typedef struct mbedtls_aes_context
+{
+    cy_stc_crypto_aes_state_t   aes_state;
+    cy_stc_crypto_aes_buffers_t aes_buffers;
+} mbedtls_aes_context;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AES_ALT_H_ */
@@ -0,0 +1,184 @@
+/******************************************************************************
+* File Name:   cy_hw_crypto.c
+*
+* Description: This file contains the crypto block access shared by the mbedTLS
+*              alternative implementations
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include "cy_hw_crypto.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#if defined(HW_CRYPTO_WRAP_GCM)
+#include "mbedtls/gcm.h"
+#include "mbedtls/error.h"
+#endif
+
+/**********************************************************************************************************************************
+ * local variables & data
+ **********************************************************************************************************************************/
+static SemaphoreHandle_t    hw_crypto_mutex;
+static StaticSemaphore_t    hw_crypto_mutex_struct;
+static volatile bool        hw_crypto_enabled;
+
+/**********************************************************************************************************************************
+ * External Functions
+ **********************************************************************************************************************************/
+CRYPTO_Type *cy_hw_crypto_lock( void )
+{
+    /* Before the scheduler runs there is nobody to share the block with */
+    if(xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    {
+        if(hw_crypto_mutex == NULL)
+        {
+            taskENTER_CRITICAL();
+            if(hw_crypto_mutex == NULL)
+            {
+                hw_crypto_mutex = xSemaphoreCreateRecursiveMutexStatic(&hw_crypto_mutex_struct);
+            }
+            taskEXIT_CRITICAL();
+        }
+        xSemaphoreTakeRecursive(hw_crypto_mutex, portMAX_DELAY);
+    }
+
+    if(!hw_crypto_enabled)
+    {
+        if(Cy_Crypto_Core_Enable(CRYPTO) != CY_CRYPTO_SUCCESS)
+        {
+            cy_hw_crypto_unlock();
+            return NULL;
+        }
+        hw_crypto_enabled = true;
+    }
+
+    return CRYPTO;
+}
+
+void cy_hw_crypto_unlock( void )
+{
+    if((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && (hw_crypto_mutex != NULL))
+    {
+        xSemaphoreGiveRecursive(hw_crypto_mutex);
+    }
+}
+
+#if defined(HW_CRYPTO_WRAP_GCM)
+/*
+ * mbedTLS GCM runs the AES of each 16 byte block through the cipher layer.
+ * These hooks hold the crypto block for the whole GCM call, the block
+ * encryptions inside only take it again from the same task.
+ */
+int __real_mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx, int mode, size_t length,
+                                      const unsigned char *iv, size_t iv_len,
+                                      const unsigned char *add, size_t add_len,
+                                      const unsigned char *input, unsigned char *output,
+                                      size_t tag_len, unsigned char *tag );
+int __real_mbedtls_gcm_auth_decrypt( mbedtls_gcm_context *ctx, size_t length,
+                                     const unsigned char *iv, size_t iv_len,
+                                     const unsigned char *add, size_t add_len,
+                                     const unsigned char *tag, size_t tag_len,
+                                     const unsigned char *input, unsigned char *output );
+int __real_mbedtls_gcm_update( mbedtls_gcm_context *ctx, const unsigned char *input, size_t input_length,
+                               unsigned char *output, size_t output_size, size_t *output_length );
+int __wrap_mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx, int mode, size_t length,
+                                      const unsigned char *iv, size_t iv_len,
+                                      const unsigned char *add, size_t add_len,
+                                      const unsigned char *input, unsigned char *output,
+                                      size_t tag_len, unsigned char *tag );
+int __wrap_mbedtls_gcm_auth_decrypt( mbedtls_gcm_context *ctx, size_t length,
+                                     const unsigned char *iv, size_t iv_len,
+                                     const unsigned char *add, size_t add_len,
+                                     const unsigned char *tag, size_t tag_len,
+                                     const unsigned char *input, unsigned char *output );
+int __wrap_mbedtls_gcm_update( mbedtls_gcm_context *ctx, const unsigned char *input, size_t input_length,
+                               unsigned char *output, size_t output_size, size_t *output_length );
+
+int __wrap_mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx, int mode, size_t length,
+                                      const unsigned char *iv, size_t iv_len,
+                                      const unsigned char *add, size_t add_len,
+                                      const unsigned char *input, unsigned char *output,
+                                      size_t tag_len, unsigned char *tag )
+{
+    int ret;
+
+    if(cy_hw_crypto_lock() == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+    ret = __real_mbedtls_gcm_crypt_and_tag(ctx, mode, length, iv, iv_len, add, add_len, input, output,
+                                           tag_len, tag);
+    cy_hw_crypto_unlock();
+
+    return ret;
+}
+
+int __wrap_mbedtls_gcm_auth_decrypt( mbedtls_gcm_context *ctx, size_t length,
+                                     const unsigned char *iv, size_t iv_len,
+                                     const unsigned char *add, size_t add_len,
+                                     const unsigned char *tag, size_t tag_len,
+                                     const unsigned char *input, unsigned char *output )
+{
+    int ret;
+
+    if(cy_hw_crypto_lock() == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+    ret = __real_mbedtls_gcm_auth_decrypt(ctx, length, iv, iv_len, add, add_len, tag, tag_len, input, output);
+    cy_hw_crypto_unlock();
+
+    return ret;
+}
+
+int __wrap_mbedtls_gcm_update( mbedtls_gcm_context *ctx, const unsigned char *input, size_t input_length,
+                               unsigned char *output, size_t output_size, size_t *output_length )
+{
+    int ret;
+
+    if(cy_hw_crypto_lock() == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+    ret = __real_mbedtls_gcm_update(ctx, input, input_length, output, output_size, output_length);
+    cy_hw_crypto_unlock();
+
+    return ret;
+}
+#endif /* HW_CRYPTO_WRAP_GCM */
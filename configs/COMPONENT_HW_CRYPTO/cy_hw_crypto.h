@@ -0,0 +1,78 @@
+/******************************************************************************
+* File Name:   cy_hw_crypto.h
+*
+* Description: This file contains the declarations of the crypto block access
+*              shared by the mbedTLS alternative implementations
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef CY_HW_CRYPTO_H_
+#define CY_HW_CRYPTO_H_
+
+#include <stdbool.h>
+#include "cy_pdl.h"
+
+#if !defined(CY_IP_MXCRYPTO)
+#error "COMPONENT_HW_CRYPTO needs a device with the crypto block"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Take exclusive use of the crypto block
+ *
+ * The TLS connections of several tasks share the crypto block. Each operation
+ * loads its own key or hash state, so it only has to be exclusive for the
+ * duration of one mbedTLS call, its blocks are run under one lock. The lock
+ * can be taken again by the task holding it. Enables the block on first use.
+ *
+ * @return  The crypto block registers, NULL if it could not be enabled
+ */
+CRYPTO_Type *cy_hw_crypto_lock( void );
+
+/**
+ * @brief Release the crypto block taken by cy_hw_crypto_lock()
+ */
+void cy_hw_crypto_unlock( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CY_HW_CRYPTO_H_ */
@@ -0,0 +1,164 @@
+/******************************************************************************
+* File Name:   sha256_alt.c
+*
+* Description: This file contains the mbedTLS SHA-224/SHA-256 alternative
+*              implementation running on the crypto block
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include "mbedtls/build_info.h"
+
+#if defined(MBEDTLS_SHA256_ALT)
+
+#include <string.h>
+#include "mbedtls/sha256.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+
+/**********************************************************************************************************************************
+ * Internal Functions
+ **********************************************************************************************************************************/
+/* Point the state of a copied context at its own buffers */
+static void sha256_rebase( mbedtls_sha256_context *dst, const mbedtls_sha256_context *src )
+{
+    const uint8_t *src_base = (const uint8_t *)&src->sha_buffers;
+    uint8_t *dst_base = (uint8_t *)&dst->sha_buffers;
+    uint8_t **pointers[] = { &dst->hash_state.block, &dst->hash_state.hash, &dst->hash_state.roundMem };
+
+    for(uint32_t i = 0; i < (sizeof(pointers) / sizeof(pointers[0])); i++)
+    {
+        const uint8_t *p = *pointers[i];
+        if((p >= src_base) && (p < (src_base + sizeof(src->sha_buffers))))
+        {
+            *pointers[i] = dst_base + (p - src_base);
+        }
+    }
+}
+
+/**********************************************************************************************************************************
+ * External Functions
+ **********************************************************************************************************************************/
+void mbedtls_sha256_init( mbedtls_sha256_context *ctx )
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free( mbedtls_sha256_context *ctx )
+{
+    if(ctx == NULL)
+    {
+        return;
+    }
+
+    mbedtls_platform_zeroize(ctx, sizeof(*ctx));
+}
+
+void mbedtls_sha256_clone( mbedtls_sha256_context *dst, const mbedtls_sha256_context *src )
+{
+    memcpy(dst, src, sizeof(*dst));
+    sha256_rebase(dst, src);
+}
+
+int mbedtls_sha256_starts( mbedtls_sha256_context *ctx, int is224 )
+{
+    CRYPTO_Type *base;
+    cy_en_crypto_status_t status;
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    status = Cy_Crypto_Core_Sha_Init(base, &ctx->hash_state,
+                                     (is224 != 0) ? CY_CRYPTO_MODE_SHA224 : CY_CRYPTO_MODE_SHA256,
+                                     &ctx->sha_buffers);
+    if(status == CY_CRYPTO_SUCCESS)
+    {
+        status = Cy_Crypto_Core_Sha_Start(base, &ctx->hash_state);
+    }
+    cy_hw_crypto_unlock();
+
+    return (status == CY_CRYPTO_SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+int mbedtls_sha256_update( mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen )
+{
+    CRYPTO_Type *base;
+    cy_en_crypto_status_t status;
+
+    if(ilen == 0)
+    {
+        return 0;
+    }
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    status = Cy_Crypto_Core_Sha_Update(base, &ctx->hash_state, input, (uint32_t)ilen);
+    cy_hw_crypto_unlock();
+
+    return (status == CY_CRYPTO_SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+int mbedtls_sha256_finish( mbedtls_sha256_context *ctx, unsigned char *output )
+{
+    CRYPTO_Type *base;
+    cy_en_crypto_status_t status;
+
+    base = cy_hw_crypto_lock();
+    if(base == NULL)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    status = Cy_Crypto_Core_Sha_Finish(base, &ctx->hash_state, output);
+    cy_hw_crypto_unlock();
+
+    return (status == CY_CRYPTO_SUCCESS) ? 0 : MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+}
+
+/* Feeds one block through the context, the hardware keeps no separate block API */
+int mbedtls_internal_sha256_process( mbedtls_sha256_context *ctx, const unsigned char data[64] )
+{
+    return mbedtls_sha256_update(ctx, data, 64);
+}
+
+#endif /* MBEDTLS_SHA256_ALT */
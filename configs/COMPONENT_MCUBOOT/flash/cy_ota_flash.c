@@ -48,6 +48,20 @@
 #include "cyhal.h"
 #include "cybsp.h"
 #include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+#include "mbedtls/sha256.h"
+#if (OTA_FLASH_CM0P == 1)
+#include "cy_ota_flash_ipc.h"
+#endif
+
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+
+/* Asynchronous log */
+#include "app_log.h"
 
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
 #include <cycfg_pins.h>
@@ -70,6 +84,150 @@
 #define CY_FLASH_BASE                       0x10000000UL
 #endif /* XMC7200 */
 
+/* The upgrade slot can be in the QSPI memory of the SMIF. The XMC parts only
+ * use it when the flashmap places the upgrade slot there (OTA_EXTERNAL_FLASH=1
+ * in the Makefile), their QSPI memory is not running code. */
+#if defined (CY_IP_MXSMIF) && (!(defined (XMC7100) || defined (XMC7200)) || defined (OTA_USE_EXTERNAL_FLASH))
+#define OTA_FLASH_SMIF                      (1)
+#else
+#define OTA_FLASH_SMIF                      (0)
+#endif
+
+/* Program downloaded rows from a dedicated task so that the OTA task can keep
+ * receiving while a row is being programmed. Set to 0 to program in the caller. */
+#ifndef OTA_FLASH_ASYNC_WRITE
+#define OTA_FLASH_ASYNC_WRITE               (1)
+#endif
+
+/* Number of row buffers cycled between the OTA task and the flash writer task */
+#define OTA_FLASH_ASYNC_ROWS                (2u)
+
+/* Flash writer task configurations. The writer runs above the OTA task
+ * (OTA_TASK_PRIORITY in main.c) and the range workers so that it starts the next
+ * row as soon as the flash is done with the previous one. It sleeps while the
+ * flash works (OTA_FLASH_NONBLOCKING), which is when they receive. */
+#define OTA_FLASH_WRITER_TASK_STACK_SIZE    (1024)
+#define OTA_FLASH_WRITER_TASK_PRIORITY      (configMAX_PRIORITIES - 2)
+
+/* Program and erase the code flash with the non-blocking driver calls and poll for
+ * the end of the operation a tick at a time, with the interrupts enabled, so that
+ * the network stack and the other tasks run while a row is programmed or a sector
+ * erased. Meanwhile, reads of the code flash follow the read-while-write rules of
+ * the device. Before the scheduler runs, and with 0, the blocking calls are made
+ * with the interrupts masked. */
+#if (defined (XMC7100) || defined (XMC7200)) && !defined (OTA_FLASH_NONBLOCKING)
+#define OTA_FLASH_NONBLOCKING               (1)
+#endif
+
+/* Ticks between two polls of a flash operation in progress */
+#define OTA_FLASH_NONBLOCKING_POLL_TICKS    (1)
+
+/* Delay between checks while waiting for the flash writer task */
+#define OTA_FLASH_WRITER_WAIT_MS            (1)
+
+/* While a download is in progress, erase the upgrade slot just in time, this many
+ * sectors ahead of the row being programmed, instead of all of it when the slot
+ * is opened. Set to 0 to erase the whole slot up front. */
+#ifndef OTA_FLASH_ERASE_AHEAD_SECTORS
+#define OTA_FLASH_ERASE_AHEAD_SECTORS       (4u)
+#endif
+
+/* Erase size of the code flash large sectors holding the application slots */
+#define XMC_FLASH_ERASE_SECTOR_SIZE         (0x8000U) /* 32KB */
+
+/* Value read back from an erased code flash location */
+#define XMC_FLASH_ERASE_VALUE               (0xFFU)
+
+/* Once the running image is validated, erase the upgrade slot from a low priority
+ * task so that the next update can start writing right away. Needs the slot
+ * location generated from the flashmap, in internal flash. Set to 0 to disable. */
+#if (defined (XMC7100) || defined (XMC7200)) && !defined (OTA_USE_EXTERNAL_FLASH) && \
+    defined (FLASH_AREA_IMG_1_SECONDARY_START) && defined (FLASH_AREA_IMG_1_SECONDARY_SIZE)
+#ifndef OTA_FLASH_PRE_ERASE
+#define OTA_FLASH_PRE_ERASE                 (1)
+#endif
+#else
+#undef  OTA_FLASH_PRE_ERASE
+#define OTA_FLASH_PRE_ERASE                 (0)
+#endif
+
+/* Background erase task configurations */
+#define OTA_FLASH_PRE_ERASE_TASK_STACK_SIZE (512)
+#define OTA_FLASH_PRE_ERASE_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+
+/* Hash the image in the upgrade slot as its rows are programmed, so that the
+ * check after the download only has to compare the digest with the SHA-256 TLV
+ * instead of reading the slot back. Only an upgrade slot in internal flash that
+ * is not encrypted on the fly is hashed this way; the others, and a download that
+ * did not program the rows in order, are read back. Set to 0 to disable. */
+#if defined (FLASH_AREA_IMG_1_SECONDARY_START) && defined (FLASH_AREA_IMG_1_SECONDARY_SIZE) && \
+    !defined (ENABLE_ON_THE_FLY_ENCRYPTION) && !defined (OTA_USE_EXTERNAL_FLASH)
+#ifndef OTA_FLASH_STREAM_HASH
+#define OTA_FLASH_STREAM_HASH               (1)
+#endif
+#else
+#undef  OTA_FLASH_STREAM_HASH
+#define OTA_FLASH_STREAM_HASH               (0)
+#endif
+
+/* Check the downloaded image against its SHA-256 TLV, see cy_ota_mem_verify_image_hash() */
+#if defined (FLASH_AREA_IMG_1_SECONDARY_START) && defined (FLASH_AREA_IMG_1_SECONDARY_SIZE)
+#define OTA_FLASH_IMAGE_CHECK               (1)
+#else
+#define OTA_FLASH_IMAGE_CHECK               (0)
+#endif
+
+#if defined (OTA_USE_EXTERNAL_FLASH)
+#define OTA_FLASH_SLOT_MEM_TYPE             CY_OTA_MEM_TYPE_EXTERNAL_FLASH
+#else
+#define OTA_FLASH_SLOT_MEM_TYPE             CY_OTA_MEM_TYPE_INTERNAL_FLASH
+#endif
+
+/* Hand the erase-ahead, the programming of the downloaded rows and their hash
+ * to the flash service of the CM0+ (CM0P_FLASH=1 in the Makefile, see
+ * cm0p/ota_flash_service.c), so that the CM7 only receives. Without the
+ * service the CM7 does the work itself. The service only programs the internal
+ * flash. */
+#if !(defined (XMC7100) || defined (XMC7200)) || defined (OTA_USE_EXTERNAL_FLASH)
+#undef  OTA_FLASH_CM0P
+#endif
+#ifndef OTA_FLASH_CM0P
+#define OTA_FLASH_CM0P                      (0)
+#endif
+
+/* Time the flash service of the CM0+ gets to answer, before the first download */
+#define OTA_FLASH_CM0P_READY_MS             (100u)
+
+/* Longest time the CM0+ gets to complete one queued operation, a sector erase
+ * at most, while the CM7 waits for the ring. A service that does not is taken
+ * as stalled: the session fails and the CM7 programs the flash from then on. */
+#define OTA_FLASH_CM0P_TIMEOUT_MS           (2000u)
+
+/* Read every row back once it is programmed and compare it with the data it was
+ * programmed from, a word at a time. With OTA_FLASH_ASYNC_WRITE this runs on the
+ * flash writer task. A row that does not read back is programmed once more, which
+ * sets the bits that did not program, before the write fails. The hash taken while
+ * the rows are programmed (OTA_FLASH_STREAM_HASH) is over the data as it was
+ * received, not as it reads back, so it does not replace this check. Set to 0 to
+ * disable. */
+#ifndef OTA_FLASH_VERIFY_WRITE
+#define OTA_FLASH_VERIFY_WRITE              (1)
+#endif
+
+/* Programming attempts of a row that does not read back */
+#define OTA_FLASH_VERIFY_ATTEMPTS           (2u)
+
+/* Bytes of external flash read back at once by the verification */
+#define OTA_FLASH_VERIFY_CHUNK_SIZE         (64u)
+
+/* MCUboot image format, see bootutil/image.h */
+#define MCUBOOT_IMAGE_MAGIC                 (0x96f3b83dUL)
+#define MCUBOOT_IMAGE_HEADER_SIZE           (32u)
+#define MCUBOOT_IMAGE_F_ENCRYPTED           (0x04UL | 0x08UL)   /* IMAGE_F_ENCRYPTED_AES128 | IMAGE_F_ENCRYPTED_AES256 */
+#define MCUBOOT_TLV_INFO_MAGIC              (0x6907u)
+#define MCUBOOT_TLV_SHA256                  (0x10u)
+#define MCUBOOT_SHA256_SIZE                 (32u)
+
 #if defined(XMC7100)
 #ifndef CY_XIP_BASE
 #define CY_XIP_BASE                         0x60000000UL
@@ -78,9 +236,30 @@
 #define CY_FLASH_BASE                       0x10000000UL
 #endif /* XMC7100 */
 
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
-/* UN-comment to test the write functionality */
-//#define READBACK_SMIF_WRITE_TEST
+#if defined (XMC7100) || defined (XMC7200)
+/* With the CM7 data cache enabled (CM7_CACHE=1) the row source has to reach
+ * SRAM before the flash controller programs it, and the lines caching a row
+ * that was erased or programmed have to be dropped: xmc_internal_flash_write()
+ * compares the new data with the row it reads back. Inline CMSIS calls, these
+ * run from RAM while the flash is busy. */
+#if defined(CM7_CACHE)
+#define XMC_FLASH_DCACHE_CLEAN(addr, size)      SCB_CleanDCache_by_Addr((void *)(addr), (int32_t)(size))
+#define XMC_FLASH_DCACHE_INVALIDATE(addr, size) SCB_InvalidateDCache_by_Addr((void *)(addr), (int32_t)(size))
+#else
+#define XMC_FLASH_DCACHE_CLEAN(addr, size)
+#define XMC_FLASH_DCACHE_INVALIDATE(addr, size)
+#endif /* #if defined(CM7_CACHE) */
+#endif /* #if defined (XMC7100) || defined (XMC7200) */
+
+#if (OTA_FLASH_SMIF == 1)
+/* SMIF block the QSPI memory is connected to */
+#ifndef OTA_SMIF_HW
+#if defined (XMC7100) || defined (XMC7200)
+#define OTA_SMIF_HW                                 SMIF0_CORE0
+#else
+#define OTA_SMIF_HW                                 SMIF0
+#endif
+#endif
 
 // SMIF slot from which the memory configuration is picked up - fixed to 0 as
 // the driver supports only one device
@@ -115,12 +294,12 @@
 #define PRE_SMIF_ACCESS_TURN_OFF_XIP \
                     uint32_t interruptState;                            \
                     interruptState = Cy_SysLib_EnterCriticalSection();  \
-                    while(Cy_SMIF_BusyCheck(SMIF0));    \
-                    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);
+                    while(Cy_SMIF_BusyCheck(OTA_SMIF_HW));    \
+                    (void)Cy_SMIF_SetMode(OTA_SMIF_HW, CY_SMIF_NORMAL);
 
 #define POST_SMIF_ACCESS_TURN_ON_XIP \
-                    while(Cy_SMIF_BusyCheck(SMIF0));    \
-                    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_MEMORY);   \
+                    while(Cy_SMIF_BusyCheck(OTA_SMIF_HW));    \
+                    (void)Cy_SMIF_SetMode(OTA_SMIF_HW, CY_SMIF_MEMORY);   \
                     Cy_SysLib_ExitCriticalSection(interruptState);
 
 
@@ -153,50 +332,564 @@ cy_stc_smif_config_t ota_SMIF_config =
 
 extern const cy_stc_smif_mem_config_t* const smifMemConfigs[];
 extern const cy_stc_smif_block_config_t smifBlockConfig;
+#endif /* OTA_FLASH_SMIF */
 
-#ifdef READBACK_SMIF_WRITE_TEST
-/* Used for testing the write functionality */
-static uint8_t read_back_test[1024];
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+/* Row buffers holding the encrypted copy of a write to external flash whose
+ * source belongs to the caller and must keep its plain text. The row buffers of
+ * this file are encrypted in place. */
+#ifndef OTA_FLASH_ENC_POOL_ROWS
+#define OTA_FLASH_ENC_POOL_ROWS             (2u)    /* OTA task and flash writer task */
+#endif
+
+static CY_ALIGN(4) uint8_t      ota_enc_pool[OTA_FLASH_ENC_POOL_ROWS][CY_FLASH_SIZEOF_ROW];
+static uint32_t                 ota_enc_pool_used;      /* One bit per row buffer */
+static cy_ota_mem_enc_pool_stats_t ota_enc_pool_stats;
+
+/* Counts the row buffers not in use, created by cy_ota_mem_init() */
+static SemaphoreHandle_t        ota_enc_pool_free;
+static StaticSemaphore_t        ota_enc_pool_free_struct;
 #endif
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
 
-#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
 /**
- * @brief Local buffer for data flash write
+ * @brief Row-coalescing write buffer
+ *
+ * While a download is in progress, data for a flash row is collected here so
+ * that the row is programmed once instead of once per received chunk.
  */
-uint8_t *write_buffer = NULL;
-#endif
+typedef struct
+{
+    bool                enabled;        /* Set between cy_ota_mem_write_begin() and cy_ota_mem_write_end() */
+    bool                row_valid;      /* row_buffer holds data not yet programmed */
+    cy_ota_mem_type_t   mem_type;       /* Memory the buffered row belongs to */
+    uint32_t            row_base;       /* Row aligned address of the buffered row */
+    uint8_t             *row_buffer;    /* CY_FLASH_SIZEOF_ROW bytes being filled */
+} cy_ota_mem_coalesce_t;
+
+static cy_ota_mem_coalesce_t ota_coalesce;
+
+/**
+ * @brief Sector erase bookkeeping
+ *
+ * [next, end) is the part of an erase request that has been deferred until the
+ * writer gets close to it. Offsets are relative to CY_FLASH_BASE, like the
+ * addresses passed to cy_ota_mem_erase(). `pending` and `next` change in a
+ * critical section, once the sectors are erased, and are read the same way.
+ */
+typedef struct
+{
+    volatile bool       pending;        /* A deferred range is outstanding */
+    volatile uint32_t   next;           /* First sector not erased yet */
+    uint32_t            end;            /* End of the deferred range, sector aligned */
+    uint32_t            erased_sectors; /* Progress of the current erase request */
+    uint32_t            total_sectors;
+    uint32_t            keep;           /* The next open of the slot does not erase below, 0 for none */
+} cy_ota_mem_erase_state_t;
+
+static cy_ota_mem_erase_state_t         ota_erase;
+static cy_ota_mem_erase_progress_cb_t   ota_erase_progress_cb;
+
+#if (OTA_FLASH_STREAM_HASH == 1)
+/**
+ * @brief SHA-256 of the image in the upgrade slot, fed row by row as the rows are programmed
+ *
+ * Only a download that programs the slot from its first row upwards, each row once,
+ * can be hashed this way. Anything else clears `in_order` and the slot is read back
+ * to check it.
+ */
+typedef struct
+{
+    bool                    active;         /* Set by cy_ota_mem_write_begin() */
+    bool                    in_order;       /* Every row so far came right after the previous one */
+    bool                    done;           /* digest holds the hash of the whole image */
+    bool                    offloaded;      /* The rows are hashed by the CM0+ */
+    uint32_t                next;           /* Offset of the next row expected */
+    uint32_t                hash_len;       /* Bytes covered by the MCUboot hash, 0 until the header is seen */
+    uint32_t                hashed;
+    mbedtls_sha256_context  ctx;
+    uint8_t                 digest[MCUBOOT_SHA256_SIZE];
+} cy_ota_mem_stream_hash_t;
+
+static cy_ota_mem_stream_hash_t         ota_hash;
+#endif /* OTA_FLASH_STREAM_HASH */
+
+#if (OTA_FLASH_PRE_ERASE == 1)
+#define OTA_FLASH_SLOT_SECTORS  ((FLASH_AREA_IMG_1_SECONDARY_SIZE + XMC_FLASH_ERASE_SECTOR_SIZE - 1u) / XMC_FLASH_ERASE_SECTOR_SIZE)
+
+/* Sectors of the upgrade slot known to be erased, one bit per sector. This is only
+ * kept in RAM: a swap done by MCUboot would make a copy in flash stale, so the
+ * background task rebuilds it with a blank check after every boot. */
+static uint32_t                 ota_clean_sectors[(OTA_FLASH_SLOT_SECTORS + 31u) / 32u];
+static volatile bool            ota_pre_erase_stop;
+
+static TaskHandle_t             ota_pre_erase_task;
+static StaticTask_t             ota_pre_erase_task_tcb;
+static StackType_t              ota_pre_erase_task_stack[OTA_FLASH_PRE_ERASE_TASK_STACK_SIZE];
+
+/* Held by the background task while it works on a sector */
+static SemaphoreHandle_t        ota_pre_erase_lock;
+static StaticSemaphore_t        ota_pre_erase_lock_struct;
+#endif /* OTA_FLASH_PRE_ERASE */
+
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+/**
+ * @brief Row buffer handed from the OTA task to the flash writer task
+ */
+typedef struct
+{
+    volatile bool       busy;           /* Queued or being programmed */
+    cy_ota_mem_type_t   mem_type;
+    uint32_t            row_base;
+    CY_ALIGN(4) uint8_t data[CY_FLASH_SIZEOF_ROW];
+} cy_ota_mem_async_row_t;
+
+static cy_ota_mem_async_row_t   ota_async_rows[OTA_FLASH_ASYNC_ROWS];
+static uint32_t                 ota_async_fill;         /* Row buffer owned by the coalescing writer */
+static volatile cy_rslt_t       ota_async_result;       /* First programming error of the session */
+
+static TaskHandle_t             ota_async_task;
+static StaticTask_t             ota_async_task_tcb;
+static StackType_t              ota_async_task_stack[OTA_FLASH_WRITER_TASK_STACK_SIZE];
+
+/* Filled row buffers, in program order */
+static QueueHandle_t            ota_async_queue;
+static StaticQueue_t            ota_async_queue_struct;
+static uint8_t                  ota_async_queue_storage[OTA_FLASH_ASYNC_ROWS * sizeof(uint32_t)];
+
+/* Counts the row buffers that are not in flight */
+static SemaphoreHandle_t        ota_async_free;
+static StaticSemaphore_t        ota_async_free_struct;
+#else
+static CY_ALIGN(4) uint8_t      ota_coalesce_row[CY_FLASH_SIZEOF_ROW];
+#endif /* OTA_FLASH_ASYNC_WRITE */
+
+#if (OTA_FLASH_CM0P == 1)
+/* Ring of flash operations read by the CM0+, in the non-cacheable memory shared with it */
+static CY_SECTION(".cy_nocache") ota_flash_ipc_ring_t ota_ipc_ring;
+
+static bool                     ota_ipc_published;      /* Ring address written to the IPC channel */
+static bool                     ota_ipc_session;        /* The current download goes through the ring */
+static bool                     ota_ipc_stalled;        /* The CM0+ missed OTA_FLASH_CM0P_TIMEOUT_MS, ring withdrawn */
+
+/* The OTA task and the flash writer task both queue operations */
+static SemaphoreHandle_t        ota_ipc_lock;
+static StaticSemaphore_t        ota_ipc_lock_struct;
+#endif /* OTA_FLASH_CM0P */
 
 /**********************************************************************************************************************************
  * Internal Functions
  **********************************************************************************************************************************/
-#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
-static bool ota_allocate_write_buffer(uint64_t size)
+static cy_rslt_t cy_ota_mem_coalesce_flush_row( void );
+#if (OTA_FLASH_PRE_ERASE == 1)
+static void cy_ota_mem_pre_erase_halt( void );
+#endif
+
+static bool cy_ota_mem_row_overlaps( cy_ota_mem_type_t row_type, uint32_t row_base,
+                                     cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
 {
-    if(write_buffer != NULL)
+    return ((row_type == mem_type) &&
+            (addr < (row_base + CY_FLASH_SIZEOF_ROW)) &&
+            ((addr + len) > row_base));
+}
+
+#if (OTA_FLASH_PRE_ERASE == 1)
+/* Index of the upgrade slot sector holding offset `addr`, OTA_FLASH_SLOT_SECTORS if outside of the slot */
+static uint32_t cy_ota_mem_slot_sector( uint32_t addr )
+{
+    if((addr < FLASH_AREA_IMG_1_SECONDARY_START) ||
+       (addr >= (FLASH_AREA_IMG_1_SECONDARY_START + FLASH_AREA_IMG_1_SECONDARY_SIZE)))
     {
-        free(write_buffer);
-        write_buffer = NULL;
+        return OTA_FLASH_SLOT_SECTORS;
     }
 
-    write_buffer = (uint8_t *)malloc(size);
-    if(write_buffer == NULL)
+    return (addr - FLASH_AREA_IMG_1_SECONDARY_START) / XMC_FLASH_ERASE_SECTOR_SIZE;
+}
+
+static bool cy_ota_mem_sector_is_clean( uint32_t addr )
+{
+    uint32_t sector = cy_ota_mem_slot_sector(addr);
+
+    if(sector >= OTA_FLASH_SLOT_SECTORS)
     {
         return false;
     }
+
+    return ((ota_clean_sectors[sector / 32u] & (1UL << (sector % 32u))) != 0u);
+}
+
+/* The bitmap is updated from several tasks */
+static void cy_ota_mem_sector_mark( uint32_t addr, bool clean )
+{
+    uint32_t sector = cy_ota_mem_slot_sector(addr);
+
+    if(sector >= OTA_FLASH_SLOT_SECTORS)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if(clean)
+    {
+        ota_clean_sectors[sector / 32u] |= (1UL << (sector % 32u));
+    }
     else
     {
-        return true;
+        ota_clean_sectors[sector / 32u] &= ~(1UL << (sector % 32u));
+    }
+    taskEXIT_CRITICAL();
+}
+
+/* Make sure the background erase is out of the way before touching the upgrade slot */
+static void cy_ota_mem_pre_erase_guard( uint32_t addr, size_t len )
+{
+    if((addr < (FLASH_AREA_IMG_1_SECONDARY_START + FLASH_AREA_IMG_1_SECONDARY_SIZE)) &&
+       ((addr + len) > FLASH_AREA_IMG_1_SECONDARY_START))
+    {
+        cy_ota_mem_pre_erase_halt();
+    }
+}
+
+/* Keep the background erase off the flash controller while memory outside of the upgrade slot is erased or programmed */
+static bool cy_ota_mem_pre_erase_pause( uint32_t addr, size_t len )
+{
+    if((ota_pre_erase_lock == NULL) ||
+       ((addr < (FLASH_AREA_IMG_1_SECONDARY_START + FLASH_AREA_IMG_1_SECONDARY_SIZE)) &&
+        ((addr + len) > FLASH_AREA_IMG_1_SECONDARY_START)))
+    {
+        return false;
+    }
+
+    xSemaphoreTake(ota_pre_erase_lock, portMAX_DELAY);
+    return true;
+}
+
+static void cy_ota_mem_pre_erase_resume( bool paused )
+{
+    if(paused)
+    {
+        xSemaphoreGive(ota_pre_erase_lock);
+    }
+}
+
+/* Sectors about to be programmed are no longer erased */
+static void cy_ota_mem_sectors_dirty( uint32_t addr, size_t len )
+{
+    uint32_t sector_addr = (addr / XMC_FLASH_ERASE_SECTOR_SIZE) * XMC_FLASH_ERASE_SECTOR_SIZE;
+
+    cy_ota_mem_pre_erase_guard(addr, len);
+
+    for( ; sector_addr < (addr + len); sector_addr += XMC_FLASH_ERASE_SECTOR_SIZE)
+    {
+        cy_ota_mem_sector_mark(sector_addr, false);
+    }
+}
+
+/* Check a whole sector at offset `addr` for the erase value */
+static bool cy_ota_mem_sector_is_blank( uint32_t addr )
+{
+    const uint32_t *word = (const uint32_t *)(CY_FLASH_BASE + addr);
+    const uint32_t erased = XMC_FLASH_ERASE_VALUE * 0x01010101UL;
+
+    for(uint32_t i = 0; i < (XMC_FLASH_ERASE_SECTOR_SIZE / sizeof(uint32_t)); i++)
+    {
+        if(word[i] != erased)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif /* OTA_FLASH_PRE_ERASE */
+
+#if (OTA_FLASH_CM0P == 1)
+/* Publish the ring to the CM0+ on first use. true if its flash service is running. */
+static bool cy_ota_mem_ipc_init( void )
+{
+    IPC_STRUCT_Type *ipc;
+
+    if(!ota_ipc_published)
+    {
+        ota_ipc_published = true;
+
+        ota_ipc_lock = xSemaphoreCreateMutexStatic(&ota_ipc_lock_struct);
+        memset((void *)&ota_ipc_ring, 0, sizeof(ota_ipc_ring));
+        ota_ipc_ring.magic = OTA_FLASH_IPC_MAGIC;
+        __DMB();
+
+        ipc = Cy_IPC_Drv_GetIpcBaseAddress(OTA_FLASH_IPC_CHANNEL);
+        if((ota_ipc_lock == NULL) || (Cy_IPC_Drv_LockAcquire(ipc) != CY_IPC_DRV_SUCCESS))
+        {
+            APP_LOG_INFO("%s() IPC channel %u not available, the CM7 programs the flash\n", __func__, (unsigned int)OTA_FLASH_IPC_CHANNEL);
+            ota_ipc_ring.magic = 0u;
+            return false;
+        }
+        Cy_IPC_Drv_WriteDataValue(ipc, (uint32_t)&ota_ipc_ring);
+
+        for(uint32_t waited = 0; (ota_ipc_ring.ready != OTA_FLASH_IPC_READY) && (waited < OTA_FLASH_CM0P_READY_MS); waited++)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+
+        APP_LOG_INFO("%s\n", (ota_ipc_ring.ready == OTA_FLASH_IPC_READY) ? "Flash programming and image hash run on the CM0+" :
+                                                                           "No flash service on the CM0+, the CM7 programs the flash");
+    }
+
+    /* A service that starts late is used from the next download on */
+    return !ota_ipc_stalled && (ota_ipc_ring.magic == OTA_FLASH_IPC_MAGIC) && (ota_ipc_ring.ready == OTA_FLASH_IPC_READY);
+}
+
+/* Withdraw the ring from a CM0+ that stopped handling it. Operations it reaches
+ * later are skipped by the service, only the one in progress completes. */
+static void cy_ota_mem_ipc_stall( void )
+{
+    if(!ota_ipc_stalled)
+    {
+        ota_ipc_stalled = true;
+        ota_ipc_ring.magic = 0u;
+        __DMB();
+        APP_LOG_ERR("%s() The CM0+ flash service did not answer in %u ms, the CM7 programs the flash from the next download\n",
+                    __func__, (unsigned int)OTA_FLASH_CM0P_TIMEOUT_MS);
+    }
+}
+
+/* Wait for the CM0+ to handle one more operation, false once it stalled */
+static bool cy_ota_mem_ipc_wait( uint32_t *tail, TickType_t *since )
+{
+    if(ota_ipc_ring.tail != *tail)
+    {
+        *tail = ota_ipc_ring.tail;
+        *since = xTaskGetTickCount();
+    }
+    else if(ota_ipc_stalled || ((xTaskGetTickCount() - *since) >= pdMS_TO_TICKS(OTA_FLASH_CM0P_TIMEOUT_MS)))
+    {
+        cy_ota_mem_ipc_stall();
+        return false;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(OTA_FLASH_WRITER_WAIT_MS));
+    return true;
+}
+
+/* Wait until the CM0+ has handled every queued operation */
+static cy_rslt_t cy_ota_mem_ipc_drain( void )
+{
+    uint32_t tail = ota_ipc_ring.tail;
+    TickType_t since = xTaskGetTickCount();
+
+    while(ota_ipc_ring.tail != ota_ipc_ring.head)
+    {
+        if(!cy_ota_mem_ipc_wait(&tail, &since))
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+    }
+
+    return (ota_ipc_ring.error == OTA_FLASH_IPC_STATUS_OK) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/* Queue an operation for the CM0+, `data` is a whole row or NULL */
+static cy_rslt_t cy_ota_mem_ipc_post( uint32_t op, uint32_t addr, uint32_t hash_len, const uint8_t *data )
+{
+    ota_flash_ipc_desc_t *desc;
+    uint32_t tail;
+    TickType_t since;
+
+    /* The holder of the lock waits OTA_FLASH_CM0P_TIMEOUT_MS at most */
+    xSemaphoreTake(ota_ipc_lock, portMAX_DELAY);
+
+    tail = ota_ipc_ring.tail;
+    since = xTaskGetTickCount();
+    while(ota_ipc_stalled || ((ota_ipc_ring.head - ota_ipc_ring.tail) >= OTA_FLASH_IPC_RING_SIZE))
+    {
+        if(!cy_ota_mem_ipc_wait(&tail, &since))
+        {
+            xSemaphoreGive(ota_ipc_lock);
+            return CY_RSLT_TYPE_ERROR;
+        }
+    }
+
+    desc = &ota_ipc_ring.desc[ota_ipc_ring.head % OTA_FLASH_IPC_RING_SIZE];
+    desc->op       = op;
+    desc->addr     = addr;
+    desc->hash_len = hash_len;
+    desc->status   = OTA_FLASH_IPC_STATUS_OK;
+    if(data != NULL)
+    {
+        memcpy(desc->data, data, CY_FLASH_SIZEOF_ROW);
+    }
+
+    /* The descriptor is complete before the CM0+ sees it */
+    __DMB();
+    ota_ipc_ring.head++;
+
+    xSemaphoreGive(ota_ipc_lock);
+
+    /* Errors of earlier operations stop the download */
+    return (ota_ipc_ring.error == OTA_FLASH_IPC_STATUS_OK) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/* Queue the erase of the sectors in [from, to), offsets relative to CY_FLASH_BASE */
+static cy_rslt_t cy_ota_mem_ipc_erase( uint32_t from, uint32_t to )
+{
+    for(uint32_t sector_addr = from; sector_addr < to; sector_addr += XMC_FLASH_ERASE_SECTOR_SIZE)
+    {
+#if (OTA_FLASH_PRE_ERASE == 1)
+        /* Already erased in the background. Sectors erased by the CM0+ are not
+         * marked clean, they are erased again if the download fails. */
+        if (!cy_ota_mem_sector_is_clean(sector_addr))
+#endif
+        {
+            if(cy_ota_mem_ipc_post(OTA_FLASH_IPC_OP_ERASE, sector_addr + CY_FLASH_BASE, 0u, NULL) != CY_RSLT_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+        }
+
+        ota_erase.erased_sectors++;
+        if (ota_erase_progress_cb != NULL)
+        {
+            ota_erase_progress_cb(ota_erase.erased_sectors, ota_erase.total_sectors);
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/* Queue a row of the download, the first `hash_len` bytes are fed to the image hash */
+static cy_rslt_t cy_ota_mem_ipc_program_row( uint32_t row_base, const uint8_t *row_buf, uint32_t hash_len )
+{
+#if (OTA_FLASH_PRE_ERASE == 1)
+    cy_ota_mem_sectors_dirty(row_base, CY_FLASH_SIZEOF_ROW);
+#endif
+
+    return cy_ota_mem_ipc_post(OTA_FLASH_IPC_OP_PROGRAM, row_base + CY_FLASH_BASE, hash_len, row_buf);
+}
+#endif /* OTA_FLASH_CM0P */
+
+/* Deferred range not erased yet, [next, end), empty if there is none */
+static void cy_ota_mem_erase_ahead_snapshot( uint32_t *next, uint32_t *end )
+{
+    taskENTER_CRITICAL();
+    *next = ota_erase.pending ? ota_erase.next : 0u;
+    *end  = ota_erase.pending ? ota_erase.end : 0u;
+    taskEXIT_CRITICAL();
+}
+
+/* Update the deferred range once its sectors below `next` are erased */
+static void cy_ota_mem_erase_ahead_set( uint32_t next, uint32_t end, bool pending )
+{
+    taskENTER_CRITICAL();
+    ota_erase.next    = next;
+    ota_erase.end     = end;
+    ota_erase.pending = pending;
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Deferred sectors have not been erased yet, present them as erased to the reader.
+ * [next, end) is the snapshot taken before the flash was read: a sector the writer
+ * task erases while it is read is still patched.
+ */
+static void cy_ota_mem_erase_ahead_fill( uint32_t next, uint32_t end, uint32_t addr, uint8_t *data, size_t len )
+{
+    uint32_t from;
+    uint32_t to;
+
+    from = (addr > next) ? addr : next;
+    to   = ((addr + len) < end) ? (addr + len) : end;
+    if(from < to)
+    {
+        memset(&data[from - addr], XMC_FLASH_ERASE_VALUE, to - from);
+    }
+}
+
+/* Keep the program order of the buffered rows relative to reads and erases of the same area */
+static cy_rslt_t cy_ota_mem_coalesce_sync( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if(ota_coalesce.row_valid &&
+       cy_ota_mem_row_overlaps(ota_coalesce.mem_type, ota_coalesce.row_base, mem_type, addr, len))
+    {
+        result = cy_ota_mem_coalesce_flush_row();
+    }
+
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+    /* Wait for queued rows in the area, other rows keep programming in the background */
+    for(uint32_t i = 0; i < OTA_FLASH_ASYNC_ROWS; i++)
+    {
+        while(ota_async_rows[i].busy &&
+              cy_ota_mem_row_overlaps(ota_async_rows[i].mem_type, ota_async_rows[i].row_base, mem_type, addr, len))
+        {
+            vTaskDelay(pdMS_TO_TICKS(OTA_FLASH_WRITER_WAIT_MS));
+        }
+    }
+
+    if(ota_async_result != CY_RSLT_SUCCESS)
+    {
+        result = ota_async_result;
+    }
+#endif /* OTA_FLASH_ASYNC_WRITE */
+
+#if (OTA_FLASH_CM0P == 1)
+    /* Operations handed to the CM0+ are not tracked one by one, wait for all of them */
+    if(cy_ota_mem_ipc_drain() != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_TYPE_ERROR;
     }
+#endif
+
+    return result;
 }
 
-static void ota_free_write_buffer(void)
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+/* Take a row buffer of the pool, waiting for one if they are all in use */
+static uint8_t *ota_enc_pool_acquire(void)
 {
-    if(write_buffer != NULL)
+    uint8_t *buf = NULL;
+
+    if(ota_enc_pool_free == NULL)
+    {
+        return NULL;
+    }
+
+    if(xSemaphoreTake(ota_enc_pool_free, 0) != pdTRUE)
+    {
+        ota_enc_pool_stats.waits++;
+        (void)xSemaphoreTake(ota_enc_pool_free, portMAX_DELAY);
+    }
+
+    taskENTER_CRITICAL();
+    for(uint32_t i = 0; i < OTA_FLASH_ENC_POOL_ROWS; i++)
+    {
+        if((ota_enc_pool_used & (1UL << i)) == 0u)
+        {
+            ota_enc_pool_used |= (1UL << i);
+            buf = ota_enc_pool[i];
+            break;
+        }
+    }
+    ota_enc_pool_stats.in_use++;
+    if(ota_enc_pool_stats.in_use > ota_enc_pool_stats.peak)
     {
-        free(write_buffer);
-        write_buffer = NULL;
+        ota_enc_pool_stats.peak = ota_enc_pool_stats.in_use;
     }
+    taskEXIT_CRITICAL();
+
+    return buf;
+}
+
+static void ota_enc_pool_release(uint8_t *buf)
+{
+    uint32_t i = (uint32_t)(buf - ota_enc_pool[0]) / CY_FLASH_SIZEOF_ROW;
+
+    taskENTER_CRITICAL();
+    ota_enc_pool_used &= ~(1UL << i);
+    ota_enc_pool_stats.in_use--;
+    taskEXIT_CRITICAL();
+
+    xSemaphoreGive(ota_enc_pool_free);
 }
 
 static uint32_t cy_flash_addr_to_cbus_addr(uint32_t secondary_addr)
@@ -207,7 +900,7 @@ static uint32_t cy_flash_addr_to_cbus_addr(uint32_t secondary_addr)
 }
 #endif
 
-#if defined(CY_IP_MXSMIF) && !defined(PSOC_062_1M) && !defined(XMC7100) && !defined(XMC7200)
+#if (OTA_FLASH_SMIF == 1) && !defined(PSOC_062_1M)
 #if defined(OTA_USE_EXTERNAL_FLASH)
 /*******************************************************************************
 * Function Name: IsMemoryReady
@@ -231,7 +924,7 @@ static cy_en_smif_status_t IsMemoryReady(cy_stc_smif_mem_config_t const *memConf
 
     do
     {
-        isBusy = Cy_SMIF_Memslot_IsBusy(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
+        isBusy = Cy_SMIF_Memslot_IsBusy(OTA_SMIF_HW, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
         Cy_SysLib_Delay(5);
         retries++;
     }while(isBusy && (retries < MEMORY_BUSY_CHECK_RETRIES));
@@ -264,7 +957,7 @@ static cy_en_smif_status_t IsQuadEnabled(cy_stc_smif_mem_config_t const *memConf
     uint32_t statusCmd = memConfig->deviceCfg->readStsRegQeCmd->command;
     uint8_t maskQE = (uint8_t) memConfig->deviceCfg->stsRegQuadEnableMask;
 
-    status = Cy_SMIF_Memslot_CmdReadSts(SMIF0, memConfig, &readStatus, statusCmd, &ota_QSPI_context);
+    status = Cy_SMIF_Memslot_CmdReadSts(OTA_SMIF_HW, memConfig, &readStatus, statusCmd, &ota_QSPI_context);
 
     *isQuadEnabled = false;
     if(CY_SMIF_SUCCESS == status)
@@ -294,11 +987,11 @@ static cy_en_smif_status_t EnableQuadMode(cy_stc_smif_mem_config_t const *memCon
     cy_en_smif_status_t status;
 
     /* Send Write Enable to external memory */
-    status = Cy_SMIF_Memslot_CmdWriteEnable(SMIF0, smifMemConfigs[0], &ota_QSPI_context);
+    status = Cy_SMIF_Memslot_CmdWriteEnable(OTA_SMIF_HW, smifMemConfigs[0], &ota_QSPI_context);
 
     if(CY_SMIF_SUCCESS == status)
     {
-        status = Cy_SMIF_Memslot_QuadEnable(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
+        status = Cy_SMIF_Memslot_QuadEnable(OTA_SMIF_HW, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
 
         if(CY_SMIF_SUCCESS == status)
         {
@@ -310,7 +1003,7 @@ static cy_en_smif_status_t EnableQuadMode(cy_stc_smif_mem_config_t const *memCon
     return status;
 }
 #endif /* OTA_USE_EXTERNAL_FLASH */
-#endif /* CY_IP_MXSMIF & !PSOC_062_1M & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF & !PSOC_062_1M */
 
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG) || defined (XMC7100) || defined (XMC7200))
 static int psoc6_internal_flash_write(uint8_t data[], uint32_t address, size_t len)
@@ -480,14 +1173,88 @@ static int psoc6_internal_flash_erase(uint32_t addr, size_t size)
 #endif
 
 #if defined (XMC7100) || defined (XMC7200)
-CY_SECTION_RAMFUNC_BEGIN
-static int xmc_internal_flash_erase(uint32_t addr, size_t size)
-{
-    int rc                   = 0;
-    uint32_t row_addr        = 0u;
-    uint32_t erase_sz        = 0x8000U; //32KB
+#if (OTA_FLASH_NONBLOCKING == 1)
+/* One operation at a time on the flash controller, now that they run with the interrupts enabled */
+static SemaphoreHandle_t        ota_flash_op_lock;
+static StaticSemaphore_t        ota_flash_op_lock_struct;
+
+/*
+ * Takes the flash controller for a non-blocking operation. Returns false where
+ * the caller cannot sleep, before the scheduler runs or in an interrupt, and the
+ * blocking call has to be made instead.
+ */
+static bool xmc_internal_flash_op_begin(void)
+{
+    if((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) || (__get_IPSR() != 0u))
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    if(ota_flash_op_lock == NULL)
+    {
+        ota_flash_op_lock = xSemaphoreCreateMutexStatic(&ota_flash_op_lock_struct);
+    }
+    taskEXIT_CRITICAL();
+
+    (void)xSemaphoreTake(ota_flash_op_lock, portMAX_DELAY);
+    return true;
+}
+
+/*
+ * Waits for the operation started with `rc` to complete, letting the other tasks
+ * run between the polls, and gives the flash controller back.
+ */
+static cy_en_flashdrv_status_t xmc_internal_flash_op_end(cy_en_flashdrv_status_t rc)
+{
+    if((rc == CY_FLASH_DRV_SUCCESS) || (rc == CY_FLASH_DRV_OPERATION_STARTED))
+    {
+        while((rc = Cy_Flash_IsOperationComplete()) == CY_FLASH_DRV_OPCODE_BUSY)
+        {
+            vTaskDelay(OTA_FLASH_NONBLOCKING_POLL_TICKS);
+        }
+    }
+
+    xSemaphoreGive(ota_flash_op_lock);
+    return rc;
+}
+#endif /* OTA_FLASH_NONBLOCKING */
+
+CY_SECTION_RAMFUNC_BEGIN
+static int xmc_internal_flash_erase_sector(uint32_t sector_addr)
+{
+    int intr_status = 0;
     cy_en_flashdrv_status_t flashEraseStatus;
 
+#if (OTA_FLASH_NONBLOCKING == 1)
+    if(xmc_internal_flash_op_begin())
+    {
+        flashEraseStatus = xmc_internal_flash_op_end(Cy_Flash_StartEraseSector(sector_addr));
+        XMC_FLASH_DCACHE_INVALIDATE(sector_addr, XMC_FLASH_ERASE_SECTOR_SIZE);
+        return (flashEraseStatus == CY_FLASH_DRV_SUCCESS) ? 0 : 1;
+    }
+#endif
+
+    intr_status = Cy_SysLib_EnterCriticalSection();
+    flashEraseStatus = Cy_Flash_EraseSector(sector_addr);
+    XMC_FLASH_DCACHE_INVALIDATE(sector_addr, XMC_FLASH_ERASE_SECTOR_SIZE);
+    Cy_SysLib_ExitCriticalSection(intr_status);
+
+    return (flashEraseStatus == CY_FLASH_DRV_SUCCESS) ? 0 : 1;
+}
+CY_SECTION_RAMFUNC_END
+
+/*
+ * Erases the sectors covering `size` bytes at offset `addr`, one sector at a time.
+ * Interrupts are only masked while a single sector is being erased, and other
+ * ready tasks of the same priority get to run between two sectors.
+ */
+static int xmc_internal_flash_erase(uint32_t addr, size_t size)
+{
+    int rc                   = 0;
+    uint32_t row_addr        = 0u;
+    uint32_t erase_sz        = XMC_FLASH_ERASE_SECTOR_SIZE;
+
     /* flash_area_write() uses offsets, we need absolute address here */
     addr += CY_FLASH_BASE;
 
@@ -501,29 +1268,55 @@ static int xmc_internal_flash_erase(uint32_t addr, size_t size)
         row_number = 1U;
     }
 
+#if (OTA_FLASH_CM0P == 1)
+    /* One core at a time on the flash controller */
+    (void)cy_ota_mem_ipc_drain();
+#endif
+
     Cy_Flash_Init();
     Cy_Flashc_MainWriteEnable();
 
-    while (row_number != 0u) {
-        row_number--;
-        row_addr = row_start_addr + row_number * (uint32_t)erase_sz;
+    for (row_addr = row_start_addr; row_number != 0u; row_number--, row_addr += erase_sz)
+    {
+#if (OTA_FLASH_PRE_ERASE == 1)
+        /* Already erased in the background */
+        if (!cy_ota_mem_sector_is_clean(row_addr - CY_FLASH_BASE))
+#endif
+        {
+            rc = xmc_internal_flash_erase_sector(row_addr);
+            if (rc != 0)
+            {
+                break;
+            }
+#if (OTA_FLASH_PRE_ERASE == 1)
+            cy_ota_mem_sector_mark(row_addr - CY_FLASH_BASE, true);
+#endif
+        }
+
+        ota_erase.erased_sectors++;
+        if (ota_erase_progress_cb != NULL)
+        {
+            ota_erase_progress_cb(ota_erase.erased_sectors, ota_erase.total_sectors);
+        }
 
-        flashEraseStatus = Cy_Flash_EraseSector((uint32_t) row_addr);
-        if (flashEraseStatus != CY_FLASH_DRV_SUCCESS)
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
         {
-            rc = 1;
-            break;
-        } else {
-            rc = 0;
+            taskYIELD();
         }
     }
 
     return rc;
 }
-CY_SECTION_RAMFUNC_END
 
 /*
  * Writes `len` bytes of flash memory at `off` from the buffer at `src`
+ *
+ * The new row content is merged and compared against the flash a word at a time
+ * when the written span is word aligned inside the row (always the case for the
+ * row-coalescing writer and the MCUboot trailers). A whole row coming from a word
+ * aligned source is compared and programmed in place, without staging it in
+ * writeBuffer. A row that already holds the requested data is not programmed,
+ * which also skips the critical section.
  */
 CY_SECTION_RAMFUNC_BEGIN
 static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len)
@@ -533,12 +1326,19 @@ static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len
 
     uint32_t writeBuffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
     uint32_t rowId;
-    uint32_t dstIndex;
+    uint32_t rowAddr;
     uint32_t srcIndex = 0u;
     uint32_t eeOffset;
-    uint32_t byteOffset;
+    uint32_t dstStart;
+    uint32_t dstCount;
+    uint32_t wordIndex;
+    uint32_t wordStart;
+    uint32_t wordEnd;
+    uint32_t newWord;
+    uint32_t flashWord;
     uint32_t rowsNotEqual;
     uint8_t *writeBufferPointer;
+    uint32_t *rowSource;
 
     eeOffset = (uint32_t)address;
     writeBufferPointer = (uint8_t*)writeBuffer;
@@ -552,37 +1352,93 @@ static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len
     {
         eeOffset -= CY_FLASH_BASE;
         rowId = eeOffset / CY_FLASH_SIZEOF_ROW;
-        byteOffset = CY_FLASH_SIZEOF_ROW * rowId;
+        dstStart = eeOffset - (rowId * CY_FLASH_SIZEOF_ROW);
 
         while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
         {
+            rowAddr = (rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE;
             rowsNotEqual = 0u;
-            /* Copy data to the write buffer either from the source buffer or from the flash */
-            for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
+            rowSource = writeBuffer;
+
+            /* Number of source bytes that go into this row */
+            dstCount = CY_FLASH_SIZEOF_ROW - dstStart;
+            if(dstCount > (len - srcIndex))
             {
-                if((byteOffset >= eeOffset) && (srcIndex < len))
+                dstCount = len - srcIndex;
+            }
+
+            if((dstCount == CY_FLASH_SIZEOF_ROW) && ((((uint32_t)&data[srcIndex]) & (sizeof(uint32_t) - 1u)) == 0u))
+            {
+                /* Whole row from a word aligned source: program it from there */
+                rowSource = (uint32_t *)&data[srcIndex];
+                for(wordIndex = 0u; wordIndex < (CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)); wordIndex++)
                 {
-                    writeBufferPointer[dstIndex] = data[srcIndex];
                     /* Detect that row programming is required */
-                    if((rowsNotEqual == 0u) && ( (CY_GET_REG8(CY_FLASH_BASE + byteOffset) != data[srcIndex]) ) )
-                    {
-                        rowsNotEqual = 1u;
-                    }
-                    srcIndex++;
+                    rowsNotEqual |= (rowSource[wordIndex] ^ CY_GET_REG32(rowAddr + (wordIndex * sizeof(uint32_t))));
                 }
-                else
+                srcIndex += CY_FLASH_SIZEOF_ROW;
+            }
+            else if(((dstStart | dstCount) & (sizeof(uint32_t) - 1u)) == 0u)
+            {
+                /* Word aligned span: merge and compare a word at a time.
+                 * The source may be unaligned, CM7 supports unaligned word loads. */
+                wordStart = dstStart / sizeof(uint32_t);
+                wordEnd   = wordStart + (dstCount / sizeof(uint32_t));
+
+                for(wordIndex = 0u; wordIndex < wordStart; wordIndex++)
                 {
-                    writeBufferPointer[dstIndex] = CY_GET_REG8(CY_FLASH_BASE + byteOffset);
+                    writeBuffer[wordIndex] = CY_GET_REG32(rowAddr + (wordIndex * sizeof(uint32_t)));
+                }
+
+                for(; wordIndex < wordEnd; wordIndex++)
+                {
+                    newWord   = __UNALIGNED_UINT32_READ(&data[srcIndex]);
+                    flashWord = CY_GET_REG32(rowAddr + (wordIndex * sizeof(uint32_t)));
+                    /* Detect that row programming is required */
+                    rowsNotEqual |= (newWord ^ flashWord);
+                    writeBuffer[wordIndex] = newWord;
+                    srcIndex += sizeof(uint32_t);
+                }
+
+                for(; wordIndex < (CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)); wordIndex++)
+                {
+                    writeBuffer[wordIndex] = CY_GET_REG32(rowAddr + (wordIndex * sizeof(uint32_t)));
+                }
+            }
+            else
+            {
+                /* Unaligned span: copy the row word-wide, then patch in the new bytes */
+                for(wordIndex = 0u; wordIndex < (CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)); wordIndex++)
+                {
+                    writeBuffer[wordIndex] = CY_GET_REG32(rowAddr + (wordIndex * sizeof(uint32_t)));
+                }
+
+                for(wordIndex = dstStart; wordIndex < (dstStart + dstCount); wordIndex++)
+                {
+                    /* Detect that row programming is required */
+                    rowsNotEqual |= (uint32_t)(writeBufferPointer[wordIndex] ^ data[srcIndex]);
+                    writeBufferPointer[wordIndex] = data[srcIndex];
+                    srcIndex++;
                 }
-                byteOffset++;
             }
 
             if(rowsNotEqual != 0u)
             {
-                int intr_status = 0;
-                intr_status = Cy_SysLib_EnterCriticalSection();
-                rc = Cy_Flash_ProgramRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, writeBuffer);
-                Cy_SysLib_ExitCriticalSection(intr_status);
+                XMC_FLASH_DCACHE_CLEAN(rowSource, CY_FLASH_SIZEOF_ROW);
+#if (OTA_FLASH_NONBLOCKING == 1)
+                if(xmc_internal_flash_op_begin())
+                {
+                    rc = xmc_internal_flash_op_end(Cy_Flash_StartProgram(rowAddr, rowSource));
+                    XMC_FLASH_DCACHE_INVALIDATE(rowAddr, CY_FLASH_SIZEOF_ROW);
+                }
+                else
+#endif
+                {
+                    int intr_status = Cy_SysLib_EnterCriticalSection();
+                    rc = Cy_Flash_ProgramRow(rowAddr, rowSource);
+                    XMC_FLASH_DCACHE_INVALIDATE(rowAddr, CY_FLASH_SIZEOF_ROW);
+                    Cy_SysLib_ExitCriticalSection(intr_status);
+                }
                 if(rc != CY_FLASH_DRV_SUCCESS)
                 {
                     break;
@@ -591,6 +1447,7 @@ static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len
 
             /* Go to the next row */
             rowId++;
+            dstStart = 0u;
         }
     }
     else
@@ -619,19 +1476,19 @@ static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len
 CY_SECTION_RAMFUNC_END
 #endif /* XMC7100/XMC7200 */
 
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#if (OTA_FLASH_SMIF == 1)
 static uint32_t ota_smif_get_memory_size(void)
 {
     uint32_t size = 0;
 
-    if (SMIF0 != NULL)
+    if (OTA_SMIF_HW != NULL)
     {
         size = smifBlockConfig.memConfig[MEM_SLOT]->deviceCfg->memSize;
     }
 
     return size;
 }
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
 
 /**********************************************************************************************************************************
  * External Functions
@@ -646,7 +1503,17 @@ cy_rslt_t cy_ota_mem_init( void )
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+    /* Reserve the encryption row buffers once, writes never allocate */
+    if(ota_enc_pool_free == NULL)
+    {
+        ota_enc_pool_free = xSemaphoreCreateCountingStatic(OTA_FLASH_ENC_POOL_ROWS, OTA_FLASH_ENC_POOL_ROWS,
+                                                           &ota_enc_pool_free_struct);
+        ota_enc_pool_stats.size = OTA_FLASH_ENC_POOL_ROWS;
+    }
+#endif
+
+#if (OTA_FLASH_SMIF == 1)
 #if defined(OTA_USE_EXTERNAL_FLASH)
     cy_rslt_t smif_status = CY_SMIF_BAD_PARAM;    /* Does not return error if SMIF Quad fails */
     bool QE_status = false;
@@ -656,11 +1523,12 @@ cy_rslt_t cy_ota_mem_init( void )
     PRE_SMIF_ACCESS_TURN_OFF_XIP;
 #endif
 
-#if (defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
+#if (defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG) || defined (XMC7100) || defined (XMC7200))
     /* SMIF is already initialized for 20829 and 89829 so we are only initializing the
-     * SMIF base address and the context variables.
+     * SMIF base address and the context variables. Nothing runs from the QSPI memory
+     * of the XMC parts, the block is initialized here.
      */
-    smif_status = Cy_SMIF_Init(SMIF0, &ota_SMIF_config, TIMEOUT_1_MS, &ota_QSPI_context);
+    smif_status = Cy_SMIF_Init(OTA_SMIF_HW, &ota_SMIF_config, TIMEOUT_1_MS, &ota_QSPI_context);
     if (smif_status != CY_SMIF_SUCCESS)
     {
         result = smif_status;
@@ -669,11 +1537,11 @@ cy_rslt_t cy_ota_mem_init( void )
 #endif
 
     /* Set up SMIF */
-    Cy_SMIF_SetDataSelect(SMIF0, smifMemConfigs[0]->slaveSelect, smifMemConfigs[0]->dataSelect);
-    Cy_SMIF_Enable(SMIF0, &ota_QSPI_context);
+    Cy_SMIF_SetDataSelect(OTA_SMIF_HW, smifMemConfigs[0]->slaveSelect, smifMemConfigs[0]->dataSelect);
+    Cy_SMIF_Enable(OTA_SMIF_HW, &ota_QSPI_context);
 
     /* Map memory device to memory map */
-    smif_status = Cy_SMIF_Memslot_Init(SMIF0, &smifBlockConfig, &ota_QSPI_context);
+    smif_status = Cy_SMIF_Memslot_Init(OTA_SMIF_HW, &smifBlockConfig, &ota_QSPI_context);
     if (smif_status != CY_SMIF_SUCCESS)
     {
         result = smif_status;
@@ -686,7 +1554,7 @@ cy_rslt_t cy_ota_mem_init( void )
     if ((smifMemConfigs[0]->deviceCfg->readStsRegQeCmd->command == 0) ||                        /* 0 - if configurator generated code */
         (smifMemConfigs[0]->deviceCfg->readStsRegQeCmd->command == CY_SMIF_NO_COMMAND_OR_MODE)) /* 0xFF's if SFDP enumerated          */
     {
-        smif_status = Cy_SMIF_MemInitSfdpMode(SMIF0,
+        smif_status = Cy_SMIF_MemInitSfdpMode(OTA_SMIF_HW,
                                               smifMemConfigs[0],
                                               CY_SMIF_WIDTH_QUAD,
                                               CY_SMIF_SFDP_QER_1,
@@ -697,7 +1565,10 @@ cy_rslt_t cy_ota_mem_init( void )
             goto _bail;
         }
     }
-#else /* NON - CYW20829B0LKML/CYW89829B01MKSBG */
+#elif (defined (XMC7100) || defined (XMC7200))
+    /* Cy_SMIF_Memslot_Init() has read the SFDP tables of the memory when its
+     * configuration asks for it, the quad mode is enabled below */
+#else /* NON - CYW20829B0LKML/CYW89829B01MKSBG/XMC */
     #if !defined(CY_RUN_CODE_FROM_XIP) && (OTA_USE_EXTERNAL_FLASH)
         {
             /* Choose SMIF slot number (slave select).
@@ -746,7 +1617,7 @@ cy_rslt_t cy_ota_mem_init( void )
     POST_SMIF_ACCESS_TURN_ON_XIP;
 #endif
 #endif
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
     return result;
 }
 
@@ -765,24 +1636,36 @@ cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
+    if(cy_ota_mem_coalesce_sync(mem_type, addr, len) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
     if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
     {
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
+        uint32_t erase_next;
+        uint32_t erase_end;
+
+        /* Before the copy, a sector erased during it is then still patched */
+        cy_ota_mem_erase_ahead_snapshot(&erase_next, &erase_end);
+
         /* flash_area_read() uses offsets, we need absolute address here */
         addr += CY_FLASH_BASE;
 
         /* flash read by simple memory copying */
         memcpy((void *)data, (const void*)addr, (size_t)len);
+        cy_ota_mem_erase_ahead_fill(erase_next, erase_end, addr - CY_FLASH_BASE, (uint8_t *)data, len);
         return result;
 #else
         (void)result;
-        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
+        APP_LOG_ERR("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
 #endif
     }
     else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
     {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#if (OTA_FLASH_SMIF == 1)
         cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
         if (addr >= CY_SMIF_BASE_MEM_OFFSET)
         {
@@ -794,7 +1677,7 @@ cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data
             /* pre-access to SMIF */
             PRE_SMIF_ACCESS_TURN_OFF_XIP;
 
-            cy_smif_result = Cy_SMIF_MemRead(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
+            cy_smif_result = Cy_SMIF_MemRead(OTA_SMIF_HW, smifBlockConfig.memConfig[MEM_SLOT],
                     addr, data, len, &ota_QSPI_context);
             /* post-access to SMIF */
             POST_SMIF_ACCESS_TURN_ON_XIP;
@@ -803,19 +1686,162 @@ cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data
         return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
 #else
         return CY_RSLT_TYPE_ERROR;
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
     }
     else
     {
-        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
+        APP_LOG_ERR("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
     }
 }
 
-static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+#if (OTA_FLASH_VERIFY_WRITE == 1)
+/**
+ * @brief Compare `len` programmed bytes with the data they were programmed from, a word at a time
+ *
+ * @return  true if they match
+ */
+static bool cy_ota_mem_verify_compare( const uint8_t *flash, const uint8_t *data, size_t len )
+{
+    uint32_t diff = 0u;
+    size_t   i;
+
+    for(i = 0u; (i + sizeof(uint32_t)) <= len; i += sizeof(uint32_t))
+    {
+        diff |= (__UNALIGNED_UINT32_READ(&flash[i]) ^ __UNALIGNED_UINT32_READ(&data[i]));
+    }
+    for(; i < len; i++)
+    {
+        diff |= (uint32_t)(flash[i] ^ data[i]);
+    }
+
+    return (diff == 0u);
+}
+#endif /* OTA_FLASH_VERIFY_WRITE */
+
+#if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
+/**
+ * @brief Program internal flash at absolute address `addr` and, with OTA_FLASH_VERIFY_WRITE,
+ *        check that it reads back, programming it once more if it does not
+ *
+ * @return  0 on success, the error of the flash write otherwise
+ */
+static int cy_ota_mem_internal_program( uint8_t *data, uint32_t addr, size_t len )
+{
+    int rc = 0;
+
+    for(uint32_t attempt = 1u; attempt <= OTA_FLASH_VERIFY_ATTEMPTS; attempt++)
+    {
+#if defined (XMC7100) || defined (XMC7200)
+        rc = xmc_internal_flash_write(data, addr, len);
+#else
+        rc = psoc6_internal_flash_write(data, addr, len);
+#endif
+#if (OTA_FLASH_VERIFY_WRITE == 1)
+        if((rc == 0) && !cy_ota_mem_verify_compare((const uint8_t *)addr, data, len))
+        {
+            APP_LOG_ERR("%s() 0x%08x does not read back after programming attempt %u\n", __func__,
+                        (unsigned int)addr, (unsigned int)attempt);
+            rc = -1;
+            continue;
+        }
+#endif
+        break;
+    }
+
+    return rc;
+}
+#endif
+
+#if (OTA_FLASH_SMIF == 1)
+#if (OTA_FLASH_VERIFY_WRITE == 1)
+/**
+ * @brief Read `len` bytes of external flash at `addr` back and compare them with `data`
+ *
+ * @return  true if they match
+ */
+static bool cy_ota_mem_verify_smif( uint32_t addr, const uint8_t *data, size_t len )
+{
+    uint32_t            chunk[OTA_FLASH_VERIFY_CHUNK_SIZE / sizeof(uint32_t)];
+    cy_en_smif_status_t cy_smif_result;
+    size_t              done;
+    size_t              size;
+
+    for(done = 0u; done < len; done += size)
+    {
+        size = ((len - done) < sizeof(chunk)) ? (len - done) : sizeof(chunk);
+
+        /* pre-access to SMIF */
+        PRE_SMIF_ACCESS_TURN_OFF_XIP;
+        cy_smif_result = Cy_SMIF_MemRead(OTA_SMIF_HW, smifBlockConfig.memConfig[MEM_SLOT],
+                                         addr + done, (uint8_t *)chunk, size, &ota_QSPI_context);
+        /* post-access to SMIF */
+        POST_SMIF_ACCESS_TURN_ON_XIP;
+
+        if((cy_smif_result != CY_SMIF_SUCCESS) ||
+           !cy_ota_mem_verify_compare((const uint8_t *)chunk, &data[done], size))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif /* OTA_FLASH_VERIFY_WRITE */
+
+/**
+ * @brief Program external flash at offset `addr` and, with OTA_FLASH_VERIFY_WRITE,
+ *        check that it reads back, programming it once more if it does not
+ *
+ *        With ENABLE_ON_THE_FLY_ENCRYPTION `data` is the encrypted copy, as stored.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+static cy_rslt_t cy_ota_mem_smif_program( uint32_t addr, const uint8_t *data, size_t len )
+{
+    cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+
+    for(uint32_t attempt = 1u; attempt <= OTA_FLASH_VERIFY_ATTEMPTS; attempt++)
+    {
+        /* pre-access to SMIF */
+        PRE_SMIF_ACCESS_TURN_OFF_XIP;
+        cy_smif_result = Cy_SMIF_MemWrite(OTA_SMIF_HW, smifBlockConfig.memConfig[MEM_SLOT], addr, data, len, &ota_QSPI_context);
+        /* post-access to SMIF */
+        POST_SMIF_ACCESS_TURN_ON_XIP;
+
+        if(cy_smif_result != CY_SMIF_SUCCESS)
+        {
+            break;
+        }
+#if (OTA_FLASH_VERIFY_WRITE == 1)
+        if(!cy_ota_mem_verify_smif(addr, data, len))
+        {
+            APP_LOG_ERR("%s() 0x%08x does not read back after programming attempt %u\n", __func__,
+                        (unsigned int)addr, (unsigned int)attempt);
+            cy_smif_result = CY_SMIF_BAD_PARAM;
+            continue;
+        }
+#endif
+        break;
+    }
+
+    return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+#endif /* OTA_FLASH_SMIF */
+
+/*
+ * Writes at most one row. `scratch` is set when `data` is a row buffer of this
+ * file whose content is not used after the write: an encrypted write to external
+ * flash then encrypts it in place. Any other source belongs to the caller, which
+ * may still use its plain text, and a copy of it is encrypted in a row of the pool.
+ */
+static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len, bool scratch )
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
+    (void)scratch;
+
     if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
     {
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
@@ -825,15 +1851,22 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
         addr += CY_FLASH_BASE;
 
 #if defined (XMC7100) || defined (XMC7200)
-        rc = xmc_internal_flash_write((uint8_t *)data, addr, len);
+#if (OTA_FLASH_PRE_ERASE == 1)
+        cy_ota_mem_sectors_dirty(addr - CY_FLASH_BASE, len);
+#endif
+#if (OTA_FLASH_CM0P == 1)
+        /* One core at a time on the flash controller */
+        (void)cy_ota_mem_ipc_drain();
+#endif
+        rc = cy_ota_mem_internal_program((uint8_t *)data, addr, len);
         if (rc != 0 )
         {
-            printf("xmc_internal_flash_write(0x%08x, 0x%08x, %u) FAILED rc:%u\n", (unsigned int)data, (unsigned int)addr, len, rc);
+            APP_LOG_ERR("xmc_internal_flash_write(0x%08x, 0x%08x, %u) FAILED rc:%d\n", (unsigned int)data, (unsigned int)addr, len, rc);
             result = CY_RSLT_TYPE_ERROR;
         }
         return result;
 #else
-        rc = psoc6_internal_flash_write((uint8_t *)data, addr, len);
+        rc = cy_ota_mem_internal_program((uint8_t *)data, addr, len);
         if (rc != 0 )
         {
             result = CY_RSLT_TYPE_ERROR;
@@ -843,13 +1876,13 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
 
 #else
         (void)result;
-        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
+        APP_LOG_ERR("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
 #endif
     }
     else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
     {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#if (OTA_FLASH_SMIF == 1)
         cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
         uint32_t cbus_addr = 0;
@@ -863,39 +1896,40 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
         if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
         {
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+            uint8_t *write_buffer = (uint8_t *)data;
+
             cbus_addr = cy_flash_addr_to_cbus_addr(addr);
-            if(ota_allocate_write_buffer(len) != true)
+            if(!scratch)
             {
-                printf("\n%s() - Memory allocation failed at %d\n", __func__, __LINE__);
-                return CY_RSLT_TYPE_ERROR;
+                write_buffer = (len <= CY_FLASH_SIZEOF_ROW) ? ota_enc_pool_acquire() : NULL;
+                if(write_buffer == NULL)
+                {
+                    APP_LOG_ERR("%s() - No encryption buffer for %u bytes\n", __func__, (unsigned int)len);
+                    return CY_RSLT_TYPE_ERROR;
+                }
+                memcpy(write_buffer, data, len);
             }
 
-            memcpy(write_buffer, data, len);
-
             /* pre-access to SMIF */
             PRE_SMIF_ACCESS_TURN_OFF_XIP;
 
             /* Encrypt ota_Buffer */
-            cy_smif_result = Cy_SMIF_Encrypt(SMIF0, cbus_addr, write_buffer, len, &ota_QSPI_context);
+            cy_smif_result = Cy_SMIF_Encrypt(OTA_SMIF_HW, cbus_addr, write_buffer, len, &ota_QSPI_context);
 
             /* post-access to SMIF */
             POST_SMIF_ACCESS_TURN_ON_XIP;
 
             if(cy_smif_result == CY_SMIF_SUCCESS)
             {
-                cy_smif_result = Cy_SMIF_MemWrite(SMIF0, smifBlockConfig.memConfig[MEM_SLOT], addr, write_buffer, len, &ota_QSPI_context);
+                result = cy_ota_mem_smif_program(addr, write_buffer, len);
             }
 
-            ota_free_write_buffer();
-#else
-            if(cy_smif_result == CY_SMIF_SUCCESS)
+            if(!scratch)
             {
-                /* pre-access to SMIF */
-                PRE_SMIF_ACCESS_TURN_OFF_XIP;
-                cy_smif_result = Cy_SMIF_MemWrite(SMIF0, smifBlockConfig.memConfig[MEM_SLOT], addr, data, len, &ota_QSPI_context);
-                /* post-access to SMIF */
-                POST_SMIF_ACCESS_TURN_ON_XIP;
+                ota_enc_pool_release(write_buffer);
             }
+#else
+            result = cy_ota_mem_smif_program(addr, (const uint8_t *)data, len);
 #endif
         }
         else
@@ -903,184 +1937,1179 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
             cy_smif_result = (cy_en_smif_status_t)CY_RSLT_SERIAL_FLASH_ERR_NOT_INITED;
         }
 
-#ifdef READBACK_SMIF_WRITE_TEST
-        if (cy_smif_result == CY_SMIF_SUCCESS)
-        {
-            uint32_t i = 0;
-            cy_smif_result = cy_ota_mem_read(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr, &read_back_test[0], ((16 < len) ? 16 : len));
-            if(cy_smif_result == CY_RSLT_SUCCESS)
-            {
-#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
-                printf("\n\rEncrypted Data : ");
-                for(i = 0; (i < 16 && i < len); i++)
-                {
-                    printf("0x%02x ", read_back_test[i]);
-                }
-                printf("\n\n\r");
-
-                cbus_addr = cy_flash_addr_to_cbus_addr(addr);
-
-                /* pre-access to SMIF */
-                PRE_SMIF_ACCESS_TURN_OFF_XIP;
-
-                /* Encrypt again read_back_test buffer to get plain txBuffer */
-                cy_smif_result = Cy_SMIF_Encrypt(SMIF0, cbus_addr, read_back_test, len, &ota_QSPI_context);
-
-                /* post-access to SMIF */
-                POST_SMIF_ACCESS_TURN_ON_XIP;
-
-                if(cy_smif_result != CY_SMIF_SUCCESS)
-                {
-                    printf("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
-                }
-                else
-                {
-                    printf("\n\rDecrypted Data : ");
-                    for(i = 0; (i < 16 && i < len); i++)
-                    {
-                        printf("0x%02x ", read_back_test[i]);
-                    }
-                    printf("\n\n\r");
-                }
-#endif
-                for(i = 0; (i < 16 && i < len); i++)
-                {
-                    if((((uint8_t *)data)[i]) != read_back_test[i])
-                    {
-                        result  = -1;
-                        printf("[Error] Data mismatch at index %d expected : %d got : %d \r\n", i, (((uint8_t *)data)[i]), read_back_test[i]);
-                    }
-                }
-            }
-        }
-#endif
-        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+        return ((cy_smif_result == CY_SMIF_SUCCESS) && (result == CY_RSLT_SUCCESS)) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
 #else
         return CY_RSLT_TYPE_ERROR;
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
     }
     else
     {
-        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
+        APP_LOG_ERR("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
     }
 }
 
 /**
- * @brief Write to flash, QSPI flash, or any other external memory type
- *
- * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
- * @param[in]   addr       Starting address to write to.
- * @param[in]   data       Pointer to the buffer containing the data to be written.
- * @param[in]   len        Number of bytes to write.
- *
- * @return  CY_RSLT_SUCCESS on success
- *          CY_RSLT_TYPE_ERROR on failure
+ * @brief Erase the deferred sectors in [ota_erase.next, to)
  */
-cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+static cy_rslt_t cy_ota_mem_erase_ahead_to( uint32_t to )
 {
-    cy_rslt_t result = CY_RSLT_SUCCESS;
-
-    /**
-     * This is used if a block is < Block size to satisfy requirements
-     * of flash_area_write(). "static" so it is not on the stack.
-     */
-    static uint8_t block_buffer[CY_FLASH_SIZEOF_ROW];
-    uint32_t chunk_size = 0;
+#if defined (XMC7100) || defined (XMC7200)
+    uint32_t from = ota_erase.next;
 
-    uint32_t bytes_to_write = len;
-    uint32_t curr_addr = addr;
-    uint8_t *curr_src = data;
+    if(to > ota_erase.end)
+    {
+        to = ota_erase.end;
+    }
+    if(to <= from)
+    {
+        return CY_RSLT_SUCCESS;
+    }
 
-#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
-    cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+#if (OTA_FLASH_CM0P == 1)
+    if(ota_ipc_session)
+    {
+        if(cy_ota_mem_ipc_erase(from, to) != CY_RSLT_SUCCESS)
+        {
+            APP_LOG_ERR("%s() Erasing 0x%08x - 0x%08x on the CM0+ FAILED\n", __func__, (unsigned int)from, (unsigned int)to);
+            return CY_RSLT_TYPE_ERROR;
+        }
+    }
+    else
+#endif
+    if(xmc_internal_flash_erase(from, to - from) != 0)
+    {
+        APP_LOG_ERR("xmc_internal_flash_erase(0x%08x, %u) FAILED\n", (unsigned int)from, (unsigned int)(to - from));
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    cy_ota_mem_erase_ahead_set(to, ota_erase.end, (to != ota_erase.end));
+#else
+    (void)to;
+#endif
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Erase whatever is left of the deferred range
+ */
+static cy_rslt_t cy_ota_mem_erase_ahead_complete( void )
+{
+    if(!ota_erase.pending)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return cy_ota_mem_erase_ahead_to(ota_erase.end);
+}
+
+/**
+ * @brief Make sure the sector of the row about to be programmed, and the
+ *        OTA_FLASH_ERASE_AHEAD_SECTORS after it, are erased
+ */
+static cy_rslt_t cy_ota_mem_erase_ahead( cy_ota_mem_type_t mem_type, uint32_t row_base )
+{
+    uint32_t sector_base;
+
+    if(!ota_erase.pending || (mem_type != CY_OTA_MEM_TYPE_INTERNAL_FLASH) ||
+       ((row_base + CY_FLASH_SIZEOF_ROW) <= ota_erase.next) || (row_base >= ota_erase.end))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    sector_base = (row_base / XMC_FLASH_ERASE_SECTOR_SIZE) * XMC_FLASH_ERASE_SECTOR_SIZE;
+
+    return cy_ota_mem_erase_ahead_to(sector_base + ((OTA_FLASH_ERASE_AHEAD_SECTORS + 1u) * XMC_FLASH_ERASE_SECTOR_SIZE));
+}
+
+/**
+ * @brief Try to defer an erase request of the download until the writer reaches it
+ *
+ * @return  true if the request has been taken over by the erase-ahead logic
+ */
+static bool cy_ota_mem_erase_defer( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len, cy_rslt_t *result )
+{
+#if (defined (XMC7100) || defined (XMC7200)) && (OTA_FLASH_ERASE_AHEAD_SECTORS > 0)
+    uint32_t start = (addr / XMC_FLASH_ERASE_SECTOR_SIZE) * XMC_FLASH_ERASE_SECTOR_SIZE;
+    uint32_t end   = ((addr + len) / XMC_FLASH_ERASE_SECTOR_SIZE) * XMC_FLASH_ERASE_SECTOR_SIZE;
+
+    /* Only large erases of the upgrade slot while a download is starting */
+    if(!ota_coalesce.enabled || (mem_type != CY_OTA_MEM_TYPE_INTERNAL_FLASH) ||
+       ((addr % XMC_FLASH_ERASE_SECTOR_SIZE) != 0u) ||
+       ((end - start) <= (OTA_FLASH_ERASE_AHEAD_SECTORS * XMC_FLASH_ERASE_SECTOR_SIZE)))
+    {
+        return false;
+    }
+
+    *result = cy_ota_mem_erase_ahead_complete();
+    if(*result != CY_RSLT_SUCCESS)
+    {
+        return true;
+    }
+
+    /* A download resuming after a reset keeps what it stored before, once */
+    if((ota_erase.keep > start) && (ota_erase.keep < end))
+    {
+        start = ota_erase.keep;
+    }
+    ota_erase.keep = 0u;
+
+    ota_erase.erased_sectors = 0u;
+    ota_erase.total_sectors  = (end - start) / XMC_FLASH_ERASE_SECTOR_SIZE;
+    cy_ota_mem_erase_ahead_set(start, end, true);
+
+    /* Get the first sectors out of the way right now */
+    *result = cy_ota_mem_erase_ahead_to(start + (OTA_FLASH_ERASE_AHEAD_SECTORS * XMC_FLASH_ERASE_SECTOR_SIZE));
+    return true;
+#else
+    (void)mem_type;
+    (void)addr;
+    (void)len;
+    (void)result;
+    return false;
+#endif
+}
+
+#if (OTA_FLASH_IMAGE_CHECK == 1)
+static uint32_t cy_ota_mem_get_le16( const uint8_t *buf )
+{
+    return ((uint32_t)buf[0] | ((uint32_t)buf[1] << 8));
+}
+
+static uint32_t cy_ota_mem_get_le32( const uint8_t *buf )
+{
+    return (cy_ota_mem_get_le16(buf) | (cy_ota_mem_get_le16(&buf[2]) << 16));
+}
+
+/* Length covered by the MCUboot hash: header, image and protected TLVs. 0 if not hashable here. */
+static uint32_t cy_ota_mem_image_hash_len( const uint8_t *header )
+{
+    if((cy_ota_mem_get_le32(&header[0]) != MCUBOOT_IMAGE_MAGIC) ||
+       ((cy_ota_mem_get_le32(&header[16]) & MCUBOOT_IMAGE_F_ENCRYPTED) != 0u))
+    {
+        return 0u;
+    }
+
+    /* ih_hdr_size + ih_img_size + ih_protect_tlv_size */
+    return cy_ota_mem_get_le16(&header[8]) + cy_ota_mem_get_le32(&header[12]) + cy_ota_mem_get_le16(&header[10]);
+}
+#endif /* OTA_FLASH_IMAGE_CHECK */
+
+#if (OTA_FLASH_STREAM_HASH == 1)
+
+/* Feed a row that is about to be programmed to the image hash, returns the bytes of the row that belong to it.
+ * With the CM0+ service the row only needs to be accounted for here, the CM0+ hashes it. */
+static uint32_t cy_ota_mem_stream_hash_row( cy_ota_mem_type_t mem_type, uint32_t row_base, const uint8_t *row_buf )
+{
+    uint32_t len;
+
+    if(!ota_hash.active || !ota_hash.in_order || (mem_type != CY_OTA_MEM_TYPE_INTERNAL_FLASH) ||
+       (row_base < FLASH_AREA_IMG_1_SECONDARY_START) ||
+       (row_base >= (FLASH_AREA_IMG_1_SECONDARY_START + FLASH_AREA_IMG_1_SECONDARY_SIZE)))
+    {
+        return 0u;
+    }
+
+    /* Rows past the hashed area (TLVs, trailer) do not matter */
+    if((ota_hash.hash_len != 0u) && (ota_hash.hashed == ota_hash.hash_len))
+    {
+        return 0u;
+    }
+
+    if(row_base != ota_hash.next)
+    {
+        ota_hash.in_order = false;
+        return 0u;
+    }
+
+    if(row_base == FLASH_AREA_IMG_1_SECONDARY_START)
+    {
+        ota_hash.hash_len = cy_ota_mem_image_hash_len(row_buf);
+        if((ota_hash.hash_len < MCUBOOT_IMAGE_HEADER_SIZE) || (ota_hash.hash_len > FLASH_AREA_IMG_1_SECONDARY_SIZE) ||
+           (!ota_hash.offloaded && (mbedtls_sha256_starts(&ota_hash.ctx, 0) != 0)))
+        {
+            ota_hash.in_order = false;
+            return 0u;
+        }
+    }
+
+    len = ota_hash.hash_len - ota_hash.hashed;
+    if(len > CY_FLASH_SIZEOF_ROW)
+    {
+        len = CY_FLASH_SIZEOF_ROW;
+    }
+
+    if(!ota_hash.offloaded && (mbedtls_sha256_update(&ota_hash.ctx, row_buf, len) != 0))
+    {
+        ota_hash.in_order = false;
+        return 0u;
+    }
+    ota_hash.hashed += len;
+    ota_hash.next   += CY_FLASH_SIZEOF_ROW;
+
+    return len;
+}
+#endif /* OTA_FLASH_STREAM_HASH */
+
+/**
+ * @brief Program one row of the download, `scratch` as for cy_ota_mem_write_row_size()
+ */
+static cy_rslt_t cy_ota_mem_program_row( cy_ota_mem_type_t mem_type, uint32_t row_base, uint8_t *row_buf, bool scratch )
+{
+    cy_rslt_t result;
+    uint32_t hash_len = 0u;
+
+#if (OTA_FLASH_STREAM_HASH == 1)
+    hash_len = cy_ota_mem_stream_hash_row(mem_type, row_base, row_buf);
+#endif
+
+    result = cy_ota_mem_erase_ahead(mem_type, row_base);
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+#if (OTA_FLASH_CM0P == 1)
+    if(ota_ipc_session && (mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH))
+    {
+        return cy_ota_mem_ipc_program_row(row_base, row_buf, hash_len);
+    }
+#endif
+    (void)hash_len;
+
+    return cy_ota_mem_write_row_size(mem_type, row_base, (void *)row_buf, CY_FLASH_SIZEOF_ROW, scratch);
+}
+
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+/**
+ * @brief Flash writer task, programs the row buffers in the order they are queued
+ */
+static void cy_ota_mem_async_task( void *arg )
+{
+    uint32_t index;
+    cy_ota_mem_async_row_t *row;
+
+    (void)arg;
+
+    while(true)
+    {
+        if(xQueueReceive(ota_async_queue, &index, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        row = &ota_async_rows[index];
+
+        /* After an error the session is aborted, just hand the buffers back */
+        if(ota_async_result == CY_RSLT_SUCCESS)
+        {
+            if(cy_ota_mem_program_row(row->mem_type, row->row_base, row->data, true) != CY_RSLT_SUCCESS)
+            {
+                APP_LOG_ERR("%s() Programming row 0x%08x failed\n", __func__, (unsigned int)row->row_base);
+                ota_async_result = CY_RSLT_TYPE_ERROR;
+            }
+        }
+
+        row->busy = false;
+        xSemaphoreGive(ota_async_free);
+    }
+}
+
+/**
+ * @brief Create the flash writer task and its queue on first use
+ */
+static cy_rslt_t cy_ota_mem_async_init( void )
+{
+    if(ota_async_task != NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    ota_async_queue = xQueueCreateStatic(OTA_FLASH_ASYNC_ROWS, sizeof(uint32_t),
+                                         ota_async_queue_storage, &ota_async_queue_struct);
+    ota_async_free = xSemaphoreCreateCountingStatic(OTA_FLASH_ASYNC_ROWS, OTA_FLASH_ASYNC_ROWS,
+                                                    &ota_async_free_struct);
+    ota_async_task = xTaskCreateStatic(cy_ota_mem_async_task, "OTA FLASH", OTA_FLASH_WRITER_TASK_STACK_SIZE,
+                                       NULL, OTA_FLASH_WRITER_TASK_PRIORITY,
+                                       ota_async_task_stack, &ota_async_task_tcb);
+
+    if((ota_async_queue == NULL) || (ota_async_free == NULL) || (ota_async_task == NULL))
+    {
+        APP_LOG_ERR("%s() Creating the flash writer task failed\n", __func__);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Wait until every queued row has been programmed
+ *
+ * @return  CY_RSLT_SUCCESS if all rows of the session were programmed
+ *          CY_RSLT_TYPE_ERROR otherwise
+ */
+static cy_rslt_t cy_ota_mem_async_drain( void )
+{
+    for(uint32_t i = 0; i < OTA_FLASH_ASYNC_ROWS; i++)
+    {
+        while(ota_async_rows[i].busy)
+        {
+            vTaskDelay(pdMS_TO_TICKS(OTA_FLASH_WRITER_WAIT_MS));
+        }
+    }
+
+    return ota_async_result;
+}
+#endif /* OTA_FLASH_ASYNC_WRITE */
+
+#if (OTA_FLASH_PRE_ERASE == 1)
+/**
+ * @brief Background erase task, leaves every sector of the upgrade slot erased
+ */
+static void cy_ota_mem_pre_erase_task( void *arg )
+{
+    uint32_t addr;
+    uint32_t erased = 0;
+
+    (void)arg;
+
+    for(uint32_t sector = 0; sector < OTA_FLASH_SLOT_SECTORS; sector++)
+    {
+        addr = FLASH_AREA_IMG_1_SECONDARY_START + (sector * XMC_FLASH_ERASE_SECTOR_SIZE);
+
+        xSemaphoreTake(ota_pre_erase_lock, portMAX_DELAY);
+        if(ota_pre_erase_stop)
+        {
+            xSemaphoreGive(ota_pre_erase_lock);
+            break;
+        }
+
+        if(!cy_ota_mem_sector_is_clean(addr))
+        {
+            if(!cy_ota_mem_sector_is_blank(addr))
+            {
+                Cy_Flash_Init();
+                Cy_Flashc_MainWriteEnable();
+                if(xmc_internal_flash_erase_sector(CY_FLASH_BASE + addr) != 0)
+                {
+                    APP_LOG_ERR("%s() Erasing sector 0x%08x failed\n", __func__, (unsigned int)addr);
+                    xSemaphoreGive(ota_pre_erase_lock);
+                    break;
+                }
+                erased++;
+            }
+            cy_ota_mem_sector_mark(addr, true);
+        }
+        xSemaphoreGive(ota_pre_erase_lock);
+
+        /* Let the idle task run between sectors */
+        vTaskDelay(1);
+    }
+
+    APP_LOG_INFO("Upgrade slot pre-erase done, %u sectors erased\n", (unsigned int)erased);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Stop the background erase before the upgrade slot is used
+ *
+ * Returns once the sector being worked on, if any, is done.
+ */
+static void cy_ota_mem_pre_erase_halt( void )
+{
+    if((ota_pre_erase_task == NULL) || ota_pre_erase_stop)
+    {
+        return;
+    }
+
+    ota_pre_erase_stop = true;
+    xSemaphoreTake(ota_pre_erase_lock, portMAX_DELAY);
+    xSemaphoreGive(ota_pre_erase_lock);
+}
+#endif /* OTA_FLASH_PRE_ERASE */
+
+/**
+ * @brief Get a row buffer to fill. Blocks while both buffers are being programmed.
+ */
+static uint8_t *cy_ota_mem_row_acquire( void )
+{
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+    if((ota_async_result != CY_RSLT_SUCCESS) ||
+       (xSemaphoreTake(ota_async_free, portMAX_DELAY) != pdTRUE))
+    {
+        return NULL;
+    }
+
+    return ota_async_rows[ota_async_fill].data;
+#else
+    return ota_coalesce_row;
+#endif
+}
+
+/**
+ * @brief Give back a row buffer that was acquired but will not be programmed
+ */
+static void cy_ota_mem_row_release( void )
+{
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+    xSemaphoreGive(ota_async_free);
+#endif
+}
+
+/**
+ * @brief Program a filled row buffer. With OTA_FLASH_ASYNC_WRITE the row is only
+ *        queued and an error is reported by a later call.
+ */
+static cy_rslt_t cy_ota_mem_row_commit( cy_ota_mem_type_t mem_type, uint32_t row_base, uint8_t *row_buf )
+{
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+    uint32_t index = ota_async_fill;
+    cy_ota_mem_async_row_t *row = &ota_async_rows[index];
+
+    (void)row_buf;
+    row->mem_type = mem_type;
+    row->row_base = row_base;
+    row->busy     = true;
+    ota_async_fill = (ota_async_fill + 1u) % OTA_FLASH_ASYNC_ROWS;
+
+    /* Cannot fail, there is a queue slot for every row buffer */
+    (void)xQueueSend(ota_async_queue, &index, 0);
+
+    return ota_async_result;
+#else
+    return cy_ota_mem_program_row(mem_type, row_base, row_buf, true);
+#endif
+}
+
+/**
+ * @brief Read one CY_FLASH_SIZEOF_ROW block into the buffer so that it can be
+ *        patched with new data and programmed back as a whole row.
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   row_base   Row aligned address of the block.
+ * @param[out]  row_buf    Buffer of CY_FLASH_SIZEOF_ROW bytes.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+static cy_rslt_t cy_ota_mem_load_row( cy_ota_mem_type_t mem_type, uint32_t row_base, uint8_t *row_buf )
+{
+    cy_rslt_t result;
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+    cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
     uint32_t cbus_addr = 0;
 #endif
 
-    while(bytes_to_write > 0x0U)
+    result = cy_ota_mem_read( mem_type, row_base, (void *)row_buf, CY_FLASH_SIZEOF_ROW);
+    if(result != CY_RSLT_SUCCESS)
+    {
+         return CY_RSLT_TYPE_ERROR;
+    }
+
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+    cbus_addr = cy_flash_addr_to_cbus_addr(row_base);
+
+    /* pre-access to SMIF */
+    PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+    /* Encrypt again row_buf to get plain txBuffer */
+    cy_smif_result = Cy_SMIF_Encrypt(OTA_SMIF_HW, cbus_addr, row_buf, CY_FLASH_SIZEOF_ROW, &ota_QSPI_context);
+
+    /* post-access to SMIF */
+    POST_SMIF_ACCESS_TURN_ON_XIP;
+
+    if(cy_smif_result != CY_SMIF_SUCCESS)
+    {
+        APP_LOG_ERR("%s() Data encryption failed with error %d\n", __func__, cy_smif_result);
+    }
+#endif
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Program the row held in the coalescing buffer, if any.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+static cy_rslt_t cy_ota_mem_coalesce_flush_row( void )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if(ota_coalesce.row_valid)
+    {
+        /* Drop the row even on failure, the caller aborts the update anyway */
+        ota_coalesce.row_valid = false;
+        result = cy_ota_mem_row_commit(ota_coalesce.mem_type, ota_coalesce.row_base, ota_coalesce.row_buffer);
+        if(result != CY_RSLT_SUCCESS)
+        {
+            APP_LOG_ERR("%s() Programming row 0x%08x failed\n", __func__, (unsigned int)ota_coalesce.row_base);
+            result = CY_RSLT_TYPE_ERROR;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Write through the read-modify-write path that programs every chunk immediately.
+ *        Used for the MCUboot trailer updates that happen outside of a download.
+ */
+static cy_rslt_t cy_ota_mem_write_direct( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    /**
+     * This is used if a block is < Block size to satisfy requirements
+     * of flash_area_write(). "static" so it is not on the stack.
+     */
+    static uint8_t block_buffer[CY_FLASH_SIZEOF_ROW];
+    uint32_t chunk_size = 0;
+
+    uint32_t bytes_to_write = len;
+    uint32_t curr_addr = addr;
+    uint8_t *curr_src = data;
+
+    while(bytes_to_write > 0x0U)
+    {
+        chunk_size = bytes_to_write;
+        if(chunk_size > CY_FLASH_SIZEOF_ROW)
+        {
+            chunk_size = CY_FLASH_SIZEOF_ROW;
+        }
+
+        /* Is the chunk_size smaller than a flash row? */
+        if(((chunk_size % CY_FLASH_SIZEOF_ROW) != 0x0U) || ((curr_addr % CY_FLASH_SIZEOF_ROW) != 0x0U))
+        {
+            uint32_t row_offset = 0;
+            uint32_t row_base = 0;
+
+            row_base   = (curr_addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
+            row_offset = curr_addr - row_base;
+
+            if((row_offset + chunk_size) > CY_FLASH_SIZEOF_ROW)
+            {
+                chunk_size = (CY_FLASH_SIZEOF_ROW - row_offset);
+            }
+
+            /* we will read a CY_FLASH_SIZEOF_ROW byte block, write the new data into the block, then write the whole block */
+            result = cy_ota_mem_load_row( mem_type, row_base, &block_buffer[0]);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                 return CY_RSLT_TYPE_ERROR;
+            }
+
+            memcpy (&block_buffer[row_offset], curr_src, chunk_size);
+
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+            if(mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+            {
+                /* Erase while updating Image trailers */
+                if(len <= CY_BOOT_TRAILER_MAX_UPDATE_SIZE)
+                {
+                    result = cy_ota_mem_erase(mem_type, curr_addr, bytes_to_write);
+                    if(result != CY_RSLT_SUCCESS)
+                    {
+                        APP_LOG_ERR("%s() Erase failed for memory type %d\n", __func__, (int)mem_type);
+                        return CY_RSLT_TYPE_ERROR;
+                    }
+                }
+            }
+#endif
+            result = cy_ota_mem_write_row_size(mem_type, row_base, (void *)(&block_buffer[0]), sizeof(block_buffer), true);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+        }
+        else
+        {
+            result = cy_ota_mem_write_row_size(mem_type, curr_addr, curr_src, chunk_size, false);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+        }
+
+        curr_addr += chunk_size;
+        curr_src += chunk_size;
+        bytes_to_write -= chunk_size;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Write through the row-coalescing buffer.
+ *
+ * Bytes are collected per destination row and a row is programmed once, when a
+ * write reaches its end, when a write targets a different row, or on
+ * cy_ota_mem_write_end(). Whole aligned rows are programmed directly from the
+ * caller's buffer.
+ */
+static cy_rslt_t cy_ota_mem_write_coalesced( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t chunk_size = 0;
+    uint32_t row_offset = 0;
+    uint32_t row_base = 0;
+
+    uint32_t bytes_to_write = len;
+    uint32_t curr_addr = addr;
+    uint8_t *curr_src = data;
+
+    while(bytes_to_write > 0x0U)
+    {
+        row_base   = (curr_addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
+        row_offset = curr_addr - row_base;
+        chunk_size = CY_FLASH_SIZEOF_ROW - row_offset;
+        if(chunk_size > bytes_to_write)
+        {
+            chunk_size = bytes_to_write;
+        }
+
+        /* Data for another row, program the one we are holding first */
+        if(ota_coalesce.row_valid &&
+           ((ota_coalesce.row_base != row_base) || (ota_coalesce.mem_type != mem_type)))
+        {
+            result = cy_ota_mem_coalesce_flush_row();
+            if(result != CY_RSLT_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+        }
+
+        if(!ota_coalesce.row_valid)
+        {
+            if(chunk_size == CY_FLASH_SIZEOF_ROW)
+            {
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+                /* Whole row available, queue a copy as the caller reuses its buffer */
+                uint8_t *row_buf = cy_ota_mem_row_acquire();
+                if(row_buf == NULL)
+                {
+                    return CY_RSLT_TYPE_ERROR;
+                }
+                memcpy(row_buf, curr_src, CY_FLASH_SIZEOF_ROW);
+                result = cy_ota_mem_row_commit(mem_type, row_base, row_buf);
+#else
+                /* Whole row available, no need to stage it. The caller keeps its
+                 * buffer, an encrypted row is encrypted in a copy */
+                result = cy_ota_mem_program_row(mem_type, row_base, curr_src, false);
+#endif
+                if(result != CY_RSLT_SUCCESS)
+                {
+                    return CY_RSLT_TYPE_ERROR;
+                }
+
+                curr_addr += chunk_size;
+                curr_src += chunk_size;
+                bytes_to_write -= chunk_size;
+                continue;
+            }
+
+            ota_coalesce.row_buffer = cy_ota_mem_row_acquire();
+            if(ota_coalesce.row_buffer == NULL)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+
+            /* Start a new row with the current content so bytes we do not get keep their value */
+            result = cy_ota_mem_load_row(mem_type, row_base, ota_coalesce.row_buffer);
+            if(result != CY_RSLT_SUCCESS)
+            {
+                cy_ota_mem_row_release();
+                return CY_RSLT_TYPE_ERROR;
+            }
+            ota_coalesce.mem_type  = mem_type;
+            ota_coalesce.row_base  = row_base;
+            ota_coalesce.row_valid = true;
+        }
+
+        memcpy(&ota_coalesce.row_buffer[row_offset], curr_src, chunk_size);
+
+        /* Streaming writes have reached the end of the row, it is complete */
+        if((row_offset + chunk_size) == CY_FLASH_SIZEOF_ROW)
+        {
+            result = cy_ota_mem_coalesce_flush_row();
+            if(result != CY_RSLT_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+        }
+
+        curr_addr += chunk_size;
+        curr_src += chunk_size;
+        bytes_to_write -= chunk_size;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Write to flash, QSPI flash, or any other external memory type
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address to write to.
+ * @param[in]   data       Pointer to the buffer containing the data to be written.
+ * @param[in]   len        Number of bytes to write.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    if(ota_coalesce.enabled)
+    {
+        return cy_ota_mem_write_coalesced(mem_type, addr, data, len);
+    }
+
+#if (OTA_FLASH_PRE_ERASE == 1)
+    if(mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH)
+    {
+        bool paused = cy_ota_mem_pre_erase_pause(addr, len);
+        cy_rslt_t result = cy_ota_mem_write_direct(mem_type, addr, data, len);
+        cy_ota_mem_pre_erase_resume(paused);
+        return result;
+    }
+#endif
+
+    return cy_ota_mem_write_direct(mem_type, addr, data, len);
+}
+
+/**
+ * @brief Write a received chunk straight to the upgrade slot
+ *
+ * @param[in]   offset     Offset in the upgrade slot.
+ * @param[in]   data       Bytes to write.
+ * @param[in]   len        Number of bytes.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_write_upgrade_slot( uint32_t offset, const uint8_t *data, uint32_t len )
+{
+#if (CY_OTA_MEM_UPGRADE_SLOT_WRITE == 1)
+    if((offset > FLASH_AREA_IMG_1_SECONDARY_SIZE) || (len > (FLASH_AREA_IMG_1_SECONDARY_SIZE - offset)))
+    {
+        APP_LOG_ERR("%s() Write at offset 0x%08x runs past the upgrade slot\n", __func__, (unsigned int)offset);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if(len == 0u)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return cy_ota_mem_write(CY_OTA_MEM_TYPE_INTERNAL_FLASH, FLASH_AREA_IMG_1_SECONDARY_START + offset,
+                            (void *)data, len);
+#else
+    (void)offset;
+    (void)data;
+    (void)len;
+    return CY_RSLT_TYPE_ERROR;
+#endif /* CY_OTA_MEM_UPGRADE_SLOT_WRITE */
+}
+
+/**
+ * @brief Start buffering writes per flash row
+ *
+ * Called once the upgrade slot has been opened for a download. Any row left
+ * over from an aborted session is discarded.
+ *
+ * @return  CY_RSLT_SUCCESS
+ */
+cy_rslt_t cy_ota_mem_write_begin( void )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+#if (OTA_FLASH_PRE_ERASE == 1)
+    /* The download takes over the upgrade slot */
+    cy_ota_mem_pre_erase_halt();
+#endif
+
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+    result = cy_ota_mem_async_init();
+    if(result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    /* Let rows of an aborted session finish before starting over */
+    if(ota_coalesce.row_valid)
+    {
+        ota_coalesce.row_valid = false;
+        cy_ota_mem_row_release();
+    }
+    (void)cy_ota_mem_async_drain();
+    ota_async_result = CY_RSLT_SUCCESS;
+#endif
+
+    /* An aborted session leaves sectors behind, the slot is erased again when it is opened */
+    cy_ota_mem_erase_ahead_set(ota_erase.next, ota_erase.end, false);
+
+#if (OTA_FLASH_CM0P == 1)
+    /* Operations of an aborted session may still be queued */
+    (void)cy_ota_mem_ipc_drain();
+    ota_ipc_session = cy_ota_mem_ipc_init();
+    if(ota_ipc_session)
+    {
+        ota_ipc_ring.error = OTA_FLASH_IPC_STATUS_OK;
+#if (OTA_FLASH_STREAM_HASH == 1)
+        result = cy_ota_mem_ipc_post(OTA_FLASH_IPC_OP_HASH_START, 0u, 0u, NULL);
+#endif
+    }
+#endif
+
+#if (OTA_FLASH_STREAM_HASH == 1)
+    if(ota_hash.active)
+    {
+        mbedtls_sha256_free(&ota_hash.ctx);
+    }
+    memset(&ota_hash, 0, sizeof(ota_hash));
+    mbedtls_sha256_init(&ota_hash.ctx);
+    ota_hash.next     = FLASH_AREA_IMG_1_SECONDARY_START;
+    ota_hash.in_order = true;
+    ota_hash.active   = true;
+#if (OTA_FLASH_CM0P == 1)
+    ota_hash.offloaded = ota_ipc_session;
+#endif
+#endif
+
+    ota_coalesce.row_valid = false;
+    ota_coalesce.enabled   = true;
+
+    return result;
+}
+
+/**
+ * @brief Program the row held in the write buffer, if any
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_flush( void )
+{
+    cy_rslt_t result;
+
+    result = cy_ota_mem_coalesce_flush_row();
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+    if(cy_ota_mem_async_drain() != CY_RSLT_SUCCESS)
     {
-        chunk_size = bytes_to_write;
-        if(chunk_size > CY_FLASH_SIZEOF_ROW)
+        result = CY_RSLT_TYPE_ERROR;
+    }
+#endif
+#if (OTA_FLASH_CM0P == 1)
+    if(cy_ota_mem_ipc_drain() != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_TYPE_ERROR;
+    }
+#endif
+
+    return result;
+}
+
+/**
+ * @brief Flush the write buffer and go back to programming every write immediately
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_write_end( void )
+{
+    cy_rslt_t result;
+
+    result = cy_ota_mem_flush();
+
+    /* The rest of the slot, including the trailer area, must be erased as well */
+    if(cy_ota_mem_erase_ahead_complete() != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_TYPE_ERROR;
+    }
+    ota_coalesce.enabled = false;
+
+#if (OTA_FLASH_CM0P == 1)
+    if(ota_ipc_session)
+    {
+#if (OTA_FLASH_STREAM_HASH == 1)
+        if(ota_hash.active && (cy_ota_mem_ipc_post(OTA_FLASH_IPC_OP_HASH_FINISH, 0u, 0u, NULL) != CY_RSLT_SUCCESS))
         {
-            chunk_size = CY_FLASH_SIZEOF_ROW;
+            result = CY_RSLT_TYPE_ERROR;
         }
-
-        /* Is the chunk_size smaller than a flash row? */
-        if((chunk_size % CY_FLASH_SIZEOF_ROW) != 0x0U)
+#endif
+        if(cy_ota_mem_ipc_drain() != CY_RSLT_SUCCESS)
         {
-            uint32_t row_offset = 0;
-            uint32_t row_base = 0;
+            APP_LOG_ERR("%s() Flash programming on the CM0+ failed, error %d\n", __func__, (int)ota_ipc_ring.error);
+            result = CY_RSLT_TYPE_ERROR;
+        }
+        ota_ipc_session = false;
+    }
+#endif
 
-            row_base   = (curr_addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
-            row_offset = curr_addr - row_base;
+#if (OTA_FLASH_STREAM_HASH == 1)
+    if(ota_hash.active)
+    {
+        ota_hash.done = (result == CY_RSLT_SUCCESS) && ota_hash.in_order && (ota_hash.hash_len != 0u) &&
+                        (ota_hash.hashed == ota_hash.hash_len);
+#if (OTA_FLASH_CM0P == 1)
+        if(ota_hash.offloaded)
+        {
+            /* Finished by the CM0+ */
+            memcpy(ota_hash.digest, (const void *)ota_ipc_ring.digest, sizeof(ota_hash.digest));
+        }
+        else
+#endif
+        {
+            ota_hash.done = ota_hash.done && (mbedtls_sha256_finish(&ota_hash.ctx, ota_hash.digest) == 0);
+        }
+        mbedtls_sha256_free(&ota_hash.ctx);
+        ota_hash.active = false;
+    }
+#endif
 
-            if((row_offset + chunk_size) > CY_FLASH_SIZEOF_ROW)
-            {
-                chunk_size = (CY_FLASH_SIZEOF_ROW - row_offset);
-            }
+    return result;
+}
 
-            /* we will read a CY_FLASH_SIZEOF_ROW byte block, write the new data into the block, then write the whole block */
-            result = cy_ota_mem_read( mem_type, row_base, (void *)(&block_buffer[0]), sizeof(block_buffer));
-            if(result != CY_RSLT_SUCCESS)
-            {
-                 return CY_RSLT_TYPE_ERROR;
-            }
+/**
+ * @brief Start erasing the upgrade slot in the background
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR
+ */
+cy_rslt_t cy_ota_mem_pre_erase_start( void )
+{
+#if (OTA_FLASH_PRE_ERASE == 1)
+    if(ota_pre_erase_task != NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
 
-#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
-            cbus_addr = cy_flash_addr_to_cbus_addr(row_base);
+    ota_pre_erase_lock = xSemaphoreCreateMutexStatic(&ota_pre_erase_lock_struct);
+    ota_pre_erase_task = xTaskCreateStatic(cy_ota_mem_pre_erase_task, "OTA PRE-ERASE", OTA_FLASH_PRE_ERASE_TASK_STACK_SIZE,
+                                           NULL, OTA_FLASH_PRE_ERASE_TASK_PRIORITY,
+                                           ota_pre_erase_task_stack, &ota_pre_erase_task_tcb);
 
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
+    if((ota_pre_erase_lock == NULL) || (ota_pre_erase_task == NULL))
+    {
+        APP_LOG_ERR("%s() Creating the pre-erase task failed\n", __func__);
+        return CY_RSLT_TYPE_ERROR;
+    }
+#endif
+    return CY_RSLT_SUCCESS;
+}
 
-            /* Encrypt again block_buffer to get plain txBuffer */
-            cy_smif_result = Cy_SMIF_Encrypt(SMIF0, cbus_addr, &(block_buffer[0]), sizeof(block_buffer), &ota_QSPI_context);
+/**
+ * @brief Keep the start of the upgrade slot through the erase of the next download
+ *
+ * @param[in]   offset     Bytes of the slot to keep.
+ *
+ * @return  Bytes kept, `offset` rounded down to a sector, 0 if the slot cannot be kept
+ */
+uint32_t cy_ota_mem_write_keep( uint32_t offset )
+{
+#if (defined (XMC7100) || defined (XMC7200)) && (OTA_FLASH_ERASE_AHEAD_SECTORS > 0) && \
+    (CY_OTA_MEM_UPGRADE_SLOT_WRITE == 1)
+    offset = (offset / XMC_FLASH_ERASE_SECTOR_SIZE) * XMC_FLASH_ERASE_SECTOR_SIZE;
+    if(offset >= FLASH_AREA_IMG_1_SECONDARY_SIZE)
+    {
+        offset = 0u;
+    }
 
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
+#if (OTA_FLASH_PRE_ERASE == 1)
+    /* The background erase does not know what to keep */
+    if((offset != 0u) && (ota_pre_erase_task != NULL))
+    {
+        offset = 0u;
+    }
+#endif
 
-            if(cy_smif_result != CY_SMIF_SUCCESS)
-            {
-                printf("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
-            }
+    ota_erase.keep = (offset != 0u) ? (FLASH_AREA_IMG_1_SECONDARY_START + offset) : 0u;
+    return offset;
+#else
+    (void)offset;
+    return 0u;
 #endif
-            memcpy (&block_buffer[row_offset], curr_src, chunk_size);
+}
+
+/**
+ * @brief Register a function called after every erased sector
+ *
+ * @param[in]   cb         Progress callback, NULL to disable.
+ */
+void cy_ota_mem_set_erase_progress_callback( cy_ota_mem_erase_progress_cb_t cb )
+{
+    ota_erase_progress_cb = cb;
+}
 
+/**
+ * @brief Usage of the row buffers of the encrypted writes to external flash
+ *
+ * @param[out]  stats      Pool size, buffers in use, high-water mark and waits.
+ */
+void cy_ota_mem_enc_pool_get_stats( cy_ota_mem_enc_pool_stats_t *stats )
+{
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
-            if(mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
-            {
-                /* Erase while updating Image trailers */
-                if(len <= CY_BOOT_TRAILER_MAX_UPDATE_SIZE)
-                {
-                    result = cy_ota_mem_erase(mem_type, curr_addr, bytes_to_write);
-                    if(result != CY_RSLT_SUCCESS)
-                    {
-                        printf("%s() Erase failed for memory type %d\n", __func__, (int)mem_type);
-                        return CY_RSLT_TYPE_ERROR;
-                    }
-                }
-            }
+    taskENTER_CRITICAL();
+    *stats = ota_enc_pool_stats;
+    taskEXIT_CRITICAL();
+#else
+    memset(stats, 0, sizeof(*stats));
 #endif
-            result = cy_ota_mem_write_row_size(mem_type, row_base, (void *)(&block_buffer[0]), sizeof(block_buffer));
-            if(result != CY_RSLT_SUCCESS)
+}
+
+#if (OTA_FLASH_IMAGE_CHECK == 1)
+/* Read the plain text of the upgrade slot at `offset`, a row at a time */
+static cy_rslt_t cy_ota_mem_slot_read( uint32_t offset, uint8_t *data, uint32_t len )
+{
+    static CY_ALIGN(4) uint8_t row_buf[CY_FLASH_SIZEOF_ROW];
+    uint32_t addr = FLASH_AREA_IMG_1_SECONDARY_START + offset;
+    uint32_t row_base;
+    uint32_t row_offset;
+    uint32_t size;
+
+    for(; len > 0u; addr += size, data += size, len -= size)
+    {
+        row_base   = (addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
+        row_offset = addr - row_base;
+        size       = CY_FLASH_SIZEOF_ROW - row_offset;
+        if(size > len)
+        {
+            size = len;
+        }
+        if(cy_ota_mem_load_row(OTA_FLASH_SLOT_MEM_TYPE, row_base, row_buf) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+        memcpy(data, &row_buf[row_offset], size);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/* Hash of the image in the slot: from the download if it was hashed whole, else read back from flash */
+static cy_rslt_t cy_ota_mem_image_digest( uint8_t *digest, uint32_t *hash_len )
+{
+    static uint8_t read_buf[CY_FLASH_SIZEOF_ROW];
+    mbedtls_sha256_context ctx;
+    uint32_t len;
+    int ret;
+
+#if (OTA_FLASH_STREAM_HASH == 1)
+    if(ota_hash.done)
+    {
+        memcpy(digest, ota_hash.digest, MCUBOOT_SHA256_SIZE);
+        *hash_len = ota_hash.hash_len;
+        return CY_RSLT_SUCCESS;
+    }
+#endif
+
+    APP_LOG_INFO("%s() Image was not hashed during the download, reading it back\n", __func__);
+
+    if(cy_ota_mem_slot_read(0u, read_buf, MCUBOOT_IMAGE_HEADER_SIZE) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    *hash_len = cy_ota_mem_image_hash_len(read_buf);
+    if((*hash_len < MCUBOOT_IMAGE_HEADER_SIZE) || (*hash_len > FLASH_AREA_IMG_1_SECONDARY_SIZE))
+    {
+        /* Not an image, or encrypted by MCUboot, which hashes the plain text */
+        APP_LOG_ERR("%s() Image cannot be hashed here\n", __func__);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    mbedtls_sha256_init(&ctx);
+    ret = mbedtls_sha256_starts(&ctx, 0);
+    for(uint32_t offset = 0; (ret == 0) && (offset < *hash_len); offset += len)
+    {
+        len = *hash_len - offset;
+        if(len > sizeof(read_buf))
+        {
+            len = sizeof(read_buf);
+        }
+        if(cy_ota_mem_slot_read(offset, read_buf, len) != CY_RSLT_SUCCESS)
+        {
+            ret = -1;
+            break;
+        }
+        ret = mbedtls_sha256_update(&ctx, read_buf, len);
+    }
+    if(ret == 0)
+    {
+        ret = mbedtls_sha256_finish(&ctx, digest);
+    }
+    mbedtls_sha256_free(&ctx);
+
+    return (ret == 0) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+#endif /* OTA_FLASH_IMAGE_CHECK */
+
+/**
+ * @brief Check the image in the upgrade slot against its SHA-256 TLV
+ *
+ * @return  CY_RSLT_SUCCESS if the hash matches
+ *          CY_RSLT_TYPE_ERROR on mismatch, if the image is malformed or cannot be hashed
+ */
+cy_rslt_t cy_ota_mem_verify_image_hash( void )
+{
+#if (OTA_FLASH_IMAGE_CHECK == 1)
+    uint8_t digest[MCUBOOT_SHA256_SIZE];
+    uint8_t tlv_hash[MCUBOOT_SHA256_SIZE];
+    uint8_t tlv[4];
+    uint32_t hash_len;
+    uint32_t offset;
+    uint32_t end;
+
+    if(cy_ota_mem_image_digest(digest, &hash_len) != CY_RSLT_SUCCESS)
+    {
+        APP_LOG_ERR("%s() Hashing the image failed\n", __func__);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    /* The unprotected TLV area follows the hashed part of the image */
+    offset = hash_len;
+    if(cy_ota_mem_slot_read(offset, tlv, sizeof(tlv)) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    if(cy_ota_mem_get_le16(&tlv[0]) != MCUBOOT_TLV_INFO_MAGIC)
+    {
+        APP_LOG_ERR("%s() No TLV area after the image\n", __func__);
+        return CY_RSLT_TYPE_ERROR;
+    }
+    end = offset + cy_ota_mem_get_le16(&tlv[2]);
+    if(end > FLASH_AREA_IMG_1_SECONDARY_SIZE)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    for(offset += sizeof(tlv); (offset + sizeof(tlv)) <= end; offset += sizeof(tlv) + cy_ota_mem_get_le16(&tlv[2]))
+    {
+        if(cy_ota_mem_slot_read(offset, tlv, sizeof(tlv)) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+
+        if((cy_ota_mem_get_le16(&tlv[0]) == MCUBOOT_TLV_SHA256) && (cy_ota_mem_get_le16(&tlv[2]) == MCUBOOT_SHA256_SIZE))
+        {
+            if(cy_ota_mem_slot_read(offset + sizeof(tlv), tlv_hash, sizeof(tlv_hash)) != CY_RSLT_SUCCESS)
             {
                 return CY_RSLT_TYPE_ERROR;
             }
-        }
-        else
-        {
-            result = cy_ota_mem_write_row_size(mem_type, addr, data, len);
-            if(result != CY_RSLT_SUCCESS)
+            if(memcmp(digest, tlv_hash, sizeof(digest)) != 0)
             {
+                APP_LOG_ERR("%s() Image SHA-256 mismatch\n", __func__);
                 return CY_RSLT_TYPE_ERROR;
             }
+            return CY_RSLT_SUCCESS;
         }
-
-        curr_addr += chunk_size;
-        curr_src += chunk_size;
-        bytes_to_write -= chunk_size;
     }
 
+    APP_LOG_ERR("%s() No SHA-256 TLV in the image\n", __func__);
+    return CY_RSLT_TYPE_ERROR;
+#else
+    /* No upgrade slot generated from a flashmap, nothing to check */
     return CY_RSLT_SUCCESS;
+#endif /* OTA_FLASH_IMAGE_CHECK */
 }
 
 /**
@@ -1097,19 +3126,53 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
+    if(cy_ota_mem_coalesce_sync(mem_type, addr, len) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
     if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
     {
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
         int rc = 0;
 
 #if defined (XMC7100) || defined (XMC7200)
-        int intr_status = 0;
-        intr_status = Cy_SysLib_EnterCriticalSection();
+#if (OTA_FLASH_PRE_ERASE == 1)
+        cy_ota_mem_pre_erase_guard(addr, len);
+#endif
+#if (OTA_FLASH_ASYNC_WRITE == 1)
+        /* The flash writer task also erases ahead, let it go idle */
+        if(cy_ota_mem_async_drain() != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+#endif
+        if(cy_ota_mem_erase_defer(mem_type, addr, len, &result))
+        {
+            return result;
+        }
+
+        /* Never let a deferred sector be erased after this request has been written */
+        if(ota_erase.pending && (addr < ota_erase.end) && ((addr + len) > ota_erase.next))
+        {
+            if(cy_ota_mem_erase_ahead_complete() != CY_RSLT_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+        }
+
+        ota_erase.erased_sectors = 0u;
+        ota_erase.total_sectors  = (len + XMC_FLASH_ERASE_SECTOR_SIZE - 1u) / XMC_FLASH_ERASE_SECTOR_SIZE;
+#if (OTA_FLASH_PRE_ERASE == 1)
+        bool paused = cy_ota_mem_pre_erase_pause(addr, len);
+        rc = xmc_internal_flash_erase(addr, len);
+        cy_ota_mem_pre_erase_resume(paused);
+#else
         rc = xmc_internal_flash_erase(addr, len);
-        Cy_SysLib_ExitCriticalSection(intr_status);
+#endif
         if (rc != 0 )
         {
-            printf("xmc_internal_flash_erase(0x%08x, %u) FAILED rc:%d\n", (unsigned int)addr, len, rc);
+            APP_LOG_ERR("xmc_internal_flash_erase(0x%08x, %u) FAILED rc:%d\n", (unsigned int)addr, len, rc);
             result = CY_RSLT_TYPE_ERROR;
         }
 #else
@@ -1122,13 +3185,13 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
         return result;
 #else
         (void)result;
-        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
+        APP_LOG_ERR("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
 #endif
     }
     else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
     {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#if (OTA_FLASH_SMIF == 1)
         cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
 
         if (addr >= CY_SMIF_BASE_MEM_OFFSET)
@@ -1138,39 +3201,75 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
 
         if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
         {
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
-
             // If the erase is for the entire chip, use chip erase command
             if ((addr == 0u) && (len == ota_smif_get_memory_size()))
             {
-                cy_smif_result = Cy_SMIF_MemEraseChip(SMIF0,
+                /* pre-access to SMIF */
+                PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+                cy_smif_result = Cy_SMIF_MemEraseChip(OTA_SMIF_HW,
                                                     smifBlockConfig.memConfig[MEM_SLOT],
                                                     &ota_QSPI_context);
+
+                /* post-access to SMIF */
+                POST_SMIF_ACCESS_TURN_ON_XIP;
             }
             else
             {
                 // Cy_SMIF_MemEraseSector() returns error if (addr + length) > total flash size or if
                 // addr is not aligned to erase sector size or if (addr + length) is not aligned to
                 // erase sector size.
-                /* Make sure the base offset is correct */
+                // The sectors are erased one at a time, with the size of the sector at each
+                // address (256 KB on the S25FL512S of the kits, where a hybrid memory has smaller
+                // parameter sectors), and other tasks get to run between two sectors.
+                uint32_t end = addr + len;
+                uint32_t sector;
                 uint32_t erase_size;
-                uint32_t diff;
+
+                /* Make sure the base offset is correct */
                 erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
-                diff = addr & (erase_size - 1);
-                addr -= diff;
-                len += diff;
-                /* Make sure the length is correct */
-                len = (len + (erase_size - 1)) & ~(erase_size - 1);
+                if (erase_size == 0u)
+                {
+                    return CY_RSLT_TYPE_ERROR;
+                }
+                addr -= addr & (erase_size - 1);
+
+                ota_erase.erased_sectors = 0u;
+                ota_erase.total_sectors  = 0u;
+                for (sector = addr; sector < end; sector += erase_size)
+                {
+                    erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, sector);
+                    ota_erase.total_sectors++;
+                }
+
                 Cy_SMIF_SetReadyPollingDelay(20000, &ota_QSPI_context);
-                cy_smif_result = Cy_SMIF_MemEraseSector(SMIF0,
-                                                      smifBlockConfig.memConfig[MEM_SLOT],
-                                                      addr, len, &ota_QSPI_context);
+                for (sector = addr; (sector < end) && (cy_smif_result == CY_SMIF_SUCCESS); sector += erase_size)
+                {
+                    erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, sector);
+
+                    /* pre-access to SMIF */
+                    PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+                    cy_smif_result = Cy_SMIF_MemEraseSector(OTA_SMIF_HW,
+                                                          smifBlockConfig.memConfig[MEM_SLOT],
+                                                          sector, erase_size, &ota_QSPI_context);
+
+                    /* post-access to SMIF */
+                    POST_SMIF_ACCESS_TURN_ON_XIP;
+
+                    ota_erase.erased_sectors++;
+                    if (ota_erase_progress_cb != NULL)
+                    {
+                        ota_erase_progress_cb(ota_erase.erased_sectors, ota_erase.total_sectors);
+                    }
+
+                    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+                    {
+                        taskYIELD();
+                    }
+                }
                 Cy_SMIF_SetReadyPollingDelay(0, &ota_QSPI_context);
             }
-
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
         }
         else
         {
@@ -1180,11 +3279,11 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
         return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
 #else
         return CY_RSLT_TYPE_ERROR;
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
     }
     else
     {
-        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
+        APP_LOG_ERR("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
     }
 }
@@ -1209,13 +3308,13 @@ size_t cy_ota_mem_get_prog_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
     }
     else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
     {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#if (OTA_FLASH_SMIF == 1)
         uint32_t    program_size = 0;
         (void)addr; /* Hybrid parts not yet supported */
         /* pre-access to SMIF is not needed, as we are just reading data from RAM */
         if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
         {
-            if (SMIF0 != NULL)
+            if (OTA_SMIF_HW != NULL)
             {
                 program_size = smifBlockConfig.memConfig[MEM_SLOT]->deviceCfg->programSize;
             }
@@ -1225,7 +3324,7 @@ size_t cy_ota_mem_get_prog_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
         return program_size;
 #else
         return 0;
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
     }
     else
     {
@@ -1253,7 +3352,7 @@ size_t cy_ota_mem_get_erase_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
     }
     else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
     {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+#if (OTA_FLASH_SMIF == 1)
         uint32_t                            erase_sector_size = 0;
         cy_stc_smif_hybrid_region_info_t*   hybrid_info = NULL;
         cy_en_smif_status_t                 smif_status;
@@ -1283,7 +3382,7 @@ size_t cy_ota_mem_get_erase_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
         return erase_sector_size;
 #else
         return 0;
-#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+#endif /* OTA_FLASH_SMIF */
     }
     else
     {
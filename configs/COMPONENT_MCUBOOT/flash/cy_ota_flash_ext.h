@@ -0,0 +1,210 @@
+/******************************************************************************
+* File Name:   cy_ota_flash_ext.h
+*
+* Description: This file contains the declarations of the application specific
+*              extensions to the OTA flash APIs implemented in cy_ota_flash.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef CY_OTA_FLASH_EXT_H_
+#define CY_OTA_FLASH_EXT_H_
+
+#include <stdint.h>
+#include "cy_result.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief cy_ota_mem_write_upgrade_slot() writes the upgrade slot: it is in internal flash
+ *        and stored as received
+ */
+#if defined (FLASH_AREA_IMG_1_SECONDARY_START) && defined (FLASH_AREA_IMG_1_SECONDARY_SIZE) && \
+    !defined (ENABLE_ON_THE_FLY_ENCRYPTION) && !defined (OTA_USE_EXTERNAL_FLASH)
+#define CY_OTA_MEM_UPGRADE_SLOT_WRITE   (1)
+#else
+#define CY_OTA_MEM_UPGRADE_SLOT_WRITE   (0)
+#endif
+
+/**
+ * @brief Erase progress callback
+ *
+ * Called in the context of the task doing the erase, after each flash sector.
+ *
+ * @param[in]   erased_sectors  Sectors of the current erase request erased so far.
+ * @param[in]   total_sectors   Sectors of the current erase request.
+ */
+typedef void (*cy_ota_mem_erase_progress_cb_t)(uint32_t erased_sectors, uint32_t total_sectors);
+
+/**
+ * @brief Usage of the row buffers holding the encrypted copy of writes to external flash
+ *
+ * With ENABLE_ON_THE_FLY_ENCRYPTION, OTA_FLASH_ENC_POOL_ROWS buffers are reserved by
+ * cy_ota_mem_init(). All zero without on the fly encryption.
+ */
+typedef struct
+{
+    uint32_t    size;           /**< Row buffers in the pool */
+    uint32_t    in_use;         /**< Row buffers in use now */
+    uint32_t    peak;           /**< Most row buffers in use at the same time */
+    uint32_t    waits;          /**< Writes that waited for a row buffer */
+} cy_ota_mem_enc_pool_stats_t;
+
+/**
+ * @brief Start collecting writes per flash row
+ *
+ * Call after the upgrade slot is opened for a download. Until cy_ota_mem_write_end()
+ * is called, cy_ota_mem_write() programs each flash row once, when all of its bytes
+ * have been received, instead of once per received chunk. With OTA_FLASH_ASYNC_WRITE
+ * the rows are programmed by a flash writer task and cy_ota_mem_write() returns as
+ * soon as the data is queued.
+ *
+ * @return  CY_RSLT_SUCCESS
+ */
+cy_rslt_t cy_ota_mem_write_begin( void );
+
+/**
+ * @brief Program the partially filled row held by the write buffer, if any, and
+ *        wait until all queued rows have been programmed
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_flush( void );
+
+/**
+ * @brief Flush the write buffer and return to programming every write immediately
+ *
+ * Must be called before the downloaded image is closed and verified.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_write_end( void );
+
+/**
+ * @brief Start erasing the upgrade slot in the background
+ *
+ * Call once the running image has been validated. A low priority task blank checks
+ * every sector of the upgrade slot and erases the ones holding data, so that the
+ * erase done when the next update opens the slot only has to skip over them.
+ * The task stops as soon as the slot is written or erased by someone else.
+ * Does nothing if OTA_FLASH_PRE_ERASE is 0.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR
+ */
+cy_rslt_t cy_ota_mem_pre_erase_start( void );
+
+/**
+ * @brief Keep the start of the upgrade slot through the erase of the next download
+ *
+ * Call before the slot is opened, to resume a download that a reset interrupted:
+ * the erase done by the open then starts at the returned offset, a sector
+ * boundary, and the rows below it are left as they were programmed. Applies to
+ * the next open only. Not possible once the background erase of
+ * cy_ota_mem_pre_erase_start() has been started, nor with CY_OTA_MEM_UPGRADE_SLOT_WRITE 0.
+ *
+ * @param[in]   offset     Bytes of the slot known to be programmed.
+ *
+ * @return  Bytes kept, `offset` rounded down to a sector, 0 if none
+ */
+uint32_t cy_ota_mem_write_keep( uint32_t offset );
+
+/**
+ * @brief Register a function called after every erased sector
+ *
+ * While the write buffer is active, the erase of the upgrade slot is spread over
+ * the download: the first OTA_FLASH_ERASE_AHEAD_SECTORS sectors are erased when
+ * the slot is opened, and the following ones just before the writer reaches them.
+ *
+ * @param[in]   cb         Progress callback, NULL to disable.
+ */
+void cy_ota_mem_set_erase_progress_callback( cy_ota_mem_erase_progress_cb_t cb );
+
+/**
+ * @brief Get the usage of the encryption row buffers
+ *
+ * The row buffers of the writer are encrypted in place. Only the rows programmed
+ * from the caller's buffer, whole rows without OTA_FLASH_ASYNC_WRITE and direct
+ * writes outside of a download, are encrypted in a pool buffer, leaving the
+ * caller's plain text as it was.
+ *
+ * @param[out]  stats      Usage of the pool, all zero without ENABLE_ON_THE_FLY_ENCRYPTION.
+ */
+void cy_ota_mem_enc_pool_get_stats( cy_ota_mem_enc_pool_stats_t *stats );
+
+/**
+ * @brief Write a received chunk straight to the upgrade slot
+ *
+ * Same as cy_ota_mem_write() at the address of `offset` in the upgrade slot,
+ * without the flash_area_open()/flash_area_write() lookup of each chunk. The
+ * bytes still go through the row-coalescing writer: a row the chunk only
+ * partly covers is copied into the coalesce row, and with OTA_FLASH_ASYNC_WRITE
+ * every whole row is copied into a writer row buffer as the caller reuses its
+ * buffer. Only the synchronous writer programs whole rows from `data`.
+ *
+ * @param[in]   offset     Offset in the upgrade slot.
+ * @param[in]   data       Bytes to write.
+ * @param[in]   len        Number of bytes.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure, past the end of the slot or if
+ *          CY_OTA_MEM_UPGRADE_SLOT_WRITE is 0
+ */
+cy_rslt_t cy_ota_mem_write_upgrade_slot( uint32_t offset, const uint8_t *data, uint32_t len );
+
+/**
+ * @brief Check the downloaded image against the SHA-256 TLV that MCUboot verifies
+ *
+ * Call after cy_ota_mem_write_end(). With OTA_FLASH_STREAM_HASH the image was hashed
+ * while its rows were programmed, and only the TLV area is read from flash. If the
+ * rows were not programmed in order from the start of the upgrade slot, or the slot
+ * is in external flash or encrypted on the fly, the slot is read back and hashed
+ * instead.
+ *
+ * @return  CY_RSLT_SUCCESS if the hash matches
+ *          CY_RSLT_TYPE_ERROR on mismatch, if the image is malformed or cannot be hashed
+ */
+cy_rslt_t cy_ota_mem_verify_image_hash( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CY_OTA_FLASH_EXT_H_ */
@@ -0,0 +1,132 @@
+/******************************************************************************
+* File Name:   cy_ota_flash_ipc.h
+*
+* Description: This file contains the layout of the ring of flash operations
+*              that cy_ota_flash.c hands to the flash service of the CM0+
+*              (CM0P_FLASH=1). Included by both cores.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef CY_OTA_FLASH_IPC_H_
+#define CY_OTA_FLASH_IPC_H_
+
+#include <stdint.h>
+#include "cy_pdl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief IPC channel whose data register holds the address of the ring.
+ *        The CM7 acquires the channel and keeps it.
+ */
+#ifndef OTA_FLASH_IPC_CHANNEL
+#define OTA_FLASH_IPC_CHANNEL           (CY_IPC_CHAN_USER)
+#endif
+
+/**
+ * @brief Number of descriptors in the ring, a power of two
+ */
+#ifndef OTA_FLASH_IPC_RING_SIZE
+#define OTA_FLASH_IPC_RING_SIZE         (4u)
+#endif
+
+/**
+ * @brief Set by the CM7 once the ring is initialized ("OFIP")
+ */
+#define OTA_FLASH_IPC_MAGIC             (0x5049464fUL)
+
+/**
+ * @brief Set by the CM0+ once its service polls the ring ("OFSR")
+ */
+#define OTA_FLASH_IPC_READY             (0x5253464fUL)
+
+/**
+ * @brief Flash operations
+ */
+#define OTA_FLASH_IPC_OP_PROGRAM        (1u)    /* Hash the first hash_len bytes of data, then program the row at addr */
+#define OTA_FLASH_IPC_OP_ERASE          (2u)    /* Erase the sector at addr */
+#define OTA_FLASH_IPC_OP_HASH_START     (3u)    /* Start a new SHA-256 */
+#define OTA_FLASH_IPC_OP_HASH_FINISH    (4u)    /* Write the SHA-256 of the bytes hashed since HASH_START to digest */
+
+/**
+ * @brief Status of a descriptor, and first error of the ring
+ */
+#define OTA_FLASH_IPC_STATUS_OK         (0)
+#define OTA_FLASH_IPC_STATUS_FLASH      (1)     /* Cy_Flash_EraseSector() or Cy_Flash_ProgramRow() failed */
+#define OTA_FLASH_IPC_STATUS_HASH       (2)     /* SHA-256 failed */
+#define OTA_FLASH_IPC_STATUS_BAD_OP     (3)
+#define OTA_FLASH_IPC_STATUS_CANCELLED  (4)     /* Skipped, the CM7 withdrew the ring (magic cleared) */
+
+/**
+ * @brief One flash operation. Addresses are absolute.
+ */
+typedef struct
+{
+    uint32_t            op;
+    uint32_t            addr;
+    uint32_t            hash_len;       /* OTA_FLASH_IPC_OP_PROGRAM: bytes of data that belong to the image hash */
+    volatile int32_t    status;         /* Written by the CM0+ */
+    CY_ALIGN(4) uint8_t data[CY_FLASH_SIZEOF_ROW];
+} ota_flash_ipc_desc_t;
+
+/**
+ * @brief Ring of flash operations, in the memory shared by both cores
+ *
+ * head and tail count descriptors since the ring was initialized: the CM7 fills
+ * desc[head % OTA_FLASH_IPC_RING_SIZE] and then increments head, the CM0+
+ * handles desc[tail % OTA_FLASH_IPC_RING_SIZE] and then increments tail. The
+ * descriptors are handled in order, so an erase always completes before the
+ * rows programmed after it.
+ */
+typedef struct
+{
+    volatile uint32_t       magic;      /* OTA_FLASH_IPC_MAGIC, written by the CM7, cleared to withdraw the ring */
+    volatile uint32_t       ready;      /* OTA_FLASH_IPC_READY, written by the CM0+ */
+    volatile uint32_t       head;       /* Written by the CM7 only */
+    volatile uint32_t       tail;       /* Written by the CM0+ only */
+    volatile int32_t        error;      /* First failed status, cleared by the CM7 while the ring is empty */
+    volatile uint8_t        digest[32]; /* Result of OTA_FLASH_IPC_OP_HASH_FINISH */
+    ota_flash_ipc_desc_t    desc[OTA_FLASH_IPC_RING_SIZE];
+} ota_flash_ipc_ring_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CY_OTA_FLASH_IPC_H_ */
@@ -55,7 +55,12 @@ extern "C" {
  *
  * This is used to start the timer for the initial OTA update check after calling cy_ota_agent_start().
  */
+#if defined(FAST_START)
+/* The fast start checks for an update as soon as the network is up */
+#define CY_OTA_INITIAL_CHECK_SECS           (1)             /* 1 second */
+#else
 #define CY_OTA_INITIAL_CHECK_SECS           (10)            /* 10 seconds */
+#endif
 
 /**
  * @brief Next time for checking for OTA updates
@@ -137,6 +142,15 @@ extern "C" {
  *
  */
 #define CY_OTA_HTTP_TIMEOUT_SEND            (3000)          /* 3 second send timeout. */
+
+/**
+ * @brief Number of concurrent HTTP connections for the ranged image download
+ *
+ * The image is split into this many byte ranges, each fetched over its own connection.
+ * Fewer connections are used when the free heap cannot hold them all.
+ * Use 1 to download over a single connection.
+ */
+#define CY_OTA_HTTP_PARALLEL_CONNECTIONS    (1)             /* single connection */
 /**********************************************************************
  * Message Defines
  **********************************************************************/
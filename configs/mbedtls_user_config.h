@@ -155,6 +155,22 @@
  * Uncomment to use your own hardware entropy collector.
  */
 #define MBEDTLS_ENTROPY_HARDWARE_ALT
+
+#if defined(COMPONENT_HW_CRYPTO)
+/**
+ * \def MBEDTLS_SHA256_ALT
+ * \def MBEDTLS_AES_ALT
+ *
+ * Run SHA-224/SHA-256 and AES on the crypto block of the device instead of in
+ * software. The implementations are in configs/COMPONENT_HW_CRYPTO, added to
+ * the build by HW_CRYPTO=1 in the Makefile.
+ *
+ * The crypto block AES has no XTS mode, which TLS does not use anyway.
+ */
+#define MBEDTLS_SHA256_ALT
+#define MBEDTLS_AES_ALT
+#undef MBEDTLS_CIPHER_MODE_XTS
+#endif
 /**
  * \def MBEDTLS_ECP_DP_SECP192R1_ENABLED
  *
@@ -177,6 +193,40 @@
 // #undef MBEDTLS_ECP_DP_CURVE25519_ENABLED
 #undef MBEDTLS_ECP_DP_CURVE448_ENABLED
 
+#if defined(TLS_PROFILE_ECC)
+/**
+ * \def TLS_PROFILE_ECC
+ *
+ * ECDHE-ECDSA credential profile, selected by TLS_PROFILE=ECC in the Makefile.
+ * The certificates and the client key must be ECDSA P-256, as generated by
+ * "generate_ssl_cert.sh <ip> ecc".
+ *
+ * Only P-256 is offered for the key exchange, and the ciphersuite list is
+ * restricted to a single suite per protocol version so that the negotiation
+ * does not depend on the server preference. The RSA key exchanges are left
+ * out; RSA signatures stay available to verify RSA-signed CA chains.
+ */
+#define MBEDTLS_ECP_DP_SECP256R1_ENABLED
+#undef MBEDTLS_ECP_DP_CURVE25519_ENABLED
+#define MBEDTLS_ECP_NIST_OPTIM
+
+#undef MBEDTLS_KEY_EXCHANGE_RSA_ENABLED
+#undef MBEDTLS_KEY_EXCHANGE_DHE_RSA_ENABLED
+#undef MBEDTLS_KEY_EXCHANGE_ECDHE_RSA_ENABLED
+#undef MBEDTLS_KEY_EXCHANGE_ECDH_RSA_ENABLED
+#undef MBEDTLS_KEY_EXCHANGE_ECDH_ECDSA_ENABLED
+#define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
+
+#define MBEDTLS_SSL_CIPHERSUITES    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, \
+                                    MBEDTLS_TLS1_3_AES_128_GCM_SHA256
+
+/* Smaller comb tables: less peak heap in the ECDHE and ECDSA operations */
+#undef MBEDTLS_ECP_WINDOW_SIZE
+#define MBEDTLS_ECP_WINDOW_SIZE        2
+#undef MBEDTLS_ECP_FIXED_POINT_OPTIM
+#define MBEDTLS_ECP_FIXED_POINT_OPTIM  0
+#endif
+
 /**
  * \def MBEDTLS_KEY_EXCHANGE_PSK_ENABLED
  *
@@ -875,9 +925,13 @@
  * callbacks are provided by MBEDTLS_SSL_TICKET_C.
  *
  * Comment this macro to disable support for SSL session tickets
+ *
+ * Kept when the application caches TLS sessions (TLS_SESSION_CACHE in the Makefile).
  */
+#if !defined(TLS_SESSION_CACHE)
 #undef MBEDTLS_SSL_SESSION_TICKETS
 #endif
+#endif
 
 #ifdef MBEDTLS_SSL_PROTO_TLS1_3
 /**
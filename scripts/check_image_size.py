@@ -0,0 +1,58 @@
+# Python script to check that a signed OTA image fits the slot of a flashmap.
+#
+# MCUboot swap-using-move moves the sectors of the boot slot up by one sector before it swaps them, so the
+# image, with its header and TLVs, has to leave the last sector of the slot free. The check fails the build
+# of an image that would only fail the swap after the download.
+#
+# Usage:
+#   python check_image_size.py <flashmap.json> <platform.json> <image.bin> [--free-sectors <count>]
+#
+# Example:
+#   python check_image_size.py flashmap/xmc7200_int_swap_move_single.json flashmap/xmc7200_platform.json
+#                              build/KIT_XMC72_EVK/Debug/mtb-example-ethernet-ota-https.bin --free-sectors 1
+#
+import argparse
+import json
+import os
+import sys
+
+
+#Function that returns the erase size of the platform memory region holding an address, None if there is none
+def sector_size(platform, address):
+    for region in platform["memory_regions"]:
+        start = int(region["address"], 0)
+        if start <= address < start + int(region["size"], 0):
+            return int(region["erase_size"], 0)
+    return None
+
+
+#Main function. Execution starts here
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(description="Check that a signed image fits the slot of a flashmap")
+    parser.add_argument("flashmap", help="flashmap JSON file of the application")
+    parser.add_argument("platform", help="platform JSON file with the memory regions")
+    parser.add_argument("image", help="signed image (.bin)")
+    parser.add_argument("--free-sectors", type=int, default=0, help="sectors at the end of the slot the image must leave free")
+    args = parser.parse_args()
+
+    with open(args.flashmap, 'r') as fd:
+        slots = json.load(fd)["application_1"]["slots"]
+    with open(args.platform, 'r') as fd:
+        platform = json.load(fd)
+
+    boot = int(slots["boot"], 0)
+    slot_size = int(slots["size"], 0)
+    sector = sector_size(platform, boot)
+    if sector is None:
+        print("Error: the boot slot 0x%08X of %s is in no memory region of %s" % (boot, args.flashmap, args.platform))
+        sys.exit(1)
+
+    limit = slot_size - args.free_sectors * sector
+    size = os.path.getsize(args.image)
+    if size > limit:
+        print("Error: %s is %d bytes, the slot of %s takes at most %d bytes (%d byte slot, %d free %d byte sectors)" %
+              (args.image, size, os.path.basename(args.flashmap), limit, slot_size, args.free_sectors, sector))
+        sys.exit(1)
+
+    print("Image size %d of %d bytes (%.1f%%)" % (size, limit, 100.0 * size / limit))
@@ -0,0 +1,141 @@
+# Python script to compress an OTA image (or a delta update patch) for download.
+#
+# The output is a heatshrink stream behind a 12 byte header, decompressed by source/ota_decompress.c while
+# it downloads. The device needs a window of 2^WINDOW_BITS bytes, so keep WINDOW_BITS within
+# OTA_DECOMPRESS_WINDOW_BITS of the application.
+#
+# Usage:
+#   python compress_image.py <input-file> <output-file>
+#
+# Example:
+#   python compress_image.py mtb-example-ethernet-ota-https.bin mtb-example-ethernet-ota-https.hs
+#
+# Serve the output file in place of the image, with "Compression":"heatshrink" in the job document.
+#
+# Output format:
+#   header : magic "HSZ1", window bits, lookahead bits (uint8), reserved (uint16), decompressed size (uint32),
+#            little endian
+#   data   : heatshrink bit stream, most significant bit first. A 1 bit is followed by a literal byte, a 0 bit by
+#            the distance - 1 (window bits) and the length - 1 (lookahead bits) of a copy from the window.
+#
+import struct
+import sys
+
+HEADER_MAGIC = b"HSZ1"
+WINDOW_BITS = 10
+LOOKAHEAD_BITS = 5
+MIN_MATCH = 2
+MAX_CHAIN = 64
+
+
+#Class that packs bits most significant bit first
+class BitWriter:
+    def __init__(self):
+        self.data = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        for i in range(bits - 1, -1, -1):
+            self.acc = (self.acc << 1) | ((value >> i) & 1)
+            self.count += 1
+            if self.count == 8:
+                self.data.append(self.acc)
+                self.acc, self.count = 0, 0
+
+    def finish(self):
+        if self.count:
+            self.data.append(self.acc << (8 - self.count))
+        return bytes(self.data)
+
+
+#Function that compresses data, greedy matching over hash chains of 2 byte prefixes
+def compress(data):
+    window = 1 << WINDOW_BITS
+    max_len = 1 << LOOKAHEAD_BITS
+    heads = {}
+    prev = [0] * len(data)
+    out = BitWriter()
+    pos = 0
+
+    def insert(at):
+        if at + MIN_MATCH <= len(data):
+            key = data[at:at + MIN_MATCH]
+            prev[at] = heads.get(key, -1)
+            heads[key] = at
+
+    while pos < len(data):
+        best_len, best_dist = 0, 0
+        limit = min(max_len, len(data) - pos)
+        if limit >= MIN_MATCH:
+            cand = heads.get(data[pos:pos + MIN_MATCH], -1)
+            chain = 0
+            while cand >= 0 and (pos - cand) <= window and chain < MAX_CHAIN:
+                length = 0
+                while length < limit and data[cand + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_dist = length, pos - cand
+                    if length == limit:
+                        break
+                cand = prev[cand]
+                chain += 1
+
+        if best_len >= MIN_MATCH:
+            out.put(0, 1)
+            out.put(best_dist - 1, WINDOW_BITS)
+            out.put(best_len - 1, LOOKAHEAD_BITS)
+            for i in range(best_len):
+                insert(pos + i)
+            pos += best_len
+        else:
+            out.put(1, 1)
+            out.put(data[pos], 8)
+            insert(pos)
+            pos += 1
+
+    return HEADER_MAGIC + struct.pack("<BBHI", WINDOW_BITS, LOOKAHEAD_BITS, 0, len(data)) + out.finish()
+
+
+#Function that decompresses a stream the way the device does, to check it
+def decompress(stream):
+    magic, window_bits, lookahead_bits, _, size = struct.unpack_from("<4sBBHI", stream, 0)
+    if magic != HEADER_MAGIC:
+        raise ValueError("not a compressed image")
+    bits = ''.join(format(b, '08b') for b in stream[12:])
+    out = bytearray()
+    i = 0
+    while len(out) < size:
+        if bits[i] == '1':
+            out.append(int(bits[i + 1:i + 9], 2))
+            i += 9
+        else:
+            dist = int(bits[i + 1:i + 1 + window_bits], 2) + 1
+            i += 1 + window_bits
+            length = int(bits[i:i + lookahead_bits], 2) + 1
+            i += lookahead_bits
+            for _ in range(length):
+                out.append(out[-dist])
+    return bytes(out)
+
+
+#Main function. Execution starts here
+if __name__ == '__main__':
+
+    if len(sys.argv) != 3:
+        print("Usage: python compress_image.py <input-file> <output-file>")
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as fd:
+        image = fd.read()
+
+    compressed = compress(image)
+    if decompress(compressed) != image:
+        print("Internal error: the compressed image does not decompress to the input")
+        sys.exit(1)
+
+    with open(sys.argv[2], 'wb') as fd:
+        fd.write(compressed)
+
+    print("Compressed %s: %d -> %d bytes (%.1f%%)" % (sys.argv[1], len(image), len(compressed),
+                                                     100.0 * len(compressed) / max(len(image), 1)))
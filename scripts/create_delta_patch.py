@@ -0,0 +1,204 @@
+# Python script to create a delta update patch between two OTA images.
+#
+# The device rebuilds the new image from the image running in its primary slot and the patch,
+# so the base has to be the exact signed image (.bin) that the device runs.
+#
+# Usage:
+#   python create_delta_patch.py <base-image.bin> <new-image.bin> <patch-file>
+#
+# Example:
+#   python create_delta_patch.py mtb-example-ethernet-ota-https_1.0.0.bin mtb-example-ethernet-ota-https.bin mtb-example-ethernet-ota-https.patch
+#
+# Serve the patch file in place of the image, with a job document naming it in "File" and the version of the
+# base image in "BaseVersion" (see ota_update_delta.json).
+#
+# Patch format (little endian), as applied by source/ota_delta.c:
+#   header  : magic "DELT", base size, new size, reserved (4 x uint32)
+#   records : copy length, add length, extra length (uint32), seek (int32),
+#             copy length base bytes taken as they are,
+#             add length bytes added to the next base bytes,
+#             extra length bytes taken from the patch, then the base cursor moves by seek.
+#
+# Matches are found bsdiff style: exact matches of SEED_SIZE bytes are looked up in the base and
+# grown into approximate matches, so that code which only moved keeps matching with a few different bytes.
+# Within a match, runs of unchanged bytes become copies and cost no patch data.
+#
+import struct
+import sys
+
+PATCH_MAGIC = b"DELT"
+SEED_SIZE = 16
+SEED_STEP = 4
+MAX_CANDIDATES = 8
+MIN_COPY = 16
+
+
+#Function that indexes the base image by the seeds starting at every SEED_STEP bytes
+def index_base(base):
+    index = {}
+    for pos in range(0, len(base) - SEED_SIZE + 1, SEED_STEP):
+        candidates = index.setdefault(base[pos:pos + SEED_SIZE], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(pos)
+    return index
+
+
+#Function that finds the longest exact match of new[scan:] in the base, returns (base position, length)
+def find_match(base, new, scan, index):
+    best_pos, best_len = 0, 0
+    # The seed of a match can start at up to SEED_STEP - 1 bytes after scan
+    for shift in range(SEED_STEP):
+        candidates = index.get(new[scan + shift:scan + shift + SEED_SIZE])
+        if candidates is None:
+            continue
+        for pos in candidates:
+            start = pos - shift
+            if start < 0:
+                continue
+            length = 0
+            limit = min(len(base) - start, len(new) - scan)
+            while length < limit and base[start + length] == new[scan + length]:
+                length += 1
+            if length > best_len:
+                best_pos, best_len = start, length
+        if best_len >= SEED_SIZE:
+            break
+    return best_pos, best_len
+
+
+#Function that returns how far new[scan:] keeps mostly matching base[pos:], stopping at `end`
+def extend_forward(base, new, scan, pos, end):
+    score, best_score, best_len = 0, 0, 0
+    limit = min(end - scan, len(base) - pos)
+    for i in range(limit):
+        if base[pos + i] == new[scan + i]:
+            score += 1
+        if (score * 2 - (i + 1)) > (best_score * 2 - best_len):
+            best_score, best_len = score, i + 1
+    return best_len
+
+
+#Function that returns how far back from new[scan] the bytes keep mostly matching before base[pos], stopping at `start`
+def extend_backward(base, new, scan, pos, start):
+    score, best_score, best_len = 0, 0, 0
+    limit = min(scan - start, pos)
+    for i in range(1, limit + 1):
+        if base[pos - i] == new[scan - i]:
+            score += 1
+        if (score * 2 - i) > (best_score * 2 - best_len):
+            best_score, best_len = score, i
+    return best_len
+
+
+#Function that creates the patch turning base into new
+def create_patch(base, new):
+    index = index_base(base)
+    records = []
+    last_scan, last_pos = 0, 0
+    scan = 0
+
+    while scan < len(new):
+        # Still matching the current alignment, nothing to record yet
+        aligned = last_pos + (scan - last_scan)
+        if aligned + SEED_SIZE <= len(base) and base[aligned:aligned + SEED_SIZE] == new[scan:scan + SEED_SIZE]:
+            scan += SEED_SIZE
+            continue
+
+        pos, length = find_match(base, new, scan, index)
+        if length < SEED_SIZE:
+            scan += 1
+            continue
+
+        # Close the region since last_scan: approximate match at the old alignment, then extra bytes
+        lenf = extend_forward(base, new, last_scan, last_pos, scan)
+        lenb = extend_backward(base, new, scan, pos, last_scan + lenf)
+        records.append((last_scan, last_pos, lenf, scan - lenb, (pos - lenb) - (last_pos + lenf)))
+        last_scan, last_pos = scan - lenb, pos - lenb
+        scan += length
+
+    lenf = extend_forward(base, new, last_scan, last_pos, len(new))
+    records.append((last_scan, last_pos, lenf, len(new), 0))
+
+    patch = bytearray(PATCH_MAGIC + struct.pack("<III", len(base), len(new), 0))
+    for (new_start, base_start, diff_len, extra_end, seek) in records:
+        diff = bytes((new[new_start + i] - base[base_start + i]) & 0xFF for i in range(diff_len))
+        segments = split_diff(diff)
+        for (num, (copy_len, add_start, add_end)) in enumerate(segments):
+            last = (num == len(segments) - 1)
+            extra = new[new_start + diff_len:extra_end] if last else b""
+            patch += struct.pack("<IIIi", copy_len, add_end - add_start, len(extra), seek if last else 0)
+            patch += diff[add_start:add_end]
+            patch += extra
+    return bytes(patch)
+
+
+#Function that splits the difference of a match into (copy length, add start, add end) segments at runs of zeros
+def split_diff(diff):
+    segments = []
+    pos = 0
+    while True:
+        copy_start = pos
+        while pos < len(diff) and diff[pos] == 0:
+            pos += 1
+        copy_len = pos - copy_start
+        add_start = pos
+        # Add bytes up to the next run of zeros worth a record of its own
+        while pos < len(diff):
+            if diff[pos] == 0:
+                run_end = pos
+                while run_end < len(diff) and diff[run_end] == 0 and (run_end - pos) < MIN_COPY:
+                    run_end += 1
+                if (run_end - pos) >= MIN_COPY or run_end == len(diff):
+                    break
+                pos = run_end
+            else:
+                pos += 1
+        segments.append((copy_len, add_start, pos))
+        if pos >= len(diff):
+            return segments
+
+
+#Function that applies a patch the way the device does, to check it
+def apply_patch(base, patch):
+    magic, base_size, new_size, _ = struct.unpack_from("<4sIII", patch, 0)
+    if magic != PATCH_MAGIC or base_size != len(base):
+        raise ValueError("patch does not apply to this base image")
+    new = bytearray()
+    offset, base_pos = 16, 0
+    while len(new) < new_size:
+        copy_len, add_len, extra_len, seek = struct.unpack_from("<IIIi", patch, offset)
+        offset += 16
+        new += base[base_pos:base_pos + copy_len]
+        base_pos += copy_len
+        new += bytes((base[base_pos + i] + patch[offset + i]) & 0xFF for i in range(add_len))
+        offset += add_len
+        base_pos += add_len
+        new += patch[offset:offset + extra_len]
+        offset += extra_len
+        base_pos += seek
+    return bytes(new)
+
+
+#Main function. Execution starts here
+if __name__ == '__main__':
+
+    if len(sys.argv) != 4:
+        print("Usage: python create_delta_patch.py <base-image.bin> <new-image.bin> <patch-file>")
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as fd:
+        base_image = fd.read()
+    with open(sys.argv[2], 'rb') as fd:
+        new_image = fd.read()
+
+    patch_data = create_patch(base_image, new_image)
+    if apply_patch(base_image, patch_data) != new_image:
+        print("Internal error: the patch does not rebuild the new image")
+        sys.exit(1)
+
+    with open(sys.argv[3], 'wb') as fd:
+        fd.write(patch_data)
+
+    print("Base image : %d bytes" % len(base_image))
+    print("New image  : %d bytes" % len(new_image))
+    print("Patch      : %d bytes (%.1f%% of the new image)" % (len(patch_data), 100.0 * len(patch_data) / len(new_image)))
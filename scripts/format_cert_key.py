@@ -1,17 +1,30 @@
 # Python script to convert certificate/key file to string format that can be used in C source files.
 #
 # Usage:
-#   python format_cert_key.py <one-or-more-file-name-of-certificate-or-key-with-extension>
+#   python format_cert_key.py [--ecdsa] <one-or-more-file-name-of-certificate-or-key-with-extension>
 #
 # Example:
 #   python format_cert_key.py mosquitto_ca.crt mosquitto_client.crt mosquitto_client.key
+#   python format_cert_key.py --ecdsa http_ca.crt http_client.crt http_client.key
+#
+# With --ecdsa the "EC PARAMETERS" block that "openssl ecparam -genkey" puts in front of the key
+# is dropped, and RSA keys are rejected, so that the strings match the ECC profile (TLS_PROFILE=ECC)
+# of the application.
 #
 import sys
 
 #Function that adds a new line character and trailing backslash except on the final line
-def format_file(f):
+def format_file(f, ecdsa):
     with open(f, 'r') as fd:
         lines = fd.read().splitlines()
+        if (ecdsa):
+            if any("RSA PRIVATE KEY" in i for i in lines):
+                print("Skipping", f, "- RSA key, generate an ECDSA P-256 key for the ECC profile")
+                return
+            #Drop the curve parameters, the key names the curve itself
+            if "-----BEGIN EC PARAMETERS-----" in lines:
+                lines = lines[lines.index("-----END EC PARAMETERS-----") + 1:]
+        print("String format of",f,"file:")
         line_num = 0
         for i in lines:
             i = "\""+i+"\\n\""
@@ -25,13 +38,14 @@ def format_file(f):
 #Main function. Execution starts here
 if __name__ == '__main__':
 
+    ecdsa = "--ecdsa" in sys.argv
+
     for arg in (sys.argv):
         if (arg.endswith(".crt") or arg.endswith(".pem") or arg.endswith(".key")):
-            print("String format of",arg,"file:")
-            format_file(arg)
+            format_file(arg, ecdsa)
             print("")
         else:
-            if (arg.endswith(".py") == False):
+            if (arg.endswith(".py") == False and arg != "--ecdsa"):
                 print("Pass file with extension (*.crt) (*.pem) or (*.key) only!")
 
     input("Enter any key to exit...")
@@ -2,6 +2,9 @@
 
 IP_ADDRESS=$1
 
+# Key type of the CA, server, and client: rsa (RSA 2048, default) or ecc (ECDSA P-256)
+KEY_TYPE=${2:-rsa}
+
 if [ -z "$1" ]
   then
     echo "Specify IP address of the HTTP server as argument"
@@ -9,6 +12,32 @@ if [ -z "$1" ]
 	exit 1
 fi
 
+if [ "$KEY_TYPE" != "ecc" ] && [ "$KEY_TYPE" != "rsa" ]
+  then
+    echo "Specify the key type as ecc or rsa"
+	read -p "Press any key to exit ..."
+	exit 1
+fi
+
+# Generate a private key of the selected type
+gen_key()
+{
+    if [ "$KEY_TYPE" = "ecc" ]
+      then
+        openssl ecparam -name prime256v1 -genkey -noout -out $1
+    else
+        openssl genrsa -out $1 2048
+    fi
+}
+
+# ECDSA keys only sign, there is no RSA key transport
+if [ "$KEY_TYPE" = "ecc" ]
+  then
+    SERVER_KEY_USAGE="digitalSignature, keyAgreement"
+else
+    SERVER_KEY_USAGE="digitalSignature, nonRepudiation, keyEncipherment, dataEncipherment"
+fi
+
 ################################
 # Become a Certificate Authority
 ################################
@@ -17,7 +46,7 @@ MY_CA_NAME=http_ca
 OPENSSL_SUBJECT_INFO_CA="/C=IN/ST=Karnataka/L=Bengaluru/O=CY/OU=Engineering/CN=myCA"
 
 # Generate a private root key
-openssl genrsa -out $MY_CA_NAME.key 2048
+gen_key $MY_CA_NAME.key
 
 # Self-sign a certificate.
 openssl req -x509 -new -nodes -key $MY_CA_NAME.key -sha256 \
@@ -32,7 +61,7 @@ MY_SERVER_NAME=http_server
 OPENSSL_SUBJECT_INFO_SERVER="/C=IN/ST=Karnataka/L=Bengaluru/O=CY/OU=Engineering/CN=$MY_SERVER_NAME"
 
 # Generate a private key
-openssl genrsa -out $MY_SERVER_NAME.key 2048
+gen_key $MY_SERVER_NAME.key
 
 # Create the Certificate Signing Request (CSR).
 # Make sure to set the "Common Name" field with MY_SERVER_NAME.
@@ -43,7 +72,7 @@ openssl req -new -key $MY_SERVER_NAME.key -out $MY_SERVER_NAME.csr \
 >$MY_SERVER_NAME.ext cat <<-EOF
 authorityKeyIdentifier=keyid,issuer
 basicConstraints=CA:FALSE
-keyUsage = digitalSignature, nonRepudiation, keyEncipherment, dataEncipherment
+keyUsage = $SERVER_KEY_USAGE
 subjectAltName = @alt_names
 [alt_names]
 DNS.1 = $MY_SERVER_NAME
@@ -64,7 +93,7 @@ MY_CLIENT_NAME=http_client
 OPENSSL_SUBJECT_INFO_CLIENT="/C=IN/ST=Karnataka/L=Bengaluru/O=CY/OU=Engineering/CN=$MY_CLIENT_NAME"
 
 # Generate a private key
-openssl genrsa -out $MY_CLIENT_NAME.key 2048
+gen_key $MY_CLIENT_NAME.key
 
 # Create the Certificate Signing Request (CSR).
 openssl req -new -key $MY_CLIENT_NAME.key -out $MY_CLIENT_NAME.csr \
@@ -0,0 +1,396 @@
+# Python script to load test an OTA server with a fleet of emulated devices.
+#
+# Each device is a thread speaking the protocol of this example: the job document is polled with the GET
+# request of CY_OTA_HTTP_GET_TEMPLATE (cy_ota_config.h), conditional on the ETag/Last-Modified of the last
+# response as with ENABLE_CONDITIONAL_JOB_POLL, on a kept-alive connection. A device that gets a job newer than
+# its version downloads the "File" of the job in Range requests of RANGE_DOWNLOAD_CHUNK_SIZE bytes and sends the
+# result with CY_OTA_HTTP_POST_TEMPLATE and CY_OTA_HTTP_RESULT_JSON. With --cert/--key the connections use TLS
+# with the client certificate of generate_ssl_cert.sh, and resume the TLS session of the last connection.
+#
+# The report gives TLS handshakes per second (full and resumed), job polls per second, image throughput and the
+# latency percentiles of each request type, so that servers can be sized and the keep-alive, conditional poll and
+# session resumption features compared with --no-keep-alive, --no-conditional and --no-resume.
+#
+# Usage:
+#   python ota_load_test.py --server <address> [--port <port>] [--cert <client.crt> --key <client.key> --ca <ca.crt>]
+#                           [--devices <count>] [--duration <seconds>] [--interval <seconds>] [--ramp <seconds>]
+#                           [--version <x.y.z>] [--long-poll <seconds>] [--profile <name>] [--json <file>]
+#
+# Example:
+#   python ota_load_test.py --server 192.168.0.10 --port 443 --cert http_client.crt --key http_client.key
+#                           --ca http_ca.crt --devices 200 --duration 120 --version 1.0.0 --profile cellular
+#
+# Impairment profiles add a delay (with jitter) in front of every request, limit the receive rate of each
+# device and drop the connection of a request with the given probability, which makes the device reconnect:
+#   lan      :   1 ms, no limit, no loss
+#   dsl      :  20 ms +/-  5 ms, 1 MB/s,   0.1% loss
+#   cellular :  60 ms +/- 20 ms, 128 KB/s, 1% loss
+#   lossy    : 100 ms +/- 50 ms, 64 KB/s,  5% loss
+#
+import argparse
+import json
+import random
+import socket
+import ssl
+import threading
+import time
+
+GET_TEMPLATE = "GET %s HTTP/1.1\r\nHost: %s:%d \r\n"
+POST_TEMPLATE = "POST %s HTTP/1.1\r\nContent-Length:%ld \r\n\r\n%s"
+RESULT_JSON = "{\"Message\":\"%s\", \"File\":\"%s\" }"
+RANGE_DOWNLOAD_CHUNK_SIZE = 4096
+RECEIVE_TIMEOUT_SECS = 5
+
+# Name: (delay secs, jitter secs, receive bytes per second (0 for no limit), probability of a dropped connection)
+PROFILES = {
+    "none":     (0.0,   0.0,   0,          0.0),
+    "lan":      (0.001, 0.0,   0,          0.0),
+    "dsl":      (0.020, 0.005, 1024 * 1024, 0.001),
+    "cellular": (0.060, 0.020, 128 * 1024, 0.01),
+    "lossy":    (0.100, 0.050, 64 * 1024,  0.05),
+}
+
+REQUEST_TYPES = ["connect", "handshake", "resumed", "poll", "chunk", "image", "result"]
+
+
+#Class that collects the measurements of all devices
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latency = {name: [] for name in REQUEST_TYPES}
+        self.status = {}
+        self.image_bytes = 0
+        self.polls = 0
+        self.updates = 0
+        self.errors = 0
+        self.drops = 0
+
+    def add(self, name, secs):
+        with self.lock:
+            self.latency[name].append(secs)
+
+    def count(self, field, value=1):
+        with self.lock:
+            setattr(self, field, getattr(self, field) + value)
+
+    def add_status(self, status):
+        with self.lock:
+            self.status[status] = self.status.get(status, 0) + 1
+
+
+#Function that returns the given percentile of a sorted list
+def percentile(values, pct):
+    if not values:
+        return 0.0
+    return values[min(len(values) - 1, int(len(values) * pct / 100.0))]
+
+
+#Class that is one HTTP/1.1 connection to the server, with the impairment of the profile
+class Connection:
+    def __init__(self, device):
+        self.device = device
+        self.args = device.args
+        self.buffer = b""
+        start = time.monotonic()
+        raw = socket.create_connection((self.args.server, self.args.port), timeout=RECEIVE_TIMEOUT_SECS)
+        raw.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        device.stats.add("connect", time.monotonic() - start)
+        self.sock = raw
+        if device.context is not None:
+            start = time.monotonic()
+            session = device.session if not self.args.no_resume else None
+            self.sock = device.context.wrap_socket(raw, server_hostname=self.args.server, session=session)
+            device.stats.add("resumed" if self.sock.session_reused else "handshake", time.monotonic() - start)
+
+    def close(self):
+        if isinstance(self.sock, ssl.SSLSocket) and not self.args.no_resume:
+            self.device.session = self.sock.session
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
+    def receive(self):
+        size = 16384
+        limit = self.device.profile[2]
+        if limit:
+            #Receive about 20 ms worth of data at a time, then wait for the time it takes at the rate limit
+            size = max(512, limit // 50)
+        start = time.monotonic()
+        data = self.sock.recv(size)
+        if not data:
+            raise ConnectionError("connection closed by the server")
+        if limit:
+            wait = len(data) / float(limit) - (time.monotonic() - start)
+            if wait > 0:
+                time.sleep(wait)
+        self.buffer += data
+
+    def read_line(self):
+        while b"\r\n" not in self.buffer:
+            self.receive()
+        line, self.buffer = self.buffer.split(b"\r\n", 1)
+        return line.decode("latin-1")
+
+    def read_body(self, length):
+        while len(self.buffer) < length:
+            self.receive()
+        body, self.buffer = self.buffer[:length], self.buffer[length:]
+        return body
+
+    def request(self, text):
+        delay, jitter, _, loss = self.device.profile
+        if delay or jitter:
+            time.sleep(max(0.0, random.uniform(delay - jitter, delay + jitter)))
+        if loss and random.random() < loss:
+            self.device.stats.count("drops")
+            raise ConnectionError("connection dropped by the impairment profile")
+
+        self.sock.sendall(text.encode("latin-1"))
+
+        status_line = self.read_line()
+        parts = status_line.split(" ", 2)
+        if len(parts) < 2 or not parts[1].isdigit():
+            raise ConnectionError("bad status line '%s'" % status_line)
+        headers = {}
+        while True:
+            line = self.read_line()
+            if line == "":
+                break
+            name, _, value = line.partition(":")
+            headers[name.strip().lower()] = value.strip()
+
+        if headers.get("transfer-encoding", "").lower() == "chunked":
+            body = b""
+            while True:
+                length = int(self.read_line().split(";")[0], 16)
+                body += self.read_body(length)
+                self.read_line()
+                if length == 0:
+                    break
+        else:
+            body = self.read_body(int(headers.get("content-length", "0")))
+        return int(parts[1]), headers, body
+
+
+#Class that emulates one device
+class Device(threading.Thread):
+    def __init__(self, number, args, stats, context, deadline):
+        threading.Thread.__init__(self, daemon=True)
+        self.number = number
+        self.args = args
+        self.stats = stats
+        self.context = context
+        self.deadline = deadline
+        self.profile = PROFILES[args.profile]
+        self.version = tuple(int(i) for i in args.version.split("."))
+        self.session = None
+        self.connection = None
+        self.etag = None
+        self.last_modified = None
+        # Job of an unfinished download and the bytes of it received, resumed like ENABLE_RANGE_DOWNLOAD does
+        self.job = None
+        self.offset = 0
+        self.size = None
+
+    def connection_get(self):
+        if self.connection is None:
+            self.connection = Connection(self)
+        return self.connection
+
+    def connection_done(self, headers):
+        if self.args.no_keep_alive or headers.get("connection", "").lower() == "close":
+            self.connection_drop()
+
+    def connection_drop(self):
+        if self.connection is not None:
+            self.connection.close()
+            self.connection = None
+
+    def poll(self):
+        text = GET_TEMPLATE % (self.args.job, self.args.server, self.args.port)
+        if not self.args.no_conditional:
+            if self.etag:
+                text += "If-None-Match: %s\r\n" % self.etag
+            if self.last_modified:
+                text += "If-Modified-Since: %s\r\n" % self.last_modified
+            if self.args.long_poll and (self.etag or self.last_modified):
+                text += "Prefer: wait=%d\r\n" % self.args.long_poll
+        text += "\r\n"
+
+        start = time.monotonic()
+        status, headers, body = self.connection_get().request(text)
+        elapsed = time.monotonic() - start
+        self.stats.add_status(status)
+        self.stats.count("polls")
+        self.connection_done(headers)
+        # A held request measures the notification, not the server
+        if not (self.args.long_poll and status == 304):
+            self.stats.add("poll", elapsed)
+        if status == 304:
+            return None
+        if status != 200:
+            raise ConnectionError("job poll answered %d" % status)
+        self.etag = headers.get("etag")
+        self.last_modified = headers.get("last-modified")
+        return json.loads(body.decode("utf-8"))
+
+    def download(self):
+        file = self.job.get("File", "/")
+        start = time.monotonic()
+        while self.size is None or self.offset < self.size:
+            if time.monotonic() >= self.deadline:
+                return None
+            last = self.offset + self.args.chunk - 1
+            text = GET_TEMPLATE % (file, self.args.server, self.args.port)
+            text += "Range: bytes=%d-%d\r\n\r\n" % (self.offset, last)
+            chunk_start = time.monotonic()
+            status, headers, body = self.connection_get().request(text)
+            self.stats.add("chunk", time.monotonic() - chunk_start)
+            self.stats.add_status(status)
+            self.connection_done(headers)
+            if status == 200:
+                #The server does not do Range requests, the whole file came at once
+                self.offset = self.size = len(body)
+            elif status == 206:
+                self.size = int(headers.get("content-range", "/0").rpartition("/")[2])
+                self.offset += len(body)
+            else:
+                raise ConnectionError("image download answered %d" % status)
+            self.stats.count("image_bytes", len(body))
+        self.stats.add("image", time.monotonic() - start)
+        return file
+
+    def report(self, file):
+        message = RESULT_JSON % ("Success", file)
+        text = POST_TEMPLATE % (self.args.job, len(message), message)
+        start = time.monotonic()
+        status, headers, _ = self.connection_get().request(text)
+        self.stats.add("result", time.monotonic() - start)
+        self.stats.add_status(status)
+        self.connection_done(headers)
+
+    def run(self):
+        if self.args.ramp:
+            time.sleep(self.args.ramp * self.number / float(self.args.devices))
+        while time.monotonic() < self.deadline:
+            try:
+                if self.job is None:
+                    job = self.poll()
+                    if job is not None and tuple(int(i) for i in job.get("Version", "0.0.0").split(".")) > self.version:
+                        self.job, self.offset, self.size = job, 0, None
+                if self.job is not None:
+                    file = self.download()
+                    if file is not None:
+                        self.report(file)
+                        self.version = tuple(int(i) for i in self.job["Version"].split("."))
+                        self.job = None
+                        self.stats.count("updates")
+            except (OSError, ValueError) as error:
+                self.stats.count("errors")
+                if self.args.verbose:
+                    print("Device %d: %s" % (self.number, error))
+                self.connection_drop()
+            # A held request is followed by the next one at once, like OTA_JOB_NOTIFY_LONG_POLL
+            if not self.args.long_poll:
+                jitter = self.args.interval * self.args.jitter
+                time.sleep(max(0.0, self.args.interval + random.uniform(-jitter, jitter)))
+        self.connection_drop()
+
+
+#Function that prints the report and returns it as a dictionary
+def report(stats, args, elapsed):
+    result = {
+        "devices": args.devices,
+        "profile": args.profile,
+        "seconds": round(elapsed, 1),
+        "handshakes_per_sec": len(stats.latency["handshake"]) / elapsed,
+        "resumed_per_sec": len(stats.latency["resumed"]) / elapsed,
+        "connects_per_sec": len(stats.latency["connect"]) / elapsed,
+        "polls_per_sec": stats.polls / elapsed,
+        "image_mbytes_per_sec": stats.image_bytes / elapsed / 1e6,
+        "updates": stats.updates,
+        "errors": stats.errors,
+        "drops": stats.drops,
+        "status": {str(k): v for k, v in sorted(stats.status.items())},
+        "latency_ms": {},
+    }
+
+    print("")
+    print("Devices %d, profile %s, %.1f s" % (args.devices, args.profile, elapsed))
+    print("  TCP connects     : %8.1f /s" % result["connects_per_sec"])
+    print("  Full handshakes  : %8.1f /s" % result["handshakes_per_sec"])
+    print("  Resumed          : %8.1f /s" % result["resumed_per_sec"])
+    print("  Job polls        : %8.1f /s" % result["polls_per_sec"])
+    print("  Image throughput : %8.3f MB/s (%d updates)" % (result["image_mbytes_per_sec"], stats.updates))
+    print("  Errors %d, dropped connections %d, responses %s" % (stats.errors, stats.drops, result["status"]))
+    print("")
+    print("  %-10s %8s %9s %9s %9s %9s" % ("Latency", "count", "p50 ms", "p95 ms", "p99 ms", "max ms"))
+    for name in REQUEST_TYPES:
+        values = sorted(stats.latency[name])
+        if not values:
+            continue
+        row = [percentile(values, 50) * 1000, percentile(values, 95) * 1000, percentile(values, 99) * 1000,
+               values[-1] * 1000]
+        result["latency_ms"][name] = dict(zip(["count", "p50", "p95", "p99", "max"], [len(values)] + row))
+        print("  %-10s %8d %9.1f %9.1f %9.1f %9.1f" % tuple([name, len(values)] + row))
+    return result
+
+
+#Main function. Execution starts here
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(description="OTA server load test with emulated devices")
+    parser.add_argument("--server", required=True, help="address of the OTA server (HTTP_SERVER)")
+    parser.add_argument("--port", type=int, default=443, help="port of the OTA server (HTTP_SERVER_PORT)")
+    parser.add_argument("--cert", help="client certificate, enables TLS")
+    parser.add_argument("--key", help="client private key")
+    parser.add_argument("--ca", help="CA certificate of the server, the server is not checked without it")
+    parser.add_argument("--tls12", action="store_true", help="limit TLS to version 1.2")
+    parser.add_argument("--job", default="/ota_update.json", help="job document (OTA_HTTP_JOB_FILE)")
+    parser.add_argument("--devices", type=int, default=10, help="number of emulated devices")
+    parser.add_argument("--duration", type=float, default=60, help="length of the test in seconds")
+    parser.add_argument("--interval", type=float, default=10, help="seconds between job polls (CY_OTA_NEXT_CHECK_INTERVAL_SECS)")
+    parser.add_argument("--jitter", type=float, default=0.2, help="random part of the poll interval, as a fraction")
+    parser.add_argument("--ramp", type=float, default=0, help="seconds over which the devices start")
+    parser.add_argument("--long-poll", type=int, default=0, help="hold the conditional polls for this many seconds (OTA_JOB_LONG_POLL_WAIT_SECS)")
+    parser.add_argument("--version", default="99.99.99", help="version the devices run, a newer job is downloaded")
+    parser.add_argument("--chunk", type=int, default=RANGE_DOWNLOAD_CHUNK_SIZE, help="bytes of each Range request")
+    parser.add_argument("--profile", choices=sorted(PROFILES), default="none", help="network impairment profile")
+    parser.add_argument("--no-keep-alive", action="store_true", help="new connection for every request")
+    parser.add_argument("--no-conditional", action="store_true", help="polls without If-None-Match/If-Modified-Since")
+    parser.add_argument("--no-resume", action="store_true", help="full TLS handshake on every connection")
+    parser.add_argument("--json", help="file to write the results to, for comparison between runs")
+    parser.add_argument("--verbose", action="store_true", help="print the errors of the devices")
+    args = parser.parse_args()
+
+    context = None
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+        context.load_cert_chain(args.cert, args.key)
+        context.check_hostname = False
+        if args.ca:
+            context.load_verify_locations(args.ca)
+        else:
+            context.verify_mode = ssl.CERT_NONE
+        if args.tls12:
+            context.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    stats = Stats()
+    start = time.monotonic()
+    deadline = start + args.duration
+    devices = [Device(i, args, stats, context, deadline) for i in range(args.devices)]
+    print("Starting %d devices against %s:%d (%s) for %d s" % (args.devices, args.server, args.port,
+                                                            "HTTPS" if context else "HTTP", args.duration))
+    for device in devices:
+        device.start()
+    try:
+        for device in devices:
+            device.join(max(0.0, deadline - time.monotonic()) + RECEIVE_TIMEOUT_SECS + (args.long_poll or 0))
+    except KeyboardInterrupt:
+        print("Interrupted")
+
+    result = report(stats, args, time.monotonic() - start)
+    if args.json:
+        with open(args.json, 'w') as fd:
+            json.dump(result, fd, indent=2)
@@ -0,0 +1,140 @@
+# Python script to serve the OTA job document and images with long-poll update notification.
+#
+# Static file server (HTTP/1.1, kept-alive connections) with ETag/Last-Modified validators and Range
+# requests. A conditional GET carrying "Prefer: wait=<seconds>" (RFC 7240) is held until the file
+# changes or the wait runs out, so a device built with OTA_JOB_NOTIFY_MODE set to OTA_JOB_NOTIFY_LONG_POLL
+# downloads a new job document within a round trip of it being written.
+#
+# Usage:
+#   python ota_notify_server.py [--port <port>] [--cert <server.crt> --key <server.key> [--ca <ca.crt>]]
+#                               [--dir <directory>] [--max-wait <seconds>]
+#
+# Example:
+#   python ota_notify_server.py --port 443 --cert http_server.crt --key http_server.key --ca http_ca.crt
+#
+# Update the device by copying the new image next to ota_update.json and then editing the "Version" in
+# ota_update.json: the held requests are answered as soon as the job document is saved.
+#
+import argparse
+import email.utils
+import os
+import ssl
+import time
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+
+POLL_INTERVAL_SECS = 0.2
+
+
+#Function that returns the ETag and Last-Modified of a file, None if the file does not exist
+def validators(path):
+    try:
+        st = os.stat(path)
+    except OSError:
+        return None
+    return ('"%x-%x"' % (st.st_mtime_ns, st.st_size), email.utils.formatdate(st.st_mtime, usegmt=True))
+
+
+#Class that serves the files of the current directory
+class NotifyHandler(SimpleHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    max_wait = 60
+
+    def unchanged(self, path):
+        current = validators(path)
+        if current is None:
+            return False
+        etag, last_modified = current
+        if_none_match = self.headers.get("If-None-Match")
+        if if_none_match is not None:
+            return etag in [i.strip() for i in if_none_match.split(",")]
+        if_modified_since = self.headers.get("If-Modified-Since")
+        if if_modified_since is not None:
+            since = email.utils.parsedate_to_datetime(if_modified_since)
+            return int(os.stat(path).st_mtime) <= since.timestamp()
+        return False
+
+    def wait_time(self):
+        for pref in self.headers.get("Prefer", "").split(","):
+            name, _, value = pref.strip().partition("=")
+            if name.lower() == "wait" and value.isdigit():
+                return min(int(value), self.max_wait)
+        return 0
+
+    def do_GET(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            self.send_error(404, "File not found")
+            return
+
+        # Hold the request of a device that has the current file
+        deadline = time.monotonic() + self.wait_time()
+        while self.unchanged(path) and time.monotonic() < deadline:
+            time.sleep(POLL_INTERVAL_SECS)
+
+        etag, last_modified = validators(path)
+        if self.unchanged(path):
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Last-Modified", last_modified)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        with open(path, 'rb') as fd:
+            data = fd.read()
+
+        status, start, end = 200, 0, len(data)
+        byte_range = self.headers.get("Range", "")
+        if byte_range.startswith("bytes=") and len(data) > 0:
+            first, _, last = byte_range[len("bytes="):].partition("-")
+            if first.isdigit() and int(first) < len(data):
+                start = int(first)
+                end = min(int(last) + 1, len(data)) if last.isdigit() else len(data)
+                status = 206
+
+        self.send_response(status)
+        self.send_header("Content-Type", self.guess_type(path))
+        self.send_header("Content-Length", str(end - start))
+        self.send_header("ETag", etag)
+        self.send_header("Last-Modified", last_modified)
+        self.send_header("Accept-Ranges", "bytes")
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end - 1, len(data)))
+        self.end_headers()
+        self.wfile.write(data[start:end])
+
+    # Result of an update (CY_OTA_HTTP_RESULT_JSON), only logged
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", "0")))
+        self.log_message("Result %s", body.decode("utf-8", "replace"))
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+
+#Main function. Execution starts here
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(description="OTA job and image server with long-poll notification")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--cert", help="server certificate, enables HTTPS")
+    parser.add_argument("--key", help="server private key")
+    parser.add_argument("--ca", help="CA certificate, requires a client certificate signed by it")
+    parser.add_argument("--dir", default=".", help="directory to serve")
+    parser.add_argument("--max-wait", type=int, default=120, help="longest time a request is held")
+    args = parser.parse_args()
+
+    os.chdir(args.dir)
+    NotifyHandler.max_wait = args.max_wait
+    server = ThreadingHTTPServer(("", args.port), NotifyHandler)
+
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+        if args.ca:
+            context.load_verify_locations(args.ca)
+            context.verify_mode = ssl.CERT_REQUIRED
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+
+    print("Serving %s on port %d (%s)" % (os.path.abspath("."), args.port, "HTTPS" if args.cert else "HTTP"))
+    server.serve_forever()
@@ -0,0 +1,390 @@
+/******************************************************************************
+* File Name: app_log.c
+*
+* Description: This file contains the asynchronous log of the application. Messages
+* are queued in a lock-free ring buffer, from tasks or interrupts, and
+* written to the debug UART by a low priority task, off the download path.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "cyhal.h"
+#include "cybsp.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+#include "app_log.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Ring buffer size, a power of 2 */
+#define LOG_RING_SIZE                       (APP_LOG_BUFFER_SIZE)
+#define LOG_RING_MASK                       (LOG_RING_SIZE - 1u)
+
+/* Longest message formatted by app_log_printf(), on the stack of the caller */
+#define LOG_MSG_MAX                         (160u)
+
+/*
+ * Each message is a record of a 32-bit header followed by the text, padded to
+ * a multiple of 4 bytes. Records do not wrap, the end of the ring is skipped
+ * with a pad record. A header reads 0 until its record is complete.
+ */
+#define LOG_HDR_SIZE                        (sizeof(uint32_t))
+#define LOG_HDR_COMMITTED                   (0x80000000UL)
+#define LOG_HDR_PAD                         (0x40000000UL)
+#define LOG_HDR_LEN_MASK                    (0x0000FFFFUL)
+#define LOG_RECORD_SIZE(len)                (LOG_HDR_SIZE + ((((uint32_t)(len)) + 3u) & ~3u))
+
+/* Drain task */
+#define LOG_TASK_STACK_SIZE                 (1024)
+#define LOG_TASK_PRIORITY                   (tskIDLE_PRIORITY + 1)
+#define LOG_DRAIN_INTERVAL_MS               (20)
+
+#if ((LOG_RING_SIZE & LOG_RING_MASK) != 0)
+#error "APP_LOG_BUFFER_SIZE must be a power of 2"
+#endif
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Messages not written to the UART yet, word aligned for the record headers */
+static uint32_t log_ring[LOG_RING_SIZE / sizeof(uint32_t)];
+
+/* Free running byte positions: head is claimed by the producers, tail is
+ * moved by the drain task once a record is written out */
+static atomic_uint_fast32_t log_head;
+static atomic_uint_fast32_t log_tail;
+
+/* Messages lost to a full ring */
+static atomic_uint_fast32_t log_dropped;
+
+/* Messages above this level are filtered out */
+static volatile CY_LOG_LEVEL_T log_level = APP_LOG_LEVEL;
+
+/*******************************************************************************
+ * Function Name: log_header
+ *******************************************************************************
+ * Summary:
+ *  Header of the record at a byte position of the ring.
+ *
+ *******************************************************************************/
+static inline volatile uint32_t *log_header(uint32_t pos)
+{
+    return (volatile uint32_t *)&log_ring[(pos & LOG_RING_MASK) / sizeof(uint32_t)];
+}
+
+/*******************************************************************************
+ * Function Name: app_log_write
+ *******************************************************************************
+ * Summary:
+ *  Queues a message for the UART without blocking. Safe from any task and
+ *  from interrupts: space is claimed with a compare-and-swap of the head, so
+ *  concurrent writers fill separate records.
+ *
+ * Parameters:
+ *  const char *msg : Message
+ *  uint32_t len : Length of the message
+ *
+ * Return:
+ *  bool : true if queued, false if the ring is full and the message was dropped.
+ *
+ *******************************************************************************/
+bool app_log_write(const char *msg, uint32_t len)
+{
+    uint_fast32_t head;
+    uint32_t pos;
+    uint32_t pad;
+    uint32_t size;
+
+    if (len > LOG_HDR_LEN_MASK)
+    {
+        len = LOG_HDR_LEN_MASK;
+    }
+    size = LOG_RECORD_SIZE(len);
+
+    head = atomic_load_explicit(&log_head, memory_order_relaxed);
+    do
+    {
+        pos = (uint32_t)head & LOG_RING_MASK;
+        pad = ((pos + size) > LOG_RING_SIZE) ? (LOG_RING_SIZE - pos) : 0u;
+
+        if ((((uint32_t)head + pad + size) - (uint32_t)atomic_load_explicit(&log_tail, memory_order_acquire)) > LOG_RING_SIZE)
+        {
+            atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&log_head, &head, head + pad + size,
+                                                    memory_order_acquire, memory_order_relaxed));
+
+    if (pad != 0u)
+    {
+        *log_header(head) = LOG_HDR_COMMITTED | LOG_HDR_PAD | pad;
+        head += pad;
+    }
+
+    memcpy((uint8_t *)log_ring + (((uint32_t)head & LOG_RING_MASK) + LOG_HDR_SIZE), msg, len);
+
+    /* Publish the text before the header that marks it complete */
+    atomic_thread_fence(memory_order_release);
+    *log_header(head) = LOG_HDR_COMMITTED | len;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: app_log_printf
+ *******************************************************************************
+ * Summary:
+ *  Formats a message on the stack of the caller and queues it, if its level
+ *  passes the filter. Long messages are truncated to LOG_MSG_MAX bytes.
+ *
+ * Parameters:
+ *  CY_LOG_LEVEL_T level : Severity of the message
+ *  const char *fmt : printf() format
+ *
+ *******************************************************************************/
+void app_log_printf(CY_LOG_LEVEL_T level, const char *fmt, ...)
+{
+    char msg[LOG_MSG_MAX];
+    va_list args;
+    int len;
+
+    if ((level > log_level) || (level == CY_LOG_OFF))
+    {
+        return;
+    }
+
+    va_start(args, fmt);
+    len = vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+
+    if (len > 0)
+    {
+        (void)app_log_write(msg, ((uint32_t)len < sizeof(msg)) ? (uint32_t)len : (sizeof(msg) - 1u));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: app_log_text
+ *******************************************************************************
+ * Summary:
+ *  Queues a text as it is, without the LOG_MSG_MAX limit of app_log_printf(),
+ *  if its level passes the filter.
+ *
+ * Parameters:
+ *  CY_LOG_LEVEL_T level : Severity of the text
+ *  const char *text : Text
+ *  uint32_t len : Length of the text
+ *
+ *******************************************************************************/
+void app_log_text(CY_LOG_LEVEL_T level, const char *text, uint32_t len)
+{
+    if ((level > log_level) || (level == CY_LOG_OFF))
+    {
+        return;
+    }
+
+    (void)app_log_write(text, len);
+}
+
+/*******************************************************************************
+ * Function Name: app_log_progress
+ *******************************************************************************
+ * Summary:
+ *  Rate limit for progress messages: tells whether a percentage is worth a
+ *  message, once per APP_LOG_PROGRESS_STEP percent and at 100%.
+ *
+ * Parameters:
+ *  uint32_t *last_step : Step of the last message, UINT32_MAX before the first one
+ *  uint32_t percentage : Progress
+ *
+ * Return:
+ *  bool : true to log the progress.
+ *
+ *******************************************************************************/
+bool app_log_progress(uint32_t *last_step, uint32_t percentage)
+{
+    uint32_t step = percentage / APP_LOG_PROGRESS_STEP;
+
+    if ((*last_step != UINT32_MAX) && (step == *last_step) && (percentage < 100u))
+    {
+        return false;
+    }
+
+    *last_step = step;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: app_log_set_level
+ *******************************************************************************
+ * Summary:
+ *  Sets the severity filter of the application and of the middleware logs.
+ *
+ * Parameters:
+ *  CY_LOG_LEVEL_T level : Most verbose level written
+ *
+ *******************************************************************************/
+void app_log_set_level(CY_LOG_LEVEL_T level)
+{
+    log_level = level;
+    (void)cy_log_set_all_levels(level);
+}
+
+/*******************************************************************************
+ * Function Name: log_cy_log_output
+ *******************************************************************************
+ * Summary:
+ *  Output of cy_log, the middleware messages go through the same ring.
+ *
+ *******************************************************************************/
+static int log_cy_log_output(CY_LOG_FACILITY_T facility, CY_LOG_LEVEL_T level, char *logmsg)
+{
+    (void)facility;
+    (void)level;
+
+    return app_log_write(logmsg, strlen(logmsg)) ? 1 : 0;
+}
+
+/*******************************************************************************
+ * Function Name: log_get_time
+ *******************************************************************************
+ * Summary:
+ *  Time stamp of the cy_log messages, milliseconds since the scheduler start.
+ *
+ *******************************************************************************/
+static cy_rslt_t log_get_time(uint32_t *time)
+{
+    *time = (uint32_t)pdTICKS_TO_MS(xTaskGetTickCount());
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: log_task
+ *******************************************************************************
+ * Summary:
+ *  Writes the queued messages to the UART, in order. Runs just above idle so
+ *  that the blocking UART output never delays the download.
+ *
+ * Parameters:
+ *  void *args : Unused
+ *
+ *******************************************************************************/
+static void log_task(void *args)
+{
+    uint_fast32_t tail;
+    uint32_t header;
+    uint32_t len;
+    uint32_t size;
+    uint32_t dropped;
+
+    (void)args;
+
+    for (;;)
+    {
+        tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+
+        while (tail != atomic_load_explicit(&log_head, memory_order_acquire))
+        {
+            header = *log_header(tail);
+            if ((header & LOG_HDR_COMMITTED) == 0u)
+            {
+                /* Its writer was preempted before finishing, come back later */
+                break;
+            }
+            atomic_thread_fence(memory_order_acquire);
+
+            len = header & LOG_HDR_LEN_MASK;
+            if ((header & LOG_HDR_PAD) != 0u)
+            {
+                size = len;
+            }
+            else
+            {
+                size = LOG_RECORD_SIZE(len);
+                fwrite((uint8_t *)log_ring + (((uint32_t)tail & LOG_RING_MASK) + LOG_HDR_SIZE), 1, len, stdout);
+            }
+
+            /* Any word of the record can be the header of a later one */
+            memset((uint8_t *)log_ring + ((uint32_t)tail & LOG_RING_MASK), 0, size);
+            tail += size;
+            atomic_store_explicit(&log_tail, tail, memory_order_release);
+        }
+
+        dropped = (uint32_t)atomic_exchange_explicit(&log_dropped, 0, memory_order_relaxed);
+        if (dropped != 0u)
+        {
+            printf("\n[%lu log messages dropped]\n", (unsigned long)dropped);
+        }
+        fflush(stdout);
+
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: app_log_init
+ *******************************************************************************
+ * Summary:
+ *  Starts the drain task and routes cy_log, with the APP_LOG_LEVEL filter,
+ *  to the ring. Messages queued before are kept.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t app_log_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_log_init(APP_LOG_LEVEL, log_cy_log_output, log_get_time);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    if (pdPASS != xTaskCreate(log_task, "LOG TASK", LOG_TASK_STACK_SIZE, NULL, LOG_TASK_PRIORITY, NULL))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
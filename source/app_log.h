@@ -0,0 +1,66 @@
+/******************************************************************************
+* File Name: app_log.h
+*
+* Description: This file contains declaration of the asynchronous, ring buffered
+* application log.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_APP_LOG_H_
+#define SOURCE_APP_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_log.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#define APP_LOG_ERR(...)                    app_log_printf(CY_LOG_ERR, __VA_ARGS__)
+#define APP_LOG_WARNING(...)                app_log_printf(CY_LOG_WARNING, __VA_ARGS__)
+#define APP_LOG_INFO(...)                   app_log_printf(CY_LOG_INFO, __VA_ARGS__)
+#define APP_LOG_DEBUG(...)                  app_log_printf(CY_LOG_DEBUG, __VA_ARGS__)
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t app_log_init(void);
+void app_log_set_level(CY_LOG_LEVEL_T level);
+void app_log_printf(CY_LOG_LEVEL_T level, const char *fmt, ...);
+void app_log_text(CY_LOG_LEVEL_T level, const char *text, uint32_t len);
+bool app_log_write(const char *msg, uint32_t len);
+bool app_log_progress(uint32_t *last_step, uint32_t percentage);
+
+#endif /* SOURCE_APP_LOG_H_ */
@@ -0,0 +1,175 @@
+/******************************************************************************
+* File Name: cm7_cache.c
+*
+* Description: This file contains the CM7 cache configuration. With CM7_CACHE=1
+* the instruction and data caches are enabled and the MPU maps the
+* NOCACHE region of the linker script, which holds the Ethernet DMA
+* descriptors and buffers and the memory shared with the CM0+,
+* non-cacheable. Otherwise both caches are disabled.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include "cy_pdl.h"
+#include "cm7_cache.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Smallest region the MPU maps */
+#define CM7_CACHE_MPU_MIN_SIZE              (32u)
+
+/* Bounds of the NOCACHE region, exported by the linker script */
+#if defined(__ARMCC_VERSION)
+extern uint8_t Image$$RW_NOCACHE$$Base[];
+extern uint8_t Image$$RW_NOCACHE_END$$ZI$$Limit[];
+#define CM7_NOCACHE_START                   ((uint32_t)Image$$RW_NOCACHE$$Base)
+#define CM7_NOCACHE_END                     ((uint32_t)Image$$RW_NOCACHE_END$$ZI$$Limit)
+#elif defined(__ICCARM__)
+#pragma section = "NOCACHE"
+#define CM7_NOCACHE_START                   ((uint32_t)__section_begin("NOCACHE"))
+#define CM7_NOCACHE_END                     ((uint32_t)__section_end("NOCACHE"))
+#else
+extern uint8_t __nocache_start__[];
+extern uint8_t __nocache_end__[];
+#define CM7_NOCACHE_START                   ((uint32_t)__nocache_start__)
+#define CM7_NOCACHE_END                     ((uint32_t)__nocache_end__)
+#endif /* #if defined(__ARMCC_VERSION) */
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static bool cm7_dcache_enabled = false;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+#if defined(CM7_CACHE)
+static bool cm7_cache_map_nocache(void);
+#endif
+
+/*******************************************************************************
+ * Function Name: cm7_cache_init
+ *******************************************************************************
+ * Summary:
+ *  Configures the CM7 caches. Called once from main(), before the Ethernet
+ *  interface is started.
+ *
+ *  With CM7_CACHE=1 the NOCACHE region is mapped non-cacheable and both
+ *  caches are enabled. The data cache stays disabled if the region can not
+ *  be mapped by the MPU. Without CM7_CACHE both caches are disabled, the
+ *  data cache is cleaned and invalidated first.
+ *
+ *******************************************************************************/
+void cm7_cache_init(void)
+{
+#if defined(CM7_CACHE)
+    /* Start from clean caches, the MPU attributes only apply to new lines */
+    SCB_DisableDCache();
+    SCB_EnableICache();
+
+    if (cm7_cache_map_nocache())
+    {
+        SCB_EnableDCache();
+        cm7_dcache_enabled = true;
+    }
+    else
+    {
+        printf("CM7 data cache left disabled: NOCACHE region 0x%08lx - 0x%08lx can not be mapped by the MPU\n",
+                (unsigned long)CM7_NOCACHE_START, (unsigned long)CM7_NOCACHE_END);
+    }
+#else
+    /* Disables and invalidate instruction cache and disable, clean and invalidate data cache for XMC7200 */
+    SCB_DisableICache();
+    SCB_DisableDCache();
+#endif /* #if defined(CM7_CACHE) */
+}
+
+/*******************************************************************************
+ * Function Name: cm7_cache_enabled
+ *******************************************************************************
+ * Summary:
+ *  Whether cm7_cache_init() enabled the data cache.
+ *
+ * Return:
+ *  bool : true if the data cache is enabled
+ *
+ *******************************************************************************/
+bool cm7_cache_enabled(void)
+{
+    return cm7_dcache_enabled;
+}
+
+#if defined(CM7_CACHE)
+/*******************************************************************************
+ * Function Name: cm7_cache_map_nocache
+ *******************************************************************************
+ * Summary:
+ *  Maps the NOCACHE region as normal, non-cacheable, shareable memory with
+ *  the highest numbered MPU region, which takes priority over any other
+ *  region covering it. The rest of the memory map keeps its default
+ *  attributes (PRIVDEFENA).
+ *
+ * Return:
+ *  bool : false if the region is not a power of two in size, aligned on its
+ *         size, as the linker scripts define it
+ *
+ *******************************************************************************/
+static bool cm7_cache_map_nocache(void)
+{
+    uint32_t start = CM7_NOCACHE_START;
+    uint32_t size = CM7_NOCACHE_END - start;
+    uint32_t regions = (MPU->TYPE & MPU_TYPE_DREGION_Msk) >> MPU_TYPE_DREGION_Pos;
+    uint32_t size_field;
+
+    if ((regions == 0u) || (size < CM7_CACHE_MPU_MIN_SIZE) || ((size & (size - 1u)) != 0u) ||
+        ((start & (size - 1u)) != 0u))
+    {
+        return false;
+    }
+
+    /* The MPU region size is 2^(SIZE + 1) bytes */
+    size_field = (31u - __CLZ(size)) - 1u;
+
+    ARM_MPU_Disable();
+    ARM_MPU_SetRegion(ARM_MPU_RBAR(regions - 1u, start),
+                      ARM_MPU_RASR(1u, ARM_MPU_AP_FULL, 1u, 1u, 0u, 0u, 0u, size_field));
+    ARM_MPU_Enable(MPU_CTRL_PRIVDEFENA_Msk);
+
+    return true;
+}
+#endif /* #if defined(CM7_CACHE) */
+
+/* [] END OF FILE */
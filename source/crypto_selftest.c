@@ -0,0 +1,327 @@
+/******************************************************************************
+* File Name: crypto_selftest.c
+*
+* Description: This file contains the known-answer self test and the benchmark of
+* the mbedTLS hash and cipher used by OTA, with the NIST vectors.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdbool.h>
+#include <string.h>
+#include "cy_result.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+/* mbedTLS */
+#include "mbedtls/sha256.h"
+#include "mbedtls/aes.h"
+#include "mbedtls/gcm.h"
+/* Asynchronous log */
+#include "app_log.h"
+#include "crypto_selftest.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Data processed by each benchmark */
+#define BENCHMARK_BUFFER_SIZE               (4096)
+#define BENCHMARK_ROUNDS                    (64)
+
+#if defined(COMPONENT_HW_CRYPTO)
+#define CRYPTO_BACKEND_NAME                 "crypto block"
+#else
+#define CRYPTO_BACKEND_NAME                 "software"
+#endif
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* FIPS 180-2, appendix B.1 and B.2 */
+static const char sha256_msg_1[] = "abc";
+static const uint8_t sha256_digest_1[32] =
+{
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+};
+static const char sha256_msg_2[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+static const uint8_t sha256_digest_2[32] =
+{
+    0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+    0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+};
+
+/* FIPS 197, appendix C.1 and C.3 */
+static const uint8_t aes_key[32] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+};
+static const uint8_t aes_plain[16] =
+{
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+static const uint8_t aes_128_cipher[16] =
+{
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+};
+static const uint8_t aes_256_cipher[16] =
+{
+    0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89
+};
+
+/* NIST SP 800-38A, F.2.1 CBC-AES128.Encrypt, first block */
+static const uint8_t cbc_key[16] =
+{
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t cbc_iv[16] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const uint8_t cbc_plain[16] =
+{
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a
+};
+static const uint8_t cbc_cipher[16] =
+{
+    0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d
+};
+
+/* GCM specification (McGrew and Viega), test case 2: zero key, IV and plain text */
+static const uint8_t gcm_cipher[16] =
+{
+    0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78
+};
+static const uint8_t gcm_tag[16] =
+{
+    0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd, 0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf
+};
+
+/* Benchmark data, not on the stack */
+static uint8_t benchmark_buffer[BENCHMARK_BUFFER_SIZE];
+
+/*******************************************************************************
+ * Function Name: selftest_sha256
+ *******************************************************************************
+ * Summary:
+ *  Checks SHA-256 against the FIPS 180-2 vectors, the second one fed in two
+ *  updates.
+ *
+ * Return:
+ *  bool : true if all digests match.
+ *
+ *******************************************************************************/
+static bool selftest_sha256(void)
+{
+    mbedtls_sha256_context ctx;
+    uint8_t digest[32];
+    bool pass;
+
+    pass = (mbedtls_sha256((const uint8_t *)sha256_msg_1, strlen(sha256_msg_1), digest, 0) == 0) &&
+           (memcmp(digest, sha256_digest_1, sizeof(digest)) == 0);
+
+    mbedtls_sha256_init(&ctx);
+    pass = pass && (mbedtls_sha256_starts(&ctx, 0) == 0) &&
+           (mbedtls_sha256_update(&ctx, (const uint8_t *)sha256_msg_2, 13) == 0) &&
+           (mbedtls_sha256_update(&ctx, (const uint8_t *)&sha256_msg_2[13], strlen(sha256_msg_2) - 13) == 0) &&
+           (mbedtls_sha256_finish(&ctx, digest) == 0) &&
+           (memcmp(digest, sha256_digest_2, sizeof(digest)) == 0);
+    mbedtls_sha256_free(&ctx);
+
+    return pass;
+}
+
+/*******************************************************************************
+ * Function Name: selftest_aes
+ *******************************************************************************
+ * Summary:
+ *  Checks AES-128/AES-256 ECB against FIPS 197 and AES-128 CBC against
+ *  SP 800-38A, in both directions.
+ *
+ * Return:
+ *  bool : true if all blocks match.
+ *
+ *******************************************************************************/
+static bool selftest_aes(void)
+{
+    mbedtls_aes_context ctx;
+    uint8_t block[16];
+    uint8_t iv[16];
+    bool pass;
+
+    mbedtls_aes_init(&ctx);
+
+    pass = (mbedtls_aes_setkey_enc(&ctx, aes_key, 128) == 0) &&
+           (mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, aes_plain, block) == 0) &&
+           (memcmp(block, aes_128_cipher, sizeof(block)) == 0);
+
+    pass = pass && (mbedtls_aes_setkey_dec(&ctx, aes_key, 128) == 0) &&
+           (mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_DECRYPT, aes_128_cipher, block) == 0) &&
+           (memcmp(block, aes_plain, sizeof(block)) == 0);
+
+    pass = pass && (mbedtls_aes_setkey_enc(&ctx, aes_key, 256) == 0) &&
+           (mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, aes_plain, block) == 0) &&
+           (memcmp(block, aes_256_cipher, sizeof(block)) == 0);
+
+    memcpy(iv, cbc_iv, sizeof(iv));
+    pass = pass && (mbedtls_aes_setkey_enc(&ctx, cbc_key, 128) == 0) &&
+           (mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, sizeof(block), iv, cbc_plain, block) == 0) &&
+           (memcmp(block, cbc_cipher, sizeof(block)) == 0) &&
+           (memcmp(iv, cbc_cipher, sizeof(iv)) == 0);
+
+    memcpy(iv, cbc_iv, sizeof(iv));
+    pass = pass && (mbedtls_aes_setkey_dec(&ctx, cbc_key, 128) == 0) &&
+           (mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_DECRYPT, sizeof(block), iv, cbc_cipher, block) == 0) &&
+           (memcmp(block, cbc_plain, sizeof(block)) == 0);
+
+    mbedtls_aes_free(&ctx);
+
+    return pass;
+}
+
+/*******************************************************************************
+ * Function Name: selftest_gcm
+ *******************************************************************************
+ * Summary:
+ *  Checks AES-128 GCM, the cipher of the TLS records, against test case 2
+ *  of the GCM specification.
+ *
+ * Return:
+ *  bool : true if the cipher text and the tag match.
+ *
+ *******************************************************************************/
+static bool selftest_gcm(void)
+{
+    mbedtls_gcm_context ctx;
+    uint8_t zero[16];
+    uint8_t block[16];
+    uint8_t tag[16];
+    bool pass;
+
+    memset(zero, 0, sizeof(zero));
+    mbedtls_gcm_init(&ctx);
+
+    pass = (mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, zero, 128) == 0) &&
+           (mbedtls_gcm_crypt_and_tag(&ctx, MBEDTLS_GCM_ENCRYPT, sizeof(block), zero, 12, NULL, 0,
+                                      zero, block, sizeof(tag), tag) == 0) &&
+           (memcmp(block, gcm_cipher, sizeof(block)) == 0) &&
+           (memcmp(tag, gcm_tag, sizeof(tag)) == 0);
+
+    mbedtls_gcm_free(&ctx);
+
+    return pass;
+}
+
+/*******************************************************************************
+ * Function Name: crypto_selftest
+ *******************************************************************************
+ * Summary:
+ *  Known-answer tests of the SHA-256 and AES used for the TLS records and the
+ *  image hash, whichever implementation (crypto block or software) is built.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if all vectors match, else CY_RSLT_TYPE_ERROR.
+ *
+ *******************************************************************************/
+cy_rslt_t crypto_selftest(void)
+{
+    bool sha256_pass = selftest_sha256();
+    bool aes_pass = selftest_aes();
+    bool gcm_pass = selftest_gcm();
+
+    APP_LOG_INFO("Crypto self test (%s): SHA-256 %s, AES %s, AES-GCM %s\n", CRYPTO_BACKEND_NAME,
+                 sha256_pass ? "PASS" : "FAIL", aes_pass ? "PASS" : "FAIL", gcm_pass ? "PASS" : "FAIL");
+
+    return (sha256_pass && aes_pass && gcm_pass) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/*******************************************************************************
+ * Function Name: crypto_benchmark
+ *******************************************************************************
+ * Summary:
+ *  Prints the SHA-256 and AES-128 GCM throughput of the implementation that
+ *  is built. Build once with HW_CRYPTO=1 and once with HW_CRYPTO=0 in the
+ *  Makefile to compare the crypto block against software.
+ *
+ *******************************************************************************/
+void crypto_benchmark(void)
+{
+    mbedtls_sha256_context sha_ctx;
+    mbedtls_gcm_context gcm_ctx;
+    uint8_t digest[32];
+    uint8_t iv[12];
+    uint8_t tag[16];
+    TickType_t start;
+    TickType_t sha_ticks;
+    TickType_t gcm_ticks;
+    uint32_t sha_ms;
+    uint32_t gcm_ms;
+    uint32_t total = BENCHMARK_BUFFER_SIZE * BENCHMARK_ROUNDS;
+
+    memset(benchmark_buffer, 0xA5, sizeof(benchmark_buffer));
+    memset(iv, 0, sizeof(iv));
+
+    mbedtls_sha256_init(&sha_ctx);
+    start = xTaskGetTickCount();
+    mbedtls_sha256_starts(&sha_ctx, 0);
+    for (uint32_t i = 0; i < BENCHMARK_ROUNDS; i++)
+    {
+        mbedtls_sha256_update(&sha_ctx, benchmark_buffer, sizeof(benchmark_buffer));
+    }
+    mbedtls_sha256_finish(&sha_ctx, digest);
+    sha_ticks = xTaskGetTickCount() - start;
+    mbedtls_sha256_free(&sha_ctx);
+
+    mbedtls_gcm_init(&gcm_ctx);
+    mbedtls_gcm_setkey(&gcm_ctx, MBEDTLS_CIPHER_ID_AES, aes_key, 128);
+    start = xTaskGetTickCount();
+    for (uint32_t i = 0; i < BENCHMARK_ROUNDS; i++)
+    {
+        /* In place, like the record layer */
+        mbedtls_gcm_crypt_and_tag(&gcm_ctx, MBEDTLS_GCM_DECRYPT, sizeof(benchmark_buffer), iv, sizeof(iv),
+                                  NULL, 0, benchmark_buffer, benchmark_buffer, sizeof(tag), tag);
+    }
+    gcm_ticks = xTaskGetTickCount() - start;
+    mbedtls_gcm_free(&gcm_ctx);
+
+    sha_ms = (pdTICKS_TO_MS(sha_ticks) > 0) ? pdTICKS_TO_MS(sha_ticks) : 1;
+    gcm_ms = (pdTICKS_TO_MS(gcm_ticks) > 0) ? pdTICKS_TO_MS(gcm_ticks) : 1;
+
+    APP_LOG_INFO("Crypto benchmark (%s), %lu KB each:\n", CRYPTO_BACKEND_NAME, (unsigned long)(total / 1024));
+    APP_LOG_INFO("  SHA-256     : %lu ms, %lu KB/s\n", (unsigned long)sha_ms,
+                 (unsigned long)((total / 1024) * 1000 / sha_ms));
+    APP_LOG_INFO("  AES-128-GCM : %lu ms, %lu KB/s\n", (unsigned long)gcm_ms,
+                 (unsigned long)((total / 1024) * 1000 / gcm_ms));
+}
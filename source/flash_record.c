@@ -0,0 +1,467 @@
+/******************************************************************************
+* File Name: flash_record.c
+*
+* Description: This file contains the small records kept in the code flash
+* sector reserved by FLASH_RECORD_FLASH_OFFSET: the network cache and the
+* resume point of a range download. Each record takes a flash row, written
+* to the next erased row of the sector, and the sector is erased only once
+* it is full.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdbool.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* OTA flash access */
+#include "cy_ota_flash.h"
+/* Asynchronous log */
+#include "app_log.h"
+#include "flash_record.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* The sector is placed next to the slots generated from the flashmap */
+#if defined(FLASH_RECORD_FLASH_OFFSET) && defined(FLASH_AREA_IMG_1_SECONDARY_START)
+#define FLASH_RECORD                        (1)
+#else
+#define FLASH_RECORD                        (0)
+#endif
+
+#define FLASH_RECORD_MAGIC                  (0x43455246UL)   /* "FREC" */
+
+/* Erase size of the code flash sector holding the records */
+#define FLASH_RECORD_SECTOR_SIZE            (0x8000U)
+
+/* One record per flash row */
+#define FLASH_RECORD_ROW_SIZE               (512u)
+#define FLASH_RECORD_ROWS                   (FLASH_RECORD_SECTOR_SIZE / FLASH_RECORD_ROW_SIZE)
+
+/* Value read back from an erased code flash location */
+#define FLASH_RECORD_ERASED                 (0xFFFFFFFFUL)
+
+/* Tags kept when the full sector is erased, see flash_record.h */
+#define FLASH_RECORD_MAX_TAGS               (2u)
+
+#if (FLASH_RECORD == 1)
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+/* One flash row */
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    tag;                    /* FLASH_RECORD_TAG_* */
+    uint32_t    len;                    /* Bytes of data, 0 once erased */
+    uint32_t    checksum;               /* FNV-1a of tag, len and data */
+    uint8_t     data[FLASH_RECORD_DATA_SIZE];
+} flash_record_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Row being read or written, and the records kept through an erase of the sector */
+static CY_ALIGN(4) flash_record_t flash_record_row;
+static CY_ALIGN(4) flash_record_t flash_record_kept[FLASH_RECORD_MAX_TAGS];
+
+/* The records are read and written by the OTA task and the range workers */
+static SemaphoreHandle_t flash_record_lock;
+static StaticSemaphore_t flash_record_lock_struct;
+
+/*******************************************************************************
+ * Function Name: flash_record_checksum
+ *******************************************************************************
+ * Summary:
+ *  FNV-1a hash of the tag, the length and the data of a record.
+ *
+ *******************************************************************************/
+static uint32_t flash_record_checksum(const flash_record_t *record)
+{
+    const uint8_t *byte = (const uint8_t *)&record->tag;
+    uint32_t hash = 0x811C9DC5UL;
+    uint32_t i;
+
+    for (i = 0; i < (2 * sizeof(uint32_t)); i++)
+    {
+        hash = (hash ^ byte[i]) * 0x01000193UL;
+    }
+    for (i = 0; (i < record->len) && (i < FLASH_RECORD_DATA_SIZE); i++)
+    {
+        hash = (hash ^ record->data[i]) * 0x01000193UL;
+    }
+
+    return hash;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_lock_take
+ *******************************************************************************
+ * Summary:
+ *  Takes the lock of the sector, created on first use.
+ *
+ *******************************************************************************/
+static void flash_record_lock_take(void)
+{
+    taskENTER_CRITICAL();
+    if (flash_record_lock == NULL)
+    {
+        flash_record_lock = xSemaphoreCreateMutexStatic(&flash_record_lock_struct);
+    }
+    taskEXIT_CRITICAL();
+
+    xSemaphoreTake(flash_record_lock, portMAX_DELAY);
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_is_erased
+ *******************************************************************************
+ * Summary:
+ *  Tells whether the row read into flash_record_row is erased.
+ *
+ *******************************************************************************/
+static bool flash_record_is_erased(void)
+{
+    const uint32_t *word = (const uint32_t *)&flash_record_row;
+    uint32_t i;
+
+    for (i = 0; i < (sizeof(flash_record_row) / sizeof(uint32_t)); i++)
+    {
+        if (word[i] != FLASH_RECORD_ERASED)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_load
+ *******************************************************************************
+ * Summary:
+ *  Reads a row of the sector into flash_record_row.
+ *
+ * Return:
+ *  bool : true if the row holds a valid record.
+ *
+ *******************************************************************************/
+static bool flash_record_load(uint32_t row)
+{
+    if (CY_RSLT_SUCCESS != cy_ota_mem_read(CY_OTA_MEM_TYPE_INTERNAL_FLASH,
+                                           FLASH_RECORD_FLASH_OFFSET + (row * FLASH_RECORD_ROW_SIZE),
+                                           &flash_record_row, sizeof(flash_record_row)))
+    {
+        return false;
+    }
+
+    return (flash_record_row.magic == FLASH_RECORD_MAGIC) && (flash_record_row.len <= FLASH_RECORD_DATA_SIZE) &&
+           (flash_record_row.checksum == flash_record_checksum(&flash_record_row));
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_scan
+ *******************************************************************************
+ * Summary:
+ *  Finds the latest record of a tag, and the first erased row after the last
+ *  written one. A row that does not hold a valid record, such as one a reset
+ *  interrupted, is skipped.
+ *
+ * Parameters:
+ *  uint32_t tag : Tag of the record
+ *  uint32_t *latest : Row of the latest record of the tag, FLASH_RECORD_ROWS if none
+ *  uint32_t *free_row : First erased row, FLASH_RECORD_ROWS if the sector is full
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void flash_record_scan(uint32_t tag, uint32_t *latest, uint32_t *free_row)
+{
+    uint32_t row;
+
+    *latest = FLASH_RECORD_ROWS;
+    *free_row = 0;
+
+    for (row = 0; row < FLASH_RECORD_ROWS; row++)
+    {
+        if (flash_record_load(row))
+        {
+            if (flash_record_row.tag == tag)
+            {
+                *latest = row;
+            }
+        }
+        else if (flash_record_is_erased())
+        {
+            continue;
+        }
+        *free_row = row + 1;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_compact
+ *******************************************************************************
+ * Summary:
+ *  Erases the full sector and writes the latest record of the other tags
+ *  back at its start. A reset in between loses them, the network cache is
+ *  then rebuilt and the download starts over.
+ *
+ * Parameters:
+ *  uint32_t tag : Tag about to be written, not kept
+ *  uint32_t *free_row : First erased row after the kept records
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_record_compact(uint32_t tag, uint32_t *free_row)
+{
+    uint32_t found = 0;
+    uint32_t written = 0;
+    uint32_t row;
+    uint32_t i;
+
+    /* From the last row, the first record of a tag is the latest, an erased one included */
+    for (row = FLASH_RECORD_ROWS; (row > 0) && (found < FLASH_RECORD_MAX_TAGS); row--)
+    {
+        if (!flash_record_load(row - 1) || (flash_record_row.tag == tag))
+        {
+            continue;
+        }
+        for (i = 0; (i < found) && (flash_record_kept[i].tag != flash_record_row.tag); i++)
+        {
+        }
+        if (i == found)
+        {
+            memcpy(&flash_record_kept[found++], &flash_record_row, sizeof(flash_record_row));
+        }
+    }
+
+    if (CY_RSLT_SUCCESS != cy_ota_mem_erase(CY_OTA_MEM_TYPE_INTERNAL_FLASH, FLASH_RECORD_FLASH_OFFSET,
+                                            FLASH_RECORD_SECTOR_SIZE))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    for (i = 0; i < found; i++)
+    {
+        if (flash_record_kept[i].len == 0)
+        {
+            continue;
+        }
+        if (CY_RSLT_SUCCESS != cy_ota_mem_write(CY_OTA_MEM_TYPE_INTERNAL_FLASH,
+                                                FLASH_RECORD_FLASH_OFFSET + (written * FLASH_RECORD_ROW_SIZE),
+                                                &flash_record_kept[i], sizeof(flash_record_kept[i])))
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+        written++;
+    }
+
+    *free_row = written;
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_append
+ *******************************************************************************
+ * Summary:
+ *  Writes a record of a tag, unless the latest record of the tag holds the
+ *  same data. Called with the lock taken.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_record_append(uint32_t tag, const void *data, uint32_t len)
+{
+    uint32_t latest;
+    uint32_t free_row;
+
+    flash_record_scan(tag, &latest, &free_row);
+
+    /* Nothing to write, or nothing to erase */
+    if (((latest < FLASH_RECORD_ROWS) && flash_record_load(latest) && (flash_record_row.len == len) &&
+         ((len == 0) || (memcmp(flash_record_row.data, data, len) == 0))) ||
+        ((latest == FLASH_RECORD_ROWS) && (len == 0)))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if ((free_row == FLASH_RECORD_ROWS) && (CY_RSLT_SUCCESS != flash_record_compact(tag, &free_row)))
+    {
+        APP_LOG_ERR("Erasing the flash record sector failed\n");
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    memset(&flash_record_row, 0xFF, sizeof(flash_record_row));
+    flash_record_row.magic = FLASH_RECORD_MAGIC;
+    flash_record_row.tag = tag;
+    flash_record_row.len = len;
+    if (len > 0)
+    {
+        memcpy(flash_record_row.data, data, len);
+    }
+    flash_record_row.checksum = flash_record_checksum(&flash_record_row);
+
+    if (CY_RSLT_SUCCESS != cy_ota_mem_write(CY_OTA_MEM_TYPE_INTERNAL_FLASH,
+                                            FLASH_RECORD_FLASH_OFFSET + (free_row * FLASH_RECORD_ROW_SIZE),
+                                            &flash_record_row, sizeof(flash_record_row)))
+    {
+        APP_LOG_ERR("Writing the flash record %08lx failed\n", (unsigned long)tag);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+#endif /* FLASH_RECORD */
+
+/*******************************************************************************
+ * Function Name: flash_record_read
+ *******************************************************************************
+ * Summary:
+ *  Reads the latest record of a tag.
+ *
+ * Parameters:
+ *  uint32_t tag : Tag of the record, FLASH_RECORD_TAG_*
+ *  void *data : Receives the record
+ *  uint32_t len : Size of the record
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if a record of len bytes was found, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_record_read(uint32_t tag, void *data, uint32_t len)
+{
+#if (FLASH_RECORD == 1)
+    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+    uint32_t latest;
+    uint32_t free_row;
+
+    if ((len == 0) || (len > FLASH_RECORD_DATA_SIZE))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    flash_record_lock_take();
+    flash_record_scan(tag, &latest, &free_row);
+    if ((latest < FLASH_RECORD_ROWS) && flash_record_load(latest) && (flash_record_row.len == len))
+    {
+        memcpy(data, flash_record_row.data, len);
+        result = CY_RSLT_SUCCESS;
+    }
+    xSemaphoreGive(flash_record_lock);
+
+    return result;
+#else
+    (void)tag;
+    (void)data;
+    (void)len;
+    return CY_RSLT_TYPE_ERROR;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_write
+ *******************************************************************************
+ * Summary:
+ *  Writes a record of a tag, in place of the previous one. A record that did
+ *  not change is not written again.
+ *
+ * Parameters:
+ *  uint32_t tag : Tag of the record, FLASH_RECORD_TAG_*
+ *  const void *data : Record to write
+ *  uint32_t len : Size of the record, up to FLASH_RECORD_DATA_SIZE
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_record_write(uint32_t tag, const void *data, uint32_t len)
+{
+#if (FLASH_RECORD == 1)
+    cy_rslt_t result;
+
+    if ((len == 0) || (len > FLASH_RECORD_DATA_SIZE))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    flash_record_lock_take();
+    result = flash_record_append(tag, data, len);
+    xSemaphoreGive(flash_record_lock);
+
+    return result;
+#else
+    (void)tag;
+    (void)data;
+    (void)len;
+    return CY_RSLT_TYPE_ERROR;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_erase
+ *******************************************************************************
+ * Summary:
+ *  Drops the record of a tag, flash_record_read() does not find it anymore.
+ *
+ * Parameters:
+ *  uint32_t tag : Tag of the record, FLASH_RECORD_TAG_*
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_record_erase(uint32_t tag)
+{
+#if (FLASH_RECORD == 1)
+    cy_rslt_t result;
+
+    flash_record_lock_take();
+    result = flash_record_append(tag, NULL, 0);
+    xSemaphoreGive(flash_record_lock);
+
+    return result;
+#else
+    (void)tag;
+    return CY_RSLT_TYPE_ERROR;
+#endif
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+* File Name: flash_record.h
+*
+* Description: This file contains declaration of the small records kept in
+* the code flash sector reserved by FLASH_RECORD_FLASH_OFFSET.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_FLASH_RECORD_H_
+#define SOURCE_FLASH_RECORD_H_
+
+#include <stdint.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Records kept in the sector, at most one of each */
+#define FLASH_RECORD_TAG_NETWORK_CACHE      (0x4E455443UL)   /* "NETC", network_task.c */
+#define FLASH_RECORD_TAG_RANGE_RESUME       (0x52455355UL)   /* "RESU", ota_range_download.c */
+
+/* Most bytes of one record, a flash row less its header */
+#define FLASH_RECORD_DATA_SIZE              (496u)
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t flash_record_read(uint32_t tag, void *data, uint32_t len);
+cy_rslt_t flash_record_write(uint32_t tag, const void *data, uint32_t len);
+cy_rslt_t flash_record_erase(uint32_t tag);
+
+#endif /* SOURCE_FLASH_RECORD_H_ */
@@ -49,6 +49,9 @@
 #include "ota_task.h"
 #include "led_task.h"
 #include "cy_log.h"
+#include "app_log.h"
+#include "telemetry.h"
+#include "cm7_cache.h"
 
 /* FreeRTOS header file */
 #include <FreeRTOS.h>
@@ -116,9 +119,8 @@ int main(void)
         CY_ASSERT(0);
     }
 
-    /* Disables and invalidate instruction cache and disable, clean and invalidate data cache for XMC7200 */
-    SCB_DisableICache();
-    SCB_DisableDCache();
+    /* Enable (CM7_CACHE=1) or disable the CM7 instruction and data caches */
+    cm7_cache_init();
 
     /* Initialize the XMC7200 flash */
     Cy_Flash_Init();
@@ -130,7 +132,8 @@ int main(void)
     printf("\r===============================================================\n");
     printf("TEST Application: OTA Update version: %d.%d.%d\n",
             APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
-    printf("===============================================================\n\n");
+    printf("===============================================================\n");
+    printf("CM7 data cache: %s\n\n", cm7_cache_enabled() ? "enabled" : "disabled");
 
 #ifdef TEST_REVERT
     printf("===============================================================\n");
@@ -144,12 +147,29 @@ int main(void)
     cyhal_wdt_free(NULL);
     printf("\nWatchdog timer started by the bootloader is now turned off!!!\n\n");
 
+    /* Log through a ring buffer drained by a low priority task, so that the
+     * UART does not slow down the download */
+    if (CY_RSLT_SUCCESS != app_log_init())
+    {
+        printf("\nStarting the application log failed, logging is disabled.\n");
+    }
+
+    /* Task CPU, stack and heap usage, and the commands of the debug UART */
+    if (CY_RSLT_SUCCESS != telemetry_init())
+    {
+        printf("\nStarting the telemetry console failed.\n");
+    }
+
     /* Create the tasks */
     xTaskCreate(ota_task, "OTA TASK", OTA_TASK_STACK_SIZE, NULL,
                 OTA_TASK_PRIORITY, &ota_task_handle);
     xTaskCreate(led_task, "LED TASK", LED_TASK_STACK_SIZE, NULL,
                 LED_TASK_PRIORITY, &led_task_handle);
 
+    /* The LED task stands in for the deadlines of the application, see
+     * OTA_RATE_LIMIT_LATENCY_US */
+    telemetry_latency_watch(led_task_handle);
+
     /* Start the FreeRTOS scheduler. */
     vTaskStartScheduler();
 
@@ -0,0 +1,761 @@
+/******************************************************************************
+* File Name: network_task.c
+*
+* Description: This file contains the Ethernet bring-up, run by its own task while
+* the OTA task initializes the storage, and the DHCP lease and host name lookup
+* cached in flash for the next boot.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+/* Ethernet connection manager header files */
+#include "cy_ecm.h"
+#include "cy_ecm_error.h"
+/* Ethernet PHY driver */
+#include "cy_eth_phy_driver.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <event_groups.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* Network cache in flash */
+#include "flash_record.h"
+/* Asynchronous log */
+#include "app_log.h"
+/* Update phase and start up timing */
+#include "ota_timing.h"
+#include "network_task.h"
+#if defined(WRAP_GETHOSTBYNAME)
+#include "cy_secure_sockets.h"
+#endif
+#if defined(FAST_START) && (ENABLE_NETWORK_CACHE == true)
+/* DNS server of a static address setting */
+#include "lwip/dns.h"
+#include "lwip/tcpip.h"
+#endif
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* MAX connection retries to join Ethernet */
+#define MAX_CONNECTION_RETRIES              (10)
+
+/* Longest wait between connection retries, a link event retries at once */
+#define ETHERNET_CONN_RETRY_DELAY_MS        (500)
+
+/* Ethernet interface ID */
+#ifdef XMC7100D_F176K4160
+#define INTERFACE_ID                        CY_ECM_INTERFACE_ETH0
+#else
+#define INTERFACE_ID                        CY_ECM_INTERFACE_ETH1
+#endif
+
+/* Network task configurations */
+#define NETWORK_TASK_STACK_SIZE             (1024 * 2)
+#define NETWORK_TASK_PRIORITY               (configMAX_PRIORITIES - 3)
+
+/* Network events */
+#define NETWORK_EVENT_READY                 (1UL << 0)  /* Bring-up done, see network_result */
+#define NETWORK_EVENT_LINK                  (1UL << 1)  /* The connection manager reported the link */
+#define NETWORK_EVENT_RENEW                 (1UL << 2)  /* Replace the cached lease by a DHCP lease */
+
+/* The flash record sector is placed next to the slots generated from the flashmap */
+#if defined(FAST_START) && (ENABLE_NETWORK_CACHE == true) && defined(FLASH_AREA_IMG_1_SECONDARY_START)
+#define NETWORK_CACHE                       (1)
+#else
+#define NETWORK_CACHE                       (0)
+#endif
+
+/* Network cache record */
+#define NETWORK_CACHE_FLAG_REUSE_LEASE      (0x1UL)          /* The next boot starts on the lease */
+#define NETWORK_CACHE_HOST_NAME_SIZE        (64)
+
+#if (NETWORK_CACHE == 1)
+/*******************************************************************************
+* Types
+********************************************************************************/
+/* IPv4 addresses in the byte order of cy_ecm_ip_address_t and lwIP */
+typedef struct
+{
+    uint32_t    flags;                  /* NETWORK_CACHE_FLAG_* */
+    uint32_t    ip_address;
+    uint32_t    netmask;
+    uint32_t    gateway;
+    uint32_t    dns_server;
+    uint32_t    host_address;           /* Last answer for host_name */
+    char        host_name[NETWORK_CACHE_HOST_NAME_SIZE];
+} network_cache_t;
+#endif
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static cy_ecm_t network_ecm_handle;
+static EventGroupHandle_t network_events;
+
+#if defined(FAST_START)
+static cy_rslt_t network_result = CY_RSLT_TYPE_ERROR;
+#endif
+
+#if (NETWORK_CACHE == 1)
+/* The record as it is to be written, written by the OTA task between update
+ * cycles, when the agent does not use the flash */
+static network_cache_t network_cache;
+static bool network_cache_dirty;
+
+/* Static address setting of the cached lease */
+static cy_ecm_ip_setting_t network_lease;
+
+/* The interface runs on the cached lease, not renewed over DHCP yet */
+static bool network_lease_cached;
+
+/* The first lookup of the cached host name was answered from the cache */
+static bool network_dns_answered;
+
+/* An update cycle of the agent started since boot */
+static bool network_check_started;
+#endif
+
+cy_ecm_phy_callbacks_t phy_callbacks =
+{
+        .phy_init = cy_eth_phy_init,
+        .phy_configure = cy_eth_phy_configure,
+        .phy_enable_ext_reg = cy_eth_phy_enable_ext_reg,
+        .phy_discover = cy_eth_phy_discover,
+        .phy_get_auto_neg_status = cy_eth_phy_get_auto_neg_status,
+        .phy_get_link_partner_cap = cy_eth_phy_get_link_partner_cap,
+        .phy_get_linkspeed = cy_eth_phy_get_linkspeed,
+        .phy_get_linkstatus = cy_eth_phy_get_linkstatus,
+        .phy_reset = cy_eth_phy_reset
+};
+
+#if (NETWORK_CACHE == 1)
+/*******************************************************************************
+ * Function Name: network_cache_load
+ *******************************************************************************
+ * Summary:
+ *  Reads the record from flash. Starts an empty record if there is none.
+ *
+ *******************************************************************************/
+static void network_cache_load(void)
+{
+    if (CY_RSLT_SUCCESS != flash_record_read(FLASH_RECORD_TAG_NETWORK_CACHE, &network_cache, sizeof(network_cache)))
+    {
+        memset(&network_cache, 0, sizeof(network_cache));
+        return;
+    }
+
+    network_cache.host_name[NETWORK_CACHE_HOST_NAME_SIZE - 1] = '\0';
+}
+
+/*******************************************************************************
+ * Function Name: network_cache_write
+ *******************************************************************************
+ * Summary:
+ *  Writes the record to flash if it changed. A failed write is tried again on
+ *  the next call.
+ *
+ *******************************************************************************/
+static void network_cache_write(void)
+{
+    if (!network_cache_dirty)
+    {
+        return;
+    }
+
+    if (CY_RSLT_SUCCESS != flash_record_write(FLASH_RECORD_TAG_NETWORK_CACHE, &network_cache, sizeof(network_cache)))
+    {
+        APP_LOG_ERR("Writing the network cache failed\n");
+        return;
+    }
+
+    network_cache_dirty = false;
+}
+
+/*******************************************************************************
+ * Function Name: network_cache_set
+ *******************************************************************************
+ * Summary:
+ *  Updates a member of the record, which is written again only if it changed.
+ *
+ *******************************************************************************/
+static void network_cache_set(uint32_t *member, uint32_t value)
+{
+    if (*member != value)
+    {
+        *member = value;
+        network_cache_dirty = true;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: network_cache_use_lease
+ *******************************************************************************
+ * Summary:
+ *  Takes the lease that the previous image handed to this boot, if any, as
+ *  the static address setting of the first connection. The lease is used by
+ *  one boot only, a later boot may find it expired.
+ *
+ * Return:
+ *  bool : true if network_lease holds the lease to connect with.
+ *
+ *******************************************************************************/
+static bool network_cache_use_lease(void)
+{
+    if (((network_cache.flags & NETWORK_CACHE_FLAG_REUSE_LEASE) == 0u) || (network_cache.ip_address == 0u))
+    {
+        return false;
+    }
+
+    network_cache.flags &= ~NETWORK_CACHE_FLAG_REUSE_LEASE;
+    network_cache_dirty = true;
+
+    memset(&network_lease, 0, sizeof(network_lease));
+    network_lease.ip_address.version = CY_ECM_IP_VER_V4;
+    network_lease.ip_address.ip.v4 = network_cache.ip_address;
+    network_lease.netmask.version = CY_ECM_IP_VER_V4;
+    network_lease.netmask.ip.v4 = network_cache.netmask;
+    network_lease.gateway.version = CY_ECM_IP_VER_V4;
+    network_lease.gateway.ip.v4 = network_cache.gateway;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: network_cache_connected
+ *******************************************************************************
+ * Summary:
+ *  Keeps the lease of a DHCP connection in the record. A connection on the
+ *  cached lease gets the cached DNS server, a static setting has none.
+ *
+ * Parameters:
+ *  bool on_lease : The interface was connected with the cached lease
+ *
+ *******************************************************************************/
+static void network_cache_connected(bool on_lease)
+{
+    cy_ecm_ip_address_t addr;
+    ip_addr_t dns_server;
+
+    network_lease_cached = on_lease;
+
+    if (on_lease)
+    {
+        if (network_cache.dns_server != 0u)
+        {
+            ip_addr_set_ip4_u32(&dns_server, network_cache.dns_server);
+            LOCK_TCPIP_CORE();
+            dns_setserver(0, &dns_server);
+            UNLOCK_TCPIP_CORE();
+        }
+        return;
+    }
+
+    if (CY_RSLT_SUCCESS == cy_ecm_get_ip_address(network_ecm_handle, &addr))
+    {
+        network_cache_set(&network_cache.ip_address, addr.ip.v4);
+    }
+    if (CY_RSLT_SUCCESS == cy_ecm_get_netmask_address(network_ecm_handle, &addr))
+    {
+        network_cache_set(&network_cache.netmask, addr.ip.v4);
+    }
+    if (CY_RSLT_SUCCESS == cy_ecm_get_gateway_address(network_ecm_handle, &addr))
+    {
+        network_cache_set(&network_cache.gateway, addr.ip.v4);
+    }
+
+    LOCK_TCPIP_CORE();
+    network_cache_set(&network_cache.dns_server, ip_addr_get_ip4_u32(dns_getserver(0)));
+    UNLOCK_TCPIP_CORE();
+}
+#endif /* NETWORK_CACHE */
+
+/*******************************************************************************
+ * Function Name: network_ecm_event
+ *******************************************************************************
+ * Summary:
+ *  Event callback of the connection manager, wakes up a connection retry
+ *  when the link comes up.
+ *
+ *******************************************************************************/
+static void network_ecm_event(cy_ecm_event_t event, cy_ecm_event_data_t *event_data)
+{
+    (void)event_data;
+
+    switch (event)
+    {
+        case CY_ECM_EVENT_CONNECTED:
+        case CY_ECM_EVENT_IP_CHANGED:
+            xEventGroupSetBits(network_events, NETWORK_EVENT_LINK);
+            break;
+
+        case CY_ECM_EVENT_DISCONNECTED:
+            xEventGroupClearBits(network_events, NETWORK_EVENT_LINK);
+            APP_LOG_INFO("Ethernet link down\n");
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: network_connect
+ *******************************************************************************
+ * Summary:
+ *  Connects the interface over DHCP. A failed attempt is retried as soon as
+ *  the link comes up, or after ETHERNET_CONN_RETRY_DELAY_MS, a maximum of
+ *  'MAX_CONNECTION_RETRIES' times.
+ *
+ * Parameters:
+ *  cy_ecm_ip_address_t *ip_addr : Assigned IP address
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS upon a successful Ethernet connection, else an
+ *              error code indicating the failure.
+ *
+ *******************************************************************************/
+static cy_rslt_t network_connect(cy_ecm_ip_address_t *ip_addr)
+{
+    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+    uint8_t conn_retries;
+
+    for (conn_retries = 0; conn_retries < MAX_CONNECTION_RETRIES; conn_retries++)
+    {
+        APP_LOG_INFO("Initiating cy_ecm_connect \n");
+        result = cy_ecm_connect(network_ecm_handle, NULL, ip_addr);
+
+        if (CY_RSLT_SUCCESS == result)
+        {
+            return result;
+        }
+
+        APP_LOG_ERR("Connection to Ethernet network failed with error code %d."
+                    "Retrying within %d ms...\n", (int) result, ETHERNET_CONN_RETRY_DELAY_MS );
+        xEventGroupWaitBits(network_events, NETWORK_EVENT_LINK, pdTRUE, pdFALSE,
+                            pdMS_TO_TICKS(ETHERNET_CONN_RETRY_DELAY_MS));
+    }
+
+    APP_LOG_ERR("Exceeded maximum Ethernet connection attempts\n");
+
+    return result;
+}
+
+/******************************************************************************
+ * Function Name: ethernet_connect
+ ******************************************************************************
+ * Summary:
+ *  Function that initiates connection to the Ethernet. This function initializes
+ *  the Ethernet interface and then tries to establish a connection with the network.
+ *  The first boot after an update connects with the lease of the previous
+ *  image, the others over DHCP.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS upon a successful Ethernet connection, else an
+ *              error code indicating the failure.
+ *
+ ******************************************************************************/
+static cy_rslt_t ethernet_connect(void)
+{
+    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+
+    /* Structure to store IP address of the Ethernet connection. */
+    cy_ecm_ip_address_t ip_addr;
+
+    ota_timing_start(OTA_TIMING_ETH_CONNECT);
+    ota_timing_startup_begin(OTA_STARTUP_ETH_INIT);
+
+    /* Initialize Ethernet connection manager. */
+    result = cy_ecm_init();
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Ethernet Connection Manager initialization failed\n");
+        CY_ASSERT(0);
+    }
+
+    APP_LOG_INFO("Initiating cy_ecm_ethif_init \n");
+    result =  cy_ecm_ethif_init(INTERFACE_ID, &phy_callbacks, &network_ecm_handle);
+
+    if(CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Ethernet Interface initialization failed!\n");
+        CY_ASSERT(0);
+    }
+
+    /* Without the events the retries just wait for the delay */
+    if (CY_RSLT_SUCCESS != cy_ecm_register_event_callback(network_ecm_handle, network_ecm_event))
+    {
+        APP_LOG_ERR("Registering the Ethernet event callback failed\n");
+    }
+
+    ota_timing_startup_end(OTA_STARTUP_ETH_INIT);
+    ota_timing_startup_begin(OTA_STARTUP_LINK);
+
+    result = CY_RSLT_TYPE_ERROR;
+#if (NETWORK_CACHE == 1)
+    /* No DHCP exchange, the address is the one the previous image had a moment ago */
+    if (network_cache_use_lease())
+    {
+        APP_LOG_INFO("Initiating cy_ecm_connect with the cached lease \n");
+        result = cy_ecm_connect(network_ecm_handle, &network_lease, &ip_addr);
+        if (CY_RSLT_SUCCESS != result)
+        {
+            APP_LOG_INFO("Connecting with the cached lease failed with error code %d, using DHCP\n", (int)result);
+        }
+        else
+        {
+            network_cache_connected(true);
+        }
+    }
+#endif
+
+    /* Connect to Ethernet */
+    if (CY_RSLT_SUCCESS != result)
+    {
+        result = network_connect(&ip_addr);
+#if (NETWORK_CACHE == 1)
+        if (CY_RSLT_SUCCESS == result)
+        {
+            network_cache_connected(false);
+        }
+#endif
+    }
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        APP_LOG_INFO("Successfully connected to Ethernet.\n");
+        APP_LOG_INFO("IP Address Assigned: %d.%d.%d.%d\n", (uint8)ip_addr.ip.v4, (uint8)(ip_addr.ip.v4 >> 8),
+                     (uint8)(ip_addr.ip.v4 >> 16), (uint8)(ip_addr.ip.v4 >> 24));
+        ota_timing_stop(OTA_TIMING_ETH_CONNECT);
+        ota_timing_startup_end(OTA_STARTUP_LINK);
+    }
+
+    return result;
+}
+
+#if defined(FAST_START)
+#if (NETWORK_CACHE == 1)
+/*******************************************************************************
+ * Function Name: network_renew
+ *******************************************************************************
+ * Summary:
+ *  Replaces the cached lease by a lease of the DHCP server. The cached lease
+ *  was not renewed with the server, which may give the address to another
+ *  host once it expires. Falls back to the cached lease if DHCP fails.
+ *
+ *******************************************************************************/
+static void network_renew(void)
+{
+    cy_ecm_ip_address_t ip_addr;
+    cy_rslt_t result;
+
+    APP_LOG_INFO("Renewing the cached lease over DHCP\n");
+
+    result = cy_ecm_disconnect(network_ecm_handle);
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = network_connect(&ip_addr);
+        if (CY_RSLT_SUCCESS == result)
+        {
+            network_cache_connected(false);
+            APP_LOG_INFO("IP Address Assigned: %d.%d.%d.%d\n", (uint8)ip_addr.ip.v4, (uint8)(ip_addr.ip.v4 >> 8),
+                         (uint8)(ip_addr.ip.v4 >> 16), (uint8)(ip_addr.ip.v4 >> 24));
+            return;
+        }
+
+        result = cy_ecm_connect(network_ecm_handle, &network_lease, &ip_addr);
+    }
+
+    APP_LOG_ERR("Renewing the cached lease failed, error code %d\n", (int)result);
+}
+#endif
+
+/*******************************************************************************
+ * Function Name: network_task
+ *******************************************************************************
+ * Summary:
+ *  Brings the Ethernet interface up. On the cached lease, waits to renew it
+ *  over DHCP once the agent completed its first job check.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void network_task(void *args)
+{
+    (void)args;
+
+    network_result = ethernet_connect();
+    xEventGroupSetBits(network_events, NETWORK_EVENT_READY);
+
+#if (NETWORK_CACHE == 1)
+    if ((CY_RSLT_SUCCESS == network_result) && network_lease_cached)
+    {
+        xEventGroupWaitBits(network_events, NETWORK_EVENT_RENEW, pdTRUE, pdFALSE, portMAX_DELAY);
+        network_renew();
+        network_lease_cached = false;
+    }
+#endif
+
+    vTaskDelete(NULL);
+}
+#endif /* FAST_START */
+
+/*******************************************************************************
+ * Function Name: network_task_start
+ *******************************************************************************
+ * Summary:
+ *  Starts bringing the Ethernet interface up. With FAST_START the PHY
+ *  auto-negotiation and DHCP run in the network task, in parallel with the
+ *  caller, otherwise in network_task_wait().
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t network_task_start(void)
+{
+    network_events = xEventGroupCreate();
+    if (network_events == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+#if (NETWORK_CACHE == 1)
+    network_cache_load();
+#endif
+
+#if defined(FAST_START)
+    if (pdPASS != xTaskCreate(network_task, "NETWORK TASK", NETWORK_TASK_STACK_SIZE, NULL,
+                              NETWORK_TASK_PRIORITY, NULL))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+#endif
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: network_task_wait
+ *******************************************************************************
+ * Summary:
+ *  Waits until the Ethernet interface is up.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS upon a successful Ethernet connection, else an
+ *              error code indicating the failure.
+ *
+ *******************************************************************************/
+cy_rslt_t network_task_wait(void)
+{
+#if defined(FAST_START)
+    xEventGroupWaitBits(network_events, NETWORK_EVENT_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    return network_result;
+#else
+    return ethernet_connect();
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: network_task_agent_state
+ *******************************************************************************
+ * Summary:
+ *  Follows the state changes of the OTA agent: the network cache is written
+ *  at the start of an update cycle, while the agent does not use the flash,
+ *  if it changed since the last write, and the cached lease is renewed when
+ *  the first update cycle is over.
+ *
+ * Parameters:
+ *  cy_ota_agent_state_t state : New state of the OTA agent
+ *
+ *******************************************************************************/
+void network_task_agent_state(cy_ota_agent_state_t state)
+{
+#if (NETWORK_CACHE == 1)
+    switch (state)
+    {
+        case CY_OTA_STATE_START_UPDATE:
+            network_check_started = true;
+            network_cache_write();
+            break;
+
+        case CY_OTA_STATE_AGENT_WAITING:
+            if (network_check_started && network_lease_cached)
+            {
+                xEventGroupSetBits(network_events, NETWORK_EVENT_RENEW);
+            }
+            break;
+
+        default:
+            break;
+    }
+#else
+    (void)state;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: network_cache_save
+ *******************************************************************************
+ * Summary:
+ *  Writes the network cache before the reboot into a new image. The lease is
+ *  handed to the next boot only if it came from DHCP in this one.
+ *
+ * Parameters:
+ *  bool reuse_lease : The next boot runs a new image and may start on the lease
+ *
+ *******************************************************************************/
+void network_cache_save(bool reuse_lease)
+{
+#if (NETWORK_CACHE == 1)
+    if (reuse_lease && !network_lease_cached && (network_cache.ip_address != 0u))
+    {
+        network_cache_set(&network_cache.flags, network_cache.flags | NETWORK_CACHE_FLAG_REUSE_LEASE);
+    }
+    network_cache_write();
+#else
+    (void)reuse_lease;
+#endif
+}
+
+#if defined(WRAP_GETHOSTBYNAME)
+cy_rslt_t __real_cy_socket_gethostbyname(const char *hostname, cy_socket_ip_version_t ip_ver, cy_socket_ip_address_t *addr);
+cy_rslt_t __wrap_cy_socket_gethostbyname(const char *hostname, cy_socket_ip_version_t ip_ver, cy_socket_ip_address_t *addr);
+
+#if (NETWORK_CACHE == 1)
+/*******************************************************************************
+ * Function Name: network_dns_cached
+ *******************************************************************************
+ * Summary:
+ *  Answers the first lookup of the cached host name since boot from the
+ *  cache. Later lookups go to the DNS server and refresh the cache, so a
+ *  host that moved is found again by the retry of the agent.
+ *
+ * Return:
+ *  bool : true if addr holds the cached address.
+ *
+ *******************************************************************************/
+static bool network_dns_cached(const char *hostname, cy_socket_ip_version_t ip_ver, cy_socket_ip_address_t *addr)
+{
+    bool cached = false;
+
+    taskENTER_CRITICAL();
+    if (!network_dns_answered && (ip_ver == CY_SOCKET_IP_VER_V4) && (network_cache.host_address != 0u) &&
+        (strncmp(hostname, network_cache.host_name, NETWORK_CACHE_HOST_NAME_SIZE) == 0))
+    {
+        memset(addr, 0, sizeof(*addr));
+        addr->version = CY_SOCKET_IP_VER_V4;
+        addr->ip.v4 = network_cache.host_address;
+        network_dns_answered = true;
+        cached = true;
+    }
+    taskEXIT_CRITICAL();
+
+    return cached;
+}
+
+/*******************************************************************************
+ * Function Name: network_dns_update
+ *******************************************************************************
+ * Summary:
+ *  Keeps the answer of a lookup in the cache. The OTA connections all go to
+ *  HTTP_SERVER unless a job redirects them, only the last host is kept.
+ *
+ *******************************************************************************/
+static void network_dns_update(const char *hostname, const cy_socket_ip_address_t *addr)
+{
+    if ((addr->version != CY_SOCKET_IP_VER_V4) || (strlen(hostname) >= NETWORK_CACHE_HOST_NAME_SIZE))
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if (strcmp(hostname, network_cache.host_name) != 0)
+    {
+        memset(network_cache.host_name, 0, sizeof(network_cache.host_name));
+        strcpy(network_cache.host_name, hostname);
+        network_cache_dirty = true;
+    }
+    network_cache_set(&network_cache.host_address, addr->ip.v4);
+    taskEXIT_CRITICAL();
+}
+#endif /* NETWORK_CACHE */
+
+/*******************************************************************************
+ * Function Name: __wrap_cy_socket_gethostbyname
+ *******************************************************************************
+ * Summary:
+ *  Linked in place of cy_socket_gethostbyname() to time the host name
+ *  lookups of the OTA connections, and to answer the first one from the
+ *  network cache.
+ *
+ *******************************************************************************/
+cy_rslt_t __wrap_cy_socket_gethostbyname(const char *hostname, cy_socket_ip_version_t ip_ver, cy_socket_ip_address_t *addr)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    TickType_t start = xTaskGetTickCount();
+
+#if (NETWORK_CACHE == 1)
+    if (!network_dns_cached(hostname, ip_ver, addr))
+    {
+        result = __real_cy_socket_gethostbyname(hostname, ip_ver, addr);
+        if (CY_RSLT_SUCCESS == result)
+        {
+            network_dns_update(hostname, addr);
+        }
+    }
+#else
+    result = __real_cy_socket_gethostbyname(hostname, ip_ver, addr);
+#endif
+    ota_timing_add_ms(OTA_TIMING_DNS, pdTICKS_TO_MS(xTaskGetTickCount() - start));
+
+    return result;
+}
+#endif /* WRAP_GETHOSTBYNAME */
+
+/* [] END OF FILE */
@@ -0,0 +1,524 @@
+/******************************************************************************
+* File Name: ota_decompress.c
+*
+* Description: This file contains the streaming decompression stage between the
+* download and the storage of the OTA payload, for images and patches
+* compressed by scripts/compress_image.py (heatshrink).
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdlib.h>
+#include <string.h>
+#include "cy_result.h"
+#include "cy_utils.h"
+/* OTA API */
+#include "cy_ota_api.h"
+/* Asynchronous log */
+#include "app_log.h"
+#include "ota_decompress.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/*
+ * Stream format, generated by scripts/compress_image.py:
+ *
+ *   header : magic "HSZ1", window bits, lookahead bits (uint8_t), reserved (uint16_t),
+ *            decompressed size (uint32_t), little endian
+ *   data   : heatshrink bit stream, most significant bit first. A 1 bit is followed by a
+ *            literal byte, a 0 bit by the distance - 1 (window bits) and the length - 1
+ *            (lookahead bits) of a copy from the bytes already decompressed.
+ */
+#define DECOMPRESS_MAGIC                    (0x315A5348UL)  /* "HSZ1" */
+#define DECOMPRESS_HEADER_SIZE              (12u)
+
+/* Largest window accepted, the window is the only history kept in RAM */
+#ifndef OTA_DECOMPRESS_WINDOW_BITS
+#define OTA_DECOMPRESS_WINDOW_BITS          (10u)
+#endif
+#define DECOMPRESS_WINDOW_SIZE              (1u << OTA_DECOMPRESS_WINDOW_BITS)
+#define DECOMPRESS_MIN_WINDOW_BITS          (4u)
+#define DECOMPRESS_MIN_LOOKAHEAD_BITS       (3u)
+
+/* Decompressed bytes handed to the next stage at once, one flash row */
+#define DECOMPRESS_BUFFER_SIZE              (512u)
+
+/* Value of the "Compression" field for this stream format */
+#define DECOMPRESS_JOB_HEATSHRINK           "heatshrink"
+#define DECOMPRESS_JOB_NONE                 "none"
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+typedef enum
+{
+    DECOMPRESS_STATE_HEADER,
+    DECOMPRESS_STATE_TAG,
+    DECOMPRESS_STATE_LITERAL,
+    DECOMPRESS_STATE_INDEX,
+    DECOMPRESS_STATE_COUNT,
+    DECOMPRESS_STATE_COPY,
+    DECOMPRESS_STATE_DONE,
+    DECOMPRESS_STATE_ERROR
+} decompress_state_t;
+
+/* Stream being decompressed */
+typedef struct
+{
+    bool                    active;         /* The job names a compressed payload */
+    decompress_state_t      state;
+    ota_decompress_output_t output;
+    uint32_t                consumed;       /* Compressed bytes taken so far */
+    uint8_t                 header[DECOMPRESS_HEADER_SIZE];
+    uint32_t                header_len;
+    uint8_t                 window_bits;
+    uint8_t                 lookahead_bits;
+    uint32_t                size;           /* Decompressed size */
+    uint32_t                produced;
+    uint8_t                 in_byte;        /* Compressed byte being read */
+    uint8_t                 in_mask;        /* Next bit of in_byte, 0 when used up */
+    uint32_t                field;          /* Bits of the field being read */
+    uint8_t                 field_bits;
+    uint32_t                copy_dist;
+    uint32_t                copy_left;
+    uint32_t                head;           /* Next window position */
+    uint32_t                out_offset;     /* Offset of decompress_out in the payload */
+    uint32_t                out_len;
+} decompress_stream_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static decompress_stream_t decompress;
+
+/* Last DECOMPRESS_WINDOW_SIZE decompressed bytes */
+static uint8_t decompress_window[DECOMPRESS_WINDOW_SIZE];
+
+/* Decompressed bytes not handed to the next stage yet. Word aligned, the
+ * rows filled here are programmed from this buffer. */
+static CY_ALIGN(4) uint8_t decompress_out[DECOMPRESS_BUFFER_SIZE];
+
+/*******************************************************************************
+ * Function Name: decompress_flush
+ *******************************************************************************
+ * Summary:
+ *  Hands the decompressed bytes collected so far to the next stage.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_flush(cy_ota_context_ptr ctx_ptr)
+{
+    cy_rslt_t result;
+    cy_ota_storage_write_info_t chunk_info;
+
+    if (decompress.out_len == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    memset(&chunk_info, 0, sizeof(chunk_info));
+    chunk_info.total_size = decompress.size;
+    chunk_info.offset = decompress.out_offset;
+    chunk_info.buffer = decompress_out;
+    chunk_info.size = decompress.out_len;
+
+    result = decompress.output(ctx_ptr, &chunk_info);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    decompress.out_offset += decompress.out_len;
+    decompress.out_len = 0;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: decompress_emit
+ *******************************************************************************
+ * Summary:
+ *  Adds a decompressed byte to the window and to the output.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_emit(cy_ota_context_ptr ctx_ptr, uint8_t value)
+{
+    decompress_window[decompress.head] = value;
+    decompress.head = (decompress.head + 1) & (DECOMPRESS_WINDOW_SIZE - 1);
+    decompress_out[decompress.out_len++] = value;
+    decompress.produced++;
+
+    if ((decompress.out_len == DECOMPRESS_BUFFER_SIZE) || (decompress.produced == decompress.size))
+    {
+        return decompress_flush(ctx_ptr);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: decompress_get_bits
+ *******************************************************************************
+ * Summary:
+ *  Reads a field of the bit stream. A field cut by the end of a chunk is
+ *  completed by the next chunk.
+ *
+ * Parameters:
+ *  uint8_t count         : Bits in the field
+ *  uint32_t *value       : Field value
+ *  const uint8_t **data  : Compressed bytes, advanced past the bytes used
+ *  uint32_t *len         : Number of compressed bytes left
+ *
+ * Return:
+ *  bool : true once the field is complete, false if more input is needed.
+ *
+ *******************************************************************************/
+static bool decompress_get_bits(uint8_t count, uint32_t *value, const uint8_t **data, uint32_t *len)
+{
+    while (decompress.field_bits < count)
+    {
+        if (decompress.in_mask == 0)
+        {
+            if (*len == 0)
+            {
+                return false;
+            }
+            decompress.in_byte = **data;
+            decompress.in_mask = 0x80;
+            (*data)++;
+            (*len)--;
+            decompress.consumed++;
+        }
+
+        decompress.field = (decompress.field << 1) | (((decompress.in_byte & decompress.in_mask) != 0) ? 1u : 0u);
+        decompress.in_mask >>= 1;
+        decompress.field_bits++;
+    }
+
+    *value = decompress.field;
+    decompress.field = 0;
+    decompress.field_bits = 0;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: decompress_parse_header
+ *******************************************************************************
+ * Summary:
+ *  Checks the stream header against what this decoder supports.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else CY_RSLT_TYPE_ERROR.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_parse_header(void)
+{
+    uint32_t magic = (uint32_t)decompress.header[0] | ((uint32_t)decompress.header[1] << 8) |
+                     ((uint32_t)decompress.header[2] << 16) | ((uint32_t)decompress.header[3] << 24);
+
+    decompress.window_bits = decompress.header[4];
+    decompress.lookahead_bits = decompress.header[5];
+    decompress.size = (uint32_t)decompress.header[8] | ((uint32_t)decompress.header[9] << 8) |
+                      ((uint32_t)decompress.header[10] << 16) | ((uint32_t)decompress.header[11] << 24);
+
+    if ((magic != DECOMPRESS_MAGIC) || (decompress.size == 0) ||
+        (decompress.window_bits < DECOMPRESS_MIN_WINDOW_BITS) || (decompress.window_bits > OTA_DECOMPRESS_WINDOW_BITS) ||
+        (decompress.lookahead_bits < DECOMPRESS_MIN_LOOKAHEAD_BITS) || (decompress.lookahead_bits > decompress.window_bits))
+    {
+        APP_LOG_ERR("Unsupported compressed payload (window %u bits, lookahead %u bits).\n",
+                    (unsigned int)decompress.window_bits, (unsigned int)decompress.lookahead_bits);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    APP_LOG_INFO("Decompressing a %lu byte payload.\n", (unsigned long)decompress.size);
+    decompress.state = DECOMPRESS_STATE_TAG;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: decompress_apply
+ *******************************************************************************
+ * Summary:
+ *  Decompresses the next bytes of the stream.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  const uint8_t *data        : Compressed bytes
+ *  uint32_t len               : Number of compressed bytes
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_apply(cy_ota_context_ptr ctx_ptr, const uint8_t *data, uint32_t len)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t value;
+    uint32_t chunk;
+
+    while (CY_RSLT_SUCCESS == result)
+    {
+        switch (decompress.state)
+        {
+            case DECOMPRESS_STATE_HEADER:
+                chunk = DECOMPRESS_HEADER_SIZE - decompress.header_len;
+                chunk = (len < chunk) ? len : chunk;
+                memcpy(&decompress.header[decompress.header_len], data, chunk);
+                decompress.header_len += chunk;
+                decompress.consumed += chunk;
+                data += chunk;
+                len -= chunk;
+                if (decompress.header_len < DECOMPRESS_HEADER_SIZE)
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                result = decompress_parse_header();
+                break;
+
+            case DECOMPRESS_STATE_TAG:
+                if (decompress.produced == decompress.size)
+                {
+                    decompress.state = DECOMPRESS_STATE_DONE;
+                    break;
+                }
+                if (!decompress_get_bits(1, &value, &data, &len))
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                decompress.state = (value != 0) ? DECOMPRESS_STATE_LITERAL : DECOMPRESS_STATE_INDEX;
+                break;
+
+            case DECOMPRESS_STATE_LITERAL:
+                if (!decompress_get_bits(8, &value, &data, &len))
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                result = decompress_emit(ctx_ptr, (uint8_t)value);
+                decompress.state = DECOMPRESS_STATE_TAG;
+                break;
+
+            case DECOMPRESS_STATE_INDEX:
+                if (!decompress_get_bits(decompress.window_bits, &value, &data, &len))
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                decompress.copy_dist = value + 1;
+                decompress.state = DECOMPRESS_STATE_COUNT;
+                break;
+
+            case DECOMPRESS_STATE_COUNT:
+                if (!decompress_get_bits(decompress.lookahead_bits, &value, &data, &len))
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                decompress.copy_left = value + 1;
+                if (decompress.copy_left > (decompress.size - decompress.produced))
+                {
+                    APP_LOG_ERR("Compressed payload runs past its size.\n");
+                    result = CY_RSLT_TYPE_ERROR;
+                    break;
+                }
+                decompress.state = DECOMPRESS_STATE_COPY;
+                break;
+
+            case DECOMPRESS_STATE_COPY:
+                /* No input needed, the bytes come from the window */
+                while ((decompress.copy_left > 0) && (CY_RSLT_SUCCESS == result))
+                {
+                    value = decompress_window[(decompress.head - decompress.copy_dist) & (DECOMPRESS_WINDOW_SIZE - 1)];
+                    decompress.copy_left--;
+                    result = decompress_emit(ctx_ptr, (uint8_t)value);
+                }
+                decompress.state = DECOMPRESS_STATE_TAG;
+                break;
+
+            case DECOMPRESS_STATE_DONE:
+                /* Only the padding bits of the last byte may follow */
+                if (len != 0)
+                {
+                    APP_LOG_ERR("%lu bytes past the end of the compressed payload.\n", (unsigned long)len);
+                    result = CY_RSLT_TYPE_ERROR;
+                    break;
+                }
+                return CY_RSLT_SUCCESS;
+
+            case DECOMPRESS_STATE_ERROR:
+            default:
+                result = CY_RSLT_TYPE_ERROR;
+                break;
+        }
+    }
+
+    decompress.state = DECOMPRESS_STATE_ERROR;
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_job_parse
+ *******************************************************************************
+ * Summary:
+ *  Takes the compression of the payload from the job document. A job
+ *  without it names an uncompressed payload.
+ *
+ * Parameters:
+ *  const ota_job_t *job : Fields of the job document
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_OTA_CONTINUE or CY_OTA_CB_RSLT_OTA_STOP
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_decompress_job_parse(const ota_job_t *job)
+{
+    decompress.active = false;
+
+    if (strcmp(job->compression, DECOMPRESS_JOB_HEATSHRINK) == 0)
+    {
+        decompress.active = true;
+        return CY_OTA_CB_RSLT_OTA_CONTINUE;
+    }
+
+    if ((job->compression[0] == '\0') || (strcmp(job->compression, DECOMPRESS_JOB_NONE) == 0))
+    {
+        return CY_OTA_CB_RSLT_OTA_CONTINUE;
+    }
+
+    APP_LOG_ERR("Unsupported Compression \"%s\" in the job document. Skipping the update.\n", job->compression);
+    return CY_OTA_CB_RSLT_OTA_STOP;
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_is_active
+ *******************************************************************************
+ * Summary:
+ *  Tells whether the download in progress is compressed.
+ *
+ * Return:
+ *  bool : true for a compressed payload.
+ *
+ *******************************************************************************/
+bool ota_decompress_is_active(void)
+{
+    return decompress.active;
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_begin
+ *******************************************************************************
+ * Summary:
+ *  Starts decompressing from the first byte of the payload. Called when the
+ *  upgrade slot is opened.
+ *
+ * Parameters:
+ *  ota_decompress_output_t output : Stage receiving the decompressed payload
+ *
+ *******************************************************************************/
+void ota_decompress_begin(ota_decompress_output_t output)
+{
+    bool active = decompress.active;
+
+    memset(&decompress, 0, sizeof(decompress));
+    memset(decompress_window, 0, sizeof(decompress_window));
+    decompress.active = active;
+    decompress.output = output;
+    decompress.state = DECOMPRESS_STATE_HEADER;
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_write
+ *******************************************************************************
+ * Summary:
+ *  Storage write of a compressed download. Compressed bytes have to arrive in
+ *  order; bytes sent again after a resumed download are skipped.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  cy_ota_storage_write_info_t *chunk_info : Compressed bytes and their offset
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_decompress_write(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info)
+{
+    uint32_t skip;
+
+    if ((chunk_info == NULL) || (decompress.output == NULL) || (chunk_info->offset > decompress.consumed))
+    {
+        APP_LOG_ERR("Compressed data at %lu, expected %lu.\n",
+                    (unsigned long)((chunk_info != NULL) ? chunk_info->offset : 0), (unsigned long)decompress.consumed);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    skip = decompress.consumed - chunk_info->offset;
+    if (skip >= chunk_info->size)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return decompress_apply(ctx_ptr, &chunk_info->buffer[skip], chunk_info->size - skip);
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_end
+ *******************************************************************************
+ * Summary:
+ *  Checks that the whole payload was decompressed. Called before the upgrade
+ *  slot is closed.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if the whole payload was decompressed, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_decompress_end(cy_ota_context_ptr ctx_ptr)
+{
+    if (DECOMPRESS_STATE_DONE != decompress.state)
+    {
+        APP_LOG_ERR("The compressed payload ended after %lu of %lu bytes.\n",
+                    (unsigned long)decompress.produced, (unsigned long)decompress.size);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return decompress_flush(ctx_ptr);
+}
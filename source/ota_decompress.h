@@ -0,0 +1,63 @@
+/******************************************************************************
+* File Name: ota_decompress.h
+*
+* Description: This file contains declaration of the streaming decompression of
+* compressed OTA payloads.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_DECOMPRESS_H_
+#define SOURCE_OTA_DECOMPRESS_H_
+
+#include <stdbool.h>
+#include "cy_ota_api.h"
+/* Fields of the job document */
+#include "ota_job_parse.h"
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+/* Next stage of the download, receives the decompressed payload */
+typedef cy_rslt_t (*ota_decompress_output_t)(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info);
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_ota_callback_results_t ota_decompress_job_parse(const ota_job_t *job);
+bool ota_decompress_is_active(void);
+void ota_decompress_begin(ota_decompress_output_t output);
+cy_rslt_t ota_decompress_write(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info);
+cy_rslt_t ota_decompress_end(cy_ota_context_ptr ctx_ptr);
+
+#endif /* SOURCE_OTA_DECOMPRESS_H_ */
@@ -0,0 +1,553 @@
+/******************************************************************************
+* File Name: ota_delta.c
+*
+* Description: This file contains the delta update: the OTA agent downloads a patch
+* against the running image, and the new image is rebuilt into the
+* upgrade slot from the primary slot and the patch as it streams in.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cy_result.h"
+#include "cy_utils.h"
+/* OTA API */
+#include "cy_ota_api.h"
+/* OTA storage api */
+#include "cy_ota_storage_api.h"
+/* OTA flash access */
+#include "cy_ota_flash.h"
+/* Asynchronous log */
+#include "app_log.h"
+#include "ota_delta.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/*
+ * Patch format, little endian, generated by scripts/create_delta_patch.py:
+ *
+ *   header   : magic "DELT", base size, new size, reserved (4 x uint32_t)
+ *   records  : copy length, add length, extra length (uint32_t), seek (int32_t),
+ *              copy length base image bytes taken as they are,
+ *              add length bytes added to the next base image bytes,
+ *              extra length bytes taken from the patch,
+ *              then the base cursor moves by seek.
+ *
+ * Records follow each other until new size bytes have been produced.
+ */
+#define DELTA_PATCH_MAGIC                   (0x544C4544UL)  /* "DELT" */
+#define DELTA_HEADER_SIZE                   (16u)
+#define DELTA_RECORD_SIZE                   (16u)
+
+/* Bytes of the new image handed to the storage at once, one flash row */
+#define DELTA_BUFFER_SIZE                   (512u)
+
+/* The base is the image in the primary slot, located by the flashmap */
+#if defined (FLASH_AREA_IMG_1_PRIMARY_START) && defined (FLASH_AREA_IMG_1_PRIMARY_SIZE) && \
+    defined (FLASH_AREA_IMG_1_SECONDARY_SIZE)
+#define DELTA_SUPPORTED                     (1)
+#define DELTA_BASE_START                    (FLASH_AREA_IMG_1_PRIMARY_START)
+#define DELTA_BASE_SIZE                     (FLASH_AREA_IMG_1_PRIMARY_SIZE)
+#define DELTA_SLOT_SIZE                     (FLASH_AREA_IMG_1_SECONDARY_SIZE)
+#else
+#define DELTA_SUPPORTED                     (0)
+#define DELTA_BASE_START                    (0u)
+#define DELTA_BASE_SIZE                     (0u)
+#define DELTA_SLOT_SIZE                     (0u)
+#endif
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+typedef enum
+{
+    DELTA_STATE_HEADER,
+    DELTA_STATE_RECORD,
+    DELTA_STATE_COPY,
+    DELTA_STATE_ADD,
+    DELTA_STATE_EXTRA,
+    DELTA_STATE_DONE,
+    DELTA_STATE_ERROR
+} delta_state_t;
+
+/* Patch being applied */
+typedef struct
+{
+    bool            active;         /* The job names a patch instead of an image */
+    delta_state_t   state;
+    uint32_t        consumed;       /* Patch bytes applied so far */
+    uint8_t         field[DELTA_HEADER_SIZE];   /* Header or record being received */
+    uint32_t        field_len;
+    uint32_t        base_size;
+    uint32_t        new_size;
+    uint32_t        base_pos;       /* Base cursor */
+    uint32_t        new_pos;        /* New image bytes produced */
+    uint32_t        copy_left;
+    uint32_t        add_left;
+    uint32_t        extra_left;
+    int32_t         seek;
+    uint32_t        out_offset;     /* Offset of delta_out in the new image */
+    uint32_t        out_len;
+} delta_patch_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static delta_patch_t delta;
+
+/* New image bytes not handed to the storage yet. Word aligned, the rows
+ * filled here are programmed from this buffer. */
+static CY_ALIGN(4) uint8_t delta_out[DELTA_BUFFER_SIZE];
+
+/* Base image bytes the add bytes are added to */
+static uint8_t delta_base[DELTA_BUFFER_SIZE];
+
+/*******************************************************************************
+ * Function Name: delta_get_le32
+ *******************************************************************************
+ * Summary:
+ *  Reads a little endian 32-bit field of the patch.
+ *
+ *******************************************************************************/
+static uint32_t delta_get_le32(const uint8_t *buf)
+{
+    return ((uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24));
+}
+
+/*******************************************************************************
+ * Function Name: delta_flush
+ *******************************************************************************
+ * Summary:
+ *  Hands the new image bytes collected so far to the OTA storage, which writes
+ *  them to the upgrade slot through the row-coalescing writer.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_flush(cy_ota_context_ptr ctx_ptr)
+{
+    cy_rslt_t result;
+    cy_ota_storage_write_info_t chunk_info;
+
+    if (delta.out_len == 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    memset(&chunk_info, 0, sizeof(chunk_info));
+    chunk_info.total_size = delta.new_size;
+    chunk_info.offset = delta.out_offset;
+    chunk_info.buffer = delta_out;
+    chunk_info.size = delta.out_len;
+
+    result = cy_ota_storage_write(ctx_ptr, &chunk_info);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Writing the new image at %lu failed.\n", (unsigned long)delta.out_offset);
+        return result;
+    }
+
+    delta.out_offset += delta.out_len;
+    delta.out_len = 0;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: delta_parse_field
+ *******************************************************************************
+ * Summary:
+ *  Checks the patch header or a record once all of its bytes are received,
+ *  and moves on to the next state.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else CY_RSLT_TYPE_ERROR.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_parse_field(void)
+{
+    delta.field_len = 0;
+
+    if (DELTA_STATE_HEADER == delta.state)
+    {
+        delta.base_size = delta_get_le32(&delta.field[4]);
+        delta.new_size = delta_get_le32(&delta.field[8]);
+
+        if ((delta_get_le32(&delta.field[0]) != DELTA_PATCH_MAGIC) ||
+            (delta.base_size > DELTA_BASE_SIZE) ||
+            (delta.new_size == 0) || (delta.new_size > DELTA_SLOT_SIZE))
+        {
+            APP_LOG_ERR("Not a patch for this device.\n");
+            return CY_RSLT_TYPE_ERROR;
+        }
+
+        APP_LOG_INFO("Rebuilding a %lu byte image from a %lu byte base image.\n",
+                     (unsigned long)delta.new_size, (unsigned long)delta.base_size);
+        delta.state = DELTA_STATE_RECORD;
+        return CY_RSLT_SUCCESS;
+    }
+
+    delta.copy_left = delta_get_le32(&delta.field[0]);
+    delta.add_left = delta_get_le32(&delta.field[4]);
+    delta.extra_left = delta_get_le32(&delta.field[8]);
+    delta.seek = (int32_t)delta_get_le32(&delta.field[12]);
+
+    /* Both lengths taken from the base must fit in what is left of the base and of the new image */
+    if ((delta.copy_left > (delta.new_size - delta.new_pos)) ||
+        (delta.add_left > (delta.new_size - delta.new_pos - delta.copy_left)) ||
+        (delta.extra_left > (delta.new_size - delta.new_pos - delta.copy_left - delta.add_left)) ||
+        (delta.copy_left > (delta.base_size - delta.base_pos)) ||
+        (delta.add_left > (delta.base_size - delta.base_pos - delta.copy_left)))
+    {
+        APP_LOG_ERR("Patch record at %lu is out of bounds.\n", (unsigned long)delta.consumed);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    delta.state = DELTA_STATE_COPY;
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: delta_apply
+ *******************************************************************************
+ * Summary:
+ *  Applies the next bytes of the patch. Only DELTA_BUFFER_SIZE bytes of the
+ *  base and of the new image are held in RAM at any time.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  const uint8_t *data        : Patch bytes
+ *  uint32_t len               : Number of patch bytes
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_apply(cy_ota_context_ptr ctx_ptr, const uint8_t *data, uint32_t len)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t needed;
+    uint32_t chunk;
+    int64_t base_pos;
+
+    while (CY_RSLT_SUCCESS == result)
+    {
+        switch (delta.state)
+        {
+            case DELTA_STATE_HEADER:
+            case DELTA_STATE_RECORD:
+                needed = ((DELTA_STATE_HEADER == delta.state) ? DELTA_HEADER_SIZE : DELTA_RECORD_SIZE) - delta.field_len;
+                chunk = (len < needed) ? len : needed;
+                memcpy(&delta.field[delta.field_len], data, chunk);
+                delta.field_len += chunk;
+                data += chunk;
+                len -= chunk;
+                delta.consumed += chunk;
+                if (chunk < needed)
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                result = delta_parse_field();
+                break;
+
+            case DELTA_STATE_COPY:
+                if (delta.copy_left == 0)
+                {
+                    delta.state = DELTA_STATE_ADD;
+                    break;
+                }
+                /* Unchanged bytes need no patch data, straight from the base */
+                chunk = DELTA_BUFFER_SIZE - delta.out_len;
+                chunk = (delta.copy_left < chunk) ? delta.copy_left : chunk;
+                result = cy_ota_mem_read(CY_OTA_MEM_TYPE_INTERNAL_FLASH, DELTA_BASE_START + delta.base_pos,
+                                         &delta_out[delta.out_len], chunk);
+                if (CY_RSLT_SUCCESS != result)
+                {
+                    break;
+                }
+                delta.out_len += chunk;
+                delta.base_pos += chunk;
+                delta.new_pos += chunk;
+                delta.copy_left -= chunk;
+                if (delta.out_len == DELTA_BUFFER_SIZE)
+                {
+                    result = delta_flush(ctx_ptr);
+                }
+                break;
+
+            case DELTA_STATE_ADD:
+                if (delta.add_left == 0)
+                {
+                    delta.state = DELTA_STATE_EXTRA;
+                    break;
+                }
+                if (len == 0)
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                chunk = DELTA_BUFFER_SIZE - delta.out_len;
+                chunk = (len < chunk) ? len : chunk;
+                chunk = (delta.add_left < chunk) ? delta.add_left : chunk;
+
+                /* The base is read through the flash driver, like the slot itself */
+                result = cy_ota_mem_read(CY_OTA_MEM_TYPE_INTERNAL_FLASH, DELTA_BASE_START + delta.base_pos,
+                                         delta_base, chunk);
+                if (CY_RSLT_SUCCESS != result)
+                {
+                    break;
+                }
+                for (uint32_t i = 0; i < chunk; i++)
+                {
+                    delta_out[delta.out_len + i] = (uint8_t)(delta_base[i] + data[i]);
+                }
+                delta.out_len += chunk;
+                delta.base_pos += chunk;
+                delta.new_pos += chunk;
+                delta.add_left -= chunk;
+                data += chunk;
+                len -= chunk;
+                delta.consumed += chunk;
+                if (delta.out_len == DELTA_BUFFER_SIZE)
+                {
+                    result = delta_flush(ctx_ptr);
+                }
+                break;
+
+            case DELTA_STATE_EXTRA:
+                if (delta.extra_left == 0)
+                {
+                    /* End of the record, move the base cursor */
+                    base_pos = (int64_t)delta.base_pos + delta.seek;
+                    if ((base_pos < 0) || (base_pos > (int64_t)delta.base_size))
+                    {
+                        APP_LOG_ERR("Patch seeks out of the base image.\n");
+                        result = CY_RSLT_TYPE_ERROR;
+                        break;
+                    }
+                    delta.base_pos = (uint32_t)base_pos;
+                    delta.state = (delta.new_pos == delta.new_size) ? DELTA_STATE_DONE : DELTA_STATE_RECORD;
+                    break;
+                }
+                if (len == 0)
+                {
+                    return CY_RSLT_SUCCESS;
+                }
+                chunk = DELTA_BUFFER_SIZE - delta.out_len;
+                chunk = (len < chunk) ? len : chunk;
+                chunk = (delta.extra_left < chunk) ? delta.extra_left : chunk;
+                memcpy(&delta_out[delta.out_len], data, chunk);
+                delta.out_len += chunk;
+                delta.new_pos += chunk;
+                delta.extra_left -= chunk;
+                data += chunk;
+                len -= chunk;
+                delta.consumed += chunk;
+                if (delta.out_len == DELTA_BUFFER_SIZE)
+                {
+                    result = delta_flush(ctx_ptr);
+                }
+                break;
+
+            case DELTA_STATE_DONE:
+                if (len != 0)
+                {
+                    APP_LOG_ERR("%lu bytes past the end of the patch.\n", (unsigned long)len);
+                    result = CY_RSLT_TYPE_ERROR;
+                    break;
+                }
+                return delta_flush(ctx_ptr);
+
+            case DELTA_STATE_ERROR:
+            default:
+                result = CY_RSLT_TYPE_ERROR;
+                break;
+        }
+    }
+
+    delta.state = DELTA_STATE_ERROR;
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_job_parse
+ *******************************************************************************
+ * Summary:
+ *  Takes the base version of a patch from the job document. A job without
+ *  it names a full image. A patch can only be applied to the image it was
+ *  made from, so a job for another base version is refused.
+ *
+ * Parameters:
+ *  const ota_job_t *job : Fields of the job document
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_OTA_CONTINUE or CY_OTA_CB_RSLT_OTA_STOP
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_delta_job_parse(const ota_job_t *job)
+{
+    unsigned int major;
+    unsigned int minor;
+    unsigned int build;
+
+    delta.active = false;
+
+    if (job->base_version[0] == '\0')
+    {
+        return CY_OTA_CB_RSLT_OTA_CONTINUE;
+    }
+
+#if (DELTA_SUPPORTED == 1)
+    if (sscanf(job->base_version, "%u.%u.%u", &major, &minor, &build) != 3)
+    {
+        APP_LOG_ERR("Malformed BaseVersion \"%s\" in the job document.\n", job->base_version);
+        return CY_OTA_CB_RSLT_OTA_STOP;
+    }
+
+    if ((major != APP_VERSION_MAJOR) || (minor != APP_VERSION_MINOR) || (build != APP_VERSION_BUILD))
+    {
+        APP_LOG_INFO("The patch applies to %u.%u.%u, running %d.%d.%d. Skipping the update.\n",
+                     major, minor, build, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
+        return CY_OTA_CB_RSLT_OTA_STOP;
+    }
+
+    APP_LOG_INFO("The job names a patch against the running %u.%u.%u image.\n", major, minor, build);
+    delta.active = true;
+    return CY_OTA_CB_RSLT_OTA_CONTINUE;
+#else
+    (void)major;
+    (void)minor;
+    (void)build;
+    APP_LOG_ERR("Delta updates need the primary slot location from the flashmap.\n");
+    return CY_OTA_CB_RSLT_OTA_STOP;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_is_active
+ *******************************************************************************
+ * Summary:
+ *  Tells whether the download in progress is a patch.
+ *
+ * Return:
+ *  bool : true for a patch, false for a full image.
+ *
+ *******************************************************************************/
+bool ota_delta_is_active(void)
+{
+    return delta.active;
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_begin
+ *******************************************************************************
+ * Summary:
+ *  Starts applying a patch from its first byte. Called when the upgrade slot
+ *  is opened.
+ *
+ *******************************************************************************/
+void ota_delta_begin(void)
+{
+    bool active = delta.active;
+
+    memset(&delta, 0, sizeof(delta));
+    delta.active = active;
+    delta.state = DELTA_STATE_HEADER;
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_write
+ *******************************************************************************
+ * Summary:
+ *  Storage write of a patch download. Patch bytes have to arrive in order;
+ *  bytes sent again after a resumed download are skipped.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  cy_ota_storage_write_info_t *chunk_info : Patch bytes and their offset
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_delta_write(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info)
+{
+    uint32_t skip;
+
+    if ((chunk_info == NULL) || (chunk_info->offset > delta.consumed))
+    {
+        APP_LOG_ERR("Patch data at %lu, expected %lu.\n",
+                    (unsigned long)((chunk_info != NULL) ? chunk_info->offset : 0), (unsigned long)delta.consumed);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    skip = delta.consumed - chunk_info->offset;
+    if (skip >= chunk_info->size)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return delta_apply(ctx_ptr, &chunk_info->buffer[skip], chunk_info->size - skip);
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_end
+ *******************************************************************************
+ * Summary:
+ *  Writes the end of the new image. Called before the upgrade slot is closed.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if the whole image was rebuilt, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_delta_end(cy_ota_context_ptr ctx_ptr)
+{
+    if (DELTA_STATE_DONE != delta.state)
+    {
+        APP_LOG_ERR("The patch ended after %lu of %lu image bytes.\n",
+                    (unsigned long)delta.new_pos, (unsigned long)delta.new_size);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return delta_flush(ctx_ptr);
+}
@@ -0,0 +1,664 @@
+/******************************************************************************
+* File Name: ota_job_parse.c
+*
+* Description: This file contains the single pass parser of the OTA job
+* document. The fields known to the application are written straight into an
+* ota_job_t, driven by a table of the keys, without a copy of the document
+* or allocating memory.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* Asynchronous log */
+#include "app_log.h"
+#include "ota_job_parse.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#ifndef OTA_JOB_REJECT_OLD_VERSION
+#define OTA_JOB_REJECT_OLD_VERSION          (true)
+#endif
+
+/* Longest key looked up in the table, longer keys are unknown */
+#define JOB_KEY_SIZE                        (16)
+
+/* Longest number, or unquoted value of an unknown key */
+#define JOB_NUMBER_SIZE                     (12)
+
+/* Entry of the field table */
+#define JOB_FIELD(key, type, member)        { key, type, offsetof(ota_job_t, member), \
+                                              sizeof(((ota_job_t *)0)->member) }
+
+/* Version of the running image, compared with the "Version" of the job */
+#define JOB_APP_VERSION                     (((uint32_t)APP_VERSION_MAJOR << 24) | \
+                                             ((uint32_t)APP_VERSION_MINOR << 16) | (uint32_t)APP_VERSION_BUILD)
+
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+typedef enum
+{
+    JOB_FIELD_STRING,           /* Copied up to the size of the member */
+    JOB_FIELD_VERSION,          /* String checked against the running version */
+    JOB_FIELD_NUMBER,           /* uint32_t, written as a number or as a string */
+    JOB_FIELD_STRING_LIST       /* Array of strings, the count follows the rows */
+} job_field_type_t;
+
+typedef struct
+{
+    const char          *key;
+    job_field_type_t    type;
+    size_t              offset;         /* Member of ota_job_t */
+    size_t              size;
+} job_field_t;
+
+typedef enum
+{
+    JOB_STATE_OBJECT,           /* Before the opening brace */
+    JOB_STATE_KEY_START,        /* Before a key or the closing brace */
+    JOB_STATE_KEY,              /* In a key */
+    JOB_STATE_COLON,
+    JOB_STATE_VALUE,            /* Before a value */
+    JOB_STATE_STRING,           /* In a string value */
+    JOB_STATE_LITERAL,          /* In a number, true, false or null */
+    JOB_STATE_ARRAY,            /* Before an item of a list, or its end */
+    JOB_STATE_ARRAY_NEXT,       /* After an item of a list */
+    JOB_STATE_SKIP,             /* In an object or array of an unknown key */
+    JOB_STATE_VALUE_END,        /* Before a comma or the closing brace */
+    JOB_STATE_END               /* Parse stopped, see result */
+} job_state_t;
+
+typedef struct
+{
+    job_state_t             state;
+    ota_job_parse_result_t  result;
+    char                    key[JOB_KEY_SIZE];
+    size_t                  key_len;        /* JOB_KEY_SIZE for a key too long */
+    const job_field_t       *field;         /* NULL for an unknown key */
+    char                    *value;         /* Where the bytes of the value go, NULL to drop them */
+    size_t                  value_size;
+    size_t                  value_len;
+    bool                    in_list;        /* The string is an item of a list */
+    bool                    escape;         /* Previous byte was a backslash */
+    bool                    skip_string;    /* In a string of a skipped value */
+    uint32_t                depth;          /* Nesting of a skipped value */
+    char                    number[JOB_NUMBER_SIZE + 1];
+} job_parser_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Keys of the job document used by the application, any other key is skipped */
+static const job_field_t job_fields[] =
+{
+    JOB_FIELD("Version",        JOB_FIELD_VERSION,      version),
+    JOB_FIELD("BaseVersion",    JOB_FIELD_STRING,       base_version),
+    JOB_FIELD("Board",          JOB_FIELD_STRING,       board),
+    JOB_FIELD("Connection",     JOB_FIELD_STRING,       connection),
+    JOB_FIELD("Compression",    JOB_FIELD_STRING,       compression),
+    JOB_FIELD("Server",         JOB_FIELD_STRING,       server),
+    JOB_FIELD("Port",           JOB_FIELD_NUMBER,       port),
+    JOB_FIELD("File",           JOB_FIELD_STRING,       file),
+    JOB_FIELD("Peers",          JOB_FIELD_STRING_LIST,  peers),
+};
+
+static ota_job_t job;
+static job_parser_t job_parser;
+
+/*******************************************************************************
+ * Function Name: job_is_space
+ *******************************************************************************
+ * Summary:
+ *  Tells whether a byte is JSON white space.
+ *
+ *******************************************************************************/
+static bool job_is_space(char c)
+{
+    return ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'));
+}
+
+/*******************************************************************************
+ * Function Name: job_find_field
+ *******************************************************************************
+ * Summary:
+ *  Looks the key just received up in the field table.
+ *
+ * Return:
+ *  const job_field_t * : Entry of the key, NULL for an unknown key.
+ *
+ *******************************************************************************/
+static const job_field_t *job_find_field(void)
+{
+    size_t i;
+
+    if (job_parser.key_len < JOB_KEY_SIZE)
+    {
+        job_parser.key[job_parser.key_len] = '\0';
+        for (i = 0; i < (sizeof(job_fields) / sizeof(job_fields[0])); i++)
+        {
+            if (strcmp(job_fields[i].key, job_parser.key) == 0)
+            {
+                return &job_fields[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ * Function Name: job_start_value
+ *******************************************************************************
+ * Summary:
+ *  Points the parser at the destination of a string or a literal: the member
+ *  of the field, the next row of a list, the number buffer, or nowhere.
+ *
+ * Parameters:
+ *  bool quoted : true for a string, false for a literal
+ *
+ * Return:
+ *  bool : false if the field does not take this kind of value.
+ *
+ *******************************************************************************/
+static bool job_start_value(bool quoted)
+{
+    const job_field_t *field = job_parser.field;
+
+    job_parser.value = NULL;
+    job_parser.value_size = 0;
+    job_parser.value_len = 0;
+    job_parser.escape = false;
+
+    if (field == NULL)
+    {
+        return true;
+    }
+
+    switch (field->type)
+    {
+        case JOB_FIELD_STRING:
+        case JOB_FIELD_VERSION:
+            job_parser.value = (char *)&job + field->offset;
+            job_parser.value_size = field->size;
+            return true;
+
+        case JOB_FIELD_NUMBER:
+            job_parser.value = job_parser.number;
+            job_parser.value_size = sizeof(job_parser.number);
+            return true;
+
+        case JOB_FIELD_STRING_LIST:
+            if (!quoted || !job_parser.in_list)
+            {
+                return false;
+            }
+            /* Items past the last row are dropped */
+            if (job.peer_count < OTA_PEER_MAX_PEERS)
+            {
+                job_parser.value = job.peers[job.peer_count];
+                job_parser.value_size = sizeof(job.peers[0]);
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: job_end_value
+ *******************************************************************************
+ * Summary:
+ *  Completes the value just received. The "Version" is compared with the
+ *  running version as soon as it is complete.
+ *
+ * Return:
+ *  ota_job_parse_result_t : OTA_JOB_PARSE_MORE to go on, else the end of the parse.
+ *
+ *******************************************************************************/
+static ota_job_parse_result_t job_end_value(void)
+{
+    const job_field_t *field = job_parser.field;
+    unsigned int major;
+    unsigned int minor;
+    unsigned int build;
+    char *end;
+
+    if ((field == NULL) || (job_parser.value == NULL))
+    {
+        return OTA_JOB_PARSE_MORE;
+    }
+    job_parser.value[job_parser.value_len] = '\0';
+
+    switch (field->type)
+    {
+        case JOB_FIELD_VERSION:
+            if ((sscanf(job.version, "%u.%u.%u", &major, &minor, &build) != 3) ||
+                (major > UINT8_MAX) || (minor > UINT8_MAX) || (build > UINT16_MAX))
+            {
+                APP_LOG_ERR("Malformed Version \"%s\" in the job document.\n", job.version);
+                return OTA_JOB_PARSE_ERROR;
+            }
+#if (OTA_JOB_REJECT_OLD_VERSION == true)
+            if ((((uint32_t)major << 24) | ((uint32_t)minor << 16) | build) <= JOB_APP_VERSION)
+            {
+                APP_LOG_INFO("The job is for version %s, not newer than the running %d.%d.%d.\n",
+                             job.version, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
+                return OTA_JOB_PARSE_STALE;
+            }
+#endif
+            break;
+
+        case JOB_FIELD_NUMBER:
+            *(uint32_t *)((char *)&job + field->offset) = (uint32_t)strtoul(job_parser.number, &end, 10);
+            if ((job_parser.value_len == 0) || (*end != '\0'))
+            {
+                APP_LOG_ERR("Malformed %s in the job document.\n", field->key);
+                return OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_FIELD_STRING_LIST:
+            job.peer_count++;
+            break;
+
+        default:
+            break;
+    }
+
+    return OTA_JOB_PARSE_MORE;
+}
+
+/*******************************************************************************
+ * Function Name: job_append
+ *******************************************************************************
+ * Summary:
+ *  Adds a byte to the value being received. An item of a list too long for
+ *  its row is dropped, any other value too long for its field fails the parse.
+ *
+ * Return:
+ *  bool : false if the value does not fit.
+ *
+ *******************************************************************************/
+static bool job_append(char c)
+{
+    if (job_parser.value == NULL)
+    {
+        return true;
+    }
+
+    if ((job_parser.value_len + 1) >= job_parser.value_size)
+    {
+        if (job_parser.in_list)
+        {
+            job_parser.value = NULL;
+            return true;
+        }
+        APP_LOG_ERR("%s of the job document is too long.\n", job_parser.field->key);
+        return false;
+    }
+
+    job_parser.value[job_parser.value_len++] = c;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: job_parse_byte
+ *******************************************************************************
+ * Summary:
+ *  Runs the parser over one byte of the document.
+ *
+ * Parameters:
+ *  char c : Next byte
+ *
+ * Return:
+ *  ota_job_parse_result_t : OTA_JOB_PARSE_MORE to go on, else the end of the parse.
+ *
+ *******************************************************************************/
+static ota_job_parse_result_t job_parse_byte(char c)
+{
+    ota_job_parse_result_t result = OTA_JOB_PARSE_MORE;
+
+    switch (job_parser.state)
+    {
+        case JOB_STATE_OBJECT:
+            if (c == '{')
+            {
+                job_parser.state = JOB_STATE_KEY_START;
+            }
+            else if (!job_is_space(c))
+            {
+                result = OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_KEY_START:
+            if (c == '"')
+            {
+                job_parser.key_len = 0;
+                job_parser.escape = false;
+                job_parser.state = JOB_STATE_KEY;
+            }
+            else if (c == '}')
+            {
+                result = OTA_JOB_PARSE_DONE;
+            }
+            else if (!job_is_space(c))
+            {
+                result = OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_KEY:
+            if (!job_parser.escape && (c == '"'))
+            {
+                job_parser.field = job_find_field();
+                job_parser.state = JOB_STATE_COLON;
+            }
+            else if (!job_parser.escape && (c == '\\'))
+            {
+                job_parser.escape = true;
+            }
+            else
+            {
+                job_parser.escape = false;
+                if (job_parser.key_len < JOB_KEY_SIZE)
+                {
+                    job_parser.key[job_parser.key_len++] = c;
+                }
+            }
+            break;
+
+        case JOB_STATE_COLON:
+            if (c == ':')
+            {
+                job_parser.in_list = false;
+                job_parser.state = JOB_STATE_VALUE;
+            }
+            else if (!job_is_space(c))
+            {
+                result = OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_VALUE:
+            if (job_is_space(c))
+            {
+                break;
+            }
+            if (c == '"')
+            {
+                job_parser.state = JOB_STATE_STRING;
+                result = job_start_value(true) ? OTA_JOB_PARSE_MORE : OTA_JOB_PARSE_ERROR;
+            }
+            else if ((c == '[') && (job_parser.field != NULL) && (job_parser.field->type == JOB_FIELD_STRING_LIST))
+            {
+                job_parser.in_list = true;
+                job_parser.state = JOB_STATE_ARRAY;
+            }
+            else if (((c == '[') || (c == '{')) && (job_parser.field == NULL))
+            {
+                job_parser.depth = 1;
+                job_parser.skip_string = false;
+                job_parser.escape = false;
+                job_parser.state = JOB_STATE_SKIP;
+            }
+            else if ((c == '[') || (c == '{') || (c == ',') || (c == '}') || !job_start_value(false))
+            {
+                result = OTA_JOB_PARSE_ERROR;
+            }
+            else
+            {
+                job_parser.state = JOB_STATE_LITERAL;
+                result = job_append(c) ? OTA_JOB_PARSE_MORE : OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_STRING:
+            if (!job_parser.escape && (c == '"'))
+            {
+                job_parser.state = job_parser.in_list ? JOB_STATE_ARRAY_NEXT : JOB_STATE_VALUE_END;
+                result = job_end_value();
+            }
+            else if (job_parser.escape)
+            {
+                /* Only in a value that is dropped */
+                job_parser.escape = false;
+            }
+            else if (c == '\\')
+            {
+                /* Host names, paths and versions need no escapes, an escaped
+                 * byte would be kept raw. Dropped values may have them. */
+                if (job_parser.value != NULL)
+                {
+                    APP_LOG_ERR("%s of the job document has an escape sequence.\n", job_parser.field->key);
+                    result = OTA_JOB_PARSE_ERROR;
+                }
+                job_parser.escape = true;
+            }
+            else
+            {
+                result = job_append(c) ? OTA_JOB_PARSE_MORE : OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_LITERAL:
+            if (job_is_space(c) || (c == ',') || (c == '}'))
+            {
+                job_parser.state = JOB_STATE_VALUE_END;
+                result = job_end_value();
+                if (result == OTA_JOB_PARSE_MORE)
+                {
+                    result = job_parse_byte(c);
+                }
+            }
+            else
+            {
+                result = job_append(c) ? OTA_JOB_PARSE_MORE : OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_ARRAY:
+        case JOB_STATE_ARRAY_NEXT:
+            if (c == ']')
+            {
+                job_parser.in_list = false;
+                job_parser.state = JOB_STATE_VALUE_END;
+            }
+            else if ((c == '"') && (job_parser.state == JOB_STATE_ARRAY))
+            {
+                job_parser.state = JOB_STATE_STRING;
+                result = job_start_value(true) ? OTA_JOB_PARSE_MORE : OTA_JOB_PARSE_ERROR;
+            }
+            else if ((c == ',') && (job_parser.state == JOB_STATE_ARRAY_NEXT))
+            {
+                job_parser.state = JOB_STATE_ARRAY;
+            }
+            else if (!job_is_space(c))
+            {
+                result = OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_SKIP:
+            if (job_parser.skip_string)
+            {
+                if (job_parser.escape)
+                {
+                    job_parser.escape = false;
+                }
+                else if (c == '\\')
+                {
+                    job_parser.escape = true;
+                }
+                else if (c == '"')
+                {
+                    job_parser.skip_string = false;
+                }
+            }
+            else if (c == '"')
+            {
+                job_parser.skip_string = true;
+            }
+            else if ((c == '[') || (c == '{'))
+            {
+                job_parser.depth++;
+            }
+            else if (((c == ']') || (c == '}')) && (--job_parser.depth == 0))
+            {
+                job_parser.state = JOB_STATE_VALUE_END;
+            }
+            break;
+
+        case JOB_STATE_VALUE_END:
+            if (c == ',')
+            {
+                job_parser.state = JOB_STATE_KEY_START;
+            }
+            else if (c == '}')
+            {
+                result = OTA_JOB_PARSE_DONE;
+            }
+            else if (!job_is_space(c))
+            {
+                result = OTA_JOB_PARSE_ERROR;
+            }
+            break;
+
+        case JOB_STATE_END:
+        default:
+            result = job_parser.result;
+            break;
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: job_parse_begin
+ *******************************************************************************
+ * Summary:
+ *  Starts the parse of a new job document, clearing the fields of the
+ *  previous one.
+ *
+ *******************************************************************************/
+static void job_parse_begin(void)
+{
+    memset(&job, 0, sizeof(job));
+    memset(&job_parser, 0, sizeof(job_parser));
+    job_parser.state = JOB_STATE_OBJECT;
+    job_parser.result = OTA_JOB_PARSE_MORE;
+}
+
+/*******************************************************************************
+ * Function Name: job_parse_feed
+ *******************************************************************************
+ * Summary:
+ *  Parses the bytes of the job document. The parse stops at the end of the
+ *  object, at the first error, or as soon as the "Version" turns out not to
+ *  be newer than the running version, without looking at the rest of the
+ *  document.
+ *
+ * Parameters:
+ *  const char *data : Next bytes of the document
+ *  size_t len : Number of bytes
+ *
+ * Return:
+ *  ota_job_parse_result_t : OTA_JOB_PARSE_MORE until the parse stops.
+ *
+ *******************************************************************************/
+static ota_job_parse_result_t job_parse_feed(const char *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; (i < len) && (job_parser.state != JOB_STATE_END); i++)
+    {
+        job_parser.result = job_parse_byte(data[i]);
+        if (job_parser.result != OTA_JOB_PARSE_MORE)
+        {
+            job_parser.state = JOB_STATE_END;
+        }
+    }
+
+    return job_parser.result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_parse_document
+ *******************************************************************************
+ * Summary:
+ *  Parses a whole job document.
+ *
+ * Parameters:
+ *  const char *data : Job document
+ *  size_t len : Length of the document
+ *
+ * Return:
+ *  ota_job_parse_result_t : OTA_JOB_PARSE_DONE, OTA_JOB_PARSE_STALE or
+ *                           OTA_JOB_PARSE_ERROR, for a document cut short too.
+ *
+ *******************************************************************************/
+ota_job_parse_result_t ota_job_parse_document(const char *data, size_t len)
+{
+    job_parse_begin();
+
+    if (job_parse_feed(data, len) == OTA_JOB_PARSE_MORE)
+    {
+        job_parser.result = OTA_JOB_PARSE_ERROR;
+    }
+
+    return job_parser.result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_get
+ *******************************************************************************
+ * Summary:
+ *  Fields of the last job document parsed.
+ *
+ * Return:
+ *  const ota_job_t * : Fields of the job, NULL unless its parse completed.
+ *
+ *******************************************************************************/
+const ota_job_t *ota_job_get(void)
+{
+    return (job_parser.result == OTA_JOB_PARSE_DONE) ? &job : NULL;
+}
+
+/* [] END OF FILE */
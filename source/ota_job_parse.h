@@ -1,14 +1,10 @@
 /******************************************************************************
-* File Name:   heap_usage.c
+* File Name: ota_job_parse.h
 *
-* Description: This file contains the code for printing heap usage.
-*              Supports only GCC_ARM compiler. Define PRINT_HEAP_USAGE for
-*              printing the heap usage numbers.
+* Description: This file contains declaration of the single pass parser of
+* the OTA job document.
 *
-* Related Document: See README.md
-*
-*
-*******************************************************************************
+********************************************************************************
 * Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
 * an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
 *
@@ -41,61 +37,56 @@
 * so agrees to indemnify Cypress against all liability.
 *******************************************************************************/
 
-/*******************************************************************************
- * Header file includes
- ******************************************************************************/
-#include <stdint.h>
-#include <inttypes.h>
-#include <stdio.h>
-
-/* ARM compiler also defines __GNUC__ */
-#if defined (__GNUC__) && !defined(__ARMCC_VERSION)
-#include <malloc.h>
-#endif /* #if defined (__GNUC__) && !defined(__ARMCC_VERSION) */
-
-
-/*******************************************************************************
- * Macros
- ******************************************************************************/
-#define TO_KB(size_bytes)  ((float)(size_bytes)/1024)
+#ifndef SOURCE_OTA_JOB_PARSE_H_
+#define SOURCE_OTA_JOB_PARSE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
 
 /*******************************************************************************
- * Function Definitions
- ******************************************************************************/
+* Macros
+********************************************************************************/
+/* Sizes of the fields kept from the job document, with the terminating NUL */
+#define OTA_JOB_VERSION_SIZE                (16)
+#define OTA_JOB_NAME_SIZE                   (32)
+#define OTA_JOB_HOST_SIZE                   (128)
+#define OTA_JOB_FILE_SIZE                   (256)
+#define OTA_JOB_PEER_SIZE                   (40)
 
 /*******************************************************************************
-* Function Name: print_heap_usage
-********************************************************************************
-* Summary:
-* Prints the available heap and utilized heap by using mallinfo().
-*
-*******************************************************************************/
-void print_heap_usage(char *msg)
+* Types
+********************************************************************************/
+/* Fields of the job document known to the application, see scripts/ota_update.json.
+ * A field missing from the document is an empty string, or 0. */
+typedef struct
 {
-    /* ARM compiler also defines __GNUC__ */
-#if defined(PRINT_HEAP_USAGE) && defined (__GNUC__) && !defined(__ARMCC_VERSION)
-    struct mallinfo mall_info = mallinfo();
-
-    extern uint8_t __HeapBase;  /* Symbol exported by the linker. */
-    extern uint8_t __HeapLimit; /* Symbol exported by the linker. */
-
-    uint8_t* heap_base = (uint8_t *)&__HeapBase;
-    uint8_t* heap_limit = (uint8_t *)&__HeapLimit;
-    uint32_t heap_size = (uint32_t)(heap_limit - heap_base);
+    char        version[OTA_JOB_VERSION_SIZE];      /* "Version" of the image */
+    char        base_version[OTA_JOB_VERSION_SIZE]; /* "BaseVersion" a patch applies to */
+    char        board[OTA_JOB_NAME_SIZE];           /* "Board" */
+    char        connection[OTA_JOB_NAME_SIZE];      /* "Connection", HTTP or HTTPS */
+    char        compression[OTA_JOB_NAME_SIZE];     /* "Compression" of the payload */
+    char        server[OTA_JOB_HOST_SIZE];          /* "Server" of the image */
+    uint32_t    port;                               /* "Port", a string or a number */
+    char        file[OTA_JOB_FILE_SIZE];            /* "File" */
+    char        peers[OTA_PEER_MAX_PEERS][OTA_JOB_PEER_SIZE];  /* "Peers" serving the image */
+    uint32_t    peer_count;
+} ota_job_t;
 
-    printf("\r\n\n********** Heap Usage **********\r\n");
-    printf(msg);
-    printf("\r\nTotal available heap        : %"PRIu32" bytes/%.2f KB\r\n", heap_size, TO_KB(heap_size));
-
-    printf("Maximum heap utilized so far: %u bytes/%.2f KB, %.2f%% of available heap\r\n",
-            mall_info.arena, TO_KB(mall_info.arena), ((float) mall_info.arena * 100u)/heap_size);
-
-    printf("Heap in use at this point   : %u bytes/%.2f KB, %.2f%% of available heap\r\n",
-            mall_info.uordblks, TO_KB(mall_info.uordblks), ((float) mall_info.uordblks * 100u)/heap_size);
+/* Progress of the parse */
+typedef enum
+{
+    OTA_JOB_PARSE_MORE,         /* The parse goes on, not returned by ota_job_parse_document() */
+    OTA_JOB_PARSE_DONE,         /* The whole document is parsed */
+    OTA_JOB_PARSE_STALE,        /* The job is for a version not newer than the running one */
+    OTA_JOB_PARSE_ERROR         /* Malformed document, a field too long to keep or with an escape */
+} ota_job_parse_result_t;
 
-    printf("********************************\r\n\n");
-#endif /* #if defined(PRINT_HEAP_USAGE) && defined (__GNUC__) && !defined(__ARMCC_VERSION) */
-}
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+ota_job_parse_result_t ota_job_parse_document(const char *data, size_t len);
+const ota_job_t *ota_job_get(void);
 
-/* [] END OF FILE */
+#endif /* SOURCE_OTA_JOB_PARSE_H_ */
@@ -0,0 +1,581 @@
+/******************************************************************************
+* File Name: ota_job_poll.c
+*
+* Description: This file contains the conditional polling of the OTA job document
+* over a connection kept open between polls.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* OTA API */
+#include "cy_ota_api.h"
+/* HTTP client */
+#include "cy_http_client_api.h"
+/* Asynchronous log */
+#include "app_log.h"
+/* Fields of the job document */
+#include "ota_job_parse.h"
+#include "ota_job_poll.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Largest job document accepted, the agent copies it in a buffer of this size */
+#ifndef CY_OTA_JSON_DOC_BUFF_SIZE
+#define CY_OTA_JSON_DOC_BUFF_SIZE           (1024)
+#endif
+
+/* Room for the request and response headers next to the job document */
+#define JOB_POLL_HEADER_SPACE               (2048)
+
+/* Size of the buffer holding one request and its response */
+#define JOB_POLL_BUFFER_SIZE                (CY_OTA_JSON_DOC_BUFF_SIZE + JOB_POLL_HEADER_SPACE)
+
+/* Longest validator kept from a response, ETag or HTTP date */
+#define JOB_POLL_VALIDATOR_SIZE             (80)
+
+/* Longest server host name */
+#define JOB_POLL_HOST_NAME_SIZE             (128)
+
+/* HTTP status codes */
+#define HTTP_STATUS_OK                      (200)
+#define HTTP_STATUS_MULTIPLE_CHOICES        (300)
+#define HTTP_STATUS_NOT_MODIFIED            (304)
+
+/* Requests sent per poll, the second one after reconnecting when the server
+ * closed the kept-alive connection while idle */
+#define JOB_POLL_SEND_TRIES                 (2)
+
+/* Time the server takes beyond the requested wait before the device gives up */
+#define JOB_POLL_WAIT_MARGIN_MS             (10 * 1000)
+
+/* A held request answered faster than this was not held, the server does not
+ * support long polling */
+#define JOB_POLL_MIN_HOLD_MS                (1000)
+
+#if (OTA_JOB_NOTIFY_MODE == OTA_JOB_NOTIFY_LONG_POLL)
+/* Held requests wait for the job document longer than a plain request */
+#define JOB_POLL_TIMEOUT_RECEIVE            ((OTA_JOB_LONG_POLL_WAIT_SECS * 1000) + JOB_POLL_WAIT_MARGIN_MS)
+#else
+#define JOB_POLL_TIMEOUT_RECEIVE            (CY_OTA_HTTP_TIMEOUT_RECEIVE)
+#endif
+
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+/* Connection to the job server and validators of the last job document */
+typedef struct
+{
+    cy_http_client_t        client;
+    volatile bool           disconnected;   /* Set by the HTTP client */
+    char                    host_name[JOB_POLL_HOST_NAME_SIZE];
+    uint16_t                port;
+    cy_ota_connection_t     connection_type;
+    cy_awsport_ssl_credentials_t *credentials;
+    char                    etag[JOB_POLL_VALIDATOR_SIZE];
+    char                    last_modified[JOB_POLL_VALIDATOR_SIZE];
+    bool                    unchanged;      /* The last poll got a 304 */
+    bool                    no_hold;        /* The server answers held requests at once */
+} job_poll_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static job_poll_t job_poll;
+
+/* Request and response buffer of the job connection */
+static uint8_t job_poll_buffer[JOB_POLL_BUFFER_SIZE];
+
+/*******************************************************************************
+ * Function Name: job_poll_disconnect_callback
+ *******************************************************************************
+ * Summary:
+ *  HTTP client disconnect notification, the next poll reconnects.
+ *
+ * Parameters:
+ *  cy_http_client_t handle : HTTP client handle
+ *  cy_http_client_disconn_type_t type : Reason of the disconnection
+ *  void *args : Unused
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void job_poll_disconnect_callback(cy_http_client_t handle, cy_http_client_disconn_type_t type, void *args)
+{
+    (void)handle;
+    (void)type;
+    (void)args;
+
+    job_poll.disconnected = true;
+}
+
+/*******************************************************************************
+ * Function Name: job_poll_close
+ *******************************************************************************
+ * Summary:
+ *  Closes the job connection, if any.
+ *
+ *******************************************************************************/
+static void job_poll_close(void)
+{
+    if (job_poll.client != NULL)
+    {
+        cy_http_client_disconnect(job_poll.client);
+        cy_http_client_delete(job_poll.client);
+        job_poll.client = NULL;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: job_poll_open
+ *******************************************************************************
+ * Summary:
+ *  Opens the job connection, unless the one of the previous poll is still up.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t job_poll_open(void)
+{
+    cy_rslt_t result;
+    cy_awsport_server_info_t server_info;
+
+    if ((job_poll.client != NULL) && !job_poll.disconnected)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    job_poll_close();
+
+    memset(&server_info, 0, sizeof(server_info));
+    server_info.host_name = job_poll.host_name;
+    server_info.port = job_poll.port;
+
+    result = cy_http_client_create((job_poll.connection_type == CY_OTA_CONNECTION_HTTPS) ? job_poll.credentials : NULL,
+                                   &server_info, job_poll_disconnect_callback, NULL, &job_poll.client);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Creating the HTTP client for the job document failed.\n");
+        job_poll.client = NULL;
+        return result;
+    }
+
+    job_poll.disconnected = false;
+    result = cy_http_client_connect(job_poll.client, CY_OTA_HTTP_TIMEOUT_SEND, JOB_POLL_TIMEOUT_RECEIVE);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Connecting to %s:%d for the job document failed.\n", job_poll.host_name, job_poll.port);
+        cy_http_client_delete(job_poll.client);
+        job_poll.client = NULL;
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: job_poll_keep_header
+ *******************************************************************************
+ * Summary:
+ *  Copies a response header into a validator, which is left empty if the
+ *  server did not send the header or sent one too long to keep.
+ *
+ * Parameters:
+ *  cy_http_client_response_t *response : Response to the job request
+ *  const char *field : Header name
+ *  char *value : Validator, JOB_POLL_VALIDATOR_SIZE bytes
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void job_poll_keep_header(cy_http_client_response_t *response, const char *field, char *value)
+{
+    cy_http_client_header_t header;
+
+    value[0] = '\0';
+
+    memset(&header, 0, sizeof(header));
+    header.field = (char *)field;
+    header.field_len = strlen(field);
+
+    if ((CY_RSLT_SUCCESS == cy_http_client_read_header(job_poll.client, response, &header, 1)) &&
+        (header.value != NULL) && (header.value_len < JOB_POLL_VALIDATOR_SIZE))
+    {
+        memcpy(value, header.value, header.value_len);
+        value[header.value_len] = '\0';
+    }
+}
+
+/*******************************************************************************
+ * Function Name: job_poll_send
+ *******************************************************************************
+ * Summary:
+ *  Requests the job document, conditional on the validators of the last
+ *  document received. In long-poll mode the server is asked to hold the
+ *  request until the job document changes.
+ *
+ * Parameters:
+ *  const char *file : Job document path
+ *  cy_http_client_response_t *response : Response to the request
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS when a response was received, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t job_poll_send(const char *file, cy_http_client_response_t *response)
+{
+    cy_rslt_t result;
+    cy_http_client_request_header_t request;
+    cy_http_client_header_t headers[3];
+    uint32_t num_headers = 0;
+#if (OTA_JOB_NOTIFY_MODE == OTA_JOB_NOTIFY_LONG_POLL)
+    static char wait_value[16];
+#endif
+
+    result = job_poll_open();
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    memset(headers, 0, sizeof(headers));
+    if (job_poll.etag[0] != '\0')
+    {
+        headers[num_headers].field = "If-None-Match";
+        headers[num_headers].field_len = strlen(headers[num_headers].field);
+        headers[num_headers].value = job_poll.etag;
+        headers[num_headers].value_len = strlen(job_poll.etag);
+        num_headers++;
+    }
+    if (job_poll.last_modified[0] != '\0')
+    {
+        headers[num_headers].field = "If-Modified-Since";
+        headers[num_headers].field_len = strlen(headers[num_headers].field);
+        headers[num_headers].value = job_poll.last_modified;
+        headers[num_headers].value_len = strlen(job_poll.last_modified);
+        num_headers++;
+    }
+#if (OTA_JOB_NOTIFY_MODE == OTA_JOB_NOTIFY_LONG_POLL)
+    /* RFC 7240 "Prefer: wait", only a conditional request has anything to wait for */
+    if ((num_headers > 0) && !job_poll.no_hold)
+    {
+        snprintf(wait_value, sizeof(wait_value), "wait=%u", (unsigned int)OTA_JOB_LONG_POLL_WAIT_SECS);
+        headers[num_headers].field = "Prefer";
+        headers[num_headers].field_len = strlen(headers[num_headers].field);
+        headers[num_headers].value = wait_value;
+        headers[num_headers].value_len = strlen(wait_value);
+        num_headers++;
+    }
+#endif
+
+    memset(&request, 0, sizeof(request));
+    request.buffer = job_poll_buffer;
+    request.buffer_len = JOB_POLL_BUFFER_SIZE;
+    request.method = CY_HTTP_CLIENT_METHOD_GET;
+    request.resource_path = file;
+    request.range_start = -1;
+    request.range_end = -1;
+
+    result = cy_http_client_write_header(job_poll.client, &request, (num_headers > 0) ? headers : NULL, num_headers);
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_http_client_send(job_poll.client, &request, NULL, 0, response);
+    }
+    if ((CY_RSLT_SUCCESS == result) && job_poll.disconnected)
+    {
+        result = CY_RSLT_TYPE_ERROR;
+    }
+    if (CY_RSLT_SUCCESS != result)
+    {
+        job_poll_close();
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_poll_connect
+ *******************************************************************************
+ * Summary:
+ *  Job connect phase of the OTA agent. Reuses the connection of the previous
+ *  poll when it is still open to the same server.
+ *
+ * Parameters:
+ *  cy_ota_cb_struct_t *cb_data : Job server, from the OTA agent
+ *  cy_awsport_ssl_credentials_t *credentials : TLS credentials, for HTTPS
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_APP_SUCCESS or CY_OTA_CB_RSLT_APP_FAILED
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_job_poll_connect(cy_ota_cb_struct_t *cb_data, cy_awsport_ssl_credentials_t *credentials)
+{
+    job_poll.unchanged = false;
+
+    if ((cb_data->broker_server.host_name == NULL) ||
+        (strlen(cb_data->broker_server.host_name) >= JOB_POLL_HOST_NAME_SIZE))
+    {
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    /* Another server, or other credentials: the validators are not valid there */
+    if ((strcmp(job_poll.host_name, cb_data->broker_server.host_name) != 0) ||
+        (job_poll.port != cb_data->broker_server.port) ||
+        (job_poll.connection_type != cb_data->connection_type) ||
+        (job_poll.credentials != credentials))
+    {
+        job_poll_close();
+        strcpy(job_poll.host_name, cb_data->broker_server.host_name);
+        job_poll.port = cb_data->broker_server.port;
+        job_poll.connection_type = cb_data->connection_type;
+        job_poll.credentials = credentials;
+        job_poll.etag[0] = '\0';
+        job_poll.last_modified[0] = '\0';
+        job_poll.no_hold = false;
+    }
+
+    return (CY_RSLT_SUCCESS == job_poll_open()) ? CY_OTA_CB_RSLT_APP_SUCCESS : CY_OTA_CB_RSLT_APP_FAILED;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_poll_download
+ *******************************************************************************
+ * Summary:
+ *  Job download phase of the OTA agent. A new job document is parsed, and
+ *  copied to cb_data->json_doc for the agent. A 304 response ends the update
+ *  cycle before the parse, the job has not changed since the last poll, and
+ *  so does a job for a version not newer than the running one, before the
+ *  copy. In long-poll mode the server holds the request until it has a new
+ *  job, a held request that times out ends the cycle the same way, so that
+ *  cy_ota_stop() waits for one held request at most. The next check sends
+ *  the next held request.
+ *
+ * Parameters:
+ *  cy_ota_cb_struct_t *cb_data : Job document path and buffer, from the OTA agent
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_APP_SUCCESS for a new job document,
+ *                              CY_OTA_CB_RSLT_OTA_STOP for an unchanged or stale one,
+ *                              else CY_OTA_CB_RSLT_APP_FAILED.
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_job_poll_download(cy_ota_cb_struct_t *cb_data)
+{
+    cy_rslt_t result;
+    cy_http_client_response_t response;
+    ota_job_parse_result_t parse_result;
+    uint32_t tries;
+#if (OTA_JOB_NOTIFY_MODE == OTA_JOB_NOTIFY_LONG_POLL)
+    TickType_t sent;
+#endif
+
+    job_poll.unchanged = false;
+
+    result = CY_RSLT_TYPE_ERROR;
+#if (OTA_JOB_NOTIFY_MODE == OTA_JOB_NOTIFY_LONG_POLL)
+    sent = xTaskGetTickCount();
+#endif
+    for (tries = 0; (tries < JOB_POLL_SEND_TRIES) && (CY_RSLT_SUCCESS != result); tries++)
+    {
+        memset(&response, 0, sizeof(response));
+        result = job_poll_send(cb_data->file, &response);
+    }
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Requesting the job document '%s' failed.\n", cb_data->file);
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    if (response.status_code == HTTP_STATUS_NOT_MODIFIED)
+    {
+#if (OTA_JOB_NOTIFY_MODE == OTA_JOB_NOTIFY_LONG_POLL)
+        /* Held until the wait ran out, unless the server answered at once */
+        if (!job_poll.no_hold && (pdTICKS_TO_MS(xTaskGetTickCount() - sent) < JOB_POLL_MIN_HOLD_MS))
+        {
+            APP_LOG_INFO("The job server does not hold requests, polling every %u seconds.\n",
+                         (unsigned int)CY_OTA_NEXT_CHECK_INTERVAL_SECS);
+            job_poll.no_hold = true;
+        }
+#endif
+        job_poll.unchanged = true;
+        return CY_OTA_CB_RSLT_OTA_STOP;
+    }
+
+    /* A chunked or close delimited response has no Content-Length, the parser
+     * rejects a document cut short */
+    if ((response.status_code != HTTP_STATUS_OK) || (response.body_len == 0) ||
+        ((response.content_length != 0) && (response.body_len != response.content_length)) ||
+        (response.body_len >= CY_OTA_JSON_DOC_BUFF_SIZE))
+    {
+        APP_LOG_ERR("Invalid job document response, HTTP status %d, %lu bytes.\n",
+                    (int)response.status_code, (unsigned long)response.body_len);
+        job_poll_close();
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    /* Validators for the next poll */
+    job_poll_keep_header(&response, "ETag", job_poll.etag);
+    job_poll_keep_header(&response, "Last-Modified", job_poll.last_modified);
+
+    parse_result = ota_job_parse_document((const char *)response.body, response.body_len);
+    if (parse_result == OTA_JOB_PARSE_STALE)
+    {
+        /* Polls of this document are answered with a 304 from now on */
+        job_poll.unchanged = true;
+        return CY_OTA_CB_RSLT_OTA_STOP;
+    }
+    if (parse_result != OTA_JOB_PARSE_DONE)
+    {
+        APP_LOG_ERR("Invalid job document '%s'.\n", cb_data->file);
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    memcpy(cb_data->json_doc, response.body, response.body_len);
+    cb_data->json_doc[response.body_len] = '\0';
+
+    return CY_OTA_CB_RSLT_APP_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_poll_send_result
+ *******************************************************************************
+ * Summary:
+ *  Result send phase of the OTA agent. POSTs the result over the job
+ *  connection, opened again by ota_job_poll_connect() in the result connect
+ *  phase.
+ *
+ * Parameters:
+ *  cy_ota_cb_struct_t *cb_data : Result path, from the OTA agent
+ *  const char *body : Result JSON
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_APP_SUCCESS or CY_OTA_CB_RSLT_APP_FAILED
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_job_poll_send_result(cy_ota_cb_struct_t *cb_data, const char *body)
+{
+    cy_rslt_t result;
+    cy_http_client_request_header_t request;
+    cy_http_client_response_t response;
+    cy_http_client_header_t header;
+
+    result = job_poll_open();
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.field = "Content-Type";
+    header.field_len = strlen(header.field);
+    header.value = "application/json";
+    header.value_len = strlen(header.value);
+
+    memset(&request, 0, sizeof(request));
+    request.buffer = job_poll_buffer;
+    request.buffer_len = JOB_POLL_BUFFER_SIZE;
+    request.method = CY_HTTP_CLIENT_METHOD_POST;
+    request.resource_path = cb_data->file;
+    request.range_start = -1;
+    request.range_end = -1;
+
+    memset(&response, 0, sizeof(response));
+    result = cy_http_client_write_header(job_poll.client, &request, &header, 1);
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_http_client_send(job_poll.client, &request, (uint8_t *)body, strlen(body), &response);
+    }
+    if ((CY_RSLT_SUCCESS != result) || job_poll.disconnected)
+    {
+        APP_LOG_ERR("Sending the result to '%s' failed.\n", cb_data->file);
+        job_poll_close();
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    /* The update is done, a server that does not take results is not an error */
+    if ((response.status_code < HTTP_STATUS_OK) || (response.status_code >= HTTP_STATUS_MULTIPLE_CHOICES))
+    {
+        APP_LOG_ERR("The server answered the result with HTTP status %d.\n", (int)response.status_code);
+    }
+
+    return CY_OTA_CB_RSLT_APP_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_poll_disconnect
+ *******************************************************************************
+ * Summary:
+ *  Job disconnect phase of the OTA agent. The connection is kept for the
+ *  next poll, the server closing it is fine.
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_APP_SUCCESS
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_job_poll_disconnect(void)
+{
+    if (job_poll.disconnected)
+    {
+        job_poll_close();
+    }
+
+    return CY_OTA_CB_RSLT_APP_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_job_poll_unchanged
+ *******************************************************************************
+ * Summary:
+ *  Tells whether the last poll ended because the job document did not change,
+ *  or names a version not newer than the running one.
+ *
+ * Return:
+ *  bool : true after a 304 response or a stale job.
+ *
+ *******************************************************************************/
+bool ota_job_poll_unchanged(void)
+{
+    return job_poll.unchanged;
+}
@@ -0,0 +1,647 @@
+/******************************************************************************
+* File Name: ota_peer.c
+*
+* Description: This file contains the distribution of OTA images between
+* devices of the same subnet: a device running a validated image serves it over
+* HTTP, and the job document names the devices the others download it from.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cy_result.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* OTA API */
+#include "cy_ota_api.h"
+/* OTA flash access */
+#include "cy_ota_flash.h"
+/* Listening socket of the image server */
+#include "cy_secure_sockets.h"
+/* Asynchronous log */
+#include "app_log.h"
+#include "ota_peer.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#ifndef OTA_PEER_PORT
+#define OTA_PEER_PORT                       (8080)
+#endif
+
+/* The served image is the running one, in the primary slot */
+#if defined (FLASH_AREA_IMG_1_PRIMARY_START) && defined (FLASH_AREA_IMG_1_PRIMARY_SIZE)
+#define PEER_SERVER_SUPPORTED               (ENABLE_PEER_SERVER == true)
+#define PEER_IMAGE_START                    (FLASH_AREA_IMG_1_PRIMARY_START)
+#define PEER_IMAGE_SLOT_SIZE                (FLASH_AREA_IMG_1_PRIMARY_SIZE)
+#else
+#define PEER_SERVER_SUPPORTED               (0)
+#define PEER_IMAGE_START                    (0u)
+#define PEER_IMAGE_SLOT_SIZE                (0u)
+#endif
+
+/* Image of version a.b.c is served at /image/a.b.c */
+#define PEER_IMAGE_PATH                     "/image/"
+#define PEER_PATH_SIZE                      (sizeof(PEER_IMAGE_PATH) + OTA_JOB_VERSION_SIZE)
+
+/* Task serving the image, one connection at a time, below the application */
+#define PEER_SERVER_TASK_STACK_SIZE         (1024 * 2)
+#define PEER_SERVER_TASK_PRIORITY           (tskIDLE_PRIORITY + 2)
+
+/* Request line and headers of a request, and flash read per send */
+#define PEER_REQUEST_SIZE                   (512)
+#define PEER_SEND_SIZE                      (512)
+
+/* Idle connections are closed after this time */
+#define PEER_RECEIVE_TIMEOUT_MS             (10000)
+
+/*
+ * MCUboot image, as written by imgtool:
+ *
+ *   header  : magic, load address (uint32_t), header size, protected TLV size (uint16_t),
+ *             image size, flags (uint32_t), version (8 bytes), padding (uint32_t)
+ *   image   : image size bytes after the header
+ *   TLVs    : protected TLV area of protected TLV size bytes, if any, then the
+ *             TLV info (magic, total size including the info, uint16_t) and the TLVs
+ */
+#define MCUBOOT_IMAGE_MAGIC                 (0x96f3b83dUL)
+#define MCUBOOT_HEADER_SIZE                 (32u)
+#define MCUBOOT_TLV_INFO_MAGIC              (0x6907u)
+
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+/* The peers of the current job */
+typedef struct
+{
+    const ota_job_t     *job;
+    uint32_t            count;
+    char                path[PEER_PATH_SIZE];   /* Path of the image of the job */
+} peer_job_t;
+
+/* State of the image server */
+typedef struct
+{
+    uint32_t            image_size;             /* Signed image, header to TLVs */
+    char                path[PEER_PATH_SIZE];   /* Path of the running image */
+    char                request[PEER_REQUEST_SIZE + 1];
+    uint32_t            request_len;
+    uint8_t             data[PEER_SEND_SIZE];
+    uint32_t            served;                 /* Whole images sent */
+} peer_server_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static peer_job_t peer_job;
+
+#if (PEER_SERVER_SUPPORTED == 1)
+static peer_server_t peer_server;
+
+/*******************************************************************************
+ * Function Name: peer_image_size
+ *******************************************************************************
+ * Summary:
+ *  Size of the signed image in the primary slot, from its MCUboot header and
+ *  TLV info: the size of the file that was downloaded.
+ *
+ * Return:
+ *  uint32_t : Size of the image, 0 if the slot does not hold a valid image.
+ *
+ *******************************************************************************/
+static uint32_t peer_image_size(void)
+{
+    uint8_t header[MCUBOOT_HEADER_SIZE];
+    uint32_t magic;
+    uint16_t header_size;
+    uint16_t protected_size;
+    uint32_t image_size;
+    uint16_t tlv[2];
+    uint32_t tlv_start;
+
+    if (CY_RSLT_SUCCESS != cy_ota_mem_read(CY_OTA_MEM_TYPE_INTERNAL_FLASH, PEER_IMAGE_START,
+                                           header, sizeof(header)))
+    {
+        return 0;
+    }
+
+    memcpy(&magic, &header[0], sizeof(magic));
+    memcpy(&header_size, &header[8], sizeof(header_size));
+    memcpy(&protected_size, &header[10], sizeof(protected_size));
+    memcpy(&image_size, &header[12], sizeof(image_size));
+
+    tlv_start = (uint32_t)header_size + protected_size + image_size;
+    if ((magic != MCUBOOT_IMAGE_MAGIC) || (image_size >= PEER_IMAGE_SLOT_SIZE) ||
+        (tlv_start + sizeof(tlv) > PEER_IMAGE_SLOT_SIZE))
+    {
+        return 0;
+    }
+
+    if ((CY_RSLT_SUCCESS != cy_ota_mem_read(CY_OTA_MEM_TYPE_INTERNAL_FLASH, PEER_IMAGE_START + tlv_start,
+                                            tlv, sizeof(tlv))) ||
+        (tlv[0] != MCUBOOT_TLV_INFO_MAGIC) || ((tlv_start + tlv[1]) > PEER_IMAGE_SLOT_SIZE))
+    {
+        return 0;
+    }
+
+    return tlv_start + tlv[1];
+}
+
+/*******************************************************************************
+ * Function Name: peer_send
+ *******************************************************************************
+ * Summary:
+ *  Sends a buffer on a connection, all of it.
+ *
+ * Parameters:
+ *  cy_socket_t client : Connection
+ *  const void *data : Bytes to send
+ *  uint32_t len : Number of bytes
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t peer_send(cy_socket_t client, const void *data, uint32_t len)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    const uint8_t *next = (const uint8_t *)data;
+    uint32_t sent;
+
+    while ((len > 0) && (CY_RSLT_SUCCESS == result))
+    {
+        sent = 0;
+        result = cy_socket_send(client, next, len, CY_SOCKET_FLAGS_NONE, &sent);
+        next += sent;
+        len -= sent;
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: peer_header_value
+ *******************************************************************************
+ * Summary:
+ *  Finds a header of the request.
+ *
+ * Parameters:
+ *  const char *name : Header name followed by ':', any case
+ *
+ * Return:
+ *  const char * : Value of the header, NULL if the request does not have it.
+ *
+ *******************************************************************************/
+static const char *peer_header_value(const char *name)
+{
+    const char *line = strstr(peer_server.request, "\r\n");
+    size_t len = strlen(name);
+
+    while ((line != NULL) && (line[2] != '\r'))
+    {
+        line += 2;
+        if (strncasecmp(line, name, len) == 0)
+        {
+            line += len;
+            while (*line == ' ')
+            {
+                line++;
+            }
+            return line;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ * Function Name: peer_serve_request
+ *******************************************************************************
+ * Summary:
+ *  Answers the request in peer_server.request: a GET of the running image, of
+ *  all of it or of the range asked for.
+ *
+ * Parameters:
+ *  cy_socket_t client : Connection the request came from
+ *
+ * Return:
+ *  bool : true to keep the connection open for the next request.
+ *
+ *******************************************************************************/
+static bool peer_serve_request(cy_socket_t client)
+{
+    char header[160];
+    const char *range;
+    const char *connection;
+    uint32_t start = 0;
+    uint32_t end = peer_server.image_size;
+    uint32_t offset;
+    uint32_t len;
+    bool partial = false;
+    int header_len;
+
+    if (strncmp(peer_server.request, "GET ", 4) != 0)
+    {
+        header_len = snprintf(header, sizeof(header), "HTTP/1.1 405 Method Not Allowed\r\n"
+                                                      "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        (void)peer_send(client, header, (uint32_t)header_len);
+        return false;
+    }
+
+    /* Only the version this device runs */
+    len = strlen(peer_server.path);
+    if ((strncmp(&peer_server.request[4], peer_server.path, len) != 0) || (peer_server.request[4 + len] != ' '))
+    {
+        header_len = snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        return (CY_RSLT_SUCCESS == peer_send(client, header, (uint32_t)header_len));
+    }
+
+    /* Range: bytes=<first>-[<last>] or bytes=-<suffix length> */
+    range = peer_header_value("Range:");
+    if ((range != NULL) && (strncmp(range, "bytes=", 6) == 0))
+    {
+        const char *first = range + 6;
+        char *last;
+        uint32_t suffix;
+        bool valid;
+
+        if (*first == '-')
+        {
+            /* The last <suffix length> bytes */
+            suffix = (uint32_t)strtoul(first + 1, &last, 10);
+            valid = (first[1] >= '0') && (first[1] <= '9') && (suffix > 0);
+            start = (suffix < end) ? (end - suffix) : 0;
+        }
+        else
+        {
+            start = (uint32_t)strtoul(first, &last, 10);
+            valid = (*first >= '0') && (*first <= '9') && (*last == '-');
+            if (valid)
+            {
+                last++;
+                if ((*last >= '0') && (*last <= '9') && ((strtoul(last, NULL, 10) + 1) < end))
+                {
+                    end = (uint32_t)strtoul(last, NULL, 10) + 1;
+                }
+            }
+        }
+        if (!valid || (start >= end))
+        {
+            header_len = snprintf(header, sizeof(header), "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                                                          "Content-Range: bytes */%lu\r\nContent-Length: 0\r\n\r\n",
+                                  (unsigned long)peer_server.image_size);
+            return (CY_RSLT_SUCCESS == peer_send(client, header, (uint32_t)header_len));
+        }
+        partial = true;
+    }
+
+    if (partial)
+    {
+        header_len = snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\n"
+                                                      "Content-Type: application/octet-stream\r\n"
+                                                      "Content-Length: %lu\r\nContent-Range: bytes %lu-%lu/%lu\r\n\r\n",
+                              (unsigned long)(end - start), (unsigned long)start, (unsigned long)(end - 1),
+                              (unsigned long)peer_server.image_size);
+    }
+    else
+    {
+        header_len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+                                                      "Content-Type: application/octet-stream\r\n"
+                                                      "Content-Length: %lu\r\nAccept-Ranges: bytes\r\n\r\n",
+                              (unsigned long)peer_server.image_size);
+    }
+    if (CY_RSLT_SUCCESS != peer_send(client, header, (uint32_t)header_len))
+    {
+        return false;
+    }
+
+    for (offset = start; offset < end; offset += len)
+    {
+        len = ((end - offset) > PEER_SEND_SIZE) ? PEER_SEND_SIZE : (end - offset);
+        if ((CY_RSLT_SUCCESS != cy_ota_mem_read(CY_OTA_MEM_TYPE_INTERNAL_FLASH, PEER_IMAGE_START + offset,
+                                                peer_server.data, len)) ||
+            (CY_RSLT_SUCCESS != peer_send(client, peer_server.data, len)))
+        {
+            return false;
+        }
+    }
+
+    if (end == peer_server.image_size)
+    {
+        peer_server.served++;
+        APP_LOG_INFO("APP PEER: sent the end of the image, %lu times since the start\n",
+                     (unsigned long)peer_server.served);
+    }
+
+    connection = peer_header_value("Connection:");
+    return ((connection == NULL) || (strncasecmp(connection, "close", 5) != 0));
+}
+
+/*******************************************************************************
+ * Function Name: peer_serve_connection
+ *******************************************************************************
+ * Summary:
+ *  Answers the requests of a connection one after the other, until the
+ *  client closes it or stays idle for PEER_RECEIVE_TIMEOUT_MS.
+ *
+ * Parameters:
+ *  cy_socket_t client : Accepted connection
+ *
+ *******************************************************************************/
+static void peer_serve_connection(cy_socket_t client)
+{
+    uint32_t timeout = PEER_RECEIVE_TIMEOUT_MS;
+    uint32_t received;
+    char *header_end;
+    uint32_t request_end;
+
+    (void)cy_socket_setsockopt(client, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_RCVTIMEO, &timeout, sizeof(timeout));
+    peer_server.request_len = 0;
+
+    while (true)
+    {
+        peer_server.request[peer_server.request_len] = '\0';
+        header_end = strstr(peer_server.request, "\r\n\r\n");
+        if (header_end == NULL)
+        {
+            if (peer_server.request_len == PEER_REQUEST_SIZE)
+            {
+                /* Not a request of the range download */
+                return;
+            }
+
+            received = 0;
+            if ((CY_RSLT_SUCCESS != cy_socket_recv(client, &peer_server.request[peer_server.request_len],
+                                                   PEER_REQUEST_SIZE - peer_server.request_len,
+                                                   CY_SOCKET_FLAGS_NONE, &received)) || (received == 0))
+            {
+                return;
+            }
+            peer_server.request_len += received;
+            continue;
+        }
+
+        /* A GET has no body, what follows belongs to the next request */
+        request_end = (uint32_t)(header_end - peer_server.request) + 4;
+        header_end[2] = '\0';
+        if (!peer_serve_request(client))
+        {
+            return;
+        }
+        memmove(peer_server.request, &peer_server.request[request_end], peer_server.request_len - request_end);
+        peer_server.request_len -= request_end;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: peer_server_task
+ *******************************************************************************
+ * Summary:
+ *  Task serving the running image to the other devices on OTA_PEER_PORT.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ *******************************************************************************/
+static void peer_server_task(void *args)
+{
+    cy_socket_t listener;
+    cy_socket_t client;
+    cy_socket_sockaddr_t address;
+    uint32_t address_len;
+
+    (void)args;
+
+    memset(&address, 0, sizeof(address));
+    address.port = OTA_PEER_PORT;
+    address.ip_address.version = CY_SOCKET_IP_VER_V4;
+
+    if ((CY_RSLT_SUCCESS != cy_socket_create(CY_SOCKET_DOMAIN_AF_INET, CY_SOCKET_TYPE_STREAM,
+                                             CY_SOCKET_IPPROTO_TCP, &listener)) ||
+        (CY_RSLT_SUCCESS != cy_socket_bind(listener, &address, sizeof(address))) ||
+        (CY_RSLT_SUCCESS != cy_socket_listen(listener, 1)))
+    {
+        APP_LOG_ERR("Opening port %d for the peer downloads failed\n", OTA_PEER_PORT);
+        vTaskDelete(NULL);
+    }
+
+    APP_LOG_INFO("APP PEER: serving %lu bytes at %s on port %d\n", (unsigned long)peer_server.image_size,
+                 peer_server.path, OTA_PEER_PORT);
+
+    while (true)
+    {
+        address_len = sizeof(address);
+        if (CY_RSLT_SUCCESS != cy_socket_accept(listener, &address, &address_len, &client))
+        {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        peer_serve_connection(client);
+        (void)cy_socket_disconnect(client, 0);
+        (void)cy_socket_delete(client);
+    }
+}
+#endif /* PEER_SERVER_SUPPORTED */
+
+/*******************************************************************************
+ * Function Name: ota_peer_server_start
+ *******************************************************************************
+ * Summary:
+ *  Starts serving the running image to the other devices of the subnet. Call
+ *  it once the image is validated and the network is up. The image is served
+ *  as it is, the devices downloading it check its signature like for a
+ *  download from the server.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success or when the server is disabled,
+ *              else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_peer_server_start(void)
+{
+#if (PEER_SERVER_SUPPORTED == 1)
+    peer_server.image_size = peer_image_size();
+    if (peer_server.image_size == 0)
+    {
+        APP_LOG_ERR("The primary slot does not hold an image to serve to the peers.\n");
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    snprintf(peer_server.path, sizeof(peer_server.path), PEER_IMAGE_PATH "%d.%d.%d",
+             APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
+
+    if (pdPASS != xTaskCreate(peer_server_task, "PEER TASK", PEER_SERVER_TASK_STACK_SIZE, NULL,
+                              PEER_SERVER_TASK_PRIORITY, NULL))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+#endif
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_peer_job_parse
+ *******************************************************************************
+ * Summary:
+ *  Takes the peers serving the image from the job document, a list of
+ *  addresses or host names. The image is downloaded from them before the
+ *  server. A job without peers downloads from the server only.
+ *
+ * Parameters:
+ *  const ota_job_t *job : Fields of the job document
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_OTA_CONTINUE
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_peer_job_parse(const ota_job_t *job)
+{
+#if (ENABLE_PEER_DOWNLOAD == true)
+    peer_job.job = job;
+    peer_job.count = (job->version[0] != '\0') ? job->peer_count : 0;
+    snprintf(peer_job.path, sizeof(peer_job.path), PEER_IMAGE_PATH "%s", job->version);
+
+    if (peer_job.count > 0)
+    {
+        APP_LOG_INFO("The job names %lu peers serving %s.\n", (unsigned long)peer_job.count, peer_job.path);
+    }
+#else
+    (void)job;
+#endif
+
+    return CY_OTA_CB_RSLT_OTA_CONTINUE;
+}
+
+/*******************************************************************************
+ * Function Name: ota_peer_image_check
+ *******************************************************************************
+ * Summary:
+ *  Checks the MCUboot header at the start of the image a peer serves against
+ *  the job. Peers are reached over plain HTTP: the signature keeps a modified
+ *  image out, the version check keeps out an older signed image, which would
+ *  otherwise roll the device back.
+ *
+ * Parameters:
+ *  const uint8_t *data : First bytes of the image, from offset 0
+ *  uint32_t len : Number of bytes
+ *
+ * Return:
+ *  bool : true when the header is valid and holds the Version of the job.
+ *
+ *******************************************************************************/
+bool ota_peer_image_check(const uint8_t *data, uint32_t len)
+{
+    uint32_t magic;
+    uint16_t revision;
+    unsigned int major;
+    unsigned int minor;
+    unsigned int build;
+
+    if ((len < MCUBOOT_HEADER_SIZE) ||
+        (sscanf(peer_job.job->version, "%u.%u.%u", &major, &minor, &build) != 3))
+    {
+        APP_LOG_ERR("The peer image is too short for an MCUboot header.\n");
+        return false;
+    }
+
+    memcpy(&magic, &data[0], sizeof(magic));
+    memcpy(&revision, &data[22], sizeof(revision));
+    if ((magic != MCUBOOT_IMAGE_MAGIC) || (data[20] != major) || (data[21] != minor) || (revision != build))
+    {
+        APP_LOG_ERR("The peer image is version %u.%u.%u, the job is for %s.\n",
+                    (unsigned int)data[20], (unsigned int)data[21], (unsigned int)revision, peer_job.job->version);
+        return false;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: ota_peer_count
+ *******************************************************************************
+ * Summary:
+ *  Number of peers named by the current job.
+ *
+ * Return:
+ *  uint32_t : Number of peers, 0 to download from the server only.
+ *
+ *******************************************************************************/
+uint32_t ota_peer_count(void)
+{
+    return peer_job.count;
+}
+
+/*******************************************************************************
+ * Function Name: ota_peer_host
+ *******************************************************************************
+ * Summary:
+ *  Address or host name of a peer of the current job, served on OTA_PEER_PORT.
+ *
+ * Parameters:
+ *  uint32_t index : Peer, less than ota_peer_count()
+ *
+ * Return:
+ *  const char * : Address or host name of the peer.
+ *
+ *******************************************************************************/
+const char *ota_peer_host(uint32_t index)
+{
+    return peer_job.job->peers[index];
+}
+
+/*******************************************************************************
+ * Function Name: ota_peer_path
+ *******************************************************************************
+ * Summary:
+ *  Path of the image of the current job on the peers.
+ *
+ * Return:
+ *  const char * : Resource path of the image.
+ *
+ *******************************************************************************/
+const char *ota_peer_path(void)
+{
+    return peer_job.path;
+}
+
+/* [] END OF FILE */
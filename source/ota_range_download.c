@@ -0,0 +1,1157 @@
+/******************************************************************************
+* File Name: ota_range_download.c
+*
+* Description: This file contains the resumable OTA image download using HTTP
+* Range requests.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* OTA API */
+#include "cy_ota_api.h"
+/* HTTP client */
+#include "cy_http_client_api.h"
+#include "ota_range_download.h"
+/* A patch has to be applied, and a compressed payload decompressed, in order */
+#include "ota_delta.h"
+#include "ota_decompress.h"
+/* Devices of the subnet serving the image */
+#include "ota_peer.h"
+/* Asynchronous log */
+#include "app_log.h"
+/* Free heap */
+#include "telemetry.h"
+/* Download rate limit */
+#include "ota_rate_limit.h"
+/* Resume point kept in flash */
+#include "flash_record.h"
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Room for the request and response headers next to the data of one range */
+#define RANGE_HEADER_SPACE                  (2048)
+
+/* Size of the buffer holding one request and its response */
+#define RANGE_BUFFER_SIZE                   (RANGE_DOWNLOAD_CHUNK_SIZE + RANGE_HEADER_SPACE)
+
+/* HTTP status codes */
+#define HTTP_STATUS_OK                      (200)
+#define HTTP_STATUS_PARTIAL_CONTENT         (206)
+
+/* Tasks running the additional connections of a parallel download */
+#define RANGE_WORKER_TASK_STACK_SIZE        (1024 * 4)
+#define RANGE_WORKER_TASK_PRIORITY          (configMAX_PRIORITIES - 3)
+
+/* Heap needed by one additional connection: task stack, range buffer and TLS session */
+#define RANGE_CONNECTION_HEAP_SIZE          ((RANGE_WORKER_TASK_STACK_SIZE * sizeof(StackType_t)) + \
+                                             RANGE_BUFFER_SIZE + (40 * 1024))
+
+/* Heap left to the rest of the application during a parallel download */
+#define RANGE_HEAP_RESERVE                  (32 * 1024)
+
+/* Failed requests before a peer is left for the next peer or the server */
+#define RANGE_PEER_MAX_TRIES                (1)
+
+/* First word of an MCUboot image, little endian */
+#define MCUBOOT_IMAGE_MAGIC                 (0x96f3b83dUL)
+
+#ifndef RANGE_DOWNLOAD_RESUME_SAVE_BYTES
+#define RANGE_DOWNLOAD_RESUME_SAVE_BYTES    (0)
+#endif
+
+/* A download resumes after a reset where the rows it stored are left in the upgrade slot */
+#if (ENABLE_RANGE_DOWNLOAD == true) && (RANGE_DOWNLOAD_RESUME_SAVE_BYTES > 0) && (CY_OTA_MEM_UPGRADE_SLOT_WRITE == 1)
+#define RANGE_RESUME                        (1)
+#else
+#define RANGE_RESUME                        (0)
+#endif
+
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+/* One connection and the slice of the image it downloads */
+typedef struct
+{
+    uint32_t                    offset;         /* Next byte to fetch */
+    uint32_t                    end;            /* End of the slice */
+    uint32_t                    failures;       /* Failed requests in a row */
+    cy_http_client_t            client;
+    volatile bool               disconnected;   /* Set by the HTTP client */
+    uint8_t                     *buffer;        /* Request and response buffer */
+    cy_ota_callback_results_t   result;
+} range_worker_t;
+
+/* State shared by the connections of one download */
+typedef struct
+{
+    cy_ota_context_ptr                  ctx_ptr;
+    cy_ota_cb_struct_t                  *cb_data;
+    const cy_ota_storage_interface_t    *storage;
+    cy_awsport_ssl_credentials_t        *credentials;
+    uint32_t                            total_size;
+    uint32_t                            stored;         /* Bytes in storage, all connections */
+    uint32_t                            progress;       /* Step of the last progress message */
+    uint32_t                            peers;          /* Peers tried before the server */
+    uint32_t                            source;         /* Current peer, peers for the server */
+    uint32_t                            peer_bytes;     /* Bytes stored from the peers */
+    volatile bool                       abort;          /* A connection gave up */
+    SemaphoreHandle_t                   write_lock;     /* The storage is not reentrant */
+    SemaphoreHandle_t                   done;           /* Given by each finished worker task */
+    bool                                resumable;      /* The resume point is saved */
+    uint32_t                            saved;          /* Resume point of the last save */
+} range_download_t;
+
+/* Resume point of the download of a full image, kept in flash */
+typedef struct
+{
+    char                                version[OTA_JOB_VERSION_SIZE];
+    char                                server[OTA_JOB_HOST_SIZE];
+    char                                file[OTA_JOB_FILE_SIZE];
+    uint32_t                            total_size;
+    uint32_t                            offset;         /* Bytes stored from the start of the image */
+} range_resume_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Request and response buffer of the first connection */
+static uint8_t range_buffer[RANGE_BUFFER_SIZE];
+
+static range_download_t range_download;
+static range_worker_t range_workers[CY_OTA_HTTP_PARALLEL_CONNECTIONS];
+
+/* Set while ota_range_download() runs, the storage writes take no tokens then */
+static volatile bool range_active;
+
+#if (RANGE_RESUME == 1)
+/* The job being downloaded, with its last resume point, and the record read from flash */
+static range_resume_t range_resume;
+static range_resume_t range_resume_saved;
+
+/* range_resume names a full image */
+static bool range_resume_job;
+#endif
+
+/* Offset the next download resumes at, a sector boundary, 0 to start at byte 0 */
+static uint32_t range_resume_at;
+
+/*******************************************************************************
+ * Function Name: range_disconnect_callback
+ *******************************************************************************
+ * Summary:
+ *  HTTP client disconnect notification.
+ *
+ * Parameters:
+ *  cy_http_client_t handle : HTTP client handle
+ *  cy_http_client_disconn_type_t type : Reason of the disconnection
+ *  void *args : Worker owning the connection
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void range_disconnect_callback(cy_http_client_t handle, cy_http_client_disconn_type_t type, void *args)
+{
+    range_worker_t *worker = (range_worker_t *)args;
+
+    (void)handle;
+    (void)type;
+
+    worker->disconnected = true;
+}
+
+/*******************************************************************************
+ * Function Name: range_connect
+ *******************************************************************************
+ * Summary:
+ *  Opens a connection to the current source of the OTA image: a peer, over
+ *  HTTP, or the server.
+ *
+ * Parameters:
+ *  range_worker_t *worker : Worker to connect
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t range_connect(range_worker_t *worker)
+{
+    cy_rslt_t result;
+    cy_awsport_server_info_t server_info;
+    cy_ota_cb_struct_t *cb_data = range_download.cb_data;
+
+    bool tls = (cb_data->connection_type == CY_OTA_CONNECTION_HTTPS);
+
+    memset(&server_info, 0, sizeof(server_info));
+    server_info.host_name = cb_data->broker_server.host_name;
+    server_info.port = cb_data->broker_server.port;
+    if (range_download.source < range_download.peers)
+    {
+        /* The image is signed and its version checked, a peer does not need to be trusted */
+        server_info.host_name = ota_peer_host(range_download.source);
+        server_info.port = OTA_PEER_PORT;
+        tls = false;
+    }
+
+    result = cy_http_client_create(tls ? range_download.credentials : NULL,
+                                   &server_info, range_disconnect_callback, worker, &worker->client);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Creating the HTTP client for the range download failed.\n");
+        worker->client = NULL;
+        return result;
+    }
+
+    worker->disconnected = false;
+    result = cy_http_client_connect(worker->client, CY_OTA_HTTP_TIMEOUT_SEND, CY_OTA_HTTP_TIMEOUT_RECEIVE);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Connecting to %s:%d for the range download failed.\n",
+                    server_info.host_name, server_info.port);
+        cy_http_client_delete(worker->client);
+        worker->client = NULL;
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: range_disconnect
+ *******************************************************************************
+ * Summary:
+ *  Closes the connection opened by range_connect(), if any.
+ *
+ * Parameters:
+ *  range_worker_t *worker : Worker to disconnect
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void range_disconnect(range_worker_t *worker)
+{
+    if (worker->client != NULL)
+    {
+        cy_http_client_disconnect(worker->client);
+        cy_http_client_delete(worker->client);
+        worker->client = NULL;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: range_max_tries
+ *******************************************************************************
+ * Summary:
+ *  Failed requests in a row before the current source is given up.
+ *
+ * Return:
+ *  uint32_t : RANGE_PEER_MAX_TRIES for a peer, CY_OTA_MAX_DOWNLOAD_TRIES for the server.
+ *
+ *******************************************************************************/
+static uint32_t range_max_tries(void)
+{
+    return (range_download.source < range_download.peers) ? RANGE_PEER_MAX_TRIES : CY_OTA_MAX_DOWNLOAD_TRIES;
+}
+
+/*******************************************************************************
+ * Function Name: range_next_source
+ *******************************************************************************
+ * Summary:
+ *  Leaves a peer that failed for the next peer, or for the server after the
+ *  last one. The download resumes at the offset of the worker.
+ *
+ * Parameters:
+ *  range_worker_t *worker : Worker downloading from the peer
+ *
+ * Return:
+ *  bool : true when the download moved on, false when the server failed.
+ *
+ *******************************************************************************/
+static bool range_next_source(range_worker_t *worker)
+{
+    if (range_download.source >= range_download.peers)
+    {
+        return false;
+    }
+
+    range_disconnect(worker);
+    worker->failures = 0;
+    APP_LOG_INFO("Peer %s failed at byte %lu, downloading from %s.\n", ota_peer_host(range_download.source),
+                 (unsigned long)worker->offset, ((range_download.source + 1) < range_download.peers) ?
+                 ota_peer_host(range_download.source + 1) : range_download.cb_data->broker_server.host_name);
+    range_download.source++;
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: range_total_size
+ *******************************************************************************
+ * Summary:
+ *  Gets the size of the whole file from the "Content-Range: bytes a-b/size"
+ *  header of a 206 response.
+ *
+ * Parameters:
+ *  cy_http_client_t client : HTTP client handle
+ *  cy_http_client_response_t *response : Response to a range request
+ *
+ * Return:
+ *  uint32_t : Size of the file, 0 if the server did not tell.
+ *
+ *******************************************************************************/
+static uint32_t range_total_size(cy_http_client_t client, cy_http_client_response_t *response)
+{
+    cy_http_client_header_t header;
+    const char *slash;
+
+    memset(&header, 0, sizeof(header));
+    header.field = "Content-Range";
+    header.field_len = strlen(header.field);
+
+    if ((CY_RSLT_SUCCESS != cy_http_client_read_header(client, response, &header, 1)) ||
+        (header.value == NULL))
+    {
+        return 0;
+    }
+
+    slash = memchr(header.value, '/', header.value_len);
+    if (slash == NULL)
+    {
+        return 0;
+    }
+
+    /* "*" when the size is unknown, strtoul() returns 0 */
+    return (uint32_t)strtoul(slash + 1, NULL, 10);
+}
+
+/*******************************************************************************
+ * Function Name: range_fetch
+ *******************************************************************************
+ * Summary:
+ *  Requests the next range of the slice of a worker, connecting as needed.
+ *  A failed request drops the connection, the next call reconnects. The
+ *  received body takes its tokens from the rate limit here, before it is
+ *  checked or stored, so that a worker waiting for tokens neither holds the
+ *  write lock nor sends its next request.
+ *
+ * Parameters:
+ *  range_worker_t *worker : Worker issuing the request
+ *  cy_http_client_response_t *response : Response to the request
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS when a response was received, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t range_fetch(range_worker_t *worker, cy_http_client_response_t *response)
+{
+    cy_rslt_t result;
+    cy_http_client_request_header_t request;
+    uint32_t range_end;
+
+    if (worker->client == NULL)
+    {
+        if (worker->failures > 0)
+        {
+            APP_LOG_INFO("Resuming the download of '%s' at byte %lu.\n",
+                         range_download.cb_data->file, (unsigned long)worker->offset);
+            vTaskDelay(pdMS_TO_TICKS(CY_OTA_RETRY_INTERVAL_SECS * 1000));
+        }
+
+        result = range_connect(worker);
+        if (CY_RSLT_SUCCESS != result)
+        {
+            return result;
+        }
+    }
+
+    /* Range: bytes=<offset>-<last byte of the range> */
+    range_end = worker->offset + RANGE_DOWNLOAD_CHUNK_SIZE;
+    if (range_end > worker->end)
+    {
+        range_end = worker->end;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.buffer = worker->buffer;
+    request.buffer_len = RANGE_BUFFER_SIZE;
+    request.method = CY_HTTP_CLIENT_METHOD_GET;
+    request.resource_path = (range_download.source < range_download.peers) ? ota_peer_path() :
+                            range_download.cb_data->file;
+    request.range_start = (int32_t)worker->offset;
+    request.range_end = (int32_t)(range_end - 1);
+
+    result = cy_http_client_write_header(worker->client, &request, NULL, 0);
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_http_client_send(worker->client, &request, NULL, 0, response);
+    }
+    if ((CY_RSLT_SUCCESS == result) && worker->disconnected)
+    {
+        result = CY_RSLT_TYPE_ERROR;
+    }
+    if (CY_RSLT_SUCCESS != result)
+    {
+        range_disconnect(worker);
+        return result;
+    }
+
+    ota_rate_limit_consume(response->body_len);
+
+    return result;
+}
+
+#if (RANGE_RESUME == 1)
+/*******************************************************************************
+ * Function Name: range_resume_committed
+ *******************************************************************************
+ * Summary:
+ *  Bytes stored from the start of the image, with no gap: the offset of the
+ *  first connection, in the order of the slices, that has not finished its
+ *  slice. Called with the write lock taken.
+ *
+ * Return:
+ *  uint32_t : Bytes stored from the start of the image.
+ *
+ *******************************************************************************/
+static uint32_t range_resume_committed(void)
+{
+    range_worker_t *worker;
+    uint32_t i;
+
+    for (i = 0; i < CY_OTA_HTTP_PARALLEL_CONNECTIONS; i++)
+    {
+        worker = &range_workers[i];
+        if ((i > 0) && (worker->buffer == NULL))
+        {
+            continue;
+        }
+        if (worker->offset < worker->end)
+        {
+            return worker->offset;
+        }
+    }
+
+    return range_download.total_size;
+}
+#endif
+
+/*******************************************************************************
+ * Function Name: range_resume_save
+ *******************************************************************************
+ * Summary:
+ *  Saves the resume point in flash every RANGE_DOWNLOAD_RESUME_SAVE_BYTES.
+ *  The record is written after the rows stored so far, through the same
+ *  writer, so it never points past a row that is not in flash. Called with
+ *  the write lock taken.
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void range_resume_save(void)
+{
+#if (RANGE_RESUME == 1)
+    uint32_t offset;
+
+    if (!range_download.resumable)
+    {
+        return;
+    }
+
+    offset = range_resume_committed();
+    if ((offset >= range_download.total_size) ||
+        (offset < (range_download.saved + RANGE_DOWNLOAD_RESUME_SAVE_BYTES)))
+    {
+        return;
+    }
+
+    range_resume.total_size = range_download.total_size;
+    range_resume.offset = offset;
+    if (CY_RSLT_SUCCESS == flash_record_write(FLASH_RECORD_TAG_RANGE_RESUME, &range_resume, sizeof(range_resume)))
+    {
+        range_download.saved = offset;
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: range_resume_drop
+ *******************************************************************************
+ * Summary:
+ *  Stops saving the resume point and drops the saved one, the next download
+ *  starts at byte 0.
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void range_resume_drop(void)
+{
+#if (RANGE_RESUME == 1)
+    if (range_download.resumable || (range_download.saved > 0))
+    {
+        range_download.resumable = false;
+        range_download.saved = 0;
+        (void)flash_record_erase(FLASH_RECORD_TAG_RANGE_RESUME);
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: range_store
+ *******************************************************************************
+ * Summary:
+ *  Writes the body of a response at the offset of the worker. Writes of all
+ *  connections go through the same offset-addressed storage path.
+ *
+ * Parameters:
+ *  range_worker_t *worker : Worker that received the response
+ *  cy_http_client_response_t *response : Response holding the range
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+static cy_rslt_t range_store(range_worker_t *worker, cy_http_client_response_t *response)
+{
+    cy_rslt_t result;
+    cy_ota_storage_write_info_t chunk_info;
+    uint32_t percentage;
+
+    memset(&chunk_info, 0, sizeof(chunk_info));
+    chunk_info.total_size = range_download.total_size;
+    chunk_info.offset = worker->offset;
+    chunk_info.buffer = response->body;
+    chunk_info.size = response->body_len;
+
+    xSemaphoreTake(range_download.write_lock, portMAX_DELAY);
+    result = range_download.storage->ota_file_write(range_download.ctx_ptr, &chunk_info);
+    if (CY_RSLT_SUCCESS == result)
+    {
+        /* Everything below offset is in storage, a reconnect resumes from here */
+        worker->offset += response->body_len;
+        worker->failures = 0;
+        range_resume_save();
+
+        range_download.stored += response->body_len;
+        if (range_download.source < range_download.peers)
+        {
+            range_download.peer_bytes += response->body_len;
+        }
+
+        percentage = (uint32_t)(((uint64_t)range_download.stored * 100) / range_download.total_size);
+        if (app_log_progress(&range_download.progress, percentage))
+        {
+            APP_LOG_INFO("APP RANGE DOWNLOAD %lu%% (%lu of %lu)\n", (unsigned long)percentage,
+                         (unsigned long)range_download.stored, (unsigned long)range_download.total_size);
+        }
+    }
+    else
+    {
+        /* The rows stored before may not have been programmed either */
+        range_resume_drop();
+    }
+    xSemaphoreGive(range_download.write_lock);
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        APP_LOG_ERR("Storing the range at %lu failed.\n", (unsigned long)worker->offset);
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: range_download_slice
+ *******************************************************************************
+ * Summary:
+ *  Downloads and stores the slice of a worker, using 206 responses only.
+ *
+ * Parameters:
+ *  range_worker_t *worker : Worker to run
+ *
+ * Return:
+ *  cy_ota_callback_results_t : CY_OTA_CB_RSLT_APP_SUCCESS or CY_OTA_CB_RSLT_APP_FAILED
+ *
+ *******************************************************************************/
+static cy_ota_callback_results_t range_download_slice(range_worker_t *worker)
+{
+    cy_http_client_response_t response;
+
+    while (worker->offset < worker->end)
+    {
+        if (range_download.abort)
+        {
+            return CY_OTA_CB_RSLT_APP_FAILED;
+        }
+
+        if (CY_RSLT_SUCCESS != range_fetch(worker, &response))
+        {
+            if ((++worker->failures >= range_max_tries()) && !range_next_source(worker))
+            {
+                APP_LOG_ERR("Range download of '%s' failed at byte %lu.\n",
+                            range_download.cb_data->file, (unsigned long)worker->offset);
+                return CY_OTA_CB_RSLT_APP_FAILED;
+            }
+            continue;
+        }
+
+        if ((response.status_code != HTTP_STATUS_PARTIAL_CONTENT) || (response.body_len == 0) ||
+            ((worker->offset + response.body_len) > worker->end))
+        {
+            if (range_next_source(worker))
+            {
+                continue;
+            }
+            APP_LOG_ERR("Invalid range response for '%s', HTTP status %d.\n",
+                        range_download.cb_data->file, (int)response.status_code);
+            return CY_OTA_CB_RSLT_APP_FAILED;
+        }
+
+        if (CY_RSLT_SUCCESS != range_store(worker, &response))
+        {
+            return CY_OTA_CB_RSLT_APP_FAILED;
+        }
+    }
+
+    return CY_OTA_CB_RSLT_APP_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: range_worker_task
+ *******************************************************************************
+ * Summary:
+ *  Task running one additional connection of a parallel download.
+ *
+ * Parameters:
+ *  void *args : Worker to run
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void range_worker_task(void *args)
+{
+    range_worker_t *worker = (range_worker_t *)args;
+
+    worker->result = range_download_slice(worker);
+    if (worker->result != CY_OTA_CB_RSLT_APP_SUCCESS)
+    {
+        range_download.abort = true;
+    }
+    range_disconnect(worker);
+
+    xSemaphoreGive(range_download.done);
+    vTaskDelete(NULL);
+}
+
+/*******************************************************************************
+ * Function Name: range_connection_count
+ *******************************************************************************
+ * Summary:
+ *  Number of connections to use for what is left of the image, bounded by
+ *  CY_OTA_HTTP_PARALLEL_CONNECTIONS and by the free heap. A patch or a
+ *  compressed payload is downloaded over a single connection since it is
+ *  applied as it arrives, and so is an image from a peer, which serves one
+ *  connection at a time.
+ *
+ * Parameters:
+ *  uint32_t remaining : Bytes still to download
+ *
+ * Return:
+ *  uint32_t : Number of connections, at least 1.
+ *
+ *******************************************************************************/
+static uint32_t range_connection_count(uint32_t remaining)
+{
+    uint32_t count = CY_OTA_HTTP_PARALLEL_CONNECTIONS;
+    uint32_t chunks = (remaining + RANGE_DOWNLOAD_CHUNK_SIZE - 1) / RANGE_DOWNLOAD_CHUNK_SIZE;
+    uint32_t free_heap;
+    uint32_t heap_limit;
+
+    if ((count <= 1) || ota_delta_is_active() || ota_decompress_is_active() ||
+        (range_download.source < range_download.peers))
+    {
+        return 1;
+    }
+
+    telemetry_log_heap("before the parallel range download");
+
+    /* Unknown heap usage (0) leaves a single connection */
+    free_heap = telemetry_heap_free();
+    heap_limit = (free_heap > RANGE_HEAP_RESERVE) ?
+                 (1 + ((free_heap - RANGE_HEAP_RESERVE) / RANGE_CONNECTION_HEAP_SIZE)) : 1;
+
+    if (count > heap_limit)
+    {
+        APP_LOG_INFO("Free heap %lu bytes, limiting the download to %lu connections.\n",
+                     (unsigned long)free_heap, (unsigned long)heap_limit);
+        count = heap_limit;
+    }
+    if (count > chunks)
+    {
+        count = (chunks > 0) ? chunks : 1;
+    }
+
+    return count;
+}
+
+/*******************************************************************************
+ * Function Name: range_download_image
+ *******************************************************************************
+ * Summary:
+ *  Downloads the OTA image in place of the OTA agent, with HTTP Range requests
+ *  of RANGE_DOWNLOAD_CHUNK_SIZE bytes. Each range is handed to the storage
+ *  before the next one is requested, so when a connection drops it reconnects
+ *  and resumes at the first byte not stored yet instead of starting over. A
+ *  connection gives up after CY_OTA_MAX_DOWNLOAD_TRIES failed requests in a row.
+ *
+ *  The first response tells the size of the image. What is left of it is then
+ *  split in up to CY_OTA_HTTP_PARALLEL_CONNECTIONS slices, each downloaded over
+ *  its own connection and written at its own offset in the upgrade slot.
+ *
+ *  A full image is downloaded from the peers named by the job first, one
+ *  after the other, and from the server once they all failed.
+ *
+ *  The resume point of a full MCUboot image is saved in flash as it is
+ *  stored. The download of the same job after a reset starts there, from
+ *  the server, see ota_range_download_job_parse().
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  cy_ota_cb_struct_t *cb_data : OTA agent callback data for the data download
+ *  const cy_ota_storage_interface_t *storage : Storage the image is written to
+ *  cy_awsport_ssl_credentials_t *credentials : TLS credentials for HTTPS
+ *
+ * Return:
+ *  cy_ota_callback_results_t :
+ *   CY_OTA_CB_RSLT_APP_SUCCESS when the whole image has been stored,
+ *   CY_OTA_CB_RSLT_OTA_CONTINUE when the server does not support Range requests,
+ *   the OTA agent then does a full download,
+ *   CY_OTA_CB_RSLT_APP_FAILED otherwise.
+ *
+ *******************************************************************************/
+static cy_ota_callback_results_t range_download_image(cy_ota_context_ptr ctx_ptr, cy_ota_cb_struct_t *cb_data,
+                                                     const cy_ota_storage_interface_t *storage,
+                                                     cy_awsport_ssl_credentials_t *credentials)
+{
+    static SemaphoreHandle_t write_lock = NULL;
+    static SemaphoreHandle_t done = NULL;
+    static StaticSemaphore_t write_lock_struct;
+    static StaticSemaphore_t done_struct;
+    cy_ota_callback_results_t cb_result = CY_OTA_CB_RSLT_APP_SUCCESS;
+    cy_http_client_response_t response;
+    range_worker_t *first = &range_workers[0];
+    uint32_t connections;
+    uint32_t started = 0;
+    uint32_t slice;
+    uint32_t resume_at = range_resume_at;
+    uint32_t i;
+
+    /* The slot has been opened with the stored rows kept, this once */
+    range_resume_at = 0;
+
+    if (write_lock == NULL)
+    {
+        write_lock = xSemaphoreCreateMutexStatic(&write_lock_struct);
+        done = xSemaphoreCreateCountingStatic(CY_OTA_HTTP_PARALLEL_CONNECTIONS, 0, &done_struct);
+    }
+
+    memset(&range_download, 0, sizeof(range_download));
+    memset(range_workers, 0, sizeof(range_workers));
+    range_download.ctx_ptr = ctx_ptr;
+    range_download.cb_data = cb_data;
+    range_download.storage = storage;
+    range_download.credentials = credentials;
+    range_download.write_lock = write_lock;
+    range_download.done = done;
+    range_download.progress = UINT32_MAX;
+#if (RANGE_RESUME == 1)
+    range_download.resumable = range_resume_job;
+#endif
+    range_download.saved = resume_at;
+    range_download.stored = resume_at;
+
+    /* Peers serve the image, not a patch or a compressed payload */
+    range_download.peers = ota_peer_count();
+    if ((range_download.peers > 0) && (ota_delta_is_active() || ota_decompress_is_active()))
+    {
+        APP_LOG_INFO("Peers only serve full images, downloading '%s' from the server.\n", cb_data->file);
+        range_download.peers = 0;
+    }
+
+    /* The version of a peer is checked in the header, which is not downloaded again */
+    if ((range_download.peers > 0) && (resume_at > 0))
+    {
+        APP_LOG_INFO("Resuming '%s' from the server.\n", cb_data->file);
+        range_download.peers = 0;
+    }
+
+    /* The first range tells whether the server supports ranges, and the image size */
+    first->buffer = range_buffer;
+    first->offset = resume_at;
+    first->end = resume_at + RANGE_DOWNLOAD_CHUNK_SIZE;
+    while (true)
+    {
+        if (CY_RSLT_SUCCESS != range_fetch(first, &response))
+        {
+            if ((++first->failures >= range_max_tries()) && !range_next_source(first))
+            {
+                APP_LOG_ERR("Range download of '%s' could not start.\n", cb_data->file);
+                return CY_OTA_CB_RSLT_APP_FAILED;
+            }
+            continue;
+        }
+
+        /*
+         * A peer without the image answers 404. The header in the first range
+         * is signed with the rest of the image, once it holds the version of
+         * the job any peer can serve the other ranges.
+         */
+        if ((range_download.source == range_download.peers) ||
+            ((response.status_code == HTTP_STATUS_PARTIAL_CONTENT) && (range_total_size(first->client, &response) > 0) &&
+             ota_peer_image_check(response.body, response.body_len)) ||
+            !range_next_source(first))
+        {
+            break;
+        }
+    }
+
+    if (response.status_code == HTTP_STATUS_OK)
+    {
+        /* The server ignored the Range header, fine if the whole file fit */
+        if (resume_at > 0)
+        {
+            /* The agent would write over the rows kept in the slot */
+            APP_LOG_INFO("Server does not support Range requests, '%s' is downloaded again on the next attempt.\n",
+                         cb_data->file);
+            range_resume_drop();
+            range_disconnect(first);
+            return CY_OTA_CB_RSLT_APP_FAILED;
+        }
+        if (response.body_len != response.content_length)
+        {
+            APP_LOG_INFO("Server does not support Range requests, falling back to a full download.\n");
+            range_disconnect(first);
+            return CY_OTA_CB_RSLT_OTA_CONTINUE;
+        }
+        range_download.total_size = response.body_len;
+    }
+    else if (response.status_code == HTTP_STATUS_PARTIAL_CONTENT)
+    {
+        range_download.total_size = range_total_size(first->client, &response);
+    }
+
+    if ((range_download.total_size == 0) || (response.body_len == 0) ||
+        ((first->offset + response.body_len) > range_download.total_size))
+    {
+        APP_LOG_ERR("Range request for '%s' failed with HTTP status %d.\n",
+                    cb_data->file, (int)response.status_code);
+        range_disconnect(first);
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+#if (RANGE_RESUME == 1)
+    if ((resume_at > 0) && (range_download.total_size != range_resume.total_size))
+    {
+        APP_LOG_INFO("'%s' changed since the download was interrupted, it is downloaded again on the next attempt.\n",
+                     cb_data->file);
+        range_resume_drop();
+        range_disconnect(first);
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    /* Only an MCUboot image is written to the slot as it is received, see ota_storage_write_payload() */
+    if ((resume_at == 0) && ((response.body_len < sizeof(uint32_t)) ||
+        ((response.body[0] | ((uint32_t)response.body[1] << 8) | ((uint32_t)response.body[2] << 16) |
+          ((uint32_t)response.body[3] << 24)) != MCUBOOT_IMAGE_MAGIC)))
+    {
+        range_resume_drop();
+    }
+#endif
+
+    first->end = range_download.total_size;
+    if (CY_RSLT_SUCCESS != range_store(first, &response))
+    {
+        range_disconnect(first);
+        return CY_OTA_CB_RSLT_APP_FAILED;
+    }
+
+    /* Split the rest in whole ranges, the first connection keeps the first slice */
+    connections = range_connection_count(range_download.total_size - first->offset);
+    slice = (range_download.total_size - first->offset + connections - 1) / connections;
+    slice = ((slice + RANGE_DOWNLOAD_CHUNK_SIZE - 1) / RANGE_DOWNLOAD_CHUNK_SIZE) * RANGE_DOWNLOAD_CHUNK_SIZE;
+
+    for (i = connections - 1; i > 0; i--)
+    {
+        range_worker_t *worker = &range_workers[i];
+
+        worker->offset = first->offset + (i * slice);
+        if (worker->offset >= range_download.total_size)
+        {
+            continue;
+        }
+        worker->end = first->end;
+        first->end = worker->offset;
+
+        worker->buffer = pvPortMalloc(RANGE_BUFFER_SIZE);
+        if ((worker->buffer == NULL) ||
+            (pdPASS != xTaskCreate(range_worker_task, "RANGE TASK", RANGE_WORKER_TASK_STACK_SIZE, worker,
+                                   RANGE_WORKER_TASK_PRIORITY, NULL)))
+        {
+            /* Not enough heap after all, the first connection takes that slice back */
+            vPortFree(worker->buffer);
+            worker->buffer = NULL;
+            first->end = worker->end;
+            continue;
+        }
+        started++;
+    }
+
+    if (started > 0)
+    {
+        APP_LOG_INFO("Downloading '%s' over %lu connections.\n", cb_data->file, (unsigned long)(started + 1));
+    }
+
+    cb_result = range_download_slice(first);
+    if (cb_result != CY_OTA_CB_RSLT_APP_SUCCESS)
+    {
+        range_download.abort = true;
+    }
+    range_disconnect(first);
+
+    for (i = 0; i < started; i++)
+    {
+        xSemaphoreTake(range_download.done, portMAX_DELAY);
+    }
+    for (i = 1; i < CY_OTA_HTTP_PARALLEL_CONNECTIONS; i++)
+    {
+        if (range_workers[i].buffer != NULL)
+        {
+            if (range_workers[i].result != CY_OTA_CB_RSLT_APP_SUCCESS)
+            {
+                cb_result = CY_OTA_CB_RSLT_APP_FAILED;
+            }
+            vPortFree(range_workers[i].buffer);
+        }
+    }
+
+    if (cb_result == CY_OTA_CB_RSLT_APP_SUCCESS)
+    {
+        APP_LOG_INFO("Range download of '%s' complete, %lu bytes, %lu from peers, %lu before a reset.\n",
+                     cb_data->file, (unsigned long)range_download.total_size, (unsigned long)range_download.peer_bytes,
+                     (unsigned long)resume_at);
+    }
+    else if (range_download.saved > 0)
+    {
+        APP_LOG_INFO("The next download of '%s' resumes at the sector holding byte %lu.\n",
+                     cb_data->file, (unsigned long)range_download.saved);
+    }
+
+    return cb_result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_range_download
+ *******************************************************************************
+ * Summary:
+ *  Downloads the OTA image with range_download_image(). The workers take the
+ *  tokens of the rate limit as they receive, ota_range_download_is_active()
+ *  tells the storage write not to take them again.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  cy_ota_cb_struct_t *cb_data : OTA agent callback data for the data download
+ *  const cy_ota_storage_interface_t *storage : Storage the image is written to
+ *  cy_awsport_ssl_credentials_t *credentials : TLS credentials for HTTPS
+ *
+ * Return:
+ *  cy_ota_callback_results_t : See range_download_image().
+ *
+ *******************************************************************************/
+cy_ota_callback_results_t ota_range_download(cy_ota_context_ptr ctx_ptr, cy_ota_cb_struct_t *cb_data,
+                                             const cy_ota_storage_interface_t *storage,
+                                             cy_awsport_ssl_credentials_t *credentials)
+{
+    cy_ota_callback_results_t cb_result;
+
+    range_active = true;
+    cb_result = range_download_image(ctx_ptr, cb_data, storage, credentials);
+    range_active = false;
+
+    return cb_result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_range_download_is_active
+ *******************************************************************************
+ * Summary:
+ *  Tells whether the storage writes come from a range download.
+ *
+ * Return:
+ *  bool : true while ota_range_download() runs.
+ *
+ *******************************************************************************/
+bool ota_range_download_is_active(void)
+{
+    return range_active;
+}
+
+/*******************************************************************************
+ * Function Name: ota_range_download_job_parse
+ *******************************************************************************
+ * Summary:
+ *  Takes the image of a new job, after the delta update and the compressed
+ *  download have parsed it. When a download of the same full image, from
+ *  the same server, was interrupted by a reset, the rows it saved are kept
+ *  through the erase of the upgrade slot and the download resumes after
+ *  them. Any other saved resume point is dropped, the slot is erased for
+ *  this job.
+ *
+ * Parameters:
+ *  const ota_job_t *job : Job document
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+void ota_range_download_job_parse(const ota_job_t *job)
+{
+    range_resume_at = 0;
+
+#if (RANGE_RESUME == 1)
+    memset(&range_resume, 0, sizeof(range_resume));
+    range_resume_job = !ota_delta_is_active() && !ota_decompress_is_active();
+    if (range_resume_job)
+    {
+        memcpy(range_resume.version, job->version, sizeof(range_resume.version));
+        memcpy(range_resume.server, job->server, sizeof(range_resume.server));
+        memcpy(range_resume.file, job->file, sizeof(range_resume.file));
+    }
+
+    if (CY_RSLT_SUCCESS == flash_record_read(FLASH_RECORD_TAG_RANGE_RESUME, &range_resume_saved,
+                                             sizeof(range_resume_saved)))
+    {
+        if (range_resume_job &&
+            (memcmp(range_resume.version, range_resume_saved.version, sizeof(range_resume.version)) == 0) &&
+            (memcmp(range_resume.server, range_resume_saved.server, sizeof(range_resume.server)) == 0) &&
+            (memcmp(range_resume.file, range_resume_saved.file, sizeof(range_resume.file)) == 0))
+        {
+            range_resume.total_size = range_resume_saved.total_size;
+            range_resume_at = range_resume_saved.offset;
+        }
+        else
+        {
+            (void)flash_record_erase(FLASH_RECORD_TAG_RANGE_RESUME);
+        }
+    }
+
+    /* Also clears what a job that was not downloaded asked to keep */
+    range_resume_at = cy_ota_mem_write_keep(range_resume_at);
+    if (range_resume_at > 0)
+    {
+        APP_LOG_INFO("Resuming the download of '%s' at byte %lu\n", job->file, (unsigned long)range_resume_at);
+    }
+#else
+    (void)job;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_range_download_resume_offset
+ *******************************************************************************
+ * Summary:
+ *  Tells where the download of the current job resumes.
+ *
+ * Return:
+ *  uint32_t : Bytes of the image kept in the upgrade slot, 0 if it starts over.
+ *
+ *******************************************************************************/
+uint32_t ota_range_download_resume_offset(void)
+{
+    return range_resume_at;
+}
+
+/*******************************************************************************
+ * Function Name: ota_range_download_resume_pending
+ *******************************************************************************
+ * Summary:
+ *  Tells whether a resume point is saved in flash, the upgrade slot then
+ *  holds the start of an image and is not erased in the background.
+ *
+ * Return:
+ *  bool : true if a download can resume.
+ *
+ *******************************************************************************/
+bool ota_range_download_resume_pending(void)
+{
+#if (RANGE_RESUME == 1)
+    return (CY_RSLT_SUCCESS == flash_record_read(FLASH_RECORD_TAG_RANGE_RESUME, &range_resume_saved,
+                                                 sizeof(range_resume_saved)));
+#else
+    return false;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_range_download_resume_clear
+ *******************************************************************************
+ * Summary:
+ *  Drops the saved resume point once the whole image is stored, before it
+ *  is verified.
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+void ota_range_download_resume_clear(void)
+{
+#if (RANGE_RESUME == 1)
+    range_resume_job = false;
+    (void)flash_record_erase(FLASH_RECORD_TAG_RANGE_RESUME);
+#endif
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+* File Name: ota_range_download.h
+*
+* Description: This file contains declaration of the resumable OTA image
+* download using HTTP Range requests.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_RANGE_DOWNLOAD_H_
+#define SOURCE_OTA_RANGE_DOWNLOAD_H_
+
+#include <stdbool.h>
+#include "cy_ota_api.h"
+#include "ota_job_parse.h"
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_ota_callback_results_t ota_range_download(cy_ota_context_ptr ctx_ptr, cy_ota_cb_struct_t *cb_data,
+                                             const cy_ota_storage_interface_t *storage,
+                                             cy_awsport_ssl_credentials_t *credentials);
+bool ota_range_download_is_active(void);
+void ota_range_download_job_parse(const ota_job_t *job);
+uint32_t ota_range_download_resume_offset(void);
+bool ota_range_download_resume_pending(void);
+void ota_range_download_resume_clear(void);
+
+#endif /* SOURCE_OTA_RANGE_DOWNLOAD_H_ */
@@ -0,0 +1,228 @@
+/******************************************************************************
+* File Name: ota_rate_limit.c
+*
+* Description: This file contains the rate limit of the OTA downloads: a
+* token bucket refilled at OTA_RATE_LIMIT_BYTES_PER_SEC, and an adaptive pause
+* when the wake-up latency of the application task goes over
+* OTA_RATE_LIMIT_LATENCY_US.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdint.h>
+#include <stdbool.h>
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* Asynchronous log */
+#include "app_log.h"
+/* Wake-up latency of the application task */
+#include "telemetry.h"
+#include "ota_rate_limit.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#ifndef OTA_RATE_LIMIT_BYTES_PER_SEC
+#define OTA_RATE_LIMIT_BYTES_PER_SEC        (0)
+#endif
+
+#ifndef OTA_RATE_LIMIT_BURST_BYTES
+#define OTA_RATE_LIMIT_BURST_BYTES          (8192)
+#endif
+
+#ifndef OTA_RATE_LIMIT_LATENCY_US
+#define OTA_RATE_LIMIT_LATENCY_US           (0)
+#endif
+
+#ifndef OTA_RATE_LIMIT_BACKOFF_MS
+#define OTA_RATE_LIMIT_BACKOFF_MS           (20)
+#endif
+
+/* The latency is measured by the telemetry hooks */
+#if (OTA_RATE_LIMIT_LATENCY_US > 0) && !defined(TELEMETRY)
+#error "OTA_RATE_LIMIT_LATENCY_US needs the latency of the telemetry build, set TELEMETRY=1 in the Makefile"
+#endif
+
+#if (OTA_RATE_LIMIT_LATENCY_US > 0)
+#define RATE_LIMIT_ADAPTIVE                 (1)
+#else
+#define RATE_LIMIT_ADAPTIVE                 (0)
+#endif
+
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+/* Token bucket of the download, in bytes */
+typedef struct
+{
+    int32_t         tokens;             /* Negative while the last chunk is paid off */
+    uint32_t        remainder;          /* Refill not counted in tokens yet, in bytes x 1000 */
+    TickType_t      last_refill;
+    uint32_t        wait_ms;            /* Time spent waiting for tokens */
+    uint32_t        backoffs;           /* Pauses for the application latency */
+    uint32_t        worst_latency_us;   /* Worst latency seen by the adaptive mode */
+} rate_limit_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static rate_limit_t rate_limit;
+
+#if (OTA_RATE_LIMIT_BYTES_PER_SEC > 0)
+/*******************************************************************************
+ * Function Name: rate_limit_refill
+ *******************************************************************************
+ * Summary:
+ *  Adds the tokens earned since the previous refill, up to the burst size.
+ *
+ *******************************************************************************/
+static void rate_limit_refill(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint64_t earned;
+    int64_t tokens;
+
+    earned = ((uint64_t)(now - rate_limit.last_refill) * portTICK_PERIOD_MS * OTA_RATE_LIMIT_BYTES_PER_SEC) +
+             rate_limit.remainder;
+    rate_limit.last_refill = now;
+    rate_limit.remainder = (uint32_t)(earned % 1000u);
+
+    tokens = (int64_t)rate_limit.tokens + (int64_t)(earned / 1000u);
+    rate_limit.tokens = (tokens > OTA_RATE_LIMIT_BURST_BYTES) ? OTA_RATE_LIMIT_BURST_BYTES : (int32_t)tokens;
+}
+#endif /* OTA_RATE_LIMIT_BYTES_PER_SEC */
+
+/*******************************************************************************
+ * Function Name: ota_rate_limit_begin
+ *******************************************************************************
+ * Summary:
+ *  Starts the rate limit of a download with a full bucket.
+ *
+ *******************************************************************************/
+void ota_rate_limit_begin(void)
+{
+    rate_limit.tokens = OTA_RATE_LIMIT_BURST_BYTES;
+    rate_limit.remainder = 0;
+    rate_limit.last_refill = xTaskGetTickCount();
+    rate_limit.wait_ms = 0;
+    rate_limit.backoffs = 0;
+    rate_limit.worst_latency_us = 0;
+
+#if (RATE_LIMIT_ADAPTIVE == 1)
+    /* Only what happens during the download counts */
+    (void)telemetry_latency_max_us(true);
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_rate_limit_consume
+ *******************************************************************************
+ * Summary:
+ *  Takes the tokens of a received chunk before it is stored, waiting while
+ *  the bucket is in debt. A chunk larger than the bucket is let through and
+ *  paid off before the next one. In the adaptive mode, pauses the download if
+ *  the application task woke up late since the previous chunk. The range
+ *  workers call it concurrently as they receive: the bucket is updated in a
+ *  critical section and each caller waits for the debt it leaves.
+ *
+ * Parameters:
+ *  size_t bytes : Size of the chunk
+ *
+ *******************************************************************************/
+void ota_rate_limit_consume(size_t bytes)
+{
+#if (OTA_RATE_LIMIT_BYTES_PER_SEC > 0)
+    uint32_t wait_ms = 0;
+
+    taskENTER_CRITICAL();
+    rate_limit_refill();
+    rate_limit.tokens -= (int32_t)bytes;
+    if (rate_limit.tokens < 0)
+    {
+        wait_ms = (uint32_t)((((uint64_t)(-rate_limit.tokens) * 1000u) + OTA_RATE_LIMIT_BYTES_PER_SEC - 1u) /
+                             OTA_RATE_LIMIT_BYTES_PER_SEC);
+        rate_limit.wait_ms += wait_ms;
+    }
+    taskEXIT_CRITICAL();
+
+    if (wait_ms > 0)
+    {
+        vTaskDelay(pdMS_TO_TICKS(wait_ms));
+    }
+#else
+    (void)bytes;
+#endif
+
+#if (RATE_LIMIT_ADAPTIVE == 1)
+    uint32_t latency_us = telemetry_latency_max_us(true);
+    bool backoff = (latency_us > OTA_RATE_LIMIT_LATENCY_US);
+
+    taskENTER_CRITICAL();
+    if (latency_us > rate_limit.worst_latency_us)
+    {
+        rate_limit.worst_latency_us = latency_us;
+    }
+    if (backoff)
+    {
+        rate_limit.backoffs++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (backoff)
+    {
+        vTaskDelay(pdMS_TO_TICKS(OTA_RATE_LIMIT_BACKOFF_MS));
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_rate_limit_report
+ *******************************************************************************
+ * Summary:
+ *  Logs how much the rate limit held the download back.
+ *
+ *******************************************************************************/
+void ota_rate_limit_report(void)
+{
+#if (OTA_RATE_LIMIT_BYTES_PER_SEC > 0) || (RATE_LIMIT_ADAPTIVE == 1)
+    APP_LOG_INFO("APP RATE LIMIT: %lu ms waiting for tokens, %lu pauses, worst application latency %lu us\n",
+                 (unsigned long)rate_limit.wait_ms, (unsigned long)rate_limit.backoffs,
+                 (unsigned long)rate_limit.worst_latency_us);
+#endif
+}
+
+/* [] END OF FILE */
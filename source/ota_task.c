@@ -40,9 +40,6 @@
 #include "cyhal.h"
 #include "cybsp.h"
 #include "cy_retarget_io.h"
-/* Ethernet connection manager header files */
-#include "cy_ecm.h"
-#include "cy_ecm_error.h"
 /* IoT SDK, Secure Sockets, and HTTP initialization */
 #include "cy_tcpip_port_secure_sockets.h"
 /* FreeRTOS */
@@ -54,33 +51,53 @@
 #include "cy_ota_api.h"
 /* OTA storage api */
 #include "cy_ota_storage_api.h"
-/* Ethernet PHY driver */
-#include "cy_eth_phy_driver.h"
+/* OTA flash write buffer */
+#include "cy_ota_flash_ext.h"
+/* Resumable image download */
+#include "ota_range_download.h"
+/* TLS session resumption */
+#include "tls_session_cache.h"
+/* mbedTLS known-answer test */
+#include "crypto_selftest.h"
+/* Delta update */
+#include "ota_delta.h"
+/* Compressed download */
+#include "ota_decompress.h"
+/* Conditional job polling */
+#include "ota_job_poll.h"
+/* Image distribution between devices */
+#include "ota_peer.h"
+/* Fields of the job document */
+#include "ota_job_parse.h"
+/* Asynchronous log */
+#include "app_log.h"
+/* Update phase timing */
+#include "ota_timing.h"
+/* Download rate limit */
+#include "ota_rate_limit.h"
+/* Task and heap telemetry */
+#include "telemetry.h"
+/* Ethernet bring-up and network cache */
+#include "network_task.h"
 /*******************************************************************************
 * Macros
 ********************************************************************************/
-/* MAX connection retries to join Ethernet */
-#define MAX_CONNECTION_RETRIES              (10)
-
-/* Wait between connection retries */
-#define ETHERNET_CONN_RETRY_DELAY_MS        (500)
-
 /* Application ID */
 #define APP_ID                              (0)
 
-/* Ethernet interface ID */
-#ifdef XMC7100D_F176K4160
-#define INTERFACE_ID                        CY_ECM_INTERFACE_ETH0
-#else
-#define INTERFACE_ID                        CY_ECM_INTERFACE_ETH1
-#endif
+/* First word of an MCUboot image, little endian */
+#define MCUBOOT_IMAGE_MAGIC                 (0x96f3b83dUL)
 
 /*******************************************************************************
 * Forward declaration
 ********************************************************************************/
-cy_rslt_t ethernet_connect(void);
 cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data);
-void print_heap_usage(char *msg);
+cy_rslt_t ota_storage_open(cy_ota_context_ptr ctx_ptr);
+cy_rslt_t ota_storage_write(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info);
+cy_rslt_t ota_storage_write_payload(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info);
+cy_rslt_t ota_storage_close(cy_ota_context_ptr ctx_ptr);
+cy_rslt_t ota_storage_verify(cy_ota_context_ptr ctx_ptr);
+void ota_erase_progress(uint32_t erased_sectors, uint32_t total_sectors);
 
 /*******************************************************************************
 * Global Variables
@@ -88,6 +105,13 @@ void print_heap_usage(char *msg);
 /* OTA context */
 cy_ota_context_ptr ota_context;
 
+/* The download is an MCUboot image, not a TAR archive: its chunks are written
+ * to the upgrade slot without going through the OTA storage library */
+static bool ota_slot_write;
+
+/* The downloaded image passed the verify, the agent reboots into it */
+static bool ota_image_verified;
+
 /* Network parameters for OTA */
 cy_ota_network_params_t ota_network_params =
 {
@@ -115,6 +139,7 @@ cy_ota_network_params_t ota_network_params =
         },
     #endif
     },
+    /* Periodic or long-poll job requests, see OTA_JOB_NOTIFY_MODE */
     .use_get_job_flow = CY_OTA_JOB_FLOW,
 #if (ENABLE_TLS == true)
     .initial_connection = CY_OTA_CONNECTION_HTTPS,
@@ -130,17 +155,21 @@ cy_ota_agent_params_t ota_agent_params =
     .cb_arg = &ota_context,
     .reboot_upon_completion = 1, /* Reboot after completing OTA with success. */
     .validate_after_reboot = 1,
+#if (OTA_TIMING_SEND_REPORT == true)
+    .do_not_send_result = 0     /* The result carries the timing report */
+#else
     .do_not_send_result = 1
+#endif
 };
 
 /* OTA storage interface callbacks */
 cy_ota_storage_interface_t ota_interfaces =
 {
-   .ota_file_open            = cy_ota_storage_open,
+   .ota_file_open            = ota_storage_open,
    .ota_file_read            = cy_ota_storage_read,
-   .ota_file_write           = cy_ota_storage_write,
-   .ota_file_close           = cy_ota_storage_close,
-   .ota_file_verify          = cy_ota_storage_verify,
+   .ota_file_write           = ota_storage_write,
+   .ota_file_close           = ota_storage_close,
+   .ota_file_verify          = ota_storage_verify,
    .ota_file_validate        = cy_ota_storage_image_validate,
    .ota_file_get_app_info    = cy_ota_storage_get_app_info
 };
@@ -160,6 +189,18 @@ cy_ota_storage_interface_t ota_interfaces =
  *******************************************************************************/
 void ota_task(void *args)
 {
+    ota_timing_init();
+    ota_timing_reboot_check();
+
+    /* Bring the Ethernet link up while the storage is initialized and the image validated */
+    if (CY_RSLT_SUCCESS != network_task_start())
+    {
+        printf("\n Starting the network task failed.\n");
+        CY_ASSERT(0);
+    }
+
+    ota_timing_startup_begin(OTA_STARTUP_STORAGE);
+
     /* initialize OTA storage */
     if (CY_RSLT_SUCCESS != cy_ota_storage_init())
     {
@@ -174,15 +215,44 @@ void ota_task(void *args)
         printf("\n Failed to validate the update.\n");
         CY_ASSERT(0);
     }
+
+    /* The previous image is not needed anymore, get the upgrade slot ready for the next update,
+     * unless it holds the start of a download to resume */
+    if(!ota_range_download_resume_pending() && (CY_RSLT_SUCCESS != cy_ota_mem_pre_erase_start()))
+    {
+        printf("\n Starting the upgrade slot pre-erase failed.\n");
+    }
+#endif
+    ota_timing_startup_end(OTA_STARTUP_STORAGE);
+
+    /* Report progress of the upgrade slot erase */
+    cy_ota_mem_set_erase_progress_callback(ota_erase_progress);
+
+    ota_timing_startup_begin(OTA_STARTUP_SELFTEST);
+#if (ENABLE_CRYPTO_SELFTEST == true)
+    /* Check the mbedTLS hash and cipher before trusting them with TLS and the image.
+     * On a failure the application keeps running, without updates. */
+    if(CY_RSLT_SUCCESS != crypto_selftest())
+    {
+        printf("\n Crypto self test failed, OTA updates are disabled.\n");
+        vTaskSuspend( NULL );
+    }
+#endif
+
+#if (ENABLE_CRYPTO_BENCHMARK == true)
+    crypto_benchmark();
 #endif
+    ota_timing_startup_end(OTA_STARTUP_SELFTEST);
 
     /* Connect to Ethernet */
-    if(CY_RSLT_SUCCESS != ethernet_connect())
+    if(CY_RSLT_SUCCESS != network_task_wait())
     {
         printf("\n Failed to connect to Ethernet.\n");
         CY_ASSERT(0);
     }
 
+    ota_timing_startup_begin(OTA_STARTUP_AGENT_START);
+
     /* Initialize underlying support code that is needed for OTA and HTTP */
     if (CY_RSLT_SUCCESS != cy_awsport_network_init())
     {
@@ -190,99 +260,274 @@ void ota_task(void *args)
         CY_ASSERT(0);
     }
 
+#if (ENABLE_TLS == true)
+    /* Resume TLS sessions across the connections of the OTA agent */
+    tls_session_cache_set_credentials(&ota_network_params.http.credentials);
+#endif
+
     /* Initialize and start the OTA agent */
     if(CY_RSLT_SUCCESS != cy_ota_agent_start(&ota_network_params, &ota_agent_params, &ota_interfaces, &ota_context))
     {
         printf("\n Initializing and starting the OTA agent failed.\n");
         CY_ASSERT(0);
     }
+    ota_timing_startup_end(OTA_STARTUP_AGENT_START);
+
+#ifndef TEST_REVERT
+    /* The running image is validated, the other devices can download it from here */
+    if (CY_RSLT_SUCCESS != ota_peer_server_start())
+    {
+        printf("\n Starting the peer image server failed.\n");
+    }
+#endif
 
     vTaskSuspend( NULL );
  }
-cy_ecm_phy_callbacks_t phy_callbacks =
+
+/*******************************************************************************
+ * Function Name: ota_storage_open
+ *******************************************************************************
+ * Summary:
+ *  Opens the upgrade slot for a download and starts collecting the received
+ *  data per flash row, so that each row is programmed only once. The slot is
+ *  erased a few sectors ahead of the received data instead of all at once.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_storage_open(cy_ota_context_ptr ctx_ptr)
 {
-        .phy_init = cy_eth_phy_init,
-        .phy_configure = cy_eth_phy_configure,
-        .phy_enable_ext_reg = cy_eth_phy_enable_ext_reg,
-        .phy_discover = cy_eth_phy_discover,
-        .phy_get_auto_neg_status = cy_eth_phy_get_auto_neg_status,
-        .phy_get_link_partner_cap = cy_eth_phy_get_link_partner_cap,
-        .phy_get_linkspeed = cy_eth_phy_get_linkspeed,
-        .phy_get_linkstatus = cy_eth_phy_get_linkstatus,
-        .phy_reset = cy_eth_phy_reset
-};
-/******************************************************************************
- * Function Name: ethernet_connect
- ******************************************************************************
+    cy_rslt_t result;
+
+    /* Until the first write, see ota_storage_write() */
+    ota_timing_start(OTA_TIMING_ERASE);
+
+    /* Start buffering first, so that the erase of the slot done by the open is
+     * spread over the download */
+    result = cy_ota_mem_write_begin();
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    result = cy_ota_storage_open(ctx_ptr);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        (void)cy_ota_mem_write_end();
+    }
+
+    /* A patch is applied, and a compressed payload decompressed, from its
+     * first byte on every download. A download resumes for an MCUboot image only. */
+    ota_slot_write = (ota_range_download_resume_offset() > 0);
+    ota_image_verified = false;
+    ota_delta_begin();
+    ota_decompress_begin(ota_storage_write_payload);
+    ota_rate_limit_begin();
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_storage_write
+ *******************************************************************************
  * Summary:
- *  Function that initiates connection to the Ethernet. This function initializes
- *  the Ethernet interface and then tries to establish a connection with the network.
- *  it retries to connect with the network a maximum of 'MAX_CONNECTION_RETRIES' times.
+ *  Stores a chunk of the download, once the rate limit lets it through. A
+ *  chunk of a compressed payload is decompressed first. The receive of the
+ *  connection waits for the storage, so the rate limit also paces the server.
  *
  * Parameters:
- *  void
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  cy_ota_storage_write_info_t *chunk_info : Downloaded chunk
  *
  * Return:
- *  cy_rslt_t : CY_RSLT_SUCCESS upon a successful Ethernet connection, else an
- *              error code indicating the failure.
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
  *
- ******************************************************************************/
-cy_rslt_t ethernet_connect(void)
+ *******************************************************************************/
+cy_rslt_t ota_storage_write(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info)
 {
-    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+    cy_rslt_t result;
+    uint32_t start;
+
+    ota_timing_stop(OTA_TIMING_ERASE);
 
-    /* Structure to store IP address of the Ethernet connection. */
-    cy_ecm_ip_address_t ip_addr;
+    /* A range download took the tokens when it received the chunk */
+    if (!ota_range_download_is_active())
+    {
+        start = ota_timing_cycles();
+        ota_rate_limit_consume(chunk_info->size);
+        ota_timing_add_cycles(OTA_TIMING_RATE_LIMIT, start);
+    }
 
-    /* Pointer to store the Ethernet connection manager handle allocated
-     * after the successful initialization of the Ethernet interface. */
-    cy_ecm_t ecm_handle;
+    start = ota_timing_chunk(chunk_info->size);
 
-    /* Variables used by Ethernet connection manager.*/
-    uint8_t conn_retries = 0;
+    if (ota_decompress_is_active())
+    {
+        result = ota_decompress_write(ctx_ptr, chunk_info);
+    }
+    else
+    {
+        result = ota_storage_write_payload(ctx_ptr, chunk_info);
+    }
 
-    /* Initialize Ethernet connection manager. */
-    result = cy_ecm_init();
+    ota_timing_add_cycles(OTA_TIMING_STORAGE_WRITE, start);
 
-    if (CY_RSLT_SUCCESS != result)
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_storage_write_payload
+ *******************************************************************************
+ * Summary:
+ *  Stores a chunk of the payload. A chunk of a patch is applied to the
+ *  running image and the rebuilt bytes are stored instead. Once the first
+ *  chunk showed an MCUboot image, the chunks of an image are written straight
+ *  to the upgrade slot.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *  cy_ota_storage_write_info_t *chunk_info : Payload chunk
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_storage_write_payload(cy_ota_context_ptr ctx_ptr, cy_ota_storage_write_info_t *chunk_info)
+{
+    if (ota_delta_is_active())
     {
-        printf("\n Ethernet Connection Manager initialization failed\n");
-        CY_ASSERT(0);
+        return ota_delta_write(ctx_ptr, chunk_info);
+    }
+
+#if (CY_OTA_MEM_UPGRADE_SLOT_WRITE == 1)
+    /* The OTA storage library tells a TAR archive from the first chunk, which
+     * it always stores */
+    if (chunk_info->offset == 0)
+    {
+        ota_slot_write = (chunk_info->size >= sizeof(uint32_t)) &&
+                         ((chunk_info->buffer[0] | ((uint32_t)chunk_info->buffer[1] << 8) |
+                           ((uint32_t)chunk_info->buffer[2] << 16) | ((uint32_t)chunk_info->buffer[3] << 24)) ==
+                          MCUBOOT_IMAGE_MAGIC);
+    }
+    else if (ota_slot_write)
+    {
+        /* Skip the flash_area lookup of each chunk, the bytes still go
+         * through the row writer and its copies */
+        return cy_ota_mem_write_upgrade_slot(chunk_info->offset, chunk_info->buffer, chunk_info->size);
     }
+#endif
 
-    printf("Initiating cy_ecm_ethif_init \n");
-    result =  cy_ecm_ethif_init(INTERFACE_ID, &phy_callbacks, &ecm_handle);
+    return cy_ota_storage_write(ctx_ptr, chunk_info);
+}
 
-    if(CY_RSLT_SUCCESS != result)
+/*******************************************************************************
+ * Function Name: ota_storage_close
+ *******************************************************************************
+ * Summary:
+ *  Checks that a compressed payload was decompressed to its end, writes
+ *  the end of an image rebuilt from a patch, programs the last
+ *  partially received flash row and closes the upgrade slot.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_storage_close(cy_ota_context_ptr ctx_ptr)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    cy_rslt_t close_result;
+
+    if (ota_decompress_is_active())
     {
-        printf("\nEthernet Interface initialization failed!\n");
-        CY_ASSERT(0);
+        result = ota_decompress_end(ctx_ptr);
     }
 
-    /* Connect to Ethernet */
-    for(conn_retries = 0; conn_retries < MAX_CONNECTION_RETRIES; conn_retries++)
+    /* Write the end of an image rebuilt from a patch */
+    if ((CY_RSLT_SUCCESS == result) && ota_delta_is_active())
     {
-        printf("Initiating cy_ecm_connect \n");
-        result = cy_ecm_connect(ecm_handle, NULL, &ip_addr);
+        result = ota_delta_end(ctx_ptr);
+    }
 
-        if (CY_RSLT_SUCCESS == result)
-        {
-            printf("Successfully connected to Ethernet.\n");
-            printf("IP Address Assigned: %d.%d.%d.%d\n", (uint8)ip_addr.ip.v4, (uint8)(ip_addr.ip.v4 >> 8),
-                    (uint8)(ip_addr.ip.v4 >> 16), (uint8)(ip_addr.ip.v4 >> 24));
-            return result;
-        }
-
-        printf( "Connection to Ethernet network failed with error code %d."
-                "Retrying in %d ms...\n", (int) result, ETHERNET_CONN_RETRY_DELAY_MS );
-        vTaskDelay(pdMS_TO_TICKS(ETHERNET_CONN_RETRY_DELAY_MS));
+    if (CY_RSLT_SUCCESS != cy_ota_mem_write_end())
+    {
+        APP_LOG_ERR("Flushing the OTA write buffer failed.\n");
+        result = CY_RSLT_TYPE_ERROR;
+    }
+
+    /* Always close so the agent can clean up the session */
+    close_result = cy_ota_storage_close(ctx_ptr);
+
+    return (CY_RSLT_SUCCESS != result) ? result : close_result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_storage_verify
+ *******************************************************************************
+ * Summary:
+ *  Compares the SHA-256 of the downloaded image, computed while its rows were
+ *  programmed, with the hash stored in the image, then lets the OTA library
+ *  mark the image for MCUboot.
+ *
+ * Parameters:
+ *  cy_ota_context_ptr ctx_ptr : OTA agent context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_storage_verify(cy_ota_context_ptr ctx_ptr)
+{
+    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+
+    ota_timing_start(OTA_TIMING_VERIFY);
+
+    /* The image is complete, a failed check downloads it again from the start */
+    ota_range_download_resume_clear();
+
+    if (CY_RSLT_SUCCESS != cy_ota_mem_verify_image_hash())
+    {
+        APP_LOG_ERR("The downloaded image does not match its SHA-256.\n");
+    }
+    else
+    {
+        result = cy_ota_storage_verify(ctx_ptr);
+        ota_image_verified = (CY_RSLT_SUCCESS == result);
     }
 
-    printf( "Exceeded maximum Ethernet connection attempts\n" );
+    ota_timing_stop(OTA_TIMING_VERIFY);
 
     return result;
 }
 
+/*******************************************************************************
+ * Function Name: ota_erase_progress
+ *******************************************************************************
+ * Summary:
+ *  Prints the progress of the upgrade slot erase every 16 sectors.
+ *
+ * Parameters:
+ *  uint32_t erased_sectors : Sectors erased so far
+ *  uint32_t total_sectors  : Sectors to erase
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+void ota_erase_progress(uint32_t erased_sectors, uint32_t total_sectors)
+{
+    if (((erased_sectors % 16u) == 0u) || (erased_sectors == total_sectors))
+    {
+        APP_LOG_INFO("APP CB OTA STORAGE ERASE %u/%u sectors\n",
+               (unsigned int)erased_sectors, (unsigned int)total_sectors);
+    }
+}
+
 /*******************************************************************************
  * Function Name: ota_callback()
  *******************************************************************************
@@ -303,6 +548,11 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
     cy_ota_callback_results_t   cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
     const char                  *state_string;
     const char                  *error_string;
+    const ota_job_t             *job;
+    static uint32_t             write_progress = UINT32_MAX;
+#if (OTA_TIMING_SEND_REPORT == true)
+    static char                 result_json[OTA_TIMING_RESULT_JSON_SIZE];
+#endif
 
     if (cb_data == NULL)
     {
@@ -312,7 +562,17 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
     state_string  = cy_ota_get_state_string(cb_data->ota_agt_state);
     error_string  = cy_ota_get_error_string(cy_ota_get_last_error());
 
-    print_heap_usage("In OTA Callback");
+    /* Not on every chunk, mallinfo() walks the heap */
+    if ((cb_data->reason != CY_OTA_REASON_STATE_CHANGE) || (cb_data->ota_agt_state != CY_OTA_STATE_STORAGE_WRITE))
+    {
+        telemetry_log_heap("in OTA callback");
+    }
+
+    if (cb_data->reason == CY_OTA_REASON_STATE_CHANGE)
+    {
+        ota_timing_state(cb_data->ota_agt_state);
+        network_task_agent_state(cb_data->ota_agt_state);
+    }
 
     switch (cb_data->reason)
     {
@@ -321,13 +581,21 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
             break;
 
         case CY_OTA_REASON_SUCCESS:
-            printf(">> APP CB OTA SUCCESS state:%d %s last_error:%s\n\n",
+            APP_LOG_INFO(">> APP CB OTA SUCCESS state:%d %s last_error:%s\n\n",
                     cb_data->ota_agt_state,
                     state_string, error_string);
             break;
 
         case CY_OTA_REASON_FAILURE:
-            printf(">> APP CB OTA FAILURE state:%d %s last_error:%s\n\n",
+#if (ENABLE_CONDITIONAL_JOB_POLL == true)
+            /* The job document did not change, or is for the running version, nothing failed */
+            if (ota_job_poll_unchanged())
+            {
+                APP_LOG_INFO(">> APP CB OTA no new job\n\n");
+                break;
+            }
+#endif
+            APP_LOG_ERR(">> APP CB OTA FAILURE state:%d %s last_error:%s\n\n",
                     cb_data->ota_agt_state, state_string, error_string);
             break;
 
@@ -342,11 +610,15 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
                     break;
 
                 case CY_OTA_STATE_START_UPDATE:
-                    printf("APP CB OTA STATE CHANGE CY_OTA_STATE_START_UPDATE\n");
+                    APP_LOG_INFO("APP CB OTA STATE CHANGE CY_OTA_STATE_START_UPDATE\n");
                     break;
 
                 case CY_OTA_STATE_JOB_CONNECT:
-                    printf("APP CB OTA CONNECT FOR JOB using ");
+#if (ENABLE_TLS == true)
+                    /* New update cycle, drop the cached TLS session if the credentials changed */
+                    tls_session_cache_set_credentials(&ota_network_params.http.credentials);
+#endif
+                    APP_LOG_INFO("APP CB OTA CONNECT FOR JOB using ");
                     /* NOTE:
                      *  HTTP - json_doc holds the HTTP "GET" request
                      */
@@ -354,114 +626,209 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
                         ( cb_data->broker_server.port == 0)         ||
                         ( strlen(cb_data->file) == 0) )
                     {
-                        printf("ERROR in callback data: HTTP: server: %p port: %d topic: '%p'\n",
+                        APP_LOG_ERR("ERROR in callback data: HTTP: server: %p port: %d topic: '%p'\n",
                                 cb_data->broker_server.host_name,
                                 cb_data->broker_server.port,
                                 cb_data->file);
                         cb_result = CY_OTA_CB_RSLT_OTA_STOP;
                     }
-                    printf("HTTP: server:%s port: %d file: '%s'\n",
+                    APP_LOG_INFO("HTTP: server:%s port: %d file: '%s'\n",
                             cb_data->broker_server.host_name,
                             cb_data->broker_server.port,
                             cb_data->file);
-
+#if (ENABLE_CONDITIONAL_JOB_POLL == true)
+                    /* Poll over the connection kept open since the previous poll */
+                    if (CY_OTA_CB_RSLT_OTA_CONTINUE == cb_result)
+                    {
+                        cb_result = ota_job_poll_connect(cb_data, &ota_network_params.http.credentials);
+                    }
+#endif
                     break;
 
                 case CY_OTA_STATE_JOB_DOWNLOAD:
-                    printf("APP CB OTA JOB DOWNLOAD using ");
+                    APP_LOG_INFO("APP CB OTA JOB DOWNLOAD using ");
                     /* NOTE:
                      *  HTTP - json_doc holds the HTTP "GET" request
                      */
-                    printf("HTTP: '%s'\n", cb_data->file);
+                    APP_LOG_INFO("HTTP: '%s'\n", cb_data->file);
+#if (ENABLE_CONDITIONAL_JOB_POLL == true)
+                    /* A 304 response stops here, without parsing the job again */
+                    cb_result = ota_job_poll_download(cb_data);
+#endif
                     break;
 
                 case CY_OTA_STATE_JOB_DISCONNECT:
-                    printf("APP CB OTA JOB DISCONNECT\n");
+                    APP_LOG_INFO("APP CB OTA JOB DISCONNECT\n");
+#if (ENABLE_CONDITIONAL_JOB_POLL == true)
+                    cb_result = ota_job_poll_disconnect();
+#endif
                     break;
 
                 case CY_OTA_STATE_JOB_PARSE:
-                    printf("APP CB OTA PARSE JOB: '%.*s' \n",
-                    strlen(cb_data->json_doc),
-                    cb_data->json_doc);
+                    /* The job document is longer than a formatted message */
+                    APP_LOG_INFO("APP CB OTA PARSE JOB: '");
+                    app_log_text(CY_LOG_INFO, cb_data->json_doc, strlen(cb_data->json_doc));
+                    APP_LOG_INFO("' \n");
+#if (ENABLE_CONDITIONAL_JOB_POLL == true)
+                    /* Parsed by the job download, which stopped a stale job there */
+                    job = ota_job_get();
+#else
+                    job = (OTA_JOB_PARSE_DONE == ota_job_parse_document(cb_data->json_doc, strlen(cb_data->json_doc))) ?
+                          ota_job_get() : NULL;
+#endif
+                    if (job == NULL)
+                    {
+                        cb_result = CY_OTA_CB_RSLT_OTA_STOP;
+                        break;
+                    }
+#if (ENABLE_DELTA_UPDATE == true)
+                    /* A job with a base version names a patch against the running image */
+                    cb_result = ota_delta_job_parse(job);
+#endif
+#if (ENABLE_COMPRESSED_DOWNLOAD == true)
+                    /* Both a patch and a full image can be served compressed */
+                    if ((CY_OTA_CB_RSLT_OTA_CONTINUE == cb_result) &&
+                        (CY_OTA_CB_RSLT_OTA_CONTINUE != ota_decompress_job_parse(job)))
+                    {
+                        cb_result = CY_OTA_CB_RSLT_OTA_STOP;
+                    }
+#endif
+#if (ENABLE_PEER_DOWNLOAD == true)
+                    /* Devices of the subnet that already run the new image */
+                    if (CY_OTA_CB_RSLT_OTA_CONTINUE == cb_result)
+                    {
+                        cb_result = ota_peer_job_parse(job);
+                    }
+#endif
+#if (ENABLE_RANGE_DOWNLOAD == true)
+                    /* A download of this full image that a reset interrupted resumes */
+                    if (CY_OTA_CB_RSLT_OTA_CONTINUE == cb_result)
+                    {
+                        ota_range_download_job_parse(job);
+                    }
+#endif
                     break;
 
                 case CY_OTA_STATE_JOB_REDIRECT:
-                    printf("APP CB OTA JOB REDIRECT\n");
+                    APP_LOG_INFO("APP CB OTA JOB REDIRECT\n");
                     break;
 
                 case CY_OTA_STATE_DATA_CONNECT:
-                    printf("APP CB OTA CONNECT FOR DATA using ");
-                    printf("HTTP: %s:%d \n", cb_data->broker_server.host_name,
+                    APP_LOG_INFO("APP CB OTA CONNECT FOR DATA using ");
+                    APP_LOG_INFO("HTTP: %s:%d \n", cb_data->broker_server.host_name,
                     cb_data->broker_server.port);
                     break;
 
                 case CY_OTA_STATE_DATA_DOWNLOAD:
-                    printf("APP CB OTA DATA DOWNLOAD using ");
+                    APP_LOG_INFO("APP CB OTA DATA DOWNLOAD using ");
                     /* NOTE:
                      *  HTTP - json_doc holds the HTTP "GET" request
                      */
-                    printf("HTTP: '%.*s' ", strlen(cb_data->json_doc), cb_data->json_doc);
-                    printf("File: '%s'\n\n", cb_data->file);
+                    APP_LOG_INFO("HTTP: '%.*s' ", strlen(cb_data->json_doc), cb_data->json_doc);
+                    APP_LOG_INFO("File: '%s'\n\n", cb_data->file);
+#if (ENABLE_RANGE_DOWNLOAD == true) || (ENABLE_PEER_DOWNLOAD == true)
+                    /* Download the image here, so it can resume after a dropped connection.
+                     * The peers of a job serve a full image in ranges, with or without
+                     * ENABLE_RANGE_DOWNLOAD. */
+                    if ((ENABLE_RANGE_DOWNLOAD == true) ||
+                        ((ota_peer_count() > 0) && !ota_delta_is_active() && !ota_decompress_is_active()))
+                    {
+                        cb_result = ota_range_download(ota_context, cb_data, &ota_interfaces,
+                                                       &ota_network_params.http.credentials);
+                    }
+#endif
                     break;
 
                 case CY_OTA_STATE_DATA_DISCONNECT:
-                    printf("APP CB OTA DATA DISCONNECT\n");
+                    APP_LOG_INFO("APP CB OTA DATA DISCONNECT\n");
                     break;
 
                 case CY_OTA_STATE_RESULT_CONNECT:
-                    printf("APP CB OTA SEND RESULT CONNECT using ");
+                    APP_LOG_INFO("APP CB OTA SEND RESULT CONNECT using ");
                     /* NOTE:
                      *  HTTP - json_doc holds the HTTP "GET" request
                      */
-                    printf("HTTP: Server:%s port: %d\n",
+                    APP_LOG_INFO("HTTP: Server:%s port: %d\n",
                             cb_data->broker_server.host_name,
                             cb_data->broker_server.port);
+#if (OTA_TIMING_SEND_REPORT == true)
+                    /* The result goes to the job server, over the job connection */
+                    cb_result = ota_job_poll_connect(cb_data, &ota_network_params.http.credentials);
+#endif
                     break;
 
                 case CY_OTA_STATE_RESULT_SEND:
-                    printf("APP CB OTA SENDING RESULT using ");
+                    APP_LOG_INFO("APP CB OTA SENDING RESULT using ");
                     /* NOTE:
                      *  HTTP - json_doc holds the HTTP "PUT"
                      */
-                    printf("HTTP: '%s' \n", cb_data->json_doc);
+                    APP_LOG_INFO("HTTP: '%s' \n", cb_data->json_doc);
+#if (OTA_TIMING_SEND_REPORT == true)
+                    /* The result of the agent, with the timing report added */
+                    if (ota_timing_result_json(result_json, sizeof(result_json),
+                                               (cy_ota_get_last_error() == CY_RSLT_SUCCESS) ?
+                                               CY_OTA_RESULT_SUCCESS : CY_OTA_RESULT_FAILURE,
+                                               cb_data->file) < 0)
+                    {
+                        APP_LOG_ERR("OTA timing report does not fit the result\n");
+                        cb_result = CY_OTA_CB_RSLT_APP_FAILED;
+                        break;
+                    }
+                    APP_LOG_INFO("APP CB OTA SENDING RESULT '%s'\n", result_json);
+                    cb_result = ota_job_poll_send_result(cb_data, result_json);
+#endif
                     break;
 
                 case CY_OTA_STATE_RESULT_RESPONSE:
-                    printf("APP CB OTA Got Result response\n");
+                    APP_LOG_INFO("APP CB OTA Got Result response\n");
                     break;
 
                 case CY_OTA_STATE_RESULT_DISCONNECT:
-                    printf("APP CB OTA Result Disconnect\n");
+                    APP_LOG_INFO("APP CB OTA Result Disconnect\n");
+#if (OTA_TIMING_SEND_REPORT == true)
+                    cb_result = ota_job_poll_disconnect();
+#endif
                     break;
 
                 case CY_OTA_STATE_OTA_COMPLETE:
-                    printf("APP CB OTA Session Complete\n");
+                    APP_LOG_INFO("APP CB OTA Session Complete\n");
+                    ota_timing_report();
+                    ota_rate_limit_report();
+                    telemetry_log_tasks();
+                    /* Before the reboot into the new image */
+                    network_cache_save(ota_image_verified);
+                    if (ota_image_verified)
+                    {
+                        ota_timing_reboot_mark();
+                    }
                     break;
 
                 case CY_OTA_STATE_STORAGE_OPEN:
-                    printf("APP CB OTA STORAGE OPEN\n");
+                    APP_LOG_INFO("APP CB OTA STORAGE OPEN\n");
+                    write_progress = UINT32_MAX;
                     break;
 
                 case CY_OTA_STATE_STORAGE_WRITE:
-                    printf("APP CB OTA STORAGE WRITE %ld%% (%ld of %ld)\n",
-                            (unsigned long)cb_data->percentage,
-                            (unsigned long)cb_data->bytes_written,
-                            (unsigned long)cb_data->total_size);
-
-                    /* Move cursor to previous line */
-                    printf("\x1b[1F");
+                    /* Every APP_LOG_PROGRESS_STEP percent, not on every chunk */
+                    if (app_log_progress(&write_progress, cb_data->percentage))
+                    {
+                        APP_LOG_INFO("APP CB OTA STORAGE WRITE %ld%% (%ld of %ld)\n",
+                                (unsigned long)cb_data->percentage,
+                                (unsigned long)cb_data->bytes_written,
+                                (unsigned long)cb_data->total_size);
+                    }
                     break;
 
                 case CY_OTA_STATE_STORAGE_CLOSE:
-                    printf("APP CB OTA STORAGE CLOSE\n");
+                    APP_LOG_INFO("APP CB OTA STORAGE CLOSE\n");
                     break;
 
                 case CY_OTA_STATE_VERIFY:
-                    printf("APP CB OTA VERIFY\n");
+                    APP_LOG_INFO("APP CB OTA VERIFY\n");
                     break;
 
                 case CY_OTA_STATE_RESULT_REDIRECT:
-                    printf("APP CB OTA RESULT REDIRECT\n");
+                    APP_LOG_INFO("APP CB OTA RESULT REDIRECT\n");
                     break;
 
                 case CY_OTA_NUM_STATES:
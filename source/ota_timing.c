@@ -0,0 +1,724 @@
+/******************************************************************************
+* File Name: ota_timing.c
+*
+* Description: This file contains the timing of the OTA update phases, measured with
+* the FreeRTOS tick and the DWT cycle counter, the timing of the start up stages,
+* and their reports.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cy_result.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+/* OTA API */
+#include "cy_ota_api.h"
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+/* Asynchronous log */
+#include "app_log.h"
+#include "ota_timing.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Upper bounds of the chunk latency histogram buckets, the last one is open */
+#define TIMING_HISTOGRAM_BOUNDS_MS          { 1, 2, 5, 10, 20, 50, 100, 200, 500 }
+#define TIMING_HISTOGRAM_BUCKETS            (10)
+
+/* DWT lock access key, the CM7 DWT ignores writes until it is unlocked */
+#define TIMING_DWT_UNLOCK                   (0xC5ACCE55UL)
+
+/* Backup register reserved by OTA_TIMING_REBOOT_BREG_INDEX, it marks a boot
+ * that follows an OTA reboot. The backup domain is not reset by the reboot. */
+#define TIMING_REBOOT_BREG                  (BACKUP->BREG_SET0[OTA_TIMING_REBOOT_BREG_INDEX])
+#define TIMING_REBOOT_MAGIC                 (0x07A0B007UL)
+
+/* Time of the RTC at the OTA reboot, 1 January 2000 00:00:00 */
+#define TIMING_REBOOT_RTC_START \
+{ \
+    .sec = 0u, .min = 0u, .hour = 0u, .amPm = CY_RTC_AM, .hrFormat = CY_RTC_24_HOURS, \
+    .dayOfWeek = CY_RTC_SATURDAY, .date = 1u, .month = CY_RTC_JANUARY, .year = 0u \
+}
+
+/* Name of the flashmap, for the reboot time of the start up report */
+#ifndef OTA_FLASH_MAP_SLOT_NAME
+#define OTA_FLASH_MAP_SLOT_NAME             "unknown"
+#endif
+
+#if defined(OTA_TIMING)
+/* The last backup register keeps the state of the HAL RTC driver */
+_Static_assert(OTA_TIMING_REBOOT_BREG_INDEX < ((sizeof(((BACKUP_Type *)0)->BREG_SET0) /
+                                               sizeof(((BACKUP_Type *)0)->BREG_SET0[0])) - 1u),
+               "OTA_TIMING_REBOOT_BREG_INDEX must name a backup register of set 0 other than the last one");
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+typedef struct
+{
+    uint64_t    total_us;
+    uint32_t    count;
+    TickType_t  started;        /* Tick of ota_timing_start() */
+    bool        running;
+} timing_phase_t;
+
+typedef struct
+{
+    timing_phase_t  phases[OTA_TIMING_NUM_PHASES];
+    uint32_t        bytes;              /* Payload bytes written */
+    uint32_t        last_chunk;         /* Cycle count of the previous chunk */
+    bool            chunk_seen;
+    uint32_t        histogram[TIMING_HISTOGRAM_BUCKETS];
+} timing_t;
+
+typedef struct
+{
+    uint32_t    begin_ms;       /* Since the scheduler started */
+    uint32_t    end_ms;
+    bool        begun;
+    bool        ended;
+} timing_stage_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static timing_t timing;
+
+/* Not cleared by a new update cycle */
+static timing_stage_t timing_stages[OTA_STARTUP_NUM_STAGES];
+static bool timing_startup_reported;
+
+/* Seconds from the OTA reboot to ota_task(), valid if timing_rebooted */
+static uint32_t timing_reboot_secs;
+static bool timing_rebooted;
+
+static const uint32_t timing_bounds_ms[TIMING_HISTOGRAM_BUCKETS - 1] = TIMING_HISTOGRAM_BOUNDS_MS;
+
+static const char *const timing_phase_names[OTA_TIMING_NUM_PHASES] =
+{
+    "Ethernet connect",
+    "DNS",
+    "TLS handshake",
+    "Job fetch",
+    "Erase",
+    "Download",
+    "Storage write",
+    "Rate limit",
+    "Verify"
+};
+
+static const char *const timing_stage_names[OTA_STARTUP_NUM_STAGES] =
+{
+    "Storage",
+    "Self test",
+    "Ethernet init",
+    "Link and address",
+    "Agent start",
+    "First job check"
+};
+
+static const char *const timing_phase_keys[OTA_TIMING_NUM_PHASES] =
+{
+    "EthernetConnect",
+    "Dns",
+    "TlsHandshake",
+    "JobFetch",
+    "Erase",
+    "Download",
+    "StorageWrite",
+    "RateLimit",
+    "Verify"
+};
+
+/*******************************************************************************
+ * Function Name: timing_add_us
+ *******************************************************************************
+ * Summary:
+ *  Adds a duration to a phase. Handshakes of a parallel download are timed
+ *  from several tasks.
+ *
+ *******************************************************************************/
+static void timing_add_us(ota_timing_phase_t phase, uint64_t us)
+{
+    taskENTER_CRITICAL();
+    timing.phases[phase].total_us += us;
+    timing.phases[phase].count++;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: timing_cycles_to_us
+ *******************************************************************************
+ * Summary:
+ *  Converts a number of CPU cycles to microseconds.
+ *
+ *******************************************************************************/
+static uint32_t timing_cycles_to_us(uint32_t cycles)
+{
+    uint32_t per_us = SystemCoreClock / 1000000UL;
+
+    return cycles / ((per_us != 0u) ? per_us : 1u);
+}
+
+/*******************************************************************************
+ * Function Name: timing_rtc_secs
+ *******************************************************************************
+ * Summary:
+ *  Reads the RTC as seconds since 1 January 2000. The RTC counts on the backup
+ *  clock of the BSP through the reset, with a resolution of one second.
+ *
+ *******************************************************************************/
+static uint32_t timing_rtc_secs(void)
+{
+    cy_stc_rtc_config_t now;
+    uint32_t days;
+    uint32_t hour;
+    uint32_t month;
+
+    Cy_RTC_GetDateAndTime(&now);
+
+    /* Leap years from 2000 up to the current year */
+    days = (now.year * 365UL) + ((now.year + 3UL) / 4UL);
+    for (month = CY_RTC_JANUARY; month < now.month; month++)
+    {
+        days += Cy_RTC_DaysInMonth(month, now.year + CY_RTC_TWO_THOUSAND_YEARS);
+    }
+    days += now.date - 1UL;
+
+    hour = now.hour;
+    if (CY_RTC_12_HOURS == now.hrFormat)
+    {
+        hour = (hour % 12UL) + ((CY_RTC_PM == now.amPm) ? 12UL : 0UL);
+    }
+
+    return (((days * 24UL) + hour) * 60UL + now.min) * 60UL + now.sec;
+}
+#endif /* OTA_TIMING */
+
+/*******************************************************************************
+ * Function Name: ota_timing_init
+ *******************************************************************************
+ * Summary:
+ *  Starts the DWT cycle counter.
+ *
+ *******************************************************************************/
+void ota_timing_init(void)
+{
+#if defined(OTA_TIMING)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = TIMING_DWT_UNLOCK;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_reboot_mark
+ *******************************************************************************
+ * Summary:
+ *  Starts the RTC from zero before the reboot into a new image, and marks the
+ *  reboot in the reserved backup register, so that the next boot can time the
+ *  bootloader and the swap of the slots. Nothing else in the application uses
+ *  the RTC, the date it held is lost.
+ *
+ *******************************************************************************/
+void ota_timing_reboot_mark(void)
+{
+#if defined(OTA_TIMING)
+    static const cy_stc_rtc_config_t start = TIMING_REBOOT_RTC_START;
+
+    TIMING_REBOOT_BREG = 0u;
+    if (CY_RTC_SUCCESS == Cy_RTC_Init(&start))
+    {
+        TIMING_REBOOT_BREG = TIMING_REBOOT_MAGIC;
+    }
+    else
+    {
+        APP_LOG_WARNING("RTC init failed, the reboot is not timed\n");
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_reboot_check
+ *******************************************************************************
+ * Summary:
+ *  Called at the start of ota_task(). Takes the time since the reboot marked
+ *  by ota_timing_reboot_mark(), if this boot follows one, for the start up
+ *  report, and clears the mark so that a later reset is not counted.
+ *
+ *******************************************************************************/
+void ota_timing_reboot_check(void)
+{
+#if defined(OTA_TIMING)
+    if (TIMING_REBOOT_BREG == TIMING_REBOOT_MAGIC)
+    {
+        timing_reboot_secs = timing_rtc_secs();
+        timing_rebooted = true;
+        TIMING_REBOOT_BREG = 0u;
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_cycles
+ *******************************************************************************
+ * Summary:
+ *  Current DWT cycle count, the start of a short measurement. The counter
+ *  wraps every few seconds, longer phases use ota_timing_start().
+ *
+ * Return:
+ *  uint32_t : Cycle count
+ *
+ *******************************************************************************/
+uint32_t ota_timing_cycles(void)
+{
+#if defined(OTA_TIMING)
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_add_cycles
+ *******************************************************************************
+ * Summary:
+ *  Adds the time since a cycle count from ota_timing_cycles() to a phase.
+ *
+ * Parameters:
+ *  ota_timing_phase_t phase : Phase
+ *  uint32_t start : Cycle count at the start
+ *
+ *******************************************************************************/
+void ota_timing_add_cycles(ota_timing_phase_t phase, uint32_t start)
+{
+#if defined(OTA_TIMING)
+    timing_add_us(phase, timing_cycles_to_us(DWT->CYCCNT - start));
+#else
+    (void)phase;
+    (void)start;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_start
+ *******************************************************************************
+ * Summary:
+ *  Starts timing a phase with the tick count, for phases longer than the
+ *  cycle counter wrap.
+ *
+ * Parameters:
+ *  ota_timing_phase_t phase : Phase
+ *
+ *******************************************************************************/
+void ota_timing_start(ota_timing_phase_t phase)
+{
+#if defined(OTA_TIMING)
+    timing.phases[phase].started = xTaskGetTickCount();
+    timing.phases[phase].running = true;
+#else
+    (void)phase;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_stop
+ *******************************************************************************
+ * Summary:
+ *  Adds the time since ota_timing_start() to a phase. Ignored if the phase
+ *  was not started.
+ *
+ * Parameters:
+ *  ota_timing_phase_t phase : Phase
+ *
+ *******************************************************************************/
+void ota_timing_stop(ota_timing_phase_t phase)
+{
+#if defined(OTA_TIMING)
+    if (timing.phases[phase].running)
+    {
+        timing.phases[phase].running = false;
+        timing_add_us(phase, (uint64_t)pdTICKS_TO_MS(xTaskGetTickCount() - timing.phases[phase].started) * 1000u);
+    }
+#else
+    (void)phase;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_add_ms
+ *******************************************************************************
+ * Summary:
+ *  Adds a duration measured by the caller to a phase.
+ *
+ * Parameters:
+ *  ota_timing_phase_t phase : Phase
+ *  uint32_t ms : Duration in milliseconds
+ *
+ *******************************************************************************/
+void ota_timing_add_ms(ota_timing_phase_t phase, uint32_t ms)
+{
+#if defined(OTA_TIMING)
+    timing_add_us(phase, (uint64_t)ms * 1000u);
+#else
+    (void)phase;
+    (void)ms;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_state
+ *******************************************************************************
+ * Summary:
+ *  Starts and stops the phases on the state changes of the OTA agent. A new
+ *  update cycle clears the measurements, except the Ethernet connect. The
+ *  first update cycle is the last start up stage, its end logs the start up
+ *  report.
+ *
+ * Parameters:
+ *  cy_ota_agent_state_t state : New state of the OTA agent
+ *
+ *******************************************************************************/
+void ota_timing_state(cy_ota_agent_state_t state)
+{
+#if defined(OTA_TIMING)
+    timing_phase_t eth_connect;
+
+    switch (state)
+    {
+        case CY_OTA_STATE_START_UPDATE:
+            eth_connect = timing.phases[OTA_TIMING_ETH_CONNECT];
+            memset(&timing, 0, sizeof(timing));
+            timing.phases[OTA_TIMING_ETH_CONNECT] = eth_connect;
+            ota_timing_startup_begin(OTA_STARTUP_FIRST_CHECK);
+            break;
+
+        case CY_OTA_STATE_AGENT_WAITING:
+            if (timing_stages[OTA_STARTUP_FIRST_CHECK].begun && !timing_startup_reported)
+            {
+                ota_timing_startup_end(OTA_STARTUP_FIRST_CHECK);
+                ota_timing_startup_report();
+            }
+            break;
+
+        case CY_OTA_STATE_JOB_CONNECT:
+            ota_timing_start(OTA_TIMING_JOB_FETCH);
+            break;
+
+        case CY_OTA_STATE_JOB_PARSE:
+            ota_timing_stop(OTA_TIMING_JOB_FETCH);
+            break;
+
+        case CY_OTA_STATE_DATA_CONNECT:
+            ota_timing_start(OTA_TIMING_DOWNLOAD);
+            break;
+
+        case CY_OTA_STATE_DATA_DISCONNECT:
+            ota_timing_stop(OTA_TIMING_DOWNLOAD);
+            break;
+
+        default:
+            break;
+    }
+#else
+    (void)state;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_chunk
+ *******************************************************************************
+ * Summary:
+ *  Counts a downloaded chunk and adds the time since the previous chunk to
+ *  the latency histogram. Called at the start of the storage write.
+ *
+ * Parameters:
+ *  uint32_t size : Bytes in the chunk
+ *
+ * Return:
+ *  uint32_t : Cycle count, for ota_timing_add_cycles() at the end of the write
+ *
+ *******************************************************************************/
+uint32_t ota_timing_chunk(uint32_t size)
+{
+#if defined(OTA_TIMING)
+    uint32_t now = DWT->CYCCNT;
+    uint32_t ms;
+    uint32_t bucket = 0;
+
+    if (timing.chunk_seen)
+    {
+        ms = timing_cycles_to_us(now - timing.last_chunk) / 1000u;
+        while ((bucket < (TIMING_HISTOGRAM_BUCKETS - 1)) && (ms >= timing_bounds_ms[bucket]))
+        {
+            bucket++;
+        }
+        timing.histogram[bucket]++;
+    }
+    timing.chunk_seen = true;
+    timing.last_chunk = now;
+    timing.bytes += size;
+
+    return now;
+#else
+    (void)size;
+    return 0;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_report
+ *******************************************************************************
+ * Summary:
+ *  Logs the time of each phase, the download rate and the chunk latency
+ *  histogram of the last update.
+ *
+ *******************************************************************************/
+void ota_timing_report(void)
+{
+#if defined(OTA_TIMING)
+    uint32_t i;
+    uint64_t download_us = timing.phases[OTA_TIMING_DOWNLOAD].total_us;
+
+    APP_LOG_INFO("\n=========== OTA timing ===========\n");
+    for (i = 0; i < OTA_TIMING_NUM_PHASES; i++)
+    {
+        APP_LOG_INFO("%-17s: %8lu ms (%lu)\n", timing_phase_names[i],
+                     (unsigned long)(timing.phases[i].total_us / 1000u), (unsigned long)timing.phases[i].count);
+    }
+    APP_LOG_INFO("Downloaded       : %8lu bytes, %lu bytes/s\n", (unsigned long)timing.bytes,
+                 (unsigned long)((download_us != 0u) ? (((uint64_t)timing.bytes * 1000000u) / download_us) : 0u));
+
+    APP_LOG_INFO("Chunk latency    :");
+    for (i = 0; i < TIMING_HISTOGRAM_BUCKETS; i++)
+    {
+        if (i < (TIMING_HISTOGRAM_BUCKETS - 1))
+        {
+            APP_LOG_INFO(" <%lums:%lu", (unsigned long)timing_bounds_ms[i], (unsigned long)timing.histogram[i]);
+        }
+        else
+        {
+            APP_LOG_INFO(" more:%lu\n", (unsigned long)timing.histogram[i]);
+        }
+    }
+    APP_LOG_INFO("==================================\n\n");
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_report_json
+ *******************************************************************************
+ * Summary:
+ *  Writes the report as a JSON object, for the result sent to the server:
+ *  {"EthernetConnectMs":..., ..., "Bytes":..., "BytesPerSecond":...,
+ *   "ChunkLatencyMs":[...]}, the histogram counts in bucket order.
+ *
+ * Parameters:
+ *  char *buffer : Output buffer
+ *  size_t size : Size of the buffer
+ *
+ * Return:
+ *  int : Length written, or a negative value if the buffer is too small.
+ *
+ *******************************************************************************/
+int ota_timing_report_json(char *buffer, size_t size)
+{
+#if defined(OTA_TIMING)
+    uint32_t i;
+    size_t len = 0;
+    int ret;
+    uint64_t download_us = timing.phases[OTA_TIMING_DOWNLOAD].total_us;
+
+    ret = snprintf(buffer, size, "{");
+    for (i = 0; (i < OTA_TIMING_NUM_PHASES) && (ret >= 0) && ((len += (size_t)ret) < size); i++)
+    {
+        ret = snprintf(&buffer[len], size - len, "\"%sMs\":%lu,", timing_phase_keys[i],
+                       (unsigned long)(timing.phases[i].total_us / 1000u));
+    }
+    if ((ret >= 0) && ((len += (size_t)ret) < size))
+    {
+        ret = snprintf(&buffer[len], size - len, "\"Bytes\":%lu,\"BytesPerSecond\":%lu,\"ChunkLatencyMs\":[",
+                       (unsigned long)timing.bytes,
+                       (unsigned long)((download_us != 0u) ? (((uint64_t)timing.bytes * 1000000u) / download_us) : 0u));
+    }
+    for (i = 0; (i < TIMING_HISTOGRAM_BUCKETS) && (ret >= 0) && ((len += (size_t)ret) < size); i++)
+    {
+        ret = snprintf(&buffer[len], size - len, "%lu%s", (unsigned long)timing.histogram[i],
+                       (i < (TIMING_HISTOGRAM_BUCKETS - 1)) ? "," : "]}");
+    }
+
+    return ((ret >= 0) && ((len += (size_t)ret) < size)) ? (int)len : -1;
+#else
+    return snprintf(buffer, size, "{}");
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_result_json
+ *******************************************************************************
+ * Summary:
+ *  Writes the result JSON of the OTA agent (CY_OTA_HTTP_RESULT_JSON) with
+ *  the report added as its "Timing" member.
+ *
+ * Parameters:
+ *  char *buffer : Output buffer
+ *  size_t size : Size of the buffer
+ *  const char *message : CY_OTA_RESULT_SUCCESS or CY_OTA_RESULT_FAILURE
+ *  const char *file : Downloaded file
+ *
+ * Return:
+ *  int : Length written, or a negative value if the buffer is too small.
+ *
+ *******************************************************************************/
+int ota_timing_result_json(char *buffer, size_t size, const char *message, const char *file)
+{
+    int ret;
+    char *end;
+    size_t len;
+
+    ret = snprintf(buffer, size, CY_OTA_HTTP_RESULT_JSON, message, file);
+    end = ((ret > 0) && ((size_t)ret < size)) ? strrchr(buffer, '}') : NULL;
+    if (end == NULL)
+    {
+        return -1;
+    }
+
+    /* Insert the report before the closing brace */
+    len = (size_t)(end - buffer);
+    ret = snprintf(end, size - len, ",\"Timing\":");
+    if ((ret < 0) || ((len += (size_t)ret) >= size))
+    {
+        return -1;
+    }
+    ret = ota_timing_report_json(&buffer[len], size - len);
+    if ((ret < 0) || ((len += (size_t)ret) >= (size - 1)))
+    {
+        return -1;
+    }
+    buffer[len++] = '}';
+    buffer[len] = '\0';
+
+    return (int)len;
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_startup_begin
+ *******************************************************************************
+ * Summary:
+ *  Records the start of a start up stage. Ignored if the stage already began,
+ *  the stages are timed once per boot.
+ *
+ * Parameters:
+ *  ota_startup_stage_t stage : Stage
+ *
+ *******************************************************************************/
+void ota_timing_startup_begin(ota_startup_stage_t stage)
+{
+#if defined(OTA_TIMING)
+    if (!timing_stages[stage].begun)
+    {
+        timing_stages[stage].begin_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        timing_stages[stage].begun = true;
+    }
+#else
+    (void)stage;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_startup_end
+ *******************************************************************************
+ * Summary:
+ *  Records the end of a start up stage. Ignored if the stage did not begin or
+ *  already ended.
+ *
+ * Parameters:
+ *  ota_startup_stage_t stage : Stage
+ *
+ *******************************************************************************/
+void ota_timing_startup_end(ota_startup_stage_t stage)
+{
+#if defined(OTA_TIMING)
+    if (timing_stages[stage].begun && !timing_stages[stage].ended)
+    {
+        timing_stages[stage].end_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        timing_stages[stage].ended = true;
+    }
+#else
+    (void)stage;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_timing_startup_report
+ *******************************************************************************
+ * Summary:
+ *  Logs the begin and end of each start up stage, in milliseconds since the
+ *  scheduler started. Stages that overlap ran in parallel.
+ *
+ *******************************************************************************/
+void ota_timing_startup_report(void)
+{
+#if defined(OTA_TIMING)
+    uint32_t i;
+
+    timing_startup_reported = true;
+
+    APP_LOG_INFO("\n========== Start up timing =========\n");
+    if (timing_rebooted)
+    {
+        APP_LOG_INFO("OTA reboot to ota_task(): %lu s (+/- 1 s), flashmap %s\n",
+                     (unsigned long)timing_reboot_secs, OTA_FLASH_MAP_SLOT_NAME);
+    }
+    for (i = 0; i < OTA_STARTUP_NUM_STAGES; i++)
+    {
+        if (timing_stages[i].ended)
+        {
+            APP_LOG_INFO("%-17s: %6lu .. %6lu ms (%lu)\n", timing_stage_names[i],
+                         (unsigned long)timing_stages[i].begin_ms, (unsigned long)timing_stages[i].end_ms,
+                         (unsigned long)(timing_stages[i].end_ms - timing_stages[i].begin_ms));
+        }
+        else
+        {
+            APP_LOG_INFO("%-17s: not run\n", timing_stage_names[i]);
+        }
+    }
+    APP_LOG_INFO("====================================\n\n");
+#endif
+}
@@ -0,0 +1,96 @@
+/******************************************************************************
+* File Name: ota_timing.h
+*
+* Description: This file contains declaration of the timing of the OTA update phases.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_TIMING_H_
+#define SOURCE_OTA_TIMING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cy_ota_api.h"
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+/* Timed phases of an update */
+typedef enum
+{
+    OTA_TIMING_ETH_CONNECT,     /* Ethernet link and DHCP, once per boot */
+    OTA_TIMING_DNS,             /* Host name lookups */
+    OTA_TIMING_TLS_HANDSHAKE,   /* TLS handshakes, all connections */
+    OTA_TIMING_JOB_FETCH,       /* Job connect to job parse */
+    OTA_TIMING_ERASE,           /* Storage open, erase ahead of the first write */
+    OTA_TIMING_DOWNLOAD,        /* Data connect to data disconnect */
+    OTA_TIMING_STORAGE_WRITE,   /* Time spent in the storage write path */
+    OTA_TIMING_RATE_LIMIT,      /* Writes held back by the download rate limit */
+    OTA_TIMING_VERIFY,          /* Image hash and signature check */
+    OTA_TIMING_NUM_PHASES
+} ota_timing_phase_t;
+
+/* Stages of the start up, up to the end of the first job check */
+typedef enum
+{
+    OTA_STARTUP_STORAGE,        /* OTA storage init, image validate, pre-erase start */
+    OTA_STARTUP_SELFTEST,       /* Crypto self test and benchmark */
+    OTA_STARTUP_ETH_INIT,       /* Connection manager and Ethernet interface init */
+    OTA_STARTUP_LINK,           /* Link up and IP address, cached lease or DHCP */
+    OTA_STARTUP_AGENT_START,    /* Secure sockets init and OTA agent start */
+    OTA_STARTUP_FIRST_CHECK,    /* First job check of the OTA agent */
+    OTA_STARTUP_NUM_STAGES
+} ota_startup_stage_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void ota_timing_init(void);
+void ota_timing_reboot_mark(void);
+void ota_timing_reboot_check(void);
+uint32_t ota_timing_cycles(void);
+void ota_timing_add_cycles(ota_timing_phase_t phase, uint32_t start);
+void ota_timing_start(ota_timing_phase_t phase);
+void ota_timing_stop(ota_timing_phase_t phase);
+void ota_timing_add_ms(ota_timing_phase_t phase, uint32_t ms);
+void ota_timing_state(cy_ota_agent_state_t state);
+uint32_t ota_timing_chunk(uint32_t size);
+void ota_timing_report(void);
+int ota_timing_report_json(char *buffer, size_t size);
+int ota_timing_result_json(char *buffer, size_t size, const char *message, const char *file);
+void ota_timing_startup_begin(ota_startup_stage_t stage);
+void ota_timing_startup_end(ota_startup_stage_t stage);
+void ota_timing_startup_report(void);
+
+#endif /* SOURCE_OTA_TIMING_H_ */
@@ -0,0 +1,932 @@
+/******************************************************************************
+* File Name: telemetry.c
+*
+* Description: This file contains the run-time telemetry: CPU usage and stack
+* high-water mark of each task, heap usage and allocation failures,
+* printed on request from the debug UART and exported as a binary record.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "cyhal.h"
+#include "cybsp.h"
+#include "cy_retarget_io.h"
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+/* OTA app specific configuration */
+#include "ota_app_config.h"
+#include "app_log.h"
+#include "telemetry.h"
+/* Encryption row buffers of the OTA flash driver */
+#include "cy_ota_flash_ext.h"
+
+/* ARM compiler also defines __GNUC__ */
+#if defined (__GNUC__) && !defined(__ARMCC_VERSION)
+#include <malloc.h>
+#define TELEMETRY_MALLINFO
+#endif /* #if defined (__GNUC__) && !defined(__ARMCC_VERSION) */
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Resolution of the task run time counter. The counter wraps after 11.9
+ * hours, CPU usage is computed over the time between two samples. */
+#define TELEMETRY_RUN_TIME_UNIT_US          (10u)
+
+/* DWT lock access key, the CM7 DWT ignores writes until it is unlocked */
+#define TELEMETRY_DWT_UNLOCK                (0xC5ACCE55UL)
+
+/* Output of the console commands, not filtered by APP_LOG_LEVEL */
+#define TELEMETRY_CONSOLE_LEVEL             (CY_LOG_OFF)
+
+/* Longest line formatted by telemetry_print() */
+#define TELEMETRY_LINE_SIZE                 (96u)
+
+/* Console task */
+#define CONSOLE_TASK_STACK_SIZE             (1024)
+#define CONSOLE_TASK_PRIORITY               (tskIDLE_PRIORITY + 1)
+#define CONSOLE_LINE_SIZE                   (32u)
+
+/* Time of each wait for a received character. cyhal_uart_getc() without a
+ * timeout polls the UART without giving up the CPU. */
+#define CONSOLE_RX_TIMEOUT_MS               (10u)
+
+/* A full log ring is retried until the log task has written some of it */
+#define CONSOLE_WRITE_TRIES                 (10u)
+#define CONSOLE_WRITE_RETRY_MS              (20u)
+
+/* Bytes of the binary record per line of hexadecimal output */
+#define CONSOLE_HEX_BYTES_PER_LINE          (32u)
+
+/* Largest record, TELEMETRY_MAX_TASKS tasks */
+#define TELEMETRY_RECORD_MAX_SIZE           (TELEMETRY_RECORD_HEADER_SIZE + \
+                                             (TELEMETRY_MAX_TASKS * TELEMETRY_RECORD_TASK_SIZE))
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+/* Run time of a task at the previous sample */
+typedef struct
+{
+    UBaseType_t     number;
+    uint32_t        run_time;
+} telemetry_task_time_t;
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Heap, updated by the allocation hooks of any task */
+static atomic_uint_least32_t heap_peak;
+static atomic_uint_least32_t heap_failures;
+static atomic_uint_least32_t rtos_allocs;
+static atomic_uint_least32_t rtos_frees;
+static atomic_uint_least32_t rtos_failures;
+
+#if defined(TELEMETRY)
+/* Task run time counter, extended from the DWT cycle counter */
+static struct
+{
+    uint32_t        last_cycles;
+    uint32_t        cycles;             /* Cycles not counted in units yet */
+    uint32_t        units;
+    uint32_t        cycles_per_unit;
+} run_time;
+
+/* Wake-up latency of the watched task, from being made ready to running, in
+ * cycles. Updated by the scheduler hooks. */
+static struct
+{
+    void            *task;
+    bool            ready;              /* Made ready, not running yet */
+    uint32_t        ready_cycles;
+    uint32_t        max_cycles;         /* Worst since telemetry_latency_max_us(true) */
+    uint32_t        peak_cycles;        /* Worst since the start */
+} latency;
+
+/* Last sample of the tasks, with CPU usage in 1/1000 since the sample before */
+static TaskStatus_t telemetry_tasks[TELEMETRY_MAX_TASKS];
+static uint16_t telemetry_cpu[TELEMETRY_MAX_TASKS];
+static telemetry_task_time_t telemetry_prev[TELEMETRY_MAX_TASKS];
+static uint32_t telemetry_prev_count;
+static uint32_t telemetry_prev_total;
+
+/* Sample of the console and of the OTA task at the same time */
+static SemaphoreHandle_t telemetry_lock = NULL;
+static StaticSemaphore_t telemetry_lock_struct;
+
+static const char *const telemetry_state_names[] = { "run", "ready", "block", "susp", "del", "inv" };
+
+/*******************************************************************************
+ * Function Name: telemetry_put_u16
+ *******************************************************************************
+ * Summary:
+ *  Stores a 16-bit value little endian.
+ *
+ *******************************************************************************/
+static uint8_t *telemetry_put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    return &p[2];
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_put_u32
+ *******************************************************************************
+ * Summary:
+ *  Stores a 32-bit value little endian.
+ *
+ *******************************************************************************/
+static uint8_t *telemetry_put_u32(uint8_t *p, uint32_t value)
+{
+    p = telemetry_put_u16(p, (uint16_t)value);
+    return telemetry_put_u16(p, (uint16_t)(value >> 16));
+}
+#endif /* TELEMETRY */
+
+/*******************************************************************************
+ * Function Name: telemetry_update_peak
+ *******************************************************************************
+ * Summary:
+ *  Raises the heap peak to a number of bytes in use.
+ *
+ *******************************************************************************/
+static void telemetry_update_peak(uint32_t in_use)
+{
+    uint_least32_t peak = atomic_load(&heap_peak);
+
+    while ((in_use > peak) && !atomic_compare_exchange_weak(&heap_peak, &peak, in_use))
+    {
+    }
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_print
+ *******************************************************************************
+ * Summary:
+ *  Writes a line to the log, or for TELEMETRY_CONSOLE_LEVEL to the console
+ *  without the log level filter. A full log ring is retried for a while, a
+ *  command answer is not dropped for a burst of log messages.
+ *
+ *******************************************************************************/
+static void telemetry_print(CY_LOG_LEVEL_T level, const char *fmt, ...)
+{
+    char line[TELEMETRY_LINE_SIZE];
+    va_list args;
+    int len;
+    uint32_t tries;
+
+    va_start(args, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len <= 0)
+    {
+        return;
+    }
+    if ((uint32_t)len >= sizeof(line))
+    {
+        len = (int)sizeof(line) - 1;
+    }
+
+    if (level != TELEMETRY_CONSOLE_LEVEL)
+    {
+        app_log_text(level, line, (uint32_t)len);
+        return;
+    }
+
+    for (tries = 0; (tries < CONSOLE_WRITE_TRIES) && !app_log_write(line, (uint32_t)len); tries++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CONSOLE_WRITE_RETRY_MS));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_heap
+ *******************************************************************************
+ * Summary:
+ *  Heap usage so far. The bytes in use come from mallinfo(), the peak is the
+ *  highest of the mallinfo() samples, taken here and after each allocation
+ *  seen by the malloc() hooks (TELEMETRY=1, GCC_ARM). Only the failure
+ *  counters are known with other toolchains.
+ *
+ * Parameters:
+ *  telemetry_heap_t *heap : Heap usage
+ *
+ *******************************************************************************/
+void telemetry_heap(telemetry_heap_t *heap)
+{
+#if defined(TELEMETRY_MALLINFO)
+    struct mallinfo mall_info = mallinfo();
+
+    extern uint8_t __HeapBase;  /* Symbol exported by the linker. */
+    extern uint8_t __HeapLimit; /* Symbol exported by the linker. */
+#endif
+
+    memset(heap, 0, sizeof(*heap));
+
+#if defined(TELEMETRY_MALLINFO)
+    heap->size = (uint32_t)((uint8_t *)&__HeapLimit - (uint8_t *)&__HeapBase);
+    heap->in_use = (uint32_t)mall_info.uordblks;
+    telemetry_update_peak(heap->in_use);
+#endif
+
+    heap->peak = atomic_load(&heap_peak);
+    heap->failures = atomic_load(&heap_failures);
+    heap->rtos_failures = atomic_load(&rtos_failures);
+    heap->rtos_blocks = atomic_load(&rtos_allocs) - atomic_load(&rtos_frees);
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_heap_free
+ *******************************************************************************
+ * Summary:
+ *  Heap not in use at this point.
+ *
+ * Return:
+ *  uint32_t : Free bytes, or 0 when the toolchain cannot tell.
+ *
+ *******************************************************************************/
+uint32_t telemetry_heap_free(void)
+{
+    telemetry_heap_t heap;
+
+    telemetry_heap(&heap);
+
+    return (heap.size > heap.in_use) ? (heap.size - heap.in_use) : 0u;
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_print_heap
+ *******************************************************************************
+ * Summary:
+ *  Prints the heap usage.
+ *
+ *******************************************************************************/
+static void telemetry_print_heap(CY_LOG_LEVEL_T level, const char *msg)
+{
+    telemetry_heap_t heap;
+    cy_ota_mem_enc_pool_stats_t enc_pool;
+
+    telemetry_heap(&heap);
+
+    telemetry_print(level, "Heap %s: %lu of %lu bytes in use, peak %lu, lowest free %lu\n", msg,
+                    (unsigned long)heap.in_use, (unsigned long)heap.size, (unsigned long)heap.peak,
+                    (unsigned long)((heap.size > heap.peak) ? (heap.size - heap.peak) : 0u));
+    telemetry_print(level, "Heap %s: %lu failed allocations, FreeRTOS %lu blocks, %lu failed\n", msg,
+                    (unsigned long)heap.failures, (unsigned long)heap.rtos_blocks,
+                    (unsigned long)heap.rtos_failures);
+
+    /* Static pool, only with ENABLE_ON_THE_FLY_ENCRYPTION */
+    cy_ota_mem_enc_pool_get_stats(&enc_pool);
+    if (enc_pool.size != 0u)
+    {
+        telemetry_print(level, "Flash encryption buffers %s: %lu of %lu in use, peak %lu, %lu waits\n", msg,
+                        (unsigned long)enc_pool.in_use, (unsigned long)enc_pool.size,
+                        (unsigned long)enc_pool.peak, (unsigned long)enc_pool.waits);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_log_heap
+ *******************************************************************************
+ * Summary:
+ *  Samples the heap usage, for the peak, and logs it as a debug message.
+ *
+ * Parameters:
+ *  const char *msg : Where the heap is sampled
+ *
+ *******************************************************************************/
+void telemetry_log_heap(const char *msg)
+{
+    telemetry_print_heap(CY_LOG_DEBUG, msg);
+}
+
+#if defined(TELEMETRY)
+/*******************************************************************************
+ * Function Name: telemetry_sample
+ *******************************************************************************
+ * Summary:
+ *  Samples the state of the tasks and computes their CPU usage since the
+ *  previous sample. Called with telemetry_lock taken.
+ *
+ * Return:
+ *  uint32_t : Number of tasks in telemetry_tasks[], 0 if they do not fit
+ *
+ *******************************************************************************/
+static uint32_t telemetry_sample(void)
+{
+    uint32_t count;
+    uint32_t total;
+    uint32_t elapsed;
+    uint32_t i;
+    uint32_t j;
+    uint32_t previous;
+
+    count = (uint32_t)uxTaskGetSystemState(telemetry_tasks, TELEMETRY_MAX_TASKS, &total);
+    if (count == 0)
+    {
+        APP_LOG_WARNING("More than %u tasks, increase TELEMETRY_MAX_TASKS\n", (unsigned int)TELEMETRY_MAX_TASKS);
+        return 0;
+    }
+
+    elapsed = total - telemetry_prev_total;
+    for (i = 0; i < count; i++)
+    {
+        /* A task created since the previous sample ran only since then */
+        previous = 0;
+        for (j = 0; j < telemetry_prev_count; j++)
+        {
+            if (telemetry_prev[j].number == telemetry_tasks[i].xTaskNumber)
+            {
+                previous = telemetry_prev[j].run_time;
+                break;
+            }
+        }
+
+        telemetry_cpu[i] = (elapsed == 0u) ? 0u :
+            (uint16_t)(((uint64_t)(telemetry_tasks[i].ulRunTimeCounter - previous) * 1000u) / elapsed);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        telemetry_prev[i].number = telemetry_tasks[i].xTaskNumber;
+        telemetry_prev[i].run_time = telemetry_tasks[i].ulRunTimeCounter;
+    }
+    telemetry_prev_count = count;
+    telemetry_prev_total = total;
+
+    return count;
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_print_tasks
+ *******************************************************************************
+ * Summary:
+ *  Prints the CPU usage since the previous sample and the unused stack at the
+ *  high-water mark of each task.
+ *
+ *******************************************************************************/
+static void telemetry_print_tasks(CY_LOG_LEVEL_T level)
+{
+    uint32_t count;
+    uint32_t i;
+
+    if (telemetry_lock == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(telemetry_lock, portMAX_DELAY);
+    count = telemetry_sample();
+
+    telemetry_print(level, "%-16s %6s %10s %4s %5s\n", "Task", "CPU", "Stack free", "Prio", "State");
+    for (i = 0; i < count; i++)
+    {
+        telemetry_print(level, "%-16s %3u.%01u%% %10lu %4u %5s\n",
+                        telemetry_tasks[i].pcTaskName,
+                        (unsigned int)(telemetry_cpu[i] / 10u), (unsigned int)(telemetry_cpu[i] % 10u),
+                        (unsigned long)(telemetry_tasks[i].usStackHighWaterMark * sizeof(StackType_t)),
+                        (unsigned int)telemetry_tasks[i].uxCurrentPriority,
+                        telemetry_state_names[(telemetry_tasks[i].eCurrentState <= eInvalid) ?
+                                              telemetry_tasks[i].eCurrentState : eInvalid]);
+    }
+    if (latency.task != NULL)
+    {
+        telemetry_print(level, "Wake-up latency of %s: %lu us worst\n", pcTaskGetName((TaskHandle_t)latency.task),
+                        (unsigned long)(latency.peak_cycles / (SystemCoreClock / 1000000UL)));
+    }
+    xSemaphoreGive(telemetry_lock);
+}
+
+/*******************************************************************************
+ * Function Name: console_command
+ *******************************************************************************
+ * Summary:
+ *  Runs a console command:
+ *   top            - CPU usage and stack of the tasks
+ *   heap           - heap usage
+ *   telemetry      - both
+ *   telemetry bin  - binary record of telemetry_export(), in hexadecimal
+ *
+ *******************************************************************************/
+static void console_command(const char *command)
+{
+    static uint8_t record[TELEMETRY_RECORD_MAX_SIZE];
+    int len;
+    int i;
+    int j;
+    char hex[(CONSOLE_HEX_BYTES_PER_LINE * 2u) + 1u];
+
+    if (strcmp(command, "top") == 0)
+    {
+        telemetry_print_tasks(TELEMETRY_CONSOLE_LEVEL);
+    }
+    else if (strcmp(command, "heap") == 0)
+    {
+        telemetry_print_heap(TELEMETRY_CONSOLE_LEVEL, "now");
+    }
+    else if (strcmp(command, "telemetry") == 0)
+    {
+        telemetry_print_tasks(TELEMETRY_CONSOLE_LEVEL);
+        telemetry_print_heap(TELEMETRY_CONSOLE_LEVEL, "now");
+    }
+    else if (strcmp(command, "telemetry bin") == 0)
+    {
+        len = telemetry_export(record, sizeof(record));
+        for (i = 0; i < len; i += (int)CONSOLE_HEX_BYTES_PER_LINE)
+        {
+            for (j = 0; (j < (int)CONSOLE_HEX_BYTES_PER_LINE) && ((i + j) < len); j++)
+            {
+                snprintf(&hex[j * 2], 3, "%02X", record[i + j]);
+            }
+            telemetry_print(TELEMETRY_CONSOLE_LEVEL, "TLM %s\n", hex);
+        }
+        telemetry_print(TELEMETRY_CONSOLE_LEVEL, "TLM END %d\n", len);
+    }
+    else
+    {
+        telemetry_print(TELEMETRY_CONSOLE_LEVEL, "Commands: top, heap, telemetry [bin]\n");
+    }
+}
+
+/*******************************************************************************
+ * Function Name: console_task
+ *******************************************************************************
+ * Summary:
+ *  Reads command lines from the debug UART.
+ *
+ * Parameters:
+ *  void *args : Unused
+ *
+ *******************************************************************************/
+static void console_task(void *args)
+{
+    char line[CONSOLE_LINE_SIZE];
+    uint32_t len = 0;
+    uint8_t c;
+
+    (void)args;
+
+    while (true)
+    {
+        if (CY_RSLT_SUCCESS != cyhal_uart_getc(&cy_retarget_io_uart_obj, &c, CONSOLE_RX_TIMEOUT_MS))
+        {
+            continue;
+        }
+
+        if ((c == '\r') || (c == '\n'))
+        {
+            line[len] = '\0';
+            if (len > 0)
+            {
+                console_command(line);
+            }
+            len = 0;
+        }
+        else if (len < (CONSOLE_LINE_SIZE - 1u))
+        {
+            line[len++] = (char)c;
+        }
+    }
+}
+#endif /* TELEMETRY */
+
+/*******************************************************************************
+ * Function Name: telemetry_init
+ *******************************************************************************
+ * Summary:
+ *  Prepares the task sampling and starts the console task, if enabled by
+ *  ENABLE_TELEMETRY_CONSOLE. Called before the scheduler starts.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, else an error code.
+ *
+ *******************************************************************************/
+cy_rslt_t telemetry_init(void)
+{
+#if defined(TELEMETRY)
+    telemetry_lock = xSemaphoreCreateMutexStatic(&telemetry_lock_struct);
+
+#if (ENABLE_TELEMETRY_CONSOLE == true)
+    if (pdPASS != xTaskCreate(console_task, "CONSOLE TASK", CONSOLE_TASK_STACK_SIZE, NULL,
+                              CONSOLE_TASK_PRIORITY, NULL))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+#endif
+#endif /* TELEMETRY */
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_log_tasks
+ *******************************************************************************
+ * Summary:
+ *  Logs the CPU usage since the previous sample and the unused stack of
+ *  each task.
+ *
+ *******************************************************************************/
+void telemetry_log_tasks(void)
+{
+#if defined(TELEMETRY)
+    telemetry_print_tasks(CY_LOG_INFO);
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_export
+ *******************************************************************************
+ * Summary:
+ *  Samples the tasks and the heap into the binary record described in
+ *  telemetry.h.
+ *
+ * Parameters:
+ *  uint8_t *buffer : Output buffer
+ *  size_t size : Size of the buffer
+ *
+ * Return:
+ *  int : Length of the record, or a negative value if the buffer is too
+ *        small or TELEMETRY is not enabled.
+ *
+ *******************************************************************************/
+int telemetry_export(uint8_t *buffer, size_t size)
+{
+#if defined(TELEMETRY)
+    telemetry_heap_t heap;
+    uint32_t count;
+    uint32_t length;
+    uint32_t i;
+    uint32_t stack;
+    uint8_t *p = buffer;
+
+    if (telemetry_lock == NULL)
+    {
+        return -1;
+    }
+
+    xSemaphoreTake(telemetry_lock, portMAX_DELAY);
+    count = telemetry_sample();
+    length = TELEMETRY_RECORD_HEADER_SIZE + (count * TELEMETRY_RECORD_TASK_SIZE);
+    if (size < length)
+    {
+        xSemaphoreGive(telemetry_lock);
+        return -1;
+    }
+
+    telemetry_heap(&heap);
+    p = telemetry_put_u32(p, TELEMETRY_RECORD_MAGIC);
+    *p++ = TELEMETRY_RECORD_VERSION;
+    *p++ = (uint8_t)count;
+    p = telemetry_put_u16(p, (uint16_t)length);
+    p = telemetry_put_u32(p, (uint32_t)pdTICKS_TO_MS(xTaskGetTickCount()));
+    p = telemetry_put_u32(p, heap.size);
+    p = telemetry_put_u32(p, heap.in_use);
+    p = telemetry_put_u32(p, heap.peak);
+    p = telemetry_put_u32(p, heap.failures);
+    p = telemetry_put_u32(p, heap.rtos_failures);
+    p = telemetry_put_u32(p, heap.rtos_blocks);
+
+    for (i = 0; i < count; i++)
+    {
+        memset(p, 0, TELEMETRY_RECORD_NAME_SIZE);
+        strncpy((char *)p, telemetry_tasks[i].pcTaskName, TELEMETRY_RECORD_NAME_SIZE);
+        p += TELEMETRY_RECORD_NAME_SIZE;
+        stack = (uint32_t)telemetry_tasks[i].usStackHighWaterMark * sizeof(StackType_t);
+        p = telemetry_put_u16(p, telemetry_cpu[i]);
+        p = telemetry_put_u16(p, (uint16_t)((stack > UINT16_MAX) ? UINT16_MAX : stack));
+        *p++ = (uint8_t)telemetry_tasks[i].uxCurrentPriority;
+        *p++ = (uint8_t)telemetry_tasks[i].eCurrentState;
+        p = telemetry_put_u16(p, 0);
+    }
+    xSemaphoreGive(telemetry_lock);
+
+    return (int)length;
+#else
+    (void)buffer;
+    (void)size;
+    return -1;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_latency_watch
+ *******************************************************************************
+ * Summary:
+ *  Selects the task whose wake-up latency is measured, the time from being
+ *  made ready, by a delay that expired or an event, to running. Stands in for
+ *  the deadlines of the application.
+ *
+ * Parameters:
+ *  void *task : Handle of the task
+ *
+ *******************************************************************************/
+void telemetry_latency_watch(void *task)
+{
+#if defined(TELEMETRY)
+    taskENTER_CRITICAL();
+    latency.task = task;
+    latency.ready = false;
+    latency.max_cycles = 0;
+    latency.peak_cycles = 0;
+    taskEXIT_CRITICAL();
+#else
+    (void)task;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_latency_max_us
+ *******************************************************************************
+ * Summary:
+ *  Worst wake-up latency of the watched task since the previous reset.
+ *
+ * Parameters:
+ *  bool reset : Start a new measurement period
+ *
+ * Return:
+ *  uint32_t : Latency in microseconds, 0 without TELEMETRY
+ *
+ *******************************************************************************/
+uint32_t telemetry_latency_max_us(bool reset)
+{
+#if defined(TELEMETRY)
+    uint32_t cycles;
+
+    taskENTER_CRITICAL();
+    cycles = latency.max_cycles;
+    if (reset)
+    {
+        latency.max_cycles = 0;
+    }
+    taskEXIT_CRITICAL();
+
+    return cycles / (SystemCoreClock / 1000000UL);
+#else
+    (void)reset;
+    return 0;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_run_time_init
+ *******************************************************************************
+ * Summary:
+ *  portCONFIGURE_TIMER_FOR_RUN_TIME_STATS(), starts the DWT cycle counter.
+ *
+ *******************************************************************************/
+void telemetry_run_time_init(void)
+{
+#if defined(TELEMETRY)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = TELEMETRY_DWT_UNLOCK;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    run_time.cycles_per_unit = (SystemCoreClock / 1000000UL) * TELEMETRY_RUN_TIME_UNIT_US;
+    if (run_time.cycles_per_unit == 0u)
+    {
+        run_time.cycles_per_unit = 1u;
+    }
+    run_time.last_cycles = DWT->CYCCNT;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_run_time
+ *******************************************************************************
+ * Summary:
+ *  portGET_RUN_TIME_COUNTER_VALUE(), the run time in units of
+ *  TELEMETRY_RUN_TIME_UNIT_US. Extends the cycle counter, which wraps every
+ *  few seconds, on each context switch: the log task switches every
+ *  LOG_DRAIN_INTERVAL_MS.
+ *
+ * Return:
+ *  uint32_t : Run time counter
+ *
+ *******************************************************************************/
+uint32_t telemetry_run_time(void)
+{
+#if defined(TELEMETRY)
+    UBaseType_t mask;
+    uint32_t now;
+    uint32_t value;
+
+    mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    now = DWT->CYCCNT;
+    run_time.cycles += now - run_time.last_cycles;
+    run_time.last_cycles = now;
+    run_time.units += run_time.cycles / run_time.cycles_per_unit;
+    run_time.cycles %= run_time.cycles_per_unit;
+    value = run_time.units;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    return value;
+#else
+    return 0;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_rtos_malloc
+ *******************************************************************************
+ * Summary:
+ *  traceMALLOC() of pvPortMalloc().
+ *
+ * Parameters:
+ *  void *ptr : Allocated block, NULL if the allocation failed
+ *  size_t size : Requested size
+ *
+ *******************************************************************************/
+void telemetry_rtos_malloc(void *ptr, size_t size)
+{
+    if (ptr != NULL)
+    {
+        atomic_fetch_add(&rtos_allocs, 1u);
+    }
+    else if (size != 0u)
+    {
+        atomic_fetch_add(&rtos_failures, 1u);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_rtos_free
+ *******************************************************************************
+ * Summary:
+ *  traceFREE() of vPortFree(), called after the block is freed.
+ *
+ * Parameters:
+ *  void *ptr : Freed block
+ *
+ *******************************************************************************/
+void telemetry_rtos_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        atomic_fetch_add(&rtos_frees, 1u);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_task_ready
+ *******************************************************************************
+ * Summary:
+ *  traceMOVED_TASK_TO_READY_STATE() of the scheduler, in a critical section
+ *  or an interrupt.
+ *
+ * Parameters:
+ *  void *task : Task added to a ready list
+ *
+ *******************************************************************************/
+void telemetry_task_ready(void *task)
+{
+#if defined(TELEMETRY)
+    if ((task == latency.task) && !latency.ready)
+    {
+        latency.ready = true;
+        latency.ready_cycles = DWT->CYCCNT;
+    }
+#else
+    (void)task;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: telemetry_task_switched_in
+ *******************************************************************************
+ * Summary:
+ *  traceTASK_SWITCHED_IN() of the scheduler, from the context switch.
+ *
+ * Parameters:
+ *  void *task : Task about to run
+ *
+ *******************************************************************************/
+void telemetry_task_switched_in(void *task)
+{
+#if defined(TELEMETRY)
+    uint32_t cycles;
+
+    if ((task == latency.task) && latency.ready)
+    {
+        latency.ready = false;
+        cycles = DWT->CYCCNT - latency.ready_cycles;
+        if (cycles > latency.max_cycles)
+        {
+            latency.max_cycles = cycles;
+        }
+        if (cycles > latency.peak_cycles)
+        {
+            latency.peak_cycles = cycles;
+        }
+    }
+#else
+    (void)task;
+#endif
+}
+
+#if defined(TELEMETRY_WRAP_MALLOC)
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+/*******************************************************************************
+ * Function Name: telemetry_alloc
+ *******************************************************************************
+ * Summary:
+ *  Counts an allocation of the C library heap. The peak is sampled from
+ *  mallinfo(), which also sees the blocks allocated inside the C library
+ *  itself, stdio buffers for example, and freed without the hooks: a count
+ *  of the hooked blocks alone would go wrong for those.
+ *
+ *******************************************************************************/
+static void telemetry_alloc(void *ptr, bool requested)
+{
+    if (ptr != NULL)
+    {
+        telemetry_update_peak((uint32_t)mallinfo().uordblks);
+    }
+    else if (requested)
+    {
+        atomic_fetch_add(&heap_failures, 1u);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: __wrap_malloc
+ *******************************************************************************
+ * Summary:
+ *  Linked in place of malloc(), and of calloc() and realloc() below, to
+ *  track the heap peak and count the failed allocations.
+ *
+ *******************************************************************************/
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+
+    telemetry_alloc(ptr, size != 0u);
+
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+
+    telemetry_alloc(ptr, (count != 0u) && (size != 0u));
+
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    void *new_ptr = __real_realloc(ptr, size);
+
+    /* For size 0 the block is freed, else a NULL leaves the old block allocated */
+    telemetry_alloc(new_ptr, size != 0u);
+
+    return new_ptr;
+}
+
+#endif /* TELEMETRY_WRAP_MALLOC */
+
+/* [] END OF FILE */
@@ -0,0 +1,103 @@
+/******************************************************************************
+* File Name: telemetry.h
+*
+* Description: This file contains declaration of the run-time telemetry: task CPU
+* usage, stack high-water marks and heap usage.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_TELEMETRY_H_
+#define SOURCE_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/*
+ * Binary record of telemetry_export(), little endian:
+ *  header (36 bytes) : magic "TLM1", version (uint8), task count (uint8),
+ *                      record size (uint16), uptime in ms, heap size,
+ *                      heap in use, heap peak in use, C library allocation
+ *                      failures, FreeRTOS allocation failures, FreeRTOS
+ *                      blocks allocated (uint32)
+ *  task (24 bytes)   : name (16 bytes, zero padded), CPU usage in 1/1000
+ *                      since the previous sample (uint16), unused stack in
+ *                      bytes at the high-water mark (uint16), priority
+ *                      (uint8), eTaskState (uint8), reserved (uint16)
+ */
+#define TELEMETRY_RECORD_MAGIC              (0x314D4C54UL)  /* "TLM1" */
+#define TELEMETRY_RECORD_VERSION            (1u)
+#define TELEMETRY_RECORD_HEADER_SIZE        (36u)
+#define TELEMETRY_RECORD_TASK_SIZE          (24u)
+#define TELEMETRY_RECORD_NAME_SIZE          (16u)
+
+/*******************************************************************************
+* Types
+********************************************************************************/
+/* Heap usage, the FreeRTOS heap (heap_3) is the C library heap */
+typedef struct
+{
+    uint32_t    size;               /* Bytes between __HeapBase and __HeapLimit */
+    uint32_t    in_use;             /* Bytes allocated now */
+    uint32_t    peak;               /* Most bytes allocated at the same time */
+    uint32_t    failures;           /* Failed malloc(), calloc() and realloc() */
+    uint32_t    rtos_failures;      /* Failed pvPortMalloc() */
+    uint32_t    rtos_blocks;        /* Blocks allocated by pvPortMalloc() now */
+} telemetry_heap_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t telemetry_init(void);
+void telemetry_heap(telemetry_heap_t *heap);
+uint32_t telemetry_heap_free(void);
+void telemetry_log_heap(const char *msg);
+void telemetry_log_tasks(void);
+int telemetry_export(uint8_t *buffer, size_t size);
+void telemetry_latency_watch(void *task);
+uint32_t telemetry_latency_max_us(bool reset);
+
+/* Hooks of FreeRTOSConfig.h */
+void telemetry_run_time_init(void);
+uint32_t telemetry_run_time(void);
+void telemetry_rtos_malloc(void *ptr, size_t size);
+void telemetry_rtos_free(void *ptr);
+void telemetry_task_ready(void *task);
+void telemetry_task_switched_in(void *task);
+
+#endif /* SOURCE_TELEMETRY_H_ */
@@ -0,0 +1,298 @@
+/******************************************************************************
+* File Name: tls_session_cache.c
+*
+* Description: This file contains the TLS session cache shared by the
+* connections of the OTA agent. Hooks mbedtls_ssl_handshake() to offer
+* the last session of a server to the next connection to that server.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include "tls_session_cache.h"
+/* Handshake time */
+#include "ota_timing.h"
+
+#if defined(TLS_SESSION_CACHE)
+/* The session and host name of a context are not part of the public API */
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+#include "mbedtls/ssl.h"
+#endif
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Longest server name the cache keeps a session for */
+#define TLS_SESSION_HOST_NAME_LEN           (64)
+
+/* FNV-1a hash of the credentials */
+#define FNV_OFFSET_BASIS                    (0x811C9DC5UL)
+#define FNV_PRIME                           (0x01000193UL)
+
+#if defined(TLS_SESSION_CACHE)
+/*******************************************************************************
+* Data Types
+********************************************************************************/
+/* Last session established with a server. The OTA job, data and result
+ * connections all go to the same server, one entry is enough. */
+typedef struct
+{
+    bool                    valid;
+    char                    host_name[TLS_SESSION_HOST_NAME_LEN];
+    mbedtls_ssl_session     session;
+} tls_cached_session_t;
+
+/*******************************************************************************
+* Forward declaration
+********************************************************************************/
+int __real_mbedtls_ssl_handshake(mbedtls_ssl_context *ssl);
+int __wrap_mbedtls_ssl_handshake(mbedtls_ssl_context *ssl);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+static tls_cached_session_t tls_cache;
+
+/* Hash of the credentials the cached session was established with */
+static uint32_t tls_cache_credentials;
+
+/* Connections of a parallel download handshake at the same time */
+static SemaphoreHandle_t tls_cache_lock = NULL;
+static StaticSemaphore_t tls_cache_lock_struct;
+
+/*******************************************************************************
+ * Function Name: tls_hash
+ *******************************************************************************
+ * Summary:
+ *  Adds a buffer to a FNV-1a hash.
+ *
+ * Parameters:
+ *  uint32_t hash : Hash so far
+ *  const void *data : Buffer to add, may be NULL
+ *  size_t len : Length of the buffer
+ *
+ * Return:
+ *  uint32_t : Updated hash
+ *
+ *******************************************************************************/
+static uint32_t tls_hash(uint32_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    if (bytes == NULL)
+    {
+        return hash;
+    }
+
+    while (len-- > 0)
+    {
+        hash = (hash ^ *bytes++) * FNV_PRIME;
+    }
+
+    return hash;
+}
+#endif /* TLS_SESSION_CACHE */
+
+/*******************************************************************************
+ * Function Name: tls_session_cache_flush
+ *******************************************************************************
+ * Summary:
+ *  Drops the cached session, the next connection does a full handshake.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+void tls_session_cache_flush(void)
+{
+#if defined(TLS_SESSION_CACHE)
+    if (tls_cache_lock == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(tls_cache_lock, portMAX_DELAY);
+    if (tls_cache.valid)
+    {
+        mbedtls_ssl_session_free(&tls_cache.session);
+        tls_cache.valid = false;
+    }
+    xSemaphoreGive(tls_cache_lock);
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: tls_session_cache_set_credentials
+ *******************************************************************************
+ * Summary:
+ *  Tells the cache which credentials the connections use. Must be called
+ *  before the first connection. The cached session is dropped when the
+ *  certificates or the key differ from the previous call.
+ *
+ * Parameters:
+ *  const cy_awsport_ssl_credentials_t *credentials : TLS credentials
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+void tls_session_cache_set_credentials(const cy_awsport_ssl_credentials_t *credentials)
+{
+#if defined(TLS_SESSION_CACHE)
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    if (tls_cache_lock == NULL)
+    {
+        mbedtls_ssl_session_init(&tls_cache.session);
+        tls_cache_lock = xSemaphoreCreateMutexStatic(&tls_cache_lock_struct);
+    }
+
+    hash = tls_hash(hash, credentials->root_ca, credentials->root_ca_size);
+    hash = tls_hash(hash, credentials->client_cert, credentials->client_cert_size);
+    hash = tls_hash(hash, credentials->private_key, credentials->private_key_size);
+
+    if (hash != tls_cache_credentials)
+    {
+        tls_session_cache_flush();
+        tls_cache_credentials = hash;
+    }
+#else
+    (void)credentials;
+#endif
+}
+
+#if defined(TLS_SESSION_CACHE)
+/*******************************************************************************
+ * Function Name: tls_handshake
+ *******************************************************************************
+ * Summary:
+ *  Runs the handshake and adds its time to the OTA timing report.
+ *
+ * Parameters:
+ *  mbedtls_ssl_context *ssl : SSL context
+ *
+ * Return:
+ *  int : Result of mbedtls_ssl_handshake()
+ *
+ *******************************************************************************/
+static int tls_handshake(mbedtls_ssl_context *ssl)
+{
+    int ret;
+    uint32_t start = ota_timing_cycles();
+
+    ret = __real_mbedtls_ssl_handshake(ssl);
+    ota_timing_add_cycles(OTA_TIMING_TLS_HANDSHAKE, start);
+
+    return ret;
+}
+
+/*******************************************************************************
+ * Function Name: __wrap_mbedtls_ssl_handshake
+ *******************************************************************************
+ * Summary:
+ *  Linked in place of mbedtls_ssl_handshake(). On the first call of a client
+ *  handshake, offers the cached session of the server so that the server can
+ *  resume it (session ID or session ticket) instead of a full handshake.
+ *  Once a handshake completes, its session is cached for the next connection.
+ *
+ * Parameters:
+ *  mbedtls_ssl_context *ssl : SSL context
+ *
+ * Return:
+ *  int : Result of mbedtls_ssl_handshake()
+ *
+ *******************************************************************************/
+int __wrap_mbedtls_ssl_handshake(mbedtls_ssl_context *ssl)
+{
+    int ret;
+    const char *host_name = ssl->hostname;
+    bool client = (ssl->conf != NULL) && (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT);
+
+    if ((tls_cache_lock == NULL) || !client || (host_name == NULL) ||
+        (strlen(host_name) >= TLS_SESSION_HOST_NAME_LEN))
+    {
+        return tls_handshake(ssl);
+    }
+
+    if (ssl->state == MBEDTLS_SSL_HELLO_REQUEST)
+    {
+        xSemaphoreTake(tls_cache_lock, portMAX_DELAY);
+        if (tls_cache.valid && (strcmp(tls_cache.host_name, host_name) == 0))
+        {
+            /* A session the server does not know anymore just costs a full handshake */
+            (void)mbedtls_ssl_set_session(ssl, &tls_cache.session);
+        }
+        xSemaphoreGive(tls_cache_lock);
+    }
+
+    ret = tls_handshake(ssl);
+
+    if (ret == 0)
+    {
+        xSemaphoreTake(tls_cache_lock, portMAX_DELAY);
+        if (tls_cache.valid)
+        {
+            mbedtls_ssl_session_free(&tls_cache.session);
+            mbedtls_ssl_session_init(&tls_cache.session);
+        }
+        tls_cache.valid = (mbedtls_ssl_get_session(ssl, &tls_cache.session) == 0);
+        if (tls_cache.valid)
+        {
+            strcpy(tls_cache.host_name, host_name);
+        }
+        else
+        {
+            mbedtls_ssl_session_free(&tls_cache.session);
+            mbedtls_ssl_session_init(&tls_cache.session);
+        }
+        xSemaphoreGive(tls_cache_lock);
+    }
+    else if ((ret != MBEDTLS_ERR_SSL_WANT_READ) && (ret != MBEDTLS_ERR_SSL_WANT_WRITE) &&
+             (ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) && (ret != MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS))
+    {
+        /* Do not offer a session that may be the reason of the failure again */
+        tls_session_cache_flush();
+    }
+
+    return ret;
+}
+#endif /* TLS_SESSION_CACHE */